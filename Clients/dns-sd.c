@@ -127,6 +127,7 @@ static const char kFilePathSep = '/';
 #include "dns_sd.h"
 #include "dns_sd_private.h"
 #include "ClientCommon.h"
+#include "dnssd_ipc.h"      // For the binary state dump format read by -Y
 
 
 #if TEST_NEW_CLIENTSTUB
@@ -487,6 +488,8 @@ static void print_usage(const char *arg0, int print_all)
     fprintf(stderr, "%s -X udp/tcp/udptcp <IntPort> <ExtPort> <TTL>           (NAT Port Mapping)\n", arg0);
     fprintf(stderr, "%s -H                               (Print usage for complete command list)\n", arg0);
     fprintf(stderr, "%s -V            (Get version of currently running daemon / system service)\n", arg0);
+    fprintf(stderr, "%s -K                (Print live metrics of running daemon / system service)\n", arg0);
+    fprintf(stderr, "%s -Y <file>                  (Print a binary state dump written by the daemon)\n", arg0);
 #ifdef APPLE_OSX_mDNSResponder
     fprintf(stderr, "%s -O [-compress|-stdout](Dump the state of mDNSResponder to file / STDOUT)\n", arg0);
 #endif // APPLE_OSX_mDNSResponder
@@ -1005,13 +1008,66 @@ static void ParseDNSSECRecords(uint16_t rrtype, char *rdb, size_t rdb_size, unsi
     return;                           
 }
 
+// Format rdata of type rrtype into rdb. Returns 1 if the type isn't one we know, in which case only the length is
+// formatted, and the caller prints the bytes.
+static int FormatRData(char *rdb, size_t rdb_size, uint16_t rrtype, const unsigned char *rd, uint16_t rdlen)
+{
+    char *p = rdb;
+    switch (rrtype)
+    {
+        case kDNSServiceType_A:
+            snprintf_safe(rdb, rdb_size, "%d.%d.%d.%d", rd[0], rd[1], rd[2], rd[3]);
+            break;
+
+        case kDNSServiceType_NS:
+        case kDNSServiceType_CNAME:
+        case kDNSServiceType_PTR:
+        case kDNSServiceType_DNAME:
+            snprintd(p, rdb_size, &rd);
+            break;
+
+        case kDNSServiceType_SOA:
+            p += snprintd(p, rdb + rdb_size - p, &rd);           // mname
+            p += snprintf_safe(p, rdb + rdb_size - p, " ");
+            p += snprintd(p, rdb + rdb_size - p, &rd);           // rname
+                 snprintf(p, rdb + rdb_size - p, " Ser %d Ref %d Ret %d Exp %d Min %d",
+                     ntohl(((uint32_t*)rd)[0]), ntohl(((uint32_t*)rd)[1]), ntohl(((uint32_t*)rd)[2]), ntohl(((uint32_t*)rd)[3]), ntohl(((uint32_t*)rd)[4]));
+            break;
+
+        case kDNSServiceType_AAAA:
+            snprintf(rdb, rdb_size, "%02X%02X:%02X%02X:%02X%02X:%02X%02X:%02X%02X:%02X%02X:%02X%02X:%02X%02X",
+                rd[0x0], rd[0x1], rd[0x2], rd[0x3], rd[0x4], rd[0x5], rd[0x6], rd[0x7],
+                rd[0x8], rd[0x9], rd[0xA], rd[0xB], rd[0xC], rd[0xD], rd[0xE], rd[0xF]);
+            break;
+
+        case kDNSServiceType_SRV:
+            p += snprintf_safe(p, rdb + rdb_size - p, "%d %d %d ",        // priority, weight, port
+                     ntohs(*(unsigned short*)rd), ntohs(*(unsigned short*)(rd+2)), ntohs(*(unsigned short*)(rd+4)));
+            rd += 6;
+                 snprintd(p, rdb + rdb_size - p, &rd);               // target host
+            break;
+
+        case kDNSServiceType_DS:
+        case kDNSServiceType_DNSKEY:
+        case kDNSServiceType_NSEC:
+        case kDNSServiceType_RRSIG:
+            ParseDNSSECRecords(rrtype, rdb, rdb_size, rd, rdlen);
+            break;
+
+        default:
+            snprintf(rdb, rdb_size, "%d bytes%s", rdlen, rdlen ? ":" : "");
+            return 1;
+    }
+    return 0;
+}
+
 static void DNSSD_API qr_reply(DNSServiceRef sdref, const DNSServiceFlags flags, uint32_t ifIndex, DNSServiceErrorType errorCode,
                                const char *fullname, uint16_t rrtype, uint16_t rrclass, uint16_t rdlen, const void *rdata, uint32_t ttl, void *context)
 {
     char *op = (flags & kDNSServiceFlagsAdd) ? "Add" : "Rmv";
     const unsigned char *rd  = rdata;
     const unsigned char *end = (const unsigned char *) rdata + rdlen;
-    char rdb[1000] = "0.0.0.0", *p = rdb;
+    char rdb[1000] = "0.0.0.0";
     int unknowntype = 0;
     char dnssec_status[15] = "Unknown";
     char rr_type[RR_TYPE_SIZE];
@@ -1048,54 +1104,7 @@ static void DNSSD_API qr_reply(DNSServiceRef sdref, const DNSServiceFlags flags,
     strncpy(rr_type, DNSTypeName(rrtype), sizeof(rr_type));
 
     if (!errorCode) //to avoid printing garbage in rdata
-    {
-        switch (rrtype)
-        {
-            case kDNSServiceType_A:
-                snprintf_safe(rdb, sizeof(rdb), "%d.%d.%d.%d", rd[0], rd[1], rd[2], rd[3]);
-                break;
-
-            case kDNSServiceType_NS:
-            case kDNSServiceType_CNAME:
-            case kDNSServiceType_PTR:
-            case kDNSServiceType_DNAME:
-                snprintd(p, sizeof(rdb), &rd);
-                break;
-
-            case kDNSServiceType_SOA:
-                p += snprintd(p, rdb + sizeof(rdb) - p, &rd);           // mname
-                p += snprintf_safe(p, rdb + sizeof(rdb) - p, " ");
-                p += snprintd(p, rdb + sizeof(rdb) - p, &rd);           // rname
-                     snprintf(p, rdb + sizeof(rdb) - p, " Ser %d Ref %d Ret %d Exp %d Min %d",
-                         ntohl(((uint32_t*)rd)[0]), ntohl(((uint32_t*)rd)[1]), ntohl(((uint32_t*)rd)[2]), ntohl(((uint32_t*)rd)[3]), ntohl(((uint32_t*)rd)[4]));
-                break;
-
-            case kDNSServiceType_AAAA:
-                snprintf(rdb, sizeof(rdb), "%02X%02X:%02X%02X:%02X%02X:%02X%02X:%02X%02X:%02X%02X:%02X%02X:%02X%02X",
-                    rd[0x0], rd[0x1], rd[0x2], rd[0x3], rd[0x4], rd[0x5], rd[0x6], rd[0x7],
-                    rd[0x8], rd[0x9], rd[0xA], rd[0xB], rd[0xC], rd[0xD], rd[0xE], rd[0xF]);
-                break;
-
-            case kDNSServiceType_SRV:
-                p += snprintf_safe(p, rdb + sizeof(rdb) - p, "%d %d %d ",        // priority, weight, port
-                         ntohs(*(unsigned short*)rd), ntohs(*(unsigned short*)(rd+2)), ntohs(*(unsigned short*)(rd+4)));
-                rd += 6;
-                     snprintd(p, rdb + sizeof(rdb) - p, &rd);               // target host
-                break;
-
-            case kDNSServiceType_DS:
-            case kDNSServiceType_DNSKEY:
-            case kDNSServiceType_NSEC:
-            case kDNSServiceType_RRSIG:
-                ParseDNSSECRecords(rrtype, rdb, sizeof(rdb), rd, rdlen);
-                break;
-
-            default:
-                snprintf(rdb, sizeof(rdb), "%d bytes%s", rdlen, rdlen ? ":" : "");
-                unknowntype = 1;
-                break;
-        }
-    }
+        unknowntype = FormatRData(rdb, sizeof(rdb), rrtype, rd, rdlen);
 
     if (check_flags & kDNSServiceFlagsSecure)
         strncpy(dnssec_status, "Secure            ", sizeof(dnssec_status));
@@ -1816,6 +1825,7 @@ static int API_input_range_test()
 #ifdef APPLE_OSX_mDNSResponder
 static void handle_state_dump_request(uint8_t if_compress_state_dump, uint8_t if_dump_to_stdout);
 #endif // APPLE_OSX_mDNSResponder
+static int print_binary_state_dump(const char *path);
 int main(int argc, char **argv)
 {
     DNSServiceErrorType err;
@@ -2008,7 +2018,7 @@ int main(int argc, char **argv)
     }
 
     if (argc < 2) goto Fail;        // Minimum command line is the command name and one argument
-    operation = getfirstoption(argc, argv, "ABCDEFHILMNPQRSTUVZhlq"
+    operation = getfirstoption(argc, argv, "ABCDEFHIKLMNPQRSTUVYZhlq"
                                "X"
                                "Gg"
                                , &opi);
@@ -2209,6 +2219,20 @@ int main(int argc, char **argv)
         else printf("Currently running daemon (system service) is version %d.%d.%d\n",  v / 10000, v / 100 % 100, v % 100);
         exit(0);
     }
+
+    case 'K':   {
+        static char text[8192];
+        uint32_t size = sizeof(text);
+        err = DNSServiceGetProperty(kDNSServiceProperty_Metrics, text, &size);
+        if (err) fprintf(stderr, "DNSServiceGetProperty failed %ld\n", (long int)err);
+        else { text[sizeof(text) - 1] = 0; fputs(text, stdout); }
+        exit(0);
+    }
+
+    case 'Y':   {
+        if (argc != opi+1) goto Fail;
+        exit(print_binary_state_dump(argv[opi]));
+    }
 #ifdef APPLE_OSX_mDNSResponder
     case 'O': {
         // check if the user specifies the flag "-compress"
@@ -2333,6 +2357,250 @@ static void handle_state_dump_request(uint8_t if_compress_state_dump, uint8_t if
 }
 #endif // APPLE_OSX_mDNSResponder
 
+// Reads a binary state dump, as written by "mdnsd -binarydump" on SIGUSR1 (see STATE_DUMP_MAGIC in dnssd_ipc.h).
+// Everything is checked against the end of its TLV, so a truncated or damaged file only loses what's damaged.
+
+static uint16_t dump_uint16(const unsigned char **ptr)
+{
+    const unsigned char *p = *ptr;
+    *ptr += 2;
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t dump_uint32(const unsigned char **ptr)
+{
+    const unsigned char *p = *ptr;
+    *ptr += 4;
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// Formats the wire-format name at *ptr, which must end before end. Returns 0 if it doesn't.
+static int dump_name(char *buf, size_t size, const unsigned char **ptr, const unsigned char *end)
+{
+    const unsigned char *p = *ptr;
+    char *b = buf;
+    while (p < end && *p)
+    {
+        if (*p > 63 || end - p <= *p + 1) return 0;
+        b += snprintf_safe(b, buf + size - b, "%.*s.", *p, p + 1);
+        p += 1 + *p;
+    }
+    if (p >= end) return 0;
+    if (b == buf) snprintf_safe(buf, size, ".");
+    *ptr = p + 1;
+    return 1;
+}
+
+// Formats the rrtype, rrclass, name and rdata that end cache and auth record TLVs
+static int dump_record(char *buf, size_t size, const unsigned char *p, const unsigned char *end)
+{
+    // snprintd() stops at a zero byte, so zero padding longer than any label keeps it inside this buffer
+    static unsigned char rdata[0x10000 + 64];
+    char name[1024], rdb[1000];
+    uint16_t rrtype, rrclass, rdlen;
+
+    if (end - p < 4) return 0;
+    rrtype  = dump_uint16(&p);
+    rrclass = dump_uint16(&p);
+    if (!dump_name(name, sizeof(name), &p, end) || end - p < 2) return 0;
+    rdlen = dump_uint16(&p);
+    if (end - p < rdlen) return 0;
+
+    if (rdlen == 0) snprintf_safe(rdb, sizeof(rdb), "(no rdata)");
+    else
+    {
+        memcpy(rdata, p, rdlen);
+        if (FormatRData(rdb, sizeof(rdb), rrtype, rdata, rdlen))
+        {
+            char *r = rdb + strlen(rdb);
+            int i;
+            for (i = 0; i < rdlen && i < 64; i++) r += snprintf_safe(r, rdb + sizeof(rdb) - r, " %02X", rdata[i]);
+            if (i < rdlen) snprintf_safe(r, rdb + sizeof(rdb) - r, " ...");
+        }
+        memset(rdata, 0, rdlen);
+    }
+    if (rrclass == kDNSServiceClass_IN) snprintf_safe(buf, size, "%-40s %-6s IN %s", name, DNSTypeName(rrtype), rdb);
+    else snprintf_safe(buf, size, "%-40s %-6s %-2d %s", name, DNSTypeName(rrtype), rrclass & 0x7FFF, rdb);
+    return 1;
+}
+
+static const char *dump_op_name(uint32_t op)
+{
+    switch (op)
+    {
+        case request_op_none:       return("none");
+        case connection_request:    return("connection");
+        case enumeration_request:   return("enumeration");
+        case reg_service_request:   return("regservice");
+        case browse_request:        return("browse");
+        case resolve_request:       return("resolve");
+        case query_request:         return("queryrecord");
+        case setdomain_request:     return("setdomain");
+        case getproperty_request:   return("getproperty");
+        case port_mapping_request:  return("portmapping");
+        case addrinfo_request:      return("addrinfo");
+        default:                    return("other");
+    }
+}
+
+static int print_binary_state_dump(const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    unsigned char *data = NULL;
+    const unsigned char *ptr, *end;
+    size_t len = 0, cap = 0, n;
+    uint16_t section = 0;
+    int complete = 0;
+
+    if (!fp) { fprintf(stderr, "Could not open %s: %s\n", path, strerror(errno)); return 1; }
+    do
+    {
+        if (len == cap)
+        {
+            unsigned char *grown = realloc(data, cap = cap ? cap * 2 : 65536);
+            if (!grown) { fprintf(stderr, "Out of memory reading %s\n", path); fclose(fp); free(data); return 1; }
+            data = grown;
+        }
+        n = fread(data + len, 1, cap - len, fp);
+        len += n;
+    } while (n);
+    fclose(fp);
+
+    if (len < STATE_DUMP_MAGIC_LEN || memcmp(data, STATE_DUMP_MAGIC, STATE_DUMP_MAGIC_LEN))
+    {
+        fprintf(stderr, "%s is not a binary state dump\n", path);
+        free(data);
+        return 1;
+    }
+
+    ptr = data + STATE_DUMP_MAGIC_LEN;
+    end = data + len;
+    while (end - ptr >= 4)
+    {
+        const uint16_t type   = dump_uint16(&ptr);
+        const uint16_t length = dump_uint16(&ptr);
+        const unsigned char *p = ptr, *vend;
+        char buf[1500];
+        if (end - ptr < length) break;
+        ptr = vend = p + length;
+
+        if (type != section)
+        {
+            switch (type)
+            {
+                case STATE_DUMP_TLV_CACHE_RECORD:
+                    printf("\n------------ Cache -------------\nSlot Interface    TTL Type Flags Name/Type/Class/Rdata\n");
+                    break;
+                case STATE_DUMP_TLV_AUTH_RECORD:
+                    printf("\n------ Authoritative Records ------\nInterface Type     TTL Flags Name/Type/Class/Rdata\n");
+                    break;
+                case STATE_DUMP_TLV_QUESTION:
+                    printf("\n----- Questions -----\nInterface Flags Int(s) Next(s) Answers Type   Name\n");
+                    break;
+                case STATE_DUMP_TLV_CLIENT:
+                    printf("\n----- Clients -----\n  Socket        PID Request      Replies    Bytes Process\n");
+                    break;
+            }
+            section = type;
+        }
+
+        switch (type)
+        {
+            case STATE_DUMP_TLV_HEADER:
+                if (length < 8) goto Damaged;
+                {
+                    const uint32_t version = dump_uint32(&p);
+                    const uint32_t cachesize = dump_uint32(&p);
+                    printf("State dump of daemon version %d.%d.%d, cache size %u\n",
+                           version / 10000, version / 100 % 100, version % 100, cachesize);
+                }
+                break;
+
+            case STATE_DUMP_TLV_CACHE_RECORD:
+                if (length < 12) goto Damaged;
+                {
+                    const uint16_t slot = dump_uint16(&p);
+                    const int32_t ifindex = (int32_t)dump_uint32(&p);
+                    const int32_t ttl = (int32_t)dump_uint32(&p);
+                    const uint8_t rtype = *p++, flags = *p++;
+                    if (!dump_record(buf, sizeof(buf), p, vend)) goto Damaged;
+                    printf("%4u %9d %6d %4X %c%c    %s\n", slot, ifindex, ttl, rtype,
+                           (flags & STATE_DUMP_CACHE_ACTIVE)  ? 'Q' : '-',
+                           (flags & STATE_DUMP_CACHE_UNICAST) ? 'U' : 'M', buf);
+                }
+                break;
+
+            case STATE_DUMP_TLV_AUTH_RECORD:
+                if (length < 10) goto Damaged;
+                {
+                    const int32_t ifindex = (int32_t)dump_uint32(&p);
+                    const uint8_t rtype = *p++, flags = *p++;
+                    const uint32_t ttl = dump_uint32(&p);
+                    if (!dump_record(buf, sizeof(buf), p, vend)) goto Damaged;
+                    printf("%9d %4X %7u %c%c%c   %s\n", ifindex, rtype, ttl,
+                           (flags & STATE_DUMP_AUTH_DUPLICATE) ? 'D' : '-',
+                           (flags & STATE_DUMP_AUTH_PROXIED)   ? 'P' : '-',
+                           (flags & STATE_DUMP_AUTH_LOCAL)     ? 'L' : '-', buf);
+                }
+                break;
+
+            case STATE_DUMP_TLV_QUESTION:
+                if (length < 19) goto Damaged;
+                {
+                    const int32_t ifindex = (int32_t)dump_uint32(&p);
+                    const uint8_t flags = *p++;
+                    const int32_t interval = (int32_t)dump_uint32(&p);
+                    const int32_t next = (int32_t)dump_uint32(&p);
+                    const uint32_t answers = dump_uint32(&p);
+                    const uint16_t qtype = dump_uint16(&p);
+                    if (!dump_name(buf, sizeof(buf), &p, vend)) goto Damaged;
+                    printf("%9d %c%c%c%c%c %6d %7d %7u %-6s %s\n", ifindex,
+                           (flags & STATE_DUMP_QUESTION_UNICAST)    ? 'U' : 'M',
+                           (flags & STATE_DUMP_QUESTION_LONGLIVED)  ? 'L' : '-',
+                           (flags & STATE_DUMP_QUESTION_DUPLICATE)  ? 'D' : '-',
+                           (flags & STATE_DUMP_QUESTION_SUPPRESSED) ? 'S' : '-',
+                           (flags & STATE_DUMP_QUESTION_LOCAL)      ? 'O' : '-',
+                           interval, next, answers, DNSTypeName(qtype), buf);
+                }
+                break;
+
+            case STATE_DUMP_TLV_CLIENT:
+                if (length < 21 || vend[-1] != 0) goto Damaged;
+                {
+                    const uint32_t sd = dump_uint32(&p);
+                    const int32_t pid = (int32_t)dump_uint32(&p);
+                    const uint32_t op = dump_uint32(&p);
+                    const uint32_t replies = dump_uint32(&p);
+                    const uint32_t bytes = dump_uint32(&p);
+                    printf("%8u %10d %-12s %8u %8u %s\n", sd, pid, dump_op_name(op), replies, bytes, (const char *)p);
+                }
+                break;
+
+            case STATE_DUMP_TLV_END:
+                if (length < 16) goto Damaged;
+                {
+                    const uint32_t tlvs = dump_uint32(&p);
+                    const uint32_t slices = dump_uint32(&p);
+                    const uint32_t longest = dump_uint32(&p);
+                    const uint32_t total = dump_uint32(&p);
+                    printf("\n%u entries written in %u slices, longest %u ms, %u ms in all\n", tlvs, slices, longest, total);
+                    complete = 1;
+                }
+                break;
+
+            default:    // Types from a newer daemon
+                break;
+        }
+        continue;
+Damaged:
+        fprintf(stderr, "Damaged entry of type %u and length %u\n", type, length);
+    }
+
+    free(data);
+    if (!complete) { fprintf(stderr, "%s ends before the end of the dump\n", path); return 1; }
+    return 0;
+}
+
 // Note: The C preprocessor stringify operator ('#') makes a string from its argument, without macro expansion
 // e.g. If "version" is #define'd to be "4", then STRINGIFY_AWE(version) will return the string "version", not "4"
 // To expand "version" to its value before making the string, use STRINGIFY(version) instead
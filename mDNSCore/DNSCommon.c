@@ -34,6 +34,26 @@
     #pragma warning(disable:4295)
 #endif
 
+// Vector kernels for case-insensitive domain name comparison.
+// Define DOMAINNAME_SIMD_DISABLED to force the portable byte-at-a-time code.
+#if !defined(DOMAINNAME_SIMD_DISABLED)
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define DOMAINNAME_SIMD_SSE2 1
+    #if defined(__AVX2__)
+        #include <immintrin.h>
+        #define DOMAINNAME_SIMD_AVX2 1
+    #endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+    #include <arm_neon.h>
+    #define DOMAINNAME_SIMD_NEON 1
+#endif
+#endif // !defined(DOMAINNAME_SIMD_DISABLED)
+
+#if DOMAINNAME_SIMD_SSE2 || DOMAINNAME_SIMD_NEON
+    #define DOMAINNAME_SIMD 1
+#endif
+
 // ***************************************************************************
 #if COMPILER_LIKES_PRAGMA_MARK
 #pragma mark - Program Constants
@@ -483,17 +503,113 @@ mDNSexport mDNSBool mDNSAddrIsDNSMulticast(const mDNSAddr *ip)
 #pragma mark - Domain Name Utility Functions
 #endif
 
+#if DOMAINNAME_SIMD
+
+// The vector routines below fold 'A'-'Z' to 'a'-'z' and leave every other byte value (including 0x80-0xFF) unchanged,
+// exactly like mDNSIsUpperCase(). They never read outside [p, p+len): a length that is not a multiple of the vector
+// width is handled by comparing an overlapping final block that ends exactly at p+len.
+
+#if DOMAINNAME_SIMD_SSE2
+
+mDNSlocal __m128i FoldToLower16(const __m128i v)
+{
+    // Signed compares are fine here: bytes 0x80-0xFF are negative, so they are never between 'A' and 'Z'
+    const __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+    return(_mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8('a' - 'A'))));
+}
+
+mDNSlocal mDNSBool SameFolded16(const __m128i a, const __m128i b)
+{
+    return(_mm_movemask_epi8(_mm_cmpeq_epi8(FoldToLower16(a), FoldToLower16(b))) == 0xFFFF);
+}
+
+#define Load16(P)       _mm_loadu_si128((const __m128i *)(P))
+#define Load8x2(P, Q)   _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)(P)), _mm_loadl_epi64((const __m128i *)(Q)))
+
+#if DOMAINNAME_SIMD_AVX2
+mDNSlocal mDNSBool SameFolded32(const mDNSu8 *const a, const mDNSu8 *const b)
+{
+    const __m256i va = _mm256_loadu_si256((const __m256i *)a);
+    const __m256i vb = _mm256_loadu_si256((const __m256i *)b);
+    const __m256i ua = _mm256_and_si256(_mm256_cmpgt_epi8(va, _mm256_set1_epi8('A' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), va));
+    const __m256i ub = _mm256_and_si256(_mm256_cmpgt_epi8(vb, _mm256_set1_epi8('A' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), vb));
+    const __m256i la = _mm256_or_si256(va, _mm256_and_si256(ua, _mm256_set1_epi8('a' - 'A')));
+    const __m256i lb = _mm256_or_si256(vb, _mm256_and_si256(ub, _mm256_set1_epi8('a' - 'A')));
+    return(_mm256_movemask_epi8(_mm256_cmpeq_epi8(la, lb)) == -1);
+}
+#endif // DOMAINNAME_SIMD_AVX2
+
+#elif DOMAINNAME_SIMD_NEON
+
+mDNSlocal uint8x16_t FoldToLower16(const uint8x16_t v)
+{
+    // (v - 'A') < 26 as an unsigned compare selects exactly 'A'-'Z'
+    const uint8x16_t upper = vcltq_u8(vsubq_u8(v, vdupq_n_u8('A')), vdupq_n_u8(26));
+    return(vorrq_u8(v, vandq_u8(upper, vdupq_n_u8('a' - 'A'))));
+}
+
+mDNSlocal mDNSBool SameFolded16(const uint8x16_t a, const uint8x16_t b)
+{
+    // Any mismatching byte makes the minimum of the comparison mask zero
+    const uint8x16_t eq = vceqq_u8(FoldToLower16(a), FoldToLower16(b));
+    const uint8x8_t  m  = vpmin_u8(vget_low_u8(eq), vget_high_u8(eq));
+    return(vget_lane_u64(vreinterpret_u64_u8(vpmin_u8(m, m)), 0) == 0xFFFFFFFFFFFFFFFFULL);
+}
+
+#define Load16(P)       vld1q_u8(P)
+#define Load8x2(P, Q)   vcombine_u8(vld1_u8(P), vld1_u8(Q))
+
+#endif // DOMAINNAME_SIMD_NEON
+
+// Returns mDNStrue if the len bytes at a and b are the same, ignoring ASCII case
+mDNSlocal mDNSBool SameBytesIgnoringCase(const mDNSu8 *a, const mDNSu8 *b, const int len)
+{
+    int i;
+    if (len >= 16)
+    {
+#if DOMAINNAME_SIMD_AVX2
+        if (len >= 32)
+        {
+            for (i = 0; i + 32 <= len; i += 32)
+                if (!SameFolded32(a + i, b + i)) return(mDNSfalse);
+            return((i == len) || SameFolded32(a + len - 32, b + len - 32));
+        }
+#endif
+        for (i = 0; i + 16 <= len; i += 16)
+            if (!SameFolded16(Load16(a + i), Load16(b + i))) return(mDNSfalse);
+        return((i == len) || SameFolded16(Load16(a + len - 16), Load16(b + len - 16)));
+    }
+    if (len >= 8)
+        return(SameFolded16(Load8x2(a, a + len - 8), Load8x2(b, b + len - 8)));
+    for (i = 0; i < len; i++)
+    {
+        mDNSu8 ac = a[i];
+        mDNSu8 bc = b[i];
+        if (mDNSIsUpperCase(ac)) ac += 'a' - 'A';
+        if (mDNSIsUpperCase(bc)) bc += 'a' - 'A';
+        if (ac != bc) return(mDNSfalse);
+    }
+    return(mDNStrue);
+}
+
+#endif // DOMAINNAME_SIMD
+
 #if !APPLE_OSX_mDNSResponder
 
 mDNSexport mDNSBool SameDomainLabel(const mDNSu8 *a, const mDNSu8 *b)
 {
+#if !DOMAINNAME_SIMD
     int i;
+#endif
     const int len = *a++;
 
     if (len > MAX_DOMAIN_LABEL)
     { debugf("Malformed label (too long)"); return(mDNSfalse); }
 
     if (len != *b++) return(mDNSfalse);
+#if DOMAINNAME_SIMD
+    return(SameBytesIgnoringCase(a, b, len));
+#else
     for (i=0; i<len; i++)
     {
         mDNSu8 ac = *a++;
@@ -503,6 +619,7 @@ mDNSexport mDNSBool SameDomainLabel(const mDNSu8 *a, const mDNSu8 *b)
         if (ac != bc) return(mDNSfalse);
     }
     return(mDNStrue);
+#endif
 }
 
 #endif // !APPLE_OSX_mDNSResponder
@@ -1853,8 +1970,102 @@ mDNSexport mDNSBool ValidateRData(const mDNSu16 rrtype, const mDNSu16 rdlength,
 #pragma mark - DNS Message Creation Functions
 #endif
 
+#if MDNSRESPONDER_SUPPORTS(COMMON, COMPRESSION_TABLE)
+
+// Compression dictionary for the message currently being built.
+// InitializeDNSMessage() binds the table to a message. From then on putDomainNameAsLabels() records the offset of
+// every label it writes literally, keyed by a hash of the name suffix that starts at that label, so later names can
+// find their compression targets in O(labels) instead of scanning the message built so far. Entries are kept in
+// ascending offset order and each hash chain is newest-first, so the first candidate on a chain that passes the same
+// byte-for-byte check FindCompressionPointer() uses is the same target the backwards scan would have found.
+// The one difference is that the scan can also point into opaque RDATA (e.g. TXT bytes) that happens to spell out a
+// name in wire format; the table only knows about names written by putDomainNameAsLabels(), so in that rare case it
+// compresses against the real name instead, which is equally valid.
+// Messages that were not started with InitializeDNSMessage(), or that outgrow the table, use the scan.
+
+#define CompressionTableSlots   256     // Number of hash chains; must be a power of two
+#define CompressionTableEntries 1024    // Maximum number of labels recorded per message
+
+typedef struct
+{
+    mDNSu32 hash;       // Hash of the name suffix starting at this label
+    mDNSu16 offset;     // Offset of the label's length byte from the start of the message
+    mDNSu16 next;       // Index + 1 of the next older entry on the same chain, or zero
+} CompressionTableEntry;
+
+typedef struct
+{
+    const DNSMessage *msg;                          // Message the table describes, or mDNSNULL if unbound
+    mDNSu16 count;
+    mDNSu16 heads[CompressionTableSlots];           // Index + 1 of the newest entry on each chain, or zero
+    CompressionTableEntry entries[CompressionTableEntries];
+} CompressionTable;
+
+mDNSlocal CompressionTable CompressionDictionary;
+
+mDNSlocal void CompressionTableBind(const DNSMessage *const msg)
+{
+    CompressionDictionary.msg   = msg;
+    CompressionDictionary.count = 0;
+    mDNSPlatformMemZero(CompressionDictionary.heads, sizeof(CompressionDictionary.heads));
+}
+
+// Computes the hash of every suffix of name, one per label, for CompressionTableFind() and CompressionTableAdd().
+// Returns mDNSfalse for malformed names, which are left to the scan so they fail exactly as they always have.
+mDNSlocal mDNSBool CompressionTableHashSuffixes(const domainname *const name, mDNSu32 *const hashes)
+{
+    const mDNSu8 *labels[MAX_DOMAIN_NAME / 2];
+    const mDNSu8 *const max = name->c + MAX_DOMAIN_NAME;
+    const mDNSu8 *np = name->c;
+    mDNSu32 hash = 2166136261U;
+    int count = 0;
+
+    while (*np)
+    {
+        if (*np > MAX_DOMAIN_LABEL || np + 1 + *np >= max) return(mDNSfalse);
+        labels[count++] = np;
+        np += 1 + *np;
+    }
+    // FNV-1a over the labels, last label first, so each suffix's hash covers exactly the bytes of that suffix
+    while (count--)
+    {
+        const mDNSu8 *c = labels[count];
+        const mDNSu8 *const end = c + 1 + *c;
+        while (c < end) hash = (hash ^ *c++) * 16777619U;
+        hashes[count] = hash;
+    }
+    return(mDNStrue);
+}
+
+// Drops entries at or beyond offset, for when the caller has backed up and is overwriting the end of the message.
+// The newest entry in the table is always the head of its own chain, so entries can be popped in reverse order.
+mDNSlocal void CompressionTableTruncate(CompressionTable *const t, const mDNSu16 offset)
+{
+    while (t->count && t->entries[t->count - 1].offset >= offset)
+    {
+        const CompressionTableEntry *const e = &t->entries[--t->count];
+        t->heads[e->hash & (CompressionTableSlots - 1)] = e->next;
+    }
+}
+
+mDNSlocal void CompressionTableAdd(CompressionTable *const t, const mDNSu16 offset, const mDNSu32 hash)
+{
+    CompressionTableEntry *e;
+    if (t->count >= CompressionTableEntries) { t->msg = mDNSNULL; return; }    // Full; rest of message uses the scan
+    e = &t->entries[t->count++];
+    e->hash   = hash;
+    e->offset = offset;
+    e->next   = t->heads[hash & (CompressionTableSlots - 1)];
+    t->heads[hash & (CompressionTableSlots - 1)] = t->count;
+}
+
+#endif // MDNSRESPONDER_SUPPORTS(COMMON, COMPRESSION_TABLE)
+
 mDNSexport void InitializeDNSMessage(DNSMessageHeader *h, mDNSOpaque16 id, mDNSOpaque16 flags)
 {
+#if MDNSRESPONDER_SUPPORTS(COMMON, COMPRESSION_TABLE)
+    CompressionTableBind((const DNSMessage *)h);
+#endif
     h->id             = id;
     h->flags          = flags;
     h->numQuestions   = 0;
@@ -1865,6 +2076,41 @@ mDNSexport void InitializeDNSMessage(DNSMessageHeader *h, mDNSOpaque16 id, mDNSO
 
 #endif // !STANDALONE
 
+// Checks whether the name at position result in the message (following compression pointers as necessary) is
+// byte-for-byte the same as domname, so that a compression pointer to result can be used in its place
+mDNSlocal mDNSBool IsCompressionTarget(const mDNSu8 *const base, const mDNSu8 *const end, const mDNSu8 *const result, const mDNSu8 *const domname)
+{
+    const mDNSu8 *name = domname;
+    const mDNSu8 *targ = result;
+
+    // If the length byte and first character of the label match, then check further to see
+    // if this location in the packet will yield a useful name compression pointer.
+    if (result[0] != domname[0] || result[1] != domname[1]) return(mDNSfalse);
+
+    while (targ + *name < end)
+    {
+        // First see if this label matches
+        int i;
+        const mDNSu8 *pointertarget;
+        for (i=0; i <= *name; i++) if (targ[i] != name[i]) break;
+        if (i <= *name) break;                          // If label did not match, bail out
+        targ += 1 + *name;                              // Else, did match, so advance target pointer
+        name += 1 + *name;                              // and proceed to check next label
+        if (*name == 0 && *targ == 0) return(mDNStrue); // If no more labels, we found a match!
+        if (*name == 0) break;                          // If no more labels to match, we failed, so bail out
+
+        // The label matched, so now follow the pointer (if appropriate) and then see if the next label matches
+        if (targ[0] < 0x40) continue;                   // If length value, continue to check next label
+        if (targ[0] < 0xC0) break;                      // If 40-BF, not valid
+        if (targ+1 >= end) break;                       // Second byte not present!
+        pointertarget = base + (((mDNSu16)(targ[0] & 0x3F)) << 8) + targ[1];
+        if (targ < pointertarget) break;                // Pointertarget must point *backwards* in the packet
+        if (pointertarget[0] >= 0x40) break;            // Pointertarget must point to a valid length byte
+        targ = pointertarget;
+    }
+    return(mDNSfalse);
+}
+
 mDNSexport const mDNSu8 *FindCompressionPointer(const mDNSu8 *const base, const mDNSu8 *const end, const mDNSu8 *const domname)
 {
     const mDNSu8 *result = end - *domname - 1;
@@ -1874,39 +2120,32 @@ mDNSexport const mDNSu8 *FindCompressionPointer(const mDNSu8 *const base, const
     // This loop examines each possible starting position in packet, starting end of the packet and working backwards
     while (result >= base)
     {
-        // If the length byte and first character of the label match, then check further to see
-        // if this location in the packet will yield a useful name compression pointer.
-        if (result[0] == domname[0] && result[1] == domname[1])
-        {
-            const mDNSu8 *name = domname;
-            const mDNSu8 *targ = result;
-            while (targ + *name < end)
-            {
-                // First see if this label matches
-                int i;
-                const mDNSu8 *pointertarget;
-                for (i=0; i <= *name; i++) if (targ[i] != name[i]) break;
-                if (i <= *name) break;                          // If label did not match, bail out
-                targ += 1 + *name;                              // Else, did match, so advance target pointer
-                name += 1 + *name;                              // and proceed to check next label
-                if (*name == 0 && *targ == 0) return(result);   // If no more labels, we found a match!
-                if (*name == 0) break;                          // If no more labels to match, we failed, so bail out
-
-                // The label matched, so now follow the pointer (if appropriate) and then see if the next label matches
-                if (targ[0] < 0x40) continue;                   // If length value, continue to check next label
-                if (targ[0] < 0xC0) break;                      // If 40-BF, not valid
-                if (targ+1 >= end) break;                       // Second byte not present!
-                pointertarget = base + (((mDNSu16)(targ[0] & 0x3F)) << 8) + targ[1];
-                if (targ < pointertarget) break;                // Pointertarget must point *backwards* in the packet
-                if (pointertarget[0] >= 0x40) break;            // Pointertarget must point to a valid length byte
-                targ = pointertarget;
-            }
-        }
+        if (IsCompressionTarget(base, end, result, domname)) return(result);
         result--;   // We failed to match at this search position, so back up the tentative result pointer and try again
     }
     return(mDNSNULL);
 }
 
+#if !defined(STANDALONE) && MDNSRESPONDER_SUPPORTS(COMMON, COMPRESSION_TABLE)
+// Same result as FindCompressionPointer(), but only looks at the labels the compression table has recorded
+// for this suffix rather than at every byte of the message
+mDNSlocal const mDNSu8 *CompressionTableFind(const CompressionTable *const t, const mDNSu8 *const base,
+                                             const mDNSu8 *const end, const mDNSu8 *const domname, const mDNSu32 hash)
+{
+    const mDNSu8 *const last = end - *domname - 1;  // Same starting position as the backwards scan
+    mDNSu16 i;
+
+    if (*domname == 0) return(mDNSNULL);
+    for (i = t->heads[hash & (CompressionTableSlots - 1)]; i; i = t->entries[i - 1].next)
+    {
+        const CompressionTableEntry *const e = &t->entries[i - 1];
+        const mDNSu8 *const result = base + e->offset;
+        if (e->hash == hash && result <= last && IsCompressionTarget(base, end, result, domname)) return(result);
+    }
+    return(mDNSNULL);
+}
+#endif
+
 // domainname is a fully-qualified name (i.e. assumed to be ending in a dot, even if it doesn't)
 // msg points to the message we're building (pass mDNSNULL if we don't want to use compression pointers)
 // end points to the end of the message so far
@@ -1921,9 +2160,22 @@ mDNSexport mDNSu8 *putDomainNameAsLabels(const DNSMessage *const msg,
     const mDNSu8 *const max         = name->c + MAX_DOMAIN_NAME;    // Maximum that's valid
     const mDNSu8 *      pointer     = mDNSNULL;
     const mDNSu8 *const searchlimit = ptr;
+#if !defined(STANDALONE) && MDNSRESPONDER_SUPPORTS(COMMON, COMPRESSION_TABLE)
+    CompressionTable *  table       = mDNSNULL;
+    mDNSu32             hashes[MAX_DOMAIN_NAME / 2];
+    int                 label       = 0;
+#endif
 
     if (!ptr) { LogMsg("putDomainNameAsLabels %##s ptr is null", name->c); return(mDNSNULL); }
 
+#if !defined(STANDALONE) && MDNSRESPONDER_SUPPORTS(COMMON, COMPRESSION_TABLE)
+    if (base && CompressionDictionary.msg == msg && CompressionTableHashSuffixes(name, hashes))
+    {
+        table = &CompressionDictionary;
+        CompressionTableTruncate(table, (mDNSu16)(searchlimit - base));
+    }
+#endif
+
     if (!*np)       // If just writing one-byte root label, make sure we have space for that
     {
         if (ptr >= limit) return(mDNSNULL);
@@ -1946,6 +2198,10 @@ mDNSexport mDNSu8 *putDomainNameAsLabels(const DNSMessage *const msg,
             if (np + 1 + *np >= max)
             { LogMsg("Malformed domain name %##s (more than 256 bytes)", name->c); return(mDNSNULL); }
 
+#if !defined(STANDALONE) && MDNSRESPONDER_SUPPORTS(COMMON, COMPRESSION_TABLE)
+            if (table) pointer = CompressionTableFind(table, base, searchlimit, np, hashes[label]);
+            else
+#endif
             if (base) pointer = FindCompressionPointer(base, searchlimit, np);
             if (pointer)                    // Use a compression pointer if we can
             {
@@ -1961,6 +2217,9 @@ mDNSexport mDNSu8 *putDomainNameAsLabels(const DNSMessage *const msg,
                 mDNSu8 len = *np++;
                 // If we don't at least have enough space for this label *plus* a terminating zero on the end, give up
                 if (ptr + 1 + len >= limit) return(mDNSNULL);
+#if !defined(STANDALONE) && MDNSRESPONDER_SUPPORTS(COMMON, COMPRESSION_TABLE)
+                if (table) CompressionTableAdd(table, (mDNSu16)(ptr - base), hashes[label++]);
+#endif
                 *ptr++ = len;
                 for (i=0; i<len; i++) *ptr++ = *np++;
             }
@@ -3154,12 +3413,9 @@ fail:
     return mDNSfalse;
 }
 
-mDNSexport const mDNSu8 *GetLargeResourceRecord(mDNS *const m, const DNSMessage *const msg, const mDNSu8 *ptr,
-                                                const mDNSu8 *end, const mDNSInterfaceID InterfaceID, mDNSu8 RecordType, LargeCacheRecord *const largecr)
+mDNSlocal void InitLargeResourceRecord(mDNS *const m, const mDNSInterfaceID InterfaceID, LargeCacheRecord *const largecr)
 {
     CacheRecord *const rr = &largecr->r;
-    mDNSu16 pktrdlength;
-    mDNSu32 maxttl = (!InterfaceID) ? mDNSMaximumUnicastTTLSeconds : mDNSMaximumMulticastTTLSeconds;
 
     if (largecr == &m->rec && m->rec.r.resrec.RecordType)
         LogFatalError("GetLargeResourceRecord: m->rec appears to be already in use for %s", CRDisplayString(m, &m->rec.r));
@@ -3185,10 +3441,17 @@ mDNSexport const mDNSu8 *GetLargeResourceRecord(mDNS *const m, const DNSMessage
 #else
     rr->resrec.rDNSServer = mDNSNULL;
 #endif
+}
 
-    ptr = getDomainName(msg, ptr, end, &largecr->namestorage);      // Will bail out correctly if ptr is NULL
-    if (!ptr) { debugf("GetLargeResourceRecord: Malformed RR name"); return(mDNSNULL); }
-    rr->resrec.namehash = DomainNameHashValue(rr->resrec.name);
+// Gets the rest of the record, once InitLargeResourceRecord() has been called and the owner name filled in.
+// ptr points to the type that follows the owner name. If view is given, e is the record's entry in it.
+mDNSlocal const mDNSu8 *GetLargeResourceRecordData(mDNS *const m, const DNSMessage *const msg, const mDNSu8 *ptr,
+                                                   const mDNSu8 *end, const mDNSInterfaceID InterfaceID, mDNSu8 RecordType, LargeCacheRecord *const largecr,
+                                                   const DNSMessageView *const view, const DNSMessageViewEntry *const e)
+{
+    CacheRecord *const rr = &largecr->r;
+    mDNSu16 pktrdlength;
+    mDNSu32 maxttl = (!InterfaceID) ? mDNSMaximumUnicastTTLSeconds : mDNSMaximumMulticastTTLSeconds;
 
     if (ptr + 10 > end) { debugf("GetLargeResourceRecord: Malformed RR -- no type/class/ttl/len!"); return(mDNSNULL); }
 
@@ -3226,17 +3489,26 @@ mDNSexport const mDNSu8 *GetLargeResourceRecord(mDNS *const m, const DNSMessage
     // bitwise memory compare (or sum). This is because a domainname is a fixed size structure holding variable-length data.
     // Any bytes past the logical end of the name are undefined, and a blind bitwise memory compare may indicate that
     // two domainnames are different when semantically they are the same name and it's only the unused bytes that differ.
-    if (rr->resrec.rrclass == kDNSQClass_ANY && pktrdlength == 0)   // Used in update packets to mean "Delete An RRset" (RFC 2136)
-        rr->resrec.rdlength = 0;
-    else if (!SetRData(msg, ptr, end, &rr->resrec, pktrdlength))
+    if (view && e->rdata != kDNSMessageViewNone)    // ParseDNSMessage() has already done SetRData() and SetNewRData()
     {
-        LogRedact(MDNS_LOG_CATEGORY_DEFAULT, MDNS_LOG_ERROR,
-            "GetLargeResourceRecord: SetRData failed for " PRI_DM_NAME " (" PUB_S ")",
-            DM_NAME_PARAM(rr->resrec.name), DNSTypeName(rr->resrec.rrtype));
-        goto fail;
+        mDNSPlatformMemCopy(rr->resrec.rdata->u.data, (const mDNSu8 *)view->space + e->rdata, e->rdlength);
+        rr->resrec.rdlength   = e->rdlength;
+        rr->resrec.rdestimate = e->rdestimate;
+        rr->resrec.rdatahash  = e->rdatahash;
+    }
+    else
+    {
+        if (rr->resrec.rrclass == kDNSQClass_ANY && pktrdlength == 0)   // Used in update packets to mean "Delete An RRset" (RFC 2136)
+            rr->resrec.rdlength = 0;
+        else if (!SetRData(msg, ptr, end, &rr->resrec, pktrdlength))
+        {
+            LogRedact(MDNS_LOG_CATEGORY_DEFAULT, MDNS_LOG_ERROR,
+                "GetLargeResourceRecord: SetRData failed for " PRI_DM_NAME " (" PUB_S ")",
+                DM_NAME_PARAM(rr->resrec.name), DNSTypeName(rr->resrec.rrtype));
+            goto fail;
+        }
+        SetNewRData(&rr->resrec, mDNSNULL, 0);      // Sets rdlength, rdestimate, rdatahash for us
     }
-
-    SetNewRData(&rr->resrec, mDNSNULL, 0);      // Sets rdlength, rdestimate, rdatahash for us
 
     // Success! Now fill in RecordType to show this record contains valid data
     rr->resrec.RecordType = RecordType;
@@ -3252,6 +3524,16 @@ fail:
     return(end);
 }
 
+mDNSexport const mDNSu8 *GetLargeResourceRecord(mDNS *const m, const DNSMessage *const msg, const mDNSu8 *ptr,
+                                                const mDNSu8 *end, const mDNSInterfaceID InterfaceID, mDNSu8 RecordType, LargeCacheRecord *const largecr)
+{
+    InitLargeResourceRecord(m, InterfaceID, largecr);
+    ptr = getDomainName(msg, ptr, end, &largecr->namestorage);      // Will bail out correctly if ptr is NULL
+    if (!ptr) { debugf("GetLargeResourceRecord: Malformed RR name"); return(mDNSNULL); }
+    largecr->r.resrec.namehash = DomainNameHashValue(largecr->r.resrec.name);
+    return(GetLargeResourceRecordData(m, msg, ptr, end, InterfaceID, RecordType, largecr, mDNSNULL, mDNSNULL));
+}
+
 mDNSexport const mDNSu8 *skipQuestion(const DNSMessage *msg, const mDNSu8 *ptr, const mDNSu8 *end)
 {
     ptr = skipDomainName(msg, ptr, end);
@@ -3329,10 +3611,11 @@ mDNSexport const mDNSu8 *LocateOptRR(const DNSMessage *const msg, const mDNSu8 *
 // The code that currently calls this assumes there's only one, instead of iterating through the set
 mDNSexport const rdataOPT *GetLLQOptData(mDNS *const m, const DNSMessage *const msg, const mDNSu8 *const end)
 {
-    const mDNSu8 *ptr = LocateOptRR(msg, end, DNSOpt_LLQData_Space);
-    if (ptr)
+    DNSMessageView *const view = GetMessageView(m, msg, end);
+    const int opt = LocateViewOptRR(view, DNSOpt_LLQData_Space);
+    if (opt >= 0)
     {
-        ptr = GetLargeResourceRecord(m, msg, ptr, end, 0, kDNSRecordTypePacketAdd, &m->rec);
+        const mDNSu8 *ptr = GetViewRecord(m, view, (mDNSu32)opt, 0, kDNSRecordTypePacketAdd, &m->rec);
         if (ptr && m->rec.r.resrec.RecordType != kDNSRecordTypePacketNegative) return(&m->rec.r.resrec.rdata->u.opt[0]);
     }
     return(mDNSNULL);
@@ -3341,10 +3624,11 @@ mDNSexport const rdataOPT *GetLLQOptData(mDNS *const m, const DNSMessage *const
 // Get the lease life of records in a dynamic update
 mDNSexport mDNSBool GetPktLease(mDNS *const m, const DNSMessage *const msg, const mDNSu8 *const end, mDNSu32 *const lease)
 {
-    const mDNSu8 *ptr = LocateOptRR(msg, end, DNSOpt_LeaseData_Space);
-    if (ptr)
+    DNSMessageView *const view = GetMessageView(m, msg, end);
+    const int opt = LocateViewOptRR(view, DNSOpt_LeaseData_Space);
+    if (opt >= 0)
     {
-        ptr = GetLargeResourceRecord(m, msg, ptr, end, 0, kDNSRecordTypePacketAdd, &m->rec);
+        const mDNSu8 *ptr = GetViewRecord(m, view, (mDNSu32)opt, 0, kDNSRecordTypePacketAdd, &m->rec);
         if (ptr && m->rec.r.resrec.RecordType != kDNSRecordTypePacketNegative && m->rec.r.resrec.rrtype == kDNSType_OPT)
         {
             const rdataOPT *o;
@@ -3362,6 +3646,240 @@ mDNSexport mDNSBool GetPktLease(mDNS *const m, const DNSMessage *const msg, cons
     return mDNSfalse;
 }
 
+// Parses the question or record at ptr into e, decompressing its owner name into name if there's room for it there.
+// Returns the end of the entry, or NULL if it's malformed.
+mDNSlocal const mDNSu8 *ParseViewEntry(const DNSMessageView *const view, const mDNSu8 *const ptr, const mDNSBool question,
+                                       domainname *const name, DNSMessageViewEntry *const e)
+{
+    const mDNSu8 *const fixed = name ? getDomainName(view->msg, ptr, view->end, name) : skipDomainName(view->msg, ptr, view->end);
+    const mDNSu8 *next;
+
+    if (!fixed) { debugf("ParseViewEntry: Malformed name"); return(mDNSNULL); }
+    e->ptr   = ptr;
+    e->fixed = (mDNSu16)(fixed - ptr);
+    e->name  = kDNSMessageViewNone;
+    e->rdata = kDNSMessageViewNone;
+    if (question) next = fixed + 4;
+    else
+    {
+        if (fixed + 10 > view->end) { debugf("ParseViewEntry: Malformed RR -- no type/class/ttl/len!"); return(mDNSNULL); }
+        next = fixed + 10 + ((mDNSu16)fixed[8] << 8 | fixed[9]);
+    }
+    if (next > view->end) { debugf("ParseViewEntry: Entry exceeds end of packet"); return(mDNSNULL); }
+    return(next);
+}
+
+// Unpacks the rdata of record e, whose owner name is in space[], into space[] at *used. Only the types that make up
+// most of what we receive, and whose SetRData() cases don't log, are done here. Other types, and rdata that SetRData()
+// rejects or that doesn't fit, are left for GetViewRecord() to unpack, and to report, as GetLargeResourceRecord() would.
+mDNSlocal void ParseViewRData(DNSMessageView *const view, DNSMessageViewEntry *const e, mDNSu32 *const used)
+{
+    const mDNSu8 *const fixed  = e->ptr + e->fixed;
+    const mDNSu16 pktrdlength  = (mDNSu16)((mDNSu16)fixed[8] << 8 | fixed[9]);
+    const mDNSu32 offset       = (*used + 3) & ~(mDNSu32)3;   // RData must be aligned
+    ResourceRecord rr;
+    mDNSu32 room;
+
+    rr.rrtype  = (mDNSu16) ((mDNSu16)fixed[0] << 8 | fixed[1]);
+    rr.rrclass = (mDNSu16)(((mDNSu16)fixed[2] << 8 | fixed[3]) & kDNSClass_Mask);
+    switch (rr.rrtype)
+    {
+    case kDNSType_A:
+    case kDNSType_AAAA:
+    case kDNSType_TXT:   room = pktrdlength;         break;
+    case kDNSType_CNAME:
+    case kDNSType_PTR:   room = MAX_DOMAIN_NAME;     break;
+    case kDNSType_SRV:   room = 6 + MAX_DOMAIN_NAME; break;
+    default:             return;
+    }
+    if (rr.rrclass == kDNSQClass_ANY || pktrdlength > MaximumRDSize || offset + sizeofRDataHeader + room > sizeof(view->space))
+        return;
+
+    rr.rdata              = (RData *)((mDNSu8 *)view->space + offset);
+    rr.rdata->MaxRDLength = (mDNSu16)room;
+    rr.rdlength           = pktrdlength;
+    rr.name               = (const domainname *)((const mDNSu8 *)view->space + e->name);
+    if (!SetRData(view->msg, fixed + 10, fixed + 10 + pktrdlength, &rr, pktrdlength)) return;
+    SetNewRData(&rr, mDNSNULL, 0);
+
+    // For these types the unpacked rdata takes exactly rdlength bytes
+    e->rdata      = (mDNSu16)(offset + sizeofRDataHeader);
+    e->rdlength   = rr.rdlength;
+    e->rdestimate = rr.rdestimate;
+    e->rdatahash  = rr.rdatahash;
+    *used = e->rdata + rr.rdlength;
+}
+
+mDNSlocal const mDNSu8 *ViewEntryEnd(const DNSMessageView *const view, const mDNSu32 n, const DNSMessageViewEntry *const e)
+{
+    const mDNSu8 *const fixed = e->ptr + e->fixed;
+    if (n < view->numQuestions) return(fixed + 4);
+    return(fixed + 10 + ((mDNSu16)fixed[8] << 8 | fixed[9]));
+}
+
+// Walks the message once, indexing each question and record. If unpack is set it also decompresses the owner names
+// and unpacks what rdata it can. The counts must already be in the view.
+mDNSlocal void IndexDNSMessage(DNSMessageView *const view, const DNSMessage *const msg, const mDNSu8 *const end,
+                               const mDNSBool unpack)
+{
+    mDNSu8 *const space = (mDNSu8 *)view->space;
+    const mDNSu8 *ptr = msg->data;
+    mDNSu32 used = 0;
+
+    view->msg        = msg;
+    view->end        = end;
+    view->total      = (mDNSu32)view->numQuestions + view->numAnswers + view->numAuthorities + view->numAdditionals;
+    view->numEntries = 0;
+    view->walkIndex  = 0;
+    view->walk.ptr   = mDNSNULL;
+
+    while (view->numEntries < view->total && view->numEntries < kDNSMessageViewMaxEntries)
+    {
+        DNSMessageViewEntry *const e = &view->entries[view->numEntries];
+        domainname *const name = (unpack && used + MAX_DOMAIN_NAME <= sizeof(view->space)) ? (domainname *)&space[used] : mDNSNULL;
+        const mDNSBool question = (view->numEntries < view->numQuestions);
+        ptr = ParseViewEntry(view, ptr, question, name, e);
+        if (!ptr) break;
+        if (name)
+        {
+            e->name     = (mDNSu16)used;
+            e->namehash = DomainNameHashValue(name);
+            used += DomainNameLength(name);
+        }
+        if (name && !question) ParseViewRData(view, e, &used);
+        view->numEntries++;
+    }
+}
+
+// Indexes msg, whose header counts are in host byte order, as they are once mDNSCoreReceive() has started on it.
+// The names and rdata are left where they are: on the core's thread, unpacking them ahead of time only adds a copy.
+mDNSexport void ParseDNSMessage(DNSMessageView *const view, const DNSMessage *const msg, const mDNSu8 *const end)
+{
+    view->numQuestions   = msg->h.numQuestions;
+    view->numAnswers     = msg->h.numAnswers;
+    view->numAuthorities = msg->h.numAuthorities;
+    view->numAdditionals = msg->h.numAdditionals;
+    IndexDNSMessage(view, msg, end, mDNSfalse);
+}
+
+// Parses msg as it came off the wire, for mDNSCoreReceiveParsed(). This only reads msg and writes view, and logs
+// nothing but debugf() messages, so the platform layer can call it on any thread.
+mDNSexport void ParseReceivedDNSMessage(DNSMessageView *const view, const DNSMessage *const msg, const mDNSu8 *const end)
+{
+    const mDNSu8 *const h = (const mDNSu8 *)&msg->h.numQuestions;
+
+    if ((const mDNSu8 *)msg + sizeof(DNSMessageHeader) > end) { view->msg = mDNSNULL; return; }  // mDNSCoreReceive() reports it
+    view->numQuestions   = (mDNSu16)((mDNSu16)h[0] << 8 | h[1]);
+    view->numAnswers     = (mDNSu16)((mDNSu16)h[2] << 8 | h[3]);
+    view->numAuthorities = (mDNSu16)((mDNSu16)h[4] << 8 | h[5]);
+    view->numAdditionals = (mDNSu16)((mDNSu16)h[6] << 8 | h[7]);
+    IndexDNSMessage(view, msg, end, mDNStrue);
+}
+
+// Returns the view of msg: the one mDNSCoreReceiveParsed() was given, or else m->rxview, parsing it first unless
+// that has already been done. Either is only kept while the core processes the message.
+mDNSexport DNSMessageView *GetMessageView(mDNS *const m, const DNSMessage *const msg, const mDNSu8 *const end)
+{
+    if (m->rxparsed && m->rxparsed->msg == msg && m->rxparsed->end == end) return(m->rxparsed);
+    if (m->rxview.msg != msg || m->rxview.end != end) ParseDNSMessage(&m->rxview, msg, end);
+    return(&m->rxview);
+}
+
+// Returns entry n, or NULL if the message ends or is malformed before it. Entries beyond entries[] are found by
+// skipping from the last one indexed, or from the last one found that way, so going through them in order is cheap.
+mDNSlocal const DNSMessageViewEntry *FindViewEntry(DNSMessageView *const view, const mDNSu32 n)
+{
+    if (n < view->numEntries) return(&view->entries[n]);
+    if (n >= view->total || view->numEntries < kDNSMessageViewMaxEntries) return(mDNSNULL);
+
+    if (!view->walk.ptr || view->walkIndex > n)
+    {
+        view->walkIndex = view->numEntries - 1;
+        view->walk      = view->entries[view->walkIndex];
+    }
+    while (view->walkIndex < n)
+    {
+        const mDNSu8 *const ptr = ViewEntryEnd(view, view->walkIndex, &view->walk);
+        view->walkIndex++;
+        if (!ParseViewEntry(view, ptr, view->walkIndex < view->numQuestions, mDNSNULL, &view->walk))
+        {
+            view->total = view->walkIndex;      // Nothing from here on can be found
+            view->walk.ptr = mDNSNULL;
+            return(mDNSNULL);
+        }
+    }
+    return(&view->walk);
+}
+
+// Returns the first answer, as LocateAnswers() would
+mDNSexport const mDNSu8 *LocateViewAnswers(DNSMessageView *const view)
+{
+    const DNSMessageViewEntry *e;
+    if (!view->numQuestions) return(view->msg->data);
+    e = FindViewEntry(view, view->numQuestions - 1);
+    return(e ? ViewEntryEnd(view, view->numQuestions - 1, e) : mDNSNULL);
+}
+
+// Gets question i, as getQuestion() would
+mDNSexport const mDNSu8 *GetViewQuestion(DNSMessageView *const view, const mDNSu32 i, const mDNSInterfaceID InterfaceID,
+                                         DNSQuestion *question)
+{
+    const DNSMessageViewEntry *const e = (i < view->numQuestions) ? FindViewEntry(view, i) : mDNSNULL;
+    const mDNSu8 *ptr;
+
+    if (!e) { debugf("GetViewQuestion: Malformed DNS question section"); return(mDNSNULL); }
+    if (e->name == kDNSMessageViewNone) return(getQuestion(view->msg, e->ptr, view->end, InterfaceID, question));
+
+    mDNSPlatformMemZero(question, sizeof(*question));
+    question->InterfaceID = InterfaceID;
+    if (!InterfaceID) question->TargetQID = onesID; // In DNSQuestions we use TargetQID as the indicator of whether it's unicast or multicast
+    AssignDomainName(&question->qname, (const domainname *)((const mDNSu8 *)view->space + e->name));
+    question->qnamehash = e->namehash;
+    ptr = e->ptr + e->fixed;
+    question->qtype  = (mDNSu16)((mDNSu16)ptr[0] << 8 | ptr[1]);            // Get type
+    question->qclass = (mDNSu16)((mDNSu16)ptr[2] << 8 | ptr[3]);            // and class
+    return(ptr+4);
+}
+
+// Gets record i, counting from the first answer, as GetLargeResourceRecord() would
+mDNSexport const mDNSu8 *GetViewRecord(mDNS *const m, DNSMessageView *const view, const mDNSu32 i,
+                                       const mDNSInterfaceID InterfaceID, mDNSu8 RecordType, LargeCacheRecord *const largecr)
+{
+    const DNSMessageViewEntry *const e = FindViewEntry(view, view->numQuestions + i);
+
+    if (!e) { debugf("GetViewRecord: Malformed RR"); return(mDNSNULL); }
+    if (e->name == kDNSMessageViewNone)
+        return(GetLargeResourceRecord(m, view->msg, e->ptr, view->end, InterfaceID, RecordType, largecr));
+
+    InitLargeResourceRecord(m, InterfaceID, largecr);
+    AssignDomainName(&largecr->namestorage, (const domainname *)((const mDNSu8 *)view->space + e->name));
+    largecr->r.resrec.namehash = e->namehash;
+    return(GetLargeResourceRecordData(m, view->msg, e->ptr + e->fixed, view->end, InterfaceID, RecordType, largecr, view, e));
+}
+
+// Returns the number of the first OPT record in the additional section with at least minsize bytes of rdata,
+// counting from the first answer as GetViewRecord() does, or -1 if there isn't one. See LocateOptRR().
+mDNSexport int LocateViewOptRR(DNSMessageView *const view, int minsize)
+{
+    const mDNSu32 first = (mDNSu32)view->numQuestions + view->numAnswers + view->numAuthorities;
+    mDNSu32 n;
+
+    for (n = first; n < view->total; n++)
+    {
+        const DNSMessageViewEntry *const e = FindViewEntry(view, n);
+        const mDNSu8 *ptr;
+        if (!e) break;
+        ptr = e->ptr;
+        if (ptr + DNSOpt_Header_Space + minsize <= view->end &&     // Make sure we have 11+minsize bytes of data
+            ptr[0] == 0                                      &&     // Name must be root label
+            ptr[1] == (kDNSType_OPT >> 8  )                  &&     // rrtype OPT
+            ptr[2] == (kDNSType_OPT & 0xFF)                  &&
+            ((mDNSu16)ptr[9] << 8 | (mDNSu16)ptr[10]) >= (mDNSu16)minsize)
+            return((int)(n - view->numQuestions));
+    }
+    return(-1);
+}
+
 #define DNS_OP_Name(X) (                              \
         (X) == kDNSFlag0_OP_StdQuery ? ""         :       \
         (X) == kDNSFlag0_OP_Iquery   ? "Iquery "  :       \
@@ -3894,6 +4412,93 @@ mDNSexport void mDNS_Unlock_(mDNS *const m, const char *const functionname)
     mDNSPlatformUnlock(m);
 }
 
+// ***************************************************************************
+#if COMPILER_LIKES_PRAGMA_MARK
+#pragma mark -
+#pragma mark - Live Metrics
+#endif
+
+mDNSexport mDNSMetrics mDNS_Metrics;
+
+mDNSexport void mDNSMetricsHistogramAdd(mDNSMetricsHistogram *const h, const mDNSu32 value)
+{
+    mDNSu32 b = 0, max;
+    while (b < mDNSMetricsHistogramBuckets - 1 && (value >> b)) b++;
+    mDNSMetricsAdd(h->buckets[b], 1);
+    mDNSMetricsAdd(h->count, 1);
+    max = mDNSMetricsGet(h->max);
+    while (max < value && !mDNSMetricsCAS(h->max, max, value)) continue;
+}
+
+// Counts a datagram in the totals and against its interface. May be called on any thread. An interface claims the
+// first free slot the first time it is seen and keeps it, so once all the slots are taken, interfaces that appear
+// after that are only counted in the totals. Datagrams with no interface index are only counted in the totals too.
+mDNSexport void mDNSMetricsCountPacket(const mDNSu32 ifindex, const mDNSBool outgoing, const mDNSu32 bytes)
+{
+    mDNSMetricsInterface *slot = mDNSNULL;
+    int i;
+
+    if (outgoing) { mDNSMetricsAdd(mDNS_Metrics.PacketsOut, 1); mDNSMetricsAdd(mDNS_Metrics.BytesOut, bytes); }
+    else          { mDNSMetricsAdd(mDNS_Metrics.PacketsIn,  1); mDNSMetricsAdd(mDNS_Metrics.BytesIn,  bytes); }
+    if (!ifindex) return;
+
+    for (i = 0; i < mDNSMetricsMaxInterfaces && !slot; i++)
+    {
+        mDNSu32 owner = mDNSMetricsGet(mDNS_Metrics.Interfaces[i].ifindex);
+        if (owner == 0) mDNSMetricsCAS(mDNS_Metrics.Interfaces[i].ifindex, owner, ifindex);    // Leaves owner zero if we got it
+        if (owner == 0 || owner == ifindex) slot = &mDNS_Metrics.Interfaces[i];
+    }
+    if (!slot) return;
+
+    if (outgoing) { mDNSMetricsAdd(slot->PacketsOut, 1); mDNSMetricsAdd(slot->BytesOut, bytes); }
+    else          { mDNSMetricsAdd(slot->PacketsIn,  1); mDNSMetricsAdd(slot->BytesIn,  bytes); }
+}
+
+mDNSlocal mDNSu32 FormatMetric(char *const buffer, const mDNSu32 buflen, const char *const prefix, const char *const name, const mDNSu32 value)
+{
+    return(mDNS_snprintf(buffer, buflen, "%smetric=%s count=%u\n", prefix, name, value));
+}
+
+// Formats the metrics as one "key=value ..." line each, for tools to parse, and returns the length written.
+// Per-interface lines start with "if=<index> ", and the histogram line adds "max=" and "buckets=".
+mDNSexport mDNSu32 mDNSMetricsFormat(char *const buffer, const mDNSu32 buflen)
+{
+    mDNSMetrics *const x = &mDNS_Metrics;
+    mDNSu32 len = 0, b;
+    int i;
+
+    len += FormatMetric(buffer + len, buflen - len, "", "packets_in",        mDNSMetricsGet(x->PacketsIn));
+    len += FormatMetric(buffer + len, buflen - len, "", "packets_out",       mDNSMetricsGet(x->PacketsOut));
+    len += FormatMetric(buffer + len, buflen - len, "", "bytes_in",          mDNSMetricsGet(x->BytesIn));
+    len += FormatMetric(buffer + len, buflen - len, "", "bytes_out",         mDNSMetricsGet(x->BytesOut));
+    len += FormatMetric(buffer + len, buflen - len, "", "questions_started", mDNSMetricsGet(x->QuestionsStarted));
+    len += FormatMetric(buffer + len, buflen - len, "", "questions_active",  mDNSMetricsGet(x->QuestionsActive));
+    len += FormatMetric(buffer + len, buflen - len, "", "cache_hits",        mDNSMetricsGet(x->CacheHits));
+    len += FormatMetric(buffer + len, buflen - len, "", "cache_misses",      mDNSMetricsGet(x->CacheMisses));
+    len += FormatMetric(buffer + len, buflen - len, "", "cache_evictions",   mDNSMetricsGet(x->CacheEvictions));
+    len += FormatMetric(buffer + len, buflen - len, "", "cache_entities",    mDNSMetricsGet(x->CacheEntities));
+
+    len += mDNS_snprintf(buffer + len, buflen - len, "metric=answer_latency_ms count=%u max=%u buckets=",
+                         mDNSMetricsGet(x->AnswerLatency.count), mDNSMetricsGet(x->AnswerLatency.max));
+    for (b = 0; b < mDNSMetricsHistogramBuckets; b++)
+        len += mDNS_snprintf(buffer + len, buflen - len, b ? ",%u" : "%u", mDNSMetricsGet(x->AnswerLatency.buckets[b]));
+    len += mDNS_snprintf(buffer + len, buflen - len, "\n");
+
+    for (i = 0; i < mDNSMetricsMaxInterfaces; i++)
+    {
+        mDNSMetricsInterface *const intf = &x->Interfaces[i];
+        const mDNSu32 ifindex = mDNSMetricsGet(intf->ifindex);
+        char prefix[16];
+        if (!ifindex) break;
+        mDNS_snprintf(prefix, sizeof(prefix), "if=%u ", ifindex);
+        len += FormatMetric(buffer + len, buflen - len, prefix, "packets_in",  mDNSMetricsGet(intf->PacketsIn));
+        len += FormatMetric(buffer + len, buflen - len, prefix, "packets_out", mDNSMetricsGet(intf->PacketsOut));
+        len += FormatMetric(buffer + len, buflen - len, prefix, "bytes_in",    mDNSMetricsGet(intf->BytesIn));
+        len += FormatMetric(buffer + len, buflen - len, prefix, "bytes_out",   mDNSMetricsGet(intf->BytesOut));
+    }
+    return(len);
+}
+
 // ***************************************************************************
 #if COMPILER_LIKES_PRAGMA_MARK
 #pragma mark -
@@ -268,6 +268,15 @@ extern const mDNSu8 *LocateAnswers(const DNSMessage *const msg, const mDNSu8 *co
 extern const mDNSu8 *LocateAuthorities(const DNSMessage *const msg, const mDNSu8 *const end);
 extern const mDNSu8 *LocateAdditionals(const DNSMessage *const msg, const mDNSu8 *const end);
 extern const mDNSu8 *LocateOptRR(const DNSMessage *const msg, const mDNSu8 *const end, int minsize);
+extern void ParseDNSMessage(DNSMessageView *const view, const DNSMessage *const msg, const mDNSu8 *const end);
+extern void ParseReceivedDNSMessage(DNSMessageView *const view, const DNSMessage *const msg, const mDNSu8 *const end);
+extern DNSMessageView *GetMessageView(mDNS *const m, const DNSMessage *const msg, const mDNSu8 *const end);
+extern const mDNSu8 *LocateViewAnswers(DNSMessageView *const view);
+extern const mDNSu8 *GetViewQuestion(DNSMessageView *const view, const mDNSu32 i, const mDNSInterfaceID InterfaceID,
+                                     DNSQuestion *question);
+extern const mDNSu8 *GetViewRecord(mDNS *const m, DNSMessageView *const view, const mDNSu32 i,
+                                   const mDNSInterfaceID InterfaceID, mDNSu8 RecordType, LargeCacheRecord *const largecr);
+extern int LocateViewOptRR(DNSMessageView *const view, int minsize);
 extern const rdataOPT *GetLLQOptData(mDNS *const m, const DNSMessage *const msg, const mDNSu8 *const end);
 extern mDNSBool GetPktLease(mDNS *const m, const DNSMessage *const msg, const mDNSu8 *const end, mDNSu32 *const lease);
 extern void DumpPacket(mStatus status, mDNSBool sent, const char *transport, const mDNSAddr *srcaddr, mDNSIPPort srcport,
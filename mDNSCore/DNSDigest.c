@@ -657,7 +657,7 @@ void md5_block_data_order (MD5_CTX *c, const void *p,int num);
 int HASH_UPDATE (HASH_CTX *c, const void *data_, unsigned long len)
 {
     const unsigned char *data=(const unsigned char *)data_;
-    const unsigned char * const data_end=(const unsigned char *)data_;
+    const unsigned char * const data_end=(const unsigned char *)data_ + len;
     register HASH_LONG * p;
     register unsigned long l;
     int sw,sc,ew,ec;
@@ -1139,6 +1139,217 @@ void md5_block_data_order (MD5_CTX *c, const void *data_, int num)
 #endif
 
 
+// ***************************************************************************
+#if COMPILER_LIKES_PRAGMA_MARK
+#pragma mark - SHA-256 Hash Functions
+#endif
+
+// SHA-256 as specified in FIPS 180-4. The block function is chosen the first time it's needed: x86 processors with
+// the SHA extensions run the rounds in hardware, and everything else uses the portable version.
+
+#define SHA256_CBLOCK 64
+
+typedef struct
+{
+    mDNSu32 h[8];
+    mDNSu32 Nl, Nh;                     // Message length in bits
+    mDNSu8  data[SHA256_CBLOCK];
+    mDNSu32 num;                        // Bytes waiting in data
+} SHA256_CTX;
+
+typedef void SHA256BlockFunc(mDNSu32 h[8], const mDNSu8 *data, mDNSu32 num);
+
+static const mDNSu32 SHA256_K[64] =
+{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const mDNSu32 SHA256_H0[8] =
+{
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+#define SHA256_ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define SHA256_S0(x) (SHA256_ROTR((x),  2) ^ SHA256_ROTR((x), 13) ^ SHA256_ROTR((x), 22))
+#define SHA256_S1(x) (SHA256_ROTR((x),  6) ^ SHA256_ROTR((x), 11) ^ SHA256_ROTR((x), 25))
+#define SHA256_s0(x) (SHA256_ROTR((x),  7) ^ SHA256_ROTR((x), 18) ^ ((x) >>  3))
+#define SHA256_s1(x) (SHA256_ROTR((x), 17) ^ SHA256_ROTR((x), 19) ^ ((x) >> 10))
+
+mDNSlocal void SHA256_Blocks_Portable(mDNSu32 h[8], const mDNSu8 *data, mDNSu32 num)
+{
+    mDNSu32 w[64];
+    int i;
+
+    for (; num--; data += SHA256_CBLOCK)
+    {
+        mDNSu32 a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], k = h[7];
+
+        for (i = 0; i < 16; i++)
+            w[i] = NToH32((mDNSu8 *)data + i * 4);
+        for (i = 16; i < 64; i++)
+            w[i] = SHA256_s1(w[i - 2]) + w[i - 7] + SHA256_s0(w[i - 15]) + w[i - 16];
+
+        for (i = 0; i < 64; i++)
+        {
+            const mDNSu32 t1 = k + SHA256_S1(e) + ((e & f) ^ (~e & g)) + SHA256_K[i] + w[i];
+            const mDNSu32 t2 = SHA256_S0(a) + ((a & b) ^ (a & c) ^ (b & c));
+            k = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+        h[4] += e; h[5] += f; h[6] += g; h[7] += k;
+    }
+}
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define SHA256_X86_SHA 1
+#include <cpuid.h>
+#include <immintrin.h>
+
+// The SHA extensions keep the state as ABEF and CDGH, and do two rounds per instruction with the round constants
+// already added to the message words. See Intel's "New Instructions Supporting the Secure Hash Algorithm on Intel
+// Architecture Processors".
+__attribute__((target("sha,sse4.1")))
+mDNSlocal void SHA256_Blocks_SHA(mDNSu32 h[8], const mDNSu8 *data, mDNSu32 num)
+{
+    const __m128i byteswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i abef, cdgh, tmp;
+    int i;
+
+    tmp  = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&h[0]), 0xB1);    // CDAB
+    cdgh = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&h[4]), 0x1B);    // EFGH
+    abef = _mm_alignr_epi8(tmp, cdgh, 8);                                       // ABEF
+    cdgh = _mm_blend_epi16(cdgh, tmp, 0xF0);                                    // CDGH
+
+    for (; num--; data += SHA256_CBLOCK)
+    {
+        const __m128i abefSaved = abef, cdghSaved = cdgh;
+        __m128i w[4];   // The last four groups of four message words
+
+        for (i = 0; i < 16; i++)
+        {
+            __m128i msg;
+            if (i < 4)
+                w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + i * 16)), byteswap);
+            else
+            {
+                // W[t..t+3] from W[t-16..t-13], W[t-15..t-12], W[t-7..t-4] and W[t-2..t-1]
+                msg = _mm_sha256msg1_epu32(w[i & 3], w[(i + 1) & 3]);
+                msg = _mm_add_epi32(msg, _mm_alignr_epi8(w[(i + 3) & 3], w[(i + 2) & 3], 4));
+                w[i & 3] = _mm_sha256msg2_epu32(msg, w[(i + 3) & 3]);
+            }
+            msg  = _mm_add_epi32(w[i & 3], _mm_loadu_si128((const __m128i *)&SHA256_K[i * 4]));
+            cdgh = _mm_sha256rnds2_epu32(cdgh, abef, msg);
+            abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(msg, 0x0E));
+        }
+
+        abef = _mm_add_epi32(abef, abefSaved);
+        cdgh = _mm_add_epi32(cdgh, cdghSaved);
+    }
+
+    tmp  = _mm_shuffle_epi32(abef, 0x1B);                                       // FEBA
+    cdgh = _mm_shuffle_epi32(cdgh, 0xB1);                                       // DCHG
+    _mm_storeu_si128((__m128i *)&h[0], _mm_blend_epi16(tmp, cdgh, 0xF0));       // DCBA
+    _mm_storeu_si128((__m128i *)&h[4], _mm_alignr_epi8(cdgh, tmp, 8));          // HGFE
+}
+#endif
+
+mDNSlocal void SHA256_Blocks_Select(mDNSu32 h[8], const mDNSu8 *data, mDNSu32 num);
+static SHA256BlockFunc *SHA256_Blocks = SHA256_Blocks_Select;
+
+mDNSlocal void SHA256_Blocks_Select(mDNSu32 h[8], const mDNSu8 *data, mDNSu32 num)
+{
+#if SHA256_X86_SHA
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_1) && (ecx & bit_SSSE3) &&
+        __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_SHA))
+        SHA256_Blocks = SHA256_Blocks_SHA;
+    else
+#endif
+    SHA256_Blocks = SHA256_Blocks_Portable;
+    SHA256_Blocks(h, data, num);
+}
+
+mDNSlocal void SHA256_Init(SHA256_CTX *c)
+{
+    mDNSPlatformMemCopy(c->h, SHA256_H0, sizeof(c->h));
+    c->Nl  = 0;
+    c->Nh  = 0;
+    c->num = 0;
+}
+
+mDNSlocal void SHA256_Update(SHA256_CTX *c, const void *data_, mDNSu32 len)
+{
+    const mDNSu8 *data = (const mDNSu8 *)data_;
+    mDNSu32 n;
+
+    if (c->Nl + (len << 3) < c->Nl) c->Nh++;
+    c->Nh += len >> 29;
+    c->Nl += len << 3;
+
+    if (c->num)
+    {
+        n = SHA256_CBLOCK - c->num;
+        if (len < n) n = len;
+        mDNSPlatformMemCopy(c->data + c->num, data, n);
+        c->num += n;
+        data   += n;
+        len    -= n;
+        if (c->num < SHA256_CBLOCK) return;
+        SHA256_Blocks(c->h, c->data, 1);
+        c->num = 0;
+    }
+    n = len / SHA256_CBLOCK;
+    if (n)
+    {
+        SHA256_Blocks(c->h, data, n);
+        data += n * SHA256_CBLOCK;
+        len  -= n * SHA256_CBLOCK;
+    }
+    if (len)
+    {
+        mDNSPlatformMemCopy(c->data, data, len);
+        c->num = len;
+    }
+}
+
+mDNSlocal void SHA256_Final(mDNSu8 md[SHA256_LEN], SHA256_CTX *c)
+{
+    int i;
+
+    c->data[c->num++] = 0x80;
+    if (c->num > SHA256_CBLOCK - 8)
+    {
+        mDNSPlatformMemZero(c->data + c->num, SHA256_CBLOCK - c->num);
+        SHA256_Blocks(c->h, c->data, 1);
+        c->num = 0;
+    }
+    mDNSPlatformMemZero(c->data + c->num, SHA256_CBLOCK - 8 - c->num);
+    for (i = 0; i < 4; i++)
+    {
+        c->data[SHA256_CBLOCK - 8 + i] = (mDNSu8)(c->Nh >> (24 - i * 8));
+        c->data[SHA256_CBLOCK - 4 + i] = (mDNSu8)(c->Nl >> (24 - i * 8));
+    }
+    SHA256_Blocks(c->h, c->data, 1);
+
+    for (i = 0; i < 8; i++)
+    {
+        md[i * 4    ] = (mDNSu8)(c->h[i] >> 24);
+        md[i * 4 + 1] = (mDNSu8)(c->h[i] >> 16);
+        md[i * 4 + 2] = (mDNSu8)(c->h[i] >>  8);
+        md[i * 4 + 3] = (mDNSu8)(c->h[i]      );
+    }
+}
+
+
 // ***************************************************************************
 #if COMPILER_LIKES_PRAGMA_MARK
 #pragma mark - base64 -> binary conversion
@@ -1294,37 +1505,139 @@ mDNSlocal mDNSs32 DNSDigest_Base64ToBin(const char *src, mDNSu8 *target, mDNSu32
 #define MD5_LEN     16
 
 #define HMAC_MD5_AlgName "\010" "hmac-md5" "\007" "sig-alg" "\003" "reg" "\003" "int"
+#define HMAC_SHA256_AlgName "\013" "hmac-sha256"
+
+mDNSlocal const domainname *TSIGAlgName(mDNSu8 algorithm)
+{
+    return (const domainname *)(algorithm == TSIG_Alg_HMAC_SHA256 ? HMAC_SHA256_AlgName : HMAC_MD5_AlgName);
+}
+
+// HMAC (RFC 2104) with the key's algorithm. DNSDigest_ConstructHMACKey hashed the padded keys once, so each message
+// resumes from those states and only costs the hashing of its own bytes plus one block for the outer hash.
+typedef struct
+{
+    mDNSu8 algorithm;
+    union
+    {
+        MD5_CTX md5;
+        SHA256_CTX sha256;
+    } u;
+} TSIGHMAC_CTX;
+
+mDNSlocal void TSIGHMAC_Resume(TSIGHMAC_CTX *c, mDNSu8 algorithm, const mDNSu32 state[8])
+{
+    c->algorithm = algorithm;
+    if (algorithm == TSIG_Alg_HMAC_SHA256)
+    {
+        SHA256_Init(&c->u.sha256);
+        mDNSPlatformMemCopy(c->u.sha256.h, state, sizeof(c->u.sha256.h));
+        c->u.sha256.Nl = HMAC_LEN * 8;
+    }
+    else
+    {
+        MD5_Init(&c->u.md5);
+        c->u.md5.A  = state[0];
+        c->u.md5.B  = state[1];
+        c->u.md5.C  = state[2];
+        c->u.md5.D  = state[3];
+        c->u.md5.Nl = HMAC_LEN * 8;
+    }
+}
+
+mDNSlocal void TSIGHMAC_Update(TSIGHMAC_CTX *c, const void *data, mDNSu32 len)
+{
+    if (c->algorithm == TSIG_Alg_HMAC_SHA256) SHA256_Update(&c->u.sha256, data, len);
+    else MD5_Update(&c->u.md5, data, len);
+}
+
+mDNSlocal mDNSu32 TSIGHMAC_Final(TSIGHMAC_CTX *c, mDNSu8 *md)
+{
+    if (c->algorithm == TSIG_Alg_HMAC_SHA256) { SHA256_Final(md, &c->u.sha256); return(SHA256_LEN); }
+    MD5_Final(md, &c->u.md5);
+    return(MD5_LEN);
+}
+
+mDNSlocal void TSIGHMAC_Begin(TSIGHMAC_CTX *c, const DomainAuthInfo *info)
+{
+    TSIGHMAC_Resume(c, info->algorithm, info->keystate_ipad);
+}
+
+// Finishes the inner hash, then does the outer hash (outer key pad, inner digest). Returns the MAC's length.
+mDNSlocal mDNSu32 TSIGHMAC_End(TSIGHMAC_CTX *c, const DomainAuthInfo *info, mDNSu8 mac[SHA256_LEN])
+{
+    const mDNSu32 len = TSIGHMAC_Final(c, mac);
+    TSIGHMAC_Resume(c, info->algorithm, info->keystate_opad);
+    TSIGHMAC_Update(c, mac, len);
+    return(TSIGHMAC_Final(c, mac));
+}
+
+// Hashes one padded key block from the algorithm's initial state, and keeps the resulting state
+mDNSlocal void DNSDigest_HashKeyPad(mDNSu8 algorithm, const mDNSu8 pad[HMAC_LEN], mDNSu32 state[8])
+{
+    if (algorithm == TSIG_Alg_HMAC_SHA256)
+    {
+        mDNSPlatformMemCopy(state, SHA256_H0, sizeof(SHA256_H0));
+        SHA256_Blocks(state, pad, 1);
+    }
+    else
+    {
+        MD5_CTX k;
+        MD5_Init(&k);
+        MD5_Update(&k, pad, HMAC_LEN);
+        state[0] = k.A;
+        state[1] = k.B;
+        state[2] = k.C;
+        state[3] = k.D;
+        state[4] = state[5] = state[6] = state[7] = 0;
+    }
+}
 
 // Adapted from Appendix, RFC 2104
 mDNSlocal void DNSDigest_ConstructHMACKey(DomainAuthInfo *info, const mDNSu8 *key, mDNSu32 len)
 {
-    MD5_CTX k;
-    mDNSu8 buf[MD5_LEN];
+    mDNSu8 buf[SHA256_LEN];
+    mDNSu8 ipad[HMAC_LEN];
+    mDNSu8 opad[HMAC_LEN];
     int i;
 
-    // If key is longer than HMAC_LEN reset it to MD5(key)
+    // If key is longer than HMAC_LEN reset it to H(key)
     if (len > HMAC_LEN)
     {
-        MD5_Init(&k);
-        MD5_Update(&k, key, len);
-        MD5_Final(buf, &k);
+        if (info->algorithm == TSIG_Alg_HMAC_SHA256)
+        {
+            SHA256_CTX k;
+            SHA256_Init(&k);
+            SHA256_Update(&k, key, len);
+            SHA256_Final(buf, &k);
+            len = SHA256_LEN;
+        }
+        else
+        {
+            MD5_CTX k;
+            MD5_Init(&k);
+            MD5_Update(&k, key, len);
+            MD5_Final(buf, &k);
+            len = MD5_LEN;
+        }
         key = buf;
-        len = MD5_LEN;
     }
 
     // store key in pads
-    mDNSPlatformMemZero(info->keydata_ipad, HMAC_LEN);
-    mDNSPlatformMemZero(info->keydata_opad, HMAC_LEN);
-    mDNSPlatformMemCopy(info->keydata_ipad, key, len);
-    mDNSPlatformMemCopy(info->keydata_opad, key, len);
+    mDNSPlatformMemZero(ipad, HMAC_LEN);
+    mDNSPlatformMemZero(opad, HMAC_LEN);
+    mDNSPlatformMemCopy(ipad, key, len);
+    mDNSPlatformMemCopy(opad, key, len);
 
     // XOR key with ipad and opad values
     for (i = 0; i < HMAC_LEN; i++)
     {
-        info->keydata_ipad[i] ^= HMAC_IPAD;
-        info->keydata_opad[i] ^= HMAC_OPAD;
+        ipad[i] ^= HMAC_IPAD;
+        opad[i] ^= HMAC_OPAD;
     }
 
+    // Hash the pads now, rather than for every message signed with this key
+    DNSDigest_HashKeyPad(info->algorithm, ipad, info->keystate_ipad);
+    DNSDigest_HashKeyPad(info->algorithm, opad, info->keystate_opad);
 }
 
 mDNSexport mDNSs32 DNSDigest_ConstructHMACKeyfromBase64(DomainAuthInfo *info, const char *b64key)
@@ -1342,39 +1655,39 @@ mDNSexport void DNSDigest_SignMessage(DNSMessage *msg, mDNSu8 **end, DomainAuthI
     mDNSu8  *rdata, *const countPtr = (mDNSu8 *)&msg->h.numAdditionals; // Get existing numAdditionals value
     mDNSu32 utc32;
     mDNSu8 utc48[6];
-    mDNSu8 digest[MD5_LEN];
+    mDNSu8 digest[SHA256_LEN];
     mDNSu8 *ptr = *end;
-    mDNSu32 len;
+    mDNSu32 len, maclen;
     mDNSOpaque16 buf;
-    MD5_CTX c;
+    TSIGHMAC_CTX c;
+    const domainname *const algName = TSIGAlgName(info->algorithm);
     mDNSu16 numAdditionals = (mDNSu16)((mDNSu16)countPtr[0] << 8 | countPtr[1]);
 
-    // Init MD5 context, digest inner key pad and message
-    MD5_Init(&c);
-    MD5_Update(&c, info->keydata_ipad, HMAC_LEN);
-    MD5_Update(&c, (mDNSu8 *)msg, (unsigned long)(*end - (mDNSu8 *)msg));
+    // Resume from the inner key pad's hash, and digest the message
+    TSIGHMAC_Begin(&c, info);
+    TSIGHMAC_Update(&c, (mDNSu8 *)msg, (mDNSu32)(*end - (mDNSu8 *)msg));
 
     // Construct TSIG RR, digesting variables as apporpriate
     mDNS_SetupResourceRecord(&tsig, mDNSNULL, 0, kDNSType_TSIG, 0, kDNSRecordTypeKnownUnique, AuthRecordAny, mDNSNULL, mDNSNULL);
 
     // key name
     AssignDomainName(&tsig.namestorage, &info->keyname);
-    MD5_Update(&c, info->keyname.c, DomainNameLength(&info->keyname));
+    TSIGHMAC_Update(&c, info->keyname.c, DomainNameLength(&info->keyname));
 
     // class
     tsig.resrec.rrclass = kDNSQClass_ANY;
     buf = mDNSOpaque16fromIntVal(kDNSQClass_ANY);
-    MD5_Update(&c, buf.b, sizeof(mDNSOpaque16));
+    TSIGHMAC_Update(&c, buf.b, sizeof(mDNSOpaque16));
 
     // ttl
     tsig.resrec.rroriginalttl = 0;
-    MD5_Update(&c, (mDNSu8 *)&tsig.resrec.rroriginalttl, sizeof(tsig.resrec.rroriginalttl));
+    TSIGHMAC_Update(&c, (mDNSu8 *)&tsig.resrec.rroriginalttl, sizeof(tsig.resrec.rroriginalttl));
 
     // alg name
-    AssignConstStringDomainName(&tsig.resrec.rdata->u.name, HMAC_MD5_AlgName);
-    len = DomainNameLengthLimit((domainname *)HMAC_MD5_AlgName, (mDNSu8 *)HMAC_MD5_AlgName + sizeof HMAC_MD5_AlgName);
+    AssignDomainName(&tsig.resrec.rdata->u.name, algName);
+    len = DomainNameLength(algName);
     rdata = tsig.resrec.rdata->u.data + len;
-    MD5_Update(&c, (mDNSu8 *)HMAC_MD5_AlgName, len);
+    TSIGHMAC_Update(&c, algName->c, len);
 
     // time
     // get UTC (universal time), convert to 48-bit unsigned in network byte order
@@ -1389,36 +1702,30 @@ mDNSexport void DNSDigest_SignMessage(DNSMessage *msg, mDNSu8 **end, DomainAuthI
 
     mDNSPlatformMemCopy(rdata, utc48, 6);
     rdata += 6;
-    MD5_Update(&c, utc48, 6);
+    TSIGHMAC_Update(&c, utc48, 6);
 
     // 300 sec is fudge recommended in RFC 2485
     rdata[0] = (mDNSu8)((300 >> 8)  & 0xff);
     rdata[1] = (mDNSu8)( 300        & 0xff);
-    MD5_Update(&c, rdata, sizeof(mDNSOpaque16));
+    TSIGHMAC_Update(&c, rdata, sizeof(mDNSOpaque16));
     rdata += sizeof(mDNSOpaque16);
 
     // digest error (tcode) and other data len (zero) - we'll add them to the rdata later
     buf.b[0] = (mDNSu8)((tcode >> 8) & 0xff);
     buf.b[1] = (mDNSu8)( tcode       & 0xff);
-    MD5_Update(&c, buf.b, sizeof(mDNSOpaque16));  // error
+    TSIGHMAC_Update(&c, buf.b, sizeof(mDNSOpaque16));  // error
     buf.NotAnInteger = 0;
-    MD5_Update(&c, buf.b, sizeof(mDNSOpaque16));  // other data len
+    TSIGHMAC_Update(&c, buf.b, sizeof(mDNSOpaque16));  // other data len
 
-    // finish the message & tsig var hash
-    MD5_Final(digest, &c);
-
-    // perform outer MD5 (outer key pad, inner digest)
-    MD5_Init(&c);
-    MD5_Update(&c, info->keydata_opad, HMAC_LEN);
-    MD5_Update(&c, digest, MD5_LEN);
-    MD5_Final(digest, &c);
+    // finish the message & tsig var hash, and perform the outer hash
+    maclen = TSIGHMAC_End(&c, info, digest);
 
     // set remaining rdata fields
-    rdata[0] = (mDNSu8)((MD5_LEN >> 8)  & 0xff);
-    rdata[1] = (mDNSu8)( MD5_LEN        & 0xff);
+    rdata[0] = (mDNSu8)((maclen >> 8)  & 0xff);
+    rdata[1] = (mDNSu8)( maclen        & 0xff);
     rdata += sizeof(mDNSOpaque16);
-    mDNSPlatformMemCopy(rdata, digest, MD5_LEN);                          // MAC
-    rdata += MD5_LEN;
+    mDNSPlatformMemCopy(rdata, digest, maclen);                           // MAC
+    rdata += maclen;
     rdata[0] = msg->h.id.b[0];                                            // original ID
     rdata[1] = msg->h.id.b[1];
     rdata[2] = (mDNSu8)((tcode >> 8) & 0xff);
@@ -1441,21 +1748,22 @@ mDNSexport mDNSBool DNSDigest_VerifyMessage(DNSMessage *msg, mDNSu8 *end, LargeC
     mDNSu8          *   ptr = (mDNSu8*) &lcr->r.resrec.rdata->u.data;
     mDNSs32 now;
     mDNSs32 then;
-    mDNSu8 thisDigest[MD5_LEN];
-    mDNSu8 thatDigest[MD5_LEN];
+    mDNSu8 thisDigest[SHA256_LEN];
+    mDNSu8 thatDigest[SHA256_LEN];
+    mDNSu16 maclen;
     mDNSOpaque16 buf;
     mDNSu8 utc48[6];
     mDNSs32 delta;
     mDNSu16 fudge;
     domainname      *   algo;
-    MD5_CTX c;
+    TSIGHMAC_CTX c;
     mDNSBool ok = mDNSfalse;
 
-    // We only support HMAC-MD5 for now
+    // The message must use the algorithm that was configured for the key
 
     algo = (domainname*) ptr;
 
-    if (!SameDomainName(algo, (domainname *)HMAC_MD5_AlgName))
+    if (!SameDomainName(algo, TSIGAlgName(info->algorithm)))
     {
         LogMsg("ERROR: DNSDigest_VerifyMessage - TSIG algorithm not supported: %##s", algo->c);
         *rcode = kDNSFlag1_RC_NotAuth;
@@ -1506,62 +1814,63 @@ mDNSexport mDNSBool DNSDigest_VerifyMessage(DNSMessage *msg, mDNSu8 *end, LargeC
 
     // MAC size
 
+    maclen = NToH16(ptr);
     ptr += sizeof(mDNSu16);
+    if (maclen != (info->algorithm == TSIG_Alg_HMAC_SHA256 ? SHA256_LEN : MD5_LEN))
+    {
+        LogMsg("ERROR: DNSDigest_VerifyMessage - bad MAC size %d", maclen);
+        *rcode = kDNSFlag1_RC_NotAuth;
+        *tcode = TSIG_ErrBadSig;
+        ok = mDNSfalse;
+        goto exit;
+    }
 
     // MAC
 
-    mDNSPlatformMemCopy(thatDigest, ptr, MD5_LEN);
+    mDNSPlatformMemCopy(thatDigest, ptr, maclen);
 
-    // Init MD5 context, digest inner key pad and message
+    // Resume from the inner key pad's hash, and digest the message
 
-    MD5_Init(&c);
-    MD5_Update(&c, info->keydata_ipad, HMAC_LEN);
-    MD5_Update(&c, (mDNSu8*) msg, (unsigned long)(end - (mDNSu8*) msg));
+    TSIGHMAC_Begin(&c, info);
+    TSIGHMAC_Update(&c, (mDNSu8*) msg, (mDNSu32)(end - (mDNSu8*) msg));
 
     // Key name
 
-    MD5_Update(&c, lcr->r.resrec.name->c, DomainNameLength(lcr->r.resrec.name));
+    TSIGHMAC_Update(&c, lcr->r.resrec.name->c, DomainNameLength(lcr->r.resrec.name));
 
     // Class name
 
     buf = mDNSOpaque16fromIntVal(lcr->r.resrec.rrclass);
-    MD5_Update(&c, buf.b, sizeof(mDNSOpaque16));
+    TSIGHMAC_Update(&c, buf.b, sizeof(mDNSOpaque16));
 
     // TTL
 
-    MD5_Update(&c, (mDNSu8*) &lcr->r.resrec.rroriginalttl, sizeof(lcr->r.resrec.rroriginalttl));
+    TSIGHMAC_Update(&c, (mDNSu8*) &lcr->r.resrec.rroriginalttl, sizeof(lcr->r.resrec.rroriginalttl));
 
     // Algorithm
 
-    MD5_Update(&c, algo->c, DomainNameLength(algo));
+    TSIGHMAC_Update(&c, algo->c, DomainNameLength(algo));
 
     // Time
 
-    MD5_Update(&c, utc48, 6);
+    TSIGHMAC_Update(&c, utc48, 6);
 
     // Fudge
 
     buf = mDNSOpaque16fromIntVal(fudge);
-    MD5_Update(&c, buf.b, sizeof(mDNSOpaque16));
+    TSIGHMAC_Update(&c, buf.b, sizeof(mDNSOpaque16));
 
     // Digest error and other data len (both zero) - we'll add them to the rdata later
 
     buf.NotAnInteger = 0;
-    MD5_Update(&c, buf.b, sizeof(mDNSOpaque16));  // error
-    MD5_Update(&c, buf.b, sizeof(mDNSOpaque16));  // other data len
-
-    // Finish the message & tsig var hash
-
-    MD5_Final(thisDigest, &c);
+    TSIGHMAC_Update(&c, buf.b, sizeof(mDNSOpaque16));  // error
+    TSIGHMAC_Update(&c, buf.b, sizeof(mDNSOpaque16));  // other data len
 
-    // perform outer MD5 (outer key pad, inner digest)
+    // Finish the message & tsig var hash, and perform the outer hash
 
-    MD5_Init(&c);
-    MD5_Update(&c, info->keydata_opad, HMAC_LEN);
-    MD5_Update(&c, thisDigest, MD5_LEN);
-    MD5_Final(thisDigest, &c);
+    TSIGHMAC_End(&c, info, thisDigest);
 
-    if (!mDNSPlatformMemSame(thisDigest, thatDigest, MD5_LEN))
+    if (!mDNSPlatformMemSame(thisDigest, thatDigest, maclen))
     {
         LogMsg("ERROR: DNSDigest_VerifyMessage - bad signature");
         *rcode = kDNSFlag1_RC_NotAuth;
@@ -279,21 +279,6 @@ mDNSlocal void SetNextQueryStopTime(mDNS *const m, const DNSQuestion *const q)
         m->NextScheduledStopTime = q->StopTime;
 }
 
-mDNSexport void SetNextQueryTime(mDNS *const m, const DNSQuestion *const q)
-{
-    mDNS_CheckLock(m);
-
-    if (ActiveQuestion(q))
-    {
-        // Depending on whether this is a multicast or unicast question we want to set either:
-        // m->NextScheduledQuery = NextQSendTime(q) or
-        // m->NextuDNSEvent      = NextQSendTime(q)
-        mDNSs32 *const timer = mDNSOpaque16IsZero(q->TargetQID) ? &m->NextScheduledQuery : &m->NextuDNSEvent;
-        if (*timer - NextQSendTime(q) > 0)
-            *timer = NextQSendTime(q);
-    }
-}
-
 mDNSlocal void ReleaseAuthEntity(AuthHash *r, AuthEntity *e)
 {
 #if MDNS_MALLOC_DEBUGGING >= 1
@@ -460,21 +445,454 @@ mDNSexport AuthGroup *RemoveAuthRecord(mDNS *const m, AuthHash *r, AuthRecord *r
     return a;
 }
 
-mDNSexport CacheGroup *CacheGroupForName(const mDNS *const m, const mDNSu32 namehash, const domainname *const name)
+// ***************************************************************************
+#if COMPILER_LIKES_PRAGMA_MARK
+#pragma mark -
+#pragma mark - Cache Name Index
+#endif
+
+// m->rrcache_index maps a name to its CacheGroup using open addressing with linear probing.
+// When the index gets more than 3/4 full, a table twice the size is allocated and the old entries are moved
+// across a few slots at a time (on each insertion, and in batches of CACHE_INDEX_MIGRATE_STEP from mDNS_Execute),
+// so no single packet pays for rehashing the whole cache. Until the move is complete, lookups check both tables.
+// Old table slots below the migration cursor, and old entries deleted during the move, are left occupied so
+// that the probe sequences of the entries still to be moved stay intact; they are never returned as matches.
+// If the index cannot be allocated, CacheGroupForName falls back to walking the rrcache_hash bucket chain,
+// and the index is rebuilt at the next CacheGroup insertion.
+
+// DomainNameHashValue() gives similar values for similar names, so the bits are mixed before use as an index
+mDNSlocal mDNSu32 CacheIndexStart(mDNSu32 h, const mDNSu32 capacity)
+{
+    h ^= h >> 16;
+    h *= 0x85EBCA6B;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35;
+    h ^= h >> 16;
+    return(h & (capacity - 1));
+}
+
+mDNSlocal CacheGroup *const CacheIndexTombstone = (CacheGroup *)&CacheIndexTombstone;
+
+mDNSlocal CacheIndexSlot *CacheIndexFind(mDNS *const m, CacheIndexSlot *const slots, const mDNSu32 capacity,
+                                         const mDNSu32 firstlive, const mDNSu32 namehash, const domainname *const name)
+{
+    CacheIndex *const ci = &m->rrcache_index;
+    mDNSu32 i = CacheIndexStart(namehash, capacity);
+    mDNSu32 probes = 1;
+    CacheIndexSlot *found = mDNSNULL;
+
+    for (; slots[i].cg; i = (i + 1) & (capacity - 1), probes++)
+    {
+        if (i >= firstlive && slots[i].cg != CacheIndexTombstone &&
+            slots[i].namehash == namehash && SameDomainName(slots[i].cg->name, name))
+        {
+            found = &slots[i];
+            break;
+        }
+    }
+    ci->probes += probes;
+    if (ci->maxprobe < probes) ci->maxprobe = probes;
+    return(found);
+}
+
+mDNSlocal void CacheIndexPut(CacheIndexSlot *const slots, const mDNSu32 capacity, CacheGroup *const cg)
+{
+    mDNSu32 i = CacheIndexStart(cg->namehash, capacity);
+    while (slots[i].cg) i = (i + 1) & (capacity - 1);
+    slots[i].namehash = cg->namehash;
+    slots[i].cg       = cg;
+}
+
+// Removes slots[i] without leaving a tombstone, by shifting back any following entries
+// that would otherwise become unreachable from their home slot.
+mDNSlocal void CacheIndexDeleteSlot(CacheIndexSlot *const slots, const mDNSu32 capacity, mDNSu32 i)
+{
+    mDNSu32 j = i;
+    for (;;)
+    {
+        mDNSu32 home;
+        slots[i].cg = mDNSNULL;
+        do
+        {
+            j = (j + 1) & (capacity - 1);
+            if (!slots[j].cg) return;
+            home = CacheIndexStart(slots[j].namehash, capacity);
+        }
+        // Leave slots[j] where it is if its home slot lies cyclically in (i, j]
+        while ((i <= j) ? (i < home && home <= j) : (i < home || home <= j));
+        slots[i] = slots[j];
+        i = j;
+    }
+}
+
+mDNSlocal void CacheIndexFree(mDNS *const m)
+{
+    CacheIndex *const ci = &m->rrcache_index;
+    if (ci->slots)    mDNSPlatformMemFree(ci->slots);
+    if (ci->oldslots) mDNSPlatformMemFree(ci->oldslots);
+    ci->slots       = mDNSNULL;
+    ci->capacity    = 0;
+    ci->count       = 0;
+    ci->oldslots    = mDNSNULL;
+    ci->oldcapacity = 0;
+    ci->oldcount    = 0;
+    ci->migrated    = 0;
+}
+
+// Move up to 'limit' slots of the old table into the current one
+mDNSlocal void CacheIndexMigrate(mDNS *const m, mDNSu32 limit)
+{
+    CacheIndex *const ci = &m->rrcache_index;
+    if (!ci->oldslots) return;
+    while (limit-- && ci->migrated < ci->oldcapacity)
+    {
+        const CacheIndexSlot *const s = &ci->oldslots[ci->migrated++];
+        if (s->cg && s->cg != CacheIndexTombstone)
+        {
+            CacheIndexPut(ci->slots, ci->capacity, s->cg);
+            ci->count++;
+            ci->oldcount--;
+        }
+    }
+    if (ci->migrated >= ci->oldcapacity)
+    {
+        mDNSPlatformMemFree(ci->oldslots);
+        ci->oldslots    = mDNSNULL;
+        ci->oldcapacity = 0;
+        ci->oldcount    = 0;
+        ci->migrated    = 0;
+    }
+}
+
+// Builds the index from scratch by walking every rrcache_hash chain. Only used at the first insertion
+// and to recover after an allocation failure.
+mDNSlocal void CacheIndexRebuild(mDNS *const m)
+{
+    CacheIndex *const ci = &m->rrcache_index;
+    mDNSu32 capacity = CACHE_INDEX_MIN_SLOTS;
+    mDNSu32 slot;
+    CacheGroup *cg;
+
+    CacheIndexFree(m);
+    while (capacity / 4 * 3 <= m->rrcache_totalused) capacity *= 2;
+    ci->slots = (CacheIndexSlot *) mDNSPlatformMemAllocateClear(capacity * sizeof(CacheIndexSlot));
+    if (!ci->slots) { LogMsg("CacheIndexRebuild: Failed to allocate %u slots", capacity); return; }
+    ci->capacity = capacity;
+    for (slot = 0; slot < CACHE_HASH_SLOTS; slot++)
+        for (cg = m->rrcache_hash[slot]; cg; cg = cg->next)
+        {
+            CacheIndexPut(ci->slots, ci->capacity, cg);
+            ci->count++;
+        }
+}
+
+// Called after cg has been linked into its rrcache_hash chain
+mDNSlocal void CacheIndexInsert(mDNS *const m, CacheGroup *const cg)
+{
+    CacheIndex *const ci = &m->rrcache_index;
+
+    if (!ci->slots) { CacheIndexRebuild(m); return; }
+
+    // Moving two old slots per insertion guarantees the old table is empty before the new one needs to grow
+    CacheIndexMigrate(m, 2);
+    if (ci->count + ci->oldcount + 1 > ci->capacity / 4 * 3)
+    {
+        CacheIndexSlot *const slots = (CacheIndexSlot *) mDNSPlatformMemAllocateClear(ci->capacity * 2 * sizeof(CacheIndexSlot));
+        if (slots)
+        {
+            if (ci->oldslots) CacheIndexMigrate(m, ci->oldcapacity);
+            ci->oldslots    = ci->slots;
+            ci->oldcapacity = ci->capacity;
+            ci->oldcount    = ci->count;
+            ci->migrated    = 0;
+            ci->slots       = slots;
+            ci->capacity   *= 2;
+            ci->count       = 0;
+            ci->resizes++;
+        }
+        else if (ci->count + ci->oldcount + 1 >= ci->capacity)
+        {
+            // Keep using the current table while it still has free slots; give up on the index once it's full
+            LogMsg("CacheIndexInsert: Failed to grow index beyond %u slots; falling back to bucket chains", ci->capacity);
+            CacheIndexFree(m);
+            return;
+        }
+    }
+    CacheIndexPut(ci->slots, ci->capacity, cg);
+    ci->count++;
+}
+
+mDNSlocal void CacheIndexRemove(mDNS *const m, const CacheGroup *const cg)
 {
+    CacheIndex *const ci = &m->rrcache_index;
+    mDNSu32 i;
+
+    if (!ci->slots) return;
+    for (i = CacheIndexStart(cg->namehash, ci->capacity); ci->slots[i].cg; i = (i + 1) & (ci->capacity - 1))
+        if (ci->slots[i].cg == cg)
+        {
+            CacheIndexDeleteSlot(ci->slots, ci->capacity, i);
+            ci->count--;
+            return;
+        }
+    if (ci->oldslots)
+    {
+        for (i = CacheIndexStart(cg->namehash, ci->oldcapacity); ci->oldslots[i].cg; i = (i + 1) & (ci->oldcapacity - 1))
+            if (i >= ci->migrated && ci->oldslots[i].cg == cg)
+            {
+                ci->oldslots[i].cg = CacheIndexTombstone;
+                ci->oldcount--;
+                return;
+            }
+    }
+    LogMsg("CacheIndexRemove: ERROR!! %##s not found in index", cg->name->c);
+}
+
+mDNSexport CacheGroup *CacheGroupForName(mDNS *const m, const mDNSu32 namehash, const domainname *const name)
+{
+    CacheIndex *const ci = &m->rrcache_index;
+    CacheIndexSlot *s;
     CacheGroup *cg;
-    mDNSu32    slot = HashSlotFromNameHash(namehash);
-    for (cg = m->rrcache_hash[slot]; cg; cg=cg->next)
+
+    if (ci->slots)
+    {
+        ci->lookups++;
+        s = CacheIndexFind(m, ci->slots, ci->capacity, 0, namehash, name);
+        if (!s && ci->oldslots) s = CacheIndexFind(m, ci->oldslots, ci->oldcapacity, ci->migrated, namehash, name);
+        // Every lookup makes at least one probe, so probes reaches 2^31 first. Halving both then keeps either from
+        // wrapping, and keeps probes / lookups the average probe length.
+        if (ci->probes & 0x80000000) { ci->lookups >>= 1; ci->probes >>= 1; }
+        return(s ? s->cg : mDNSNULL);
+    }
+
+    for (cg = m->rrcache_hash[HashSlotFromNameHash(namehash)]; cg; cg=cg->next)
         if (cg->namehash == namehash && SameDomainName(cg->name, name))
             break;
     return(cg);
 }
 
-mDNSlocal CacheGroup *CacheGroupForRecord(const mDNS *const m, const ResourceRecord *const rr)
+mDNSlocal CacheGroup *CacheGroupForRecord(mDNS *const m, const ResourceRecord *const rr)
 {
     return(CacheGroupForName(m, rr->namehash, rr->name));
 }
 
+// ***************************************************************************
+#if COMPILER_LIKES_PRAGMA_MARK
+#pragma mark -
+#pragma mark - Question Name Index
+#endif
+
+// m->QuestionHash threads every question in m->Questions onto a chain chosen by its qnamehash. New questions go
+// on the end of m->Questions, and on the end of their chain, so each chain is in m->Questions order; walking the
+// questions for one name gives the same order, and the same cut-off at m->NewQuestions, as walking the whole list.
+// A question's name only changes while it is stopped, so its chain never changes while it is in the list.
+// Questions in m->LocalOnlyQuestions are not indexed.
+
+#define QuestionHashSlot(X) ((X) % QUESTION_HASH_SLOTS)
+
+mDNSlocal void QuestionHashInsert(mDNS *const m, DNSQuestion *const question)
+{
+    DNSQuestion **qp = &m->QuestionHash[QuestionHashSlot(question->qnamehash)];
+    while (*qp) qp = &(*qp)->NextInQHash;
+    *qp = question;
+    question->NextInQHash = mDNSNULL;
+    question->QuestionSerial = m->NextQuestionSerial++;
+}
+
+mDNSlocal void QuestionHashRemove(mDNS *const m, DNSQuestion *const question)
+{
+    DNSQuestion **qp = &m->QuestionHash[QuestionHashSlot(question->qnamehash)];
+    while (*qp && *qp != question) qp = &(*qp)->NextInQHash;
+    if (*qp) *qp = question->NextInQHash;
+    else LogMsg("QuestionHashRemove: ERROR!! %##s (%s) not found in index", question->qname.c, DNSTypeName(question->qtype));
+}
+
+// Returns the first question in m->Questions with this qnamehash. Callers still check the name itself.
+mDNSlocal DNSQuestion *FirstQuestionForNameHash(const mDNS *const m, const mDNSu32 namehash)
+{
+    DNSQuestion *q = m->QuestionHash[QuestionHashSlot(namehash)];
+    while (q && q->qnamehash != namehash) q = q->NextInQHash;
+    return(q);
+}
+
+// Returns the next question after q in m->Questions with the same qnamehash
+mDNSlocal DNSQuestion *NextQuestionForNameHash(const DNSQuestion *const q)
+{
+    DNSQuestion *n = q->NextInQHash;
+    while (n && n->qnamehash != q->qnamehash) n = n->NextInQHash;
+    return(n);
+}
+
+// SendQueries only has work to do for a multicast question once it's at least half-way to its next query:
+// before that it is neither sent nor accelerated. QuestionHashNextCheck[slot] is the earliest such time of
+// any question on the chain, and QuestionHashNextQuery[slot] the earliest NextQSendTime, so SendQueries can
+// skip the chains where the first hasn't been reached and still work out m->NextScheduledQuery from the second.
+// Either may be earlier than needed (e.g. after a question stops); SendQueries then just looks at the chain
+// and works them out again.
+#define QuestionHalfWayTime(Q) ((Q)->LastQTime + (Q)->ThisQInterval/2)
+
+// SendQueries collects the questions it's sending chain by chain. This puts them back in m->Questions order,
+// the order they go into the packets in, with a bottom-up merge sort of the NextInSendList list.
+mDNSlocal DNSQuestion *SortSendListByQuestionSerial(DNSQuestion *list)
+{
+    mDNSu32 run;
+    for (run = 1; list; run *= 2)
+    {
+        DNSQuestion *a = list, *sorted = mDNSNULL, **tail = &sorted;
+        mDNSu32 merges = 0;
+        while (a)
+        {
+            DNSQuestion *b = a, *e;
+            mDNSu32 asize = 0, bsize = run;
+            merges++;
+            while (b && asize < run) { asize++; b = b->NextInSendList; }
+            while (asize || (bsize && b))
+            {
+                if (asize && (!bsize || !b || (mDNSs32)(a->QuestionSerial - b->QuestionSerial) < 0))
+                    { e = a; a = a->NextInSendList; asize--; }
+                else
+                    { e = b; b = b->NextInSendList; bsize--; }
+                *tail = e;
+                tail = &e->NextInSendList;
+            }
+            a = b;
+        }
+        *tail = mDNSNULL;
+        list = sorted;
+        if (merges <= 1) break;
+    }
+    return(list);
+}
+
+#define FORALL_CHECK_DUE_QUESTIONS(SLOT,Q)                                           \
+    for ((SLOT) = 0; (SLOT) < QUESTION_HASH_SLOTS; (SLOT)++)                         \
+        if (m->timenow - m->QuestionHashNextCheck[(SLOT)] >= 0)                      \
+            for ((Q) = m->QuestionHash[(SLOT)]; (Q) && !(Q)->InNewQuestions; (Q) = (Q)->NextInQHash)
+
+// Note: MUST call SetNextQueryTime any time we change:
+// q->LastQTime
+// q->ThisQInterval
+// q->DuplicateOf
+// in a way that could make the question due any sooner
+mDNSexport void SetNextQueryTime(mDNS *const m, const DNSQuestion *const q)
+{
+    mDNS_CheckLock(m);
+
+    if (ActiveQuestion(q))
+    {
+        // Depending on whether this is a multicast or unicast question we want to set either:
+        // m->NextScheduledQuery = NextQSendTime(q) or
+        // m->NextuDNSEvent      = NextQSendTime(q)
+        mDNSs32 *const timer = mDNSOpaque16IsZero(q->TargetQID) ? &m->NextScheduledQuery : &m->NextuDNSEvent;
+        if (*timer - NextQSendTime(q) > 0)
+            *timer = NextQSendTime(q);
+
+        if (mDNSOpaque16IsZero(q->TargetQID))
+        {
+            const mDNSu32 slot = QuestionHashSlot(q->qnamehash);
+            if (m->QuestionHashNextCheck[slot] - QuestionHalfWayTime(q) > 0)
+                m->QuestionHashNextCheck[slot] = QuestionHalfWayTime(q);
+            if (m->QuestionHashNextQuery[slot] - NextQSendTime(q) > 0)
+                m->QuestionHashNextQuery[slot] = NextQSendTime(q);
+        }
+    }
+}
+
+// ***************************************************************************
+#if COMPILER_LIKES_PRAGMA_MARK
+#pragma mark -
+#pragma mark - Record Name Index
+#endif
+
+// m->RecordHash does the same for m->ResourceRecords, keyed by resrec.namehash. Records are only appended to
+// m->ResourceRecords, or spliced in directly after the identical record they take over from, and a record's name
+// doesn't change while it is registered, so each chain is in m->ResourceRecords order too.
+// Records in m->DuplicateRecords and m->rrauth are not indexed.
+
+#define RecordHashSlot(X) ((X) % RECORD_HASH_SLOTS)
+
+mDNSlocal void RecordHashInsert(mDNS *const m, AuthRecord *const rr)
+{
+    AuthRecord **rp = &m->RecordHash[RecordHashSlot(rr->resrec.namehash)];
+    while (*rp) rp = &(*rp)->NextInRHash;
+    *rp = rr;
+    rr->NextInRHash = mDNSNULL;
+}
+
+// Puts rr on the chain immediately after prev, which must have the same name
+mDNSlocal void RecordHashInsertAfter(AuthRecord *const prev, AuthRecord *const rr)
+{
+    rr->NextInRHash   = prev->NextInRHash;
+    prev->NextInRHash = rr;
+}
+
+mDNSexport void RecordHashRemove(mDNS *const m, AuthRecord *const rr)
+{
+    AuthRecord **rp = &m->RecordHash[RecordHashSlot(rr->resrec.namehash)];
+    while (*rp && *rp != rr) rp = &(*rp)->NextInRHash;
+    if (*rp) *rp = rr->NextInRHash;
+    else LogMsg("RecordHashRemove: ERROR!! %s not found in index", ARDisplayString(m, rr));
+}
+
+// Returns the first record in m->ResourceRecords with this namehash. Callers still check the name itself.
+mDNSlocal AuthRecord *FirstRecordForNameHash(const mDNS *const m, const mDNSu32 namehash)
+{
+    AuthRecord *rr = m->RecordHash[RecordHashSlot(namehash)];
+    while (rr && rr->resrec.namehash != namehash) rr = rr->NextInRHash;
+    return(rr);
+}
+
+// Returns the next record after rr in m->ResourceRecords with the same namehash
+mDNSlocal AuthRecord *NextRecordForNameHash(const AuthRecord *const rr)
+{
+    AuthRecord *n = rr->NextInRHash;
+    while (n && n->resrec.namehash != rr->resrec.namehash) n = n->NextInRHash;
+    return(n);
+}
+
+// ***************************************************************************
+#if COMPILER_LIKES_PRAGMA_MARK
+#pragma mark -
+#pragma mark - Cache Eviction List
+#endif
+
+// m->rrcache_lru links every CacheRecord that is in a CacheGroup, least recently used first. PrevInLRU points at
+// whatever points to the record (the list head, or the previous record's NextInLRU), the same way rrcache_tail
+// does for CacheGroup members, so a record can be unlinked without searching for it.
+
+mDNSlocal void CacheLRUAppend(mDNS *const m, CacheRecord *const cr)
+{
+    CacheLRU *const lru = &m->rrcache_lru;
+    cr->NextInLRU = mDNSNULL;
+    cr->PrevInLRU = lru->tail;
+    *lru->tail = cr;
+    lru->tail = &cr->NextInLRU;
+    lru->count++;
+}
+
+mDNSlocal void CacheLRURemove(mDNS *const m, CacheRecord *const cr)
+{
+    CacheLRU *const lru = &m->rrcache_lru;
+    if (!cr->PrevInLRU) return;         // Records that were never added to a CacheGroup are not on the list
+    *cr->PrevInLRU = cr->NextInLRU;
+    if (cr->NextInLRU) cr->NextInLRU->PrevInLRU = cr->PrevInLRU;
+    else lru->tail = cr->PrevInLRU;
+    cr->NextInLRU = mDNSNULL;
+    cr->PrevInLRU = mDNSNULL;
+    lru->count--;
+}
+
+// Called when a cached record is used, to move it to the most recently used end of the list
+mDNSlocal void CacheLRUTouch(mDNS *const m, CacheRecord *const cr)
+{
+    CacheLRU *const lru = &m->rrcache_lru;
+    if (!cr->PrevInLRU) return;
+    lru->hits++;
+    if (lru->tail == &cr->NextInLRU) return;    // Already the most recently used
+    CacheLRURemove(m, cr);
+    CacheLRUAppend(m, cr);
+}
+
 mDNSexport mDNSBool mDNS_AddressIsLocalSubnet(mDNS *const m, const mDNSInterfaceID InterfaceID, const mDNSAddr *addr)
 {
     NetworkInterfaceInfo *intf;
@@ -805,8 +1223,9 @@ mDNSlocal void AnswerInterfaceAnyQuestionsWithLocalAuthRecord(mDNS *const m, Aut
     if (m->CurrentQuestion)
         LogMsg("AnswerInterfaceAnyQuestionsWithLocalAuthRecord: ERROR m->CurrentQuestion already set: %##s (%s)",
                m->CurrentQuestion->qname.c, DNSTypeName(m->CurrentQuestion->qtype));
-    m->CurrentQuestion = m->Questions;
-    while (m->CurrentQuestion && m->CurrentQuestion != m->NewQuestions)
+    m->CurrentQuestion = FirstQuestionForNameHash(m, ar->resrec.namehash);
+    m->CurrentQuestionByName = mDNStrue;
+    while (m->CurrentQuestion && !m->CurrentQuestion->InNewQuestions)
     {
         mDNSBool answered;
         DNSQuestion *q = m->CurrentQuestion;
@@ -817,9 +1236,10 @@ mDNSlocal void AnswerInterfaceAnyQuestionsWithLocalAuthRecord(mDNS *const m, Aut
         if (answered)
             AnswerLocalQuestionWithLocalAuthRecord(m, ar, AddRecord);       // MUST NOT dereference q again
         if (m->CurrentQuestion == q)    // If m->CurrentQuestion was not auto-advanced, do it ourselves now
-            m->CurrentQuestion = q->next;
+            m->CurrentQuestion = NextQuestionForNameHash(q);
     }
     m->CurrentQuestion = mDNSNULL;
+    m->CurrentQuestionByName = mDNSfalse;
 }
 
 // When a new local AuthRecord is created or deleted, AnswerAllLocalQuestionsWithLocalAuthRecord()
@@ -1793,6 +2213,7 @@ mDNSexport mStatus mDNS_Register_internal(mDNS *const m, AuthRecord *const rr)
         // records to the list, so we now need to update p to advance to the new end to the list before appending our new record.
         while (*p) p=&(*p)->next;
         *p = rr;
+        RecordHashInsert(m, rr);
         if (rr->resrec.RecordType == kDNSRecordTypeUnique) rr->resrec.RecordType = kDNSRecordTypeVerified;
         rr->ProbeCount    = 0;
         rr->ProbeRestartCount = 0;
@@ -1812,7 +2233,7 @@ mDNSexport mStatus mDNS_Register_internal(mDNS *const m, AuthRecord *const rr)
     }
     else
     {
-        for (r = m->ResourceRecords; r; r=r->next)
+        for (r = FirstRecordForNameHash(m, rr->resrec.namehash); r; r = NextRecordForNameHash(r))
             if (RecordIsLocalDuplicate(r, rr))
             {
                 if (r->resrec.RecordType == kDNSRecordTypeDeregistering) r->AnnounceCount = 0;
@@ -1852,6 +2273,7 @@ mDNSexport mStatus mDNS_Register_internal(mDNS *const m, AuthRecord *const rr)
         {
             if (!m->NewLocalRecords) m->NewLocalRecords = rr;
             *p = rr;
+            RecordHashInsert(m, rr);
         }
     }
 
@@ -1971,6 +2393,7 @@ mDNSexport mStatus mDNS_Deregister_internal(mDNS *const m, AuthRecord *const rr,
                 {
                     dup->next = rr->next;       // And then...
                     rr->next  = dup;            // ... splice it in right after the record we're about to delete
+                    RecordHashInsertAfter(rr, dup);
                 }
                 dup->resrec.RecordType        = rr->resrec.RecordType;
                 dup->ProbeCount      = rr->ProbeCount;
@@ -2108,12 +2531,14 @@ mDNSexport mStatus mDNS_Deregister_internal(mDNS *const m, AuthRecord *const rr,
         else
         {
             *p = rr->next;                  // Cut this record from the list
+            if (!dupList) RecordHashRemove(m, rr);
             if (m->NewLocalRecords == rr) m->NewLocalRecords = rr->next;
             DecrementAutoTargetServices(m, rr);
         }
         // If someone is about to look at this, bump the pointer forward
-        if (m->CurrentRecord   == rr) m->CurrentRecord   = rr->next;
+        if (m->CurrentRecord   == rr) m->CurrentRecord   = m->CurrentRecordByName ? NextRecordForNameHash(rr) : rr->next;
         rr->next = mDNSNULL;
+        rr->NextInRHash = mDNSNULL;
 
         verbosedebugf("mDNS_Deregister_internal: Deleting record for %s", ARDisplayString(m, rr));
         rr->resrec.RecordType = kDNSRecordTypeUnregistered;
@@ -2199,7 +2624,7 @@ mDNSlocal void AddRRSetAdditionalsToResponseList(mDNS *const m, AuthRecord ***nr
     AuthRecord *rr2;
     if (additional->resrec.RecordType & kDNSRecordTypeUniqueMask)
     {
-        for (rr2 = m->ResourceRecords; rr2; rr2 = rr2->next)
+        for (rr2 = FirstRecordForNameHash(m, additional->resrec.namehash); rr2; rr2 = NextRecordForNameHash(rr2))
         {
             if ((rr2->resrec.namehash == additional->resrec.namehash) &&
                 (rr2->resrec.rrtype   == additional->resrec.rrtype) &&
@@ -2237,7 +2662,7 @@ mDNSlocal void AddAdditionalsToResponseList(mDNS *const m, AuthRecord *ResponseR
         // For SRV records, automatically add the Address record(s) for the target host
         if (rr->resrec.rrtype == kDNSType_SRV)
         {
-            for (rr2=m->ResourceRecords; rr2; rr2=rr2->next)                    // Scan list of resource records
+            for (rr2 = FirstRecordForNameHash(m, rr->resrec.rdatahash); rr2; rr2 = NextRecordForNameHash(rr2))
                 if (RRTypeIsAddressType(rr2->resrec.rrtype) &&                  // For all address records (A/AAAA) ...
                     ResourceRecordIsValidInterfaceAnswer(rr2, InterfaceID) &&   // ... which are valid for answer ...
                     rr->resrec.rdatahash == rr2->resrec.namehash &&         // ... whose name is the name of the SRV target
@@ -2246,7 +2671,7 @@ mDNSlocal void AddAdditionalsToResponseList(mDNS *const m, AuthRecord *ResponseR
         }
         else if (RRTypeIsAddressType(rr->resrec.rrtype))    // For A or AAAA, put counterpart as additional
         {
-            for (rr2=m->ResourceRecords; rr2; rr2=rr2->next)                    // Scan list of resource records
+            for (rr2 = FirstRecordForNameHash(m, rr->resrec.namehash); rr2; rr2 = NextRecordForNameHash(rr2))
                 if (RRTypeIsAddressType(rr2->resrec.rrtype) &&                  // For all address records (A/AAAA) ...
                     ResourceRecordIsValidInterfaceAnswer(rr2, InterfaceID) &&   // ... which are valid for answer ...
                     rr->resrec.namehash == rr2->resrec.namehash &&              // ... and have the same name
@@ -2694,6 +3119,7 @@ mDNSlocal void SendResponses(mDNS *const m)
 {
     int pktcount = 0;
     AuthRecord *rr, *r2;
+    AuthRecord *SendList = mDNSNULL, **SendTail = &SendList;
     mDNSs32 maxExistingAnnounceInterval = 0;
     const NetworkInterfaceInfo *intf = GetFirstActiveInterface(m->HostInterfaces);
 
@@ -2808,7 +3234,7 @@ mDNSlocal void SendResponses(mDNS *const m)
     for (rr = m->ResourceRecords; rr; rr=rr->next)
     {
         if (rr->ImmedAnswer && rr->resrec.rrtype == kDNSType_SRV)
-            for (r2=m->ResourceRecords; r2; r2=r2->next)                // Scan list of resource records
+            for (r2 = FirstRecordForNameHash(m, rr->resrec.rdatahash); r2; r2 = NextRecordForNameHash(r2))
                 if (RRTypeIsAddressType(r2->resrec.rrtype) &&           // For all address records (A/AAAA) ...
                     ResourceRecordIsValidAnswer(r2) &&                  // ... which are valid for answer ...
                     rr->LastMCTime - r2->LastMCTime >= 0 &&             // ... which we have not sent recently ...
@@ -2838,7 +3264,7 @@ mDNSlocal void SendResponses(mDNS *const m)
         {
             if (rr->ImmedAnswer)            // If we're sending this as answer, see that its whole RRSet is similarly marked
             {
-                for (r2 = m->ResourceRecords; r2; r2=r2->next)
+                for (r2 = FirstRecordForNameHash(m, rr->resrec.namehash); r2; r2 = NextRecordForNameHash(r2))
                 {
                     if ((r2->resrec.RecordType & kDNSRecordTypeUniqueMask) && ResourceRecordIsValidAnswer(r2) &&
                         (r2->ImmedAnswer != mDNSInterfaceMark) && (r2->ImmedAnswer != rr->ImmedAnswer) &&
@@ -2851,7 +3277,7 @@ mDNSlocal void SendResponses(mDNS *const m)
             }
             else if (rr->ImmedAdditional)   // If we're sending this as additional, see that its whole RRSet is similarly marked
             {
-                for (r2 = m->ResourceRecords; r2; r2=r2->next)
+                for (r2 = FirstRecordForNameHash(m, rr->resrec.namehash); r2; r2 = NextRecordForNameHash(r2))
                 {
                     if ((r2->resrec.RecordType & kDNSRecordTypeUniqueMask) && ResourceRecordIsValidAnswer(r2) &&
                         (r2->ImmedAdditional != rr->ImmedAdditional) &&
@@ -2893,7 +3319,11 @@ mDNSlocal void SendResponses(mDNS *const m)
         }
         SetNextAnnounceProbeTime(m, rr);
         //if (rr->SendRNow) LogMsg("%-15.4a %s", &rr->v4Requester, ARDisplayString(m, rr));
+
+        // The per-packet passes below only need to look at records that have something to send this time
+        if (rr->SendRNow || rr->ImmedAdditional || rr->SendNSECNow) { *SendTail = rr; SendTail = &rr->NextSendR; }
     }
+    *SendTail = mDNSNULL;
 
     // ***
     // *** 2. Loop through interface list, sending records as appropriate
@@ -2914,7 +3344,7 @@ mDNSlocal void SendResponses(mDNS *const m)
         // 1. Deregistering records that need to send their goodbye packet
         // 2. Updated records that need to retract their old data
         // 3. Answers and announcements we need to send
-        for (rr = m->ResourceRecords; rr; rr=rr->next)
+        for (rr = SendList; rr; rr = rr->NextSendR)
         {
 
             // Skip this interface if the record InterfaceID is *Any and the record is not
@@ -2976,7 +3406,7 @@ mDNSlocal void SendResponses(mDNS *const m)
 
         // Second Pass. Add additional records, if there's space.
         newptr = responseptr;
-        for (rr = m->ResourceRecords; rr; rr=rr->next)
+        for (rr = SendList; rr; rr = rr->NextSendR)
             if (rr->ImmedAdditional == intf->InterfaceID)
                 if (ResourceRecordIsValidAnswer(rr))
                 {
@@ -2989,7 +3419,7 @@ mDNSlocal void SendResponses(mDNS *const m)
                     if (!SendAdditional && (rr->resrec.RecordType & kDNSRecordTypeUniqueMask))
                     {
                         const AuthRecord *a;
-                        for (a = m->ResourceRecords; a; a=a->next)
+                        for (a = FirstRecordForNameHash(m, rr->resrec.namehash); a; a = NextRecordForNameHash(a))
                             if (a->LastMCTime      == m->timenow &&
                                 a->LastMCInterface == intf->InterfaceID &&
                                 SameResourceRecordSignature(a, rr)) { SendAdditional = mDNStrue; break; }
@@ -3026,7 +3456,7 @@ mDNSlocal void SendResponses(mDNS *const m)
         // When we're generating an NSEC record in response to a specify query for that type
         // (recognized by rr->SendNSECNow == intf->InterfaceID) we should really put the NSEC in the Answer Section,
         // not Additional Section, but for now it's easier to handle both cases in this Additional Section loop here.
-        for (rr = m->ResourceRecords; rr; rr=rr->next)
+        for (rr = SendList; rr; rr = rr->NextSendR)
             if (rr->SendNSECNow == mDNSInterfaceMark || rr->SendNSECNow == intf->InterfaceID)
             {
                 AuthRecord nsec;
@@ -3046,7 +3476,7 @@ mDNSlocal void SendResponses(mDNS *const m)
                     ptr += len;
                     *ptr++ = 0; // window number
                     *ptr++ = NSEC_MCAST_WINDOW_SIZE; // window length
-                    for (r2 = m->ResourceRecords; r2; r2=r2->next)
+                    for (r2 = FirstRecordForNameHash(m, rr->resrec.namehash); r2; r2 = NextRecordForNameHash(r2))
                         if (ResourceRecordIsValidAnswer(r2) && SameResourceRecordNameClassInterface(r2, rr))
                         {
                             if (r2->resrec.rrtype >= kDNSQType_ANY) { LogMsg("SendResponses: Can't create NSEC for record %s", ARDisplayString(m, r2)); break; }
@@ -3067,7 +3497,7 @@ mDNSlocal void SendResponses(mDNS *const m)
                 {
                     rr->SendNSECNow = mDNSNULL;
                     // Run through remainder of list clearing SendNSECNow flag for all other records which would generate the same NSEC
-                    for (r2 = rr->next; r2; r2=r2->next)
+                    for (r2 = NextRecordForNameHash(rr); r2; r2 = NextRecordForNameHash(r2))
                         if (SameResourceRecordNameClassInterface(r2, rr))
                             if (r2->SendNSECNow == mDNSInterfaceMark || r2->SendNSECNow == intf->InterfaceID)
                                 r2->SendNSECNow = mDNSNULL;
@@ -3201,6 +3631,18 @@ mDNSlocal void SendResponses(mDNS *const m)
 
 #define NextCacheCheckEvent(CR) ((CR)->NextRequiredQuery + CacheCheckGracePeriod(CR))
 
+// SendQueries piggy-backs a record's refresh query on other queries once it's within 2% of the TTL of its
+// NextRequiredQuery. rrcache_nextrefresh[slot] is the earliest such time of any record in the slot that still
+// has refresh queries to do, so SendQueries only needs to look at the slots where that time has been reached.
+#define CacheRecordNeedsRefresh(CR) ((CR)->CRActiveQuestion && (CR)->UnansweredQueries < MaxUnansweredQueries)
+#define NextCacheRefreshTime(CR) ((CR)->NextRequiredQuery - TicksTTL(CR)/50)
+
+#define FORALL_REFRESH_DUE_CACHERECORDS(SLOT,CG,CR)                   \
+    for ((SLOT) = 0; (SLOT) < CACHE_HASH_SLOTS; (SLOT)++)             \
+        if (m->timenow - m->rrcache_nextrefresh[(SLOT)] >= 0)         \
+            for ((CG)=m->rrcache_hash[(SLOT)]; (CG); (CG)=(CG)->next) \
+                for ((CR) = (CG)->members; (CR); (CR)=(CR)->next)
+
 mDNSexport void ScheduleNextCacheCheckTime(mDNS *const m, const mDNSu32 slot, const mDNSs32 event)
 {
     if (m->rrcache_nextcheck[slot] - event > 0)
@@ -3216,6 +3658,7 @@ mDNSexport void ScheduleNextCacheCheckTime(mDNS *const m, const mDNSu32 slot, co
 // rr->CRActiveQuestion
 mDNSexport void SetNextCacheCheckTimeForRecord(mDNS *const m, CacheRecord *const rr)
 {
+    const mDNSu32 slot = HashSlotFromNameHash(rr->resrec.namehash);
     rr->NextRequiredQuery = RRExpireTime(rr);
 
     // If we have an active question, then see if we want to schedule a refresher query for this record.
@@ -3226,8 +3669,10 @@ mDNSexport void SetNextCacheCheckTimeForRecord(mDNS *const m, CacheRecord *const
         rr->NextRequiredQuery += mDNSRandom((mDNSu32)TicksTTL(rr)/50);
         verbosedebugf("SetNextCacheCheckTimeForRecord: NextRequiredQuery in %ld sec CacheCheckGracePeriod %d ticks for %s",
                       (rr->NextRequiredQuery - m->timenow) / mDNSPlatformOneSecond, CacheCheckGracePeriod(rr), CRDisplayString(m,rr));
+        if (m->rrcache_nextrefresh[slot] - NextCacheRefreshTime(rr) > 0)
+            m->rrcache_nextrefresh[slot] = NextCacheRefreshTime(rr);
     }
-    ScheduleNextCacheCheckTime(m, HashSlotFromNameHash(rr->resrec.namehash), NextCacheCheckEvent(rr));
+    ScheduleNextCacheCheckTime(m, slot, NextCacheCheckEvent(rr));
 }
 
 #define kMinimumReconfirmTime                     ((mDNSu32)mDNSPlatformOneSecond *  5)
@@ -3579,6 +4024,20 @@ mDNSlocal mDNSBool AccelerateThisQuery(mDNS *const m, DNSQuestion *q)
     return(mDNSfalse);
 }
 
+mDNSlocal void FinishSendingQuestion(DNSQuestion *const q)
+{
+    if (q->SendQNow)
+    {
+        // There will not be an active interface for questions applied to mDNSInterface_BLE
+        // so don't log the warning in that case.
+        if (q->InterfaceID != mDNSInterface_BLE)
+            LogInfo("SendQueries: No active interface %d to send %s question: %d %##s (%s)",
+                    IIDPrintable(q->SendQNow), q->InNewQuestions ? "new" : "old", IIDPrintable(q->InterfaceID), q->qname.c, DNSTypeName(q->qtype));
+        q->SendQNow = mDNSNULL;
+    }
+    q->CachedAnswerNeedsUpdate = mDNSfalse;
+}
+
 // How Standard Queries are generated:
 // 1. The Question Section contains the question
 // 2. The Additional Section contains answers we already know, to suppress duplicate responses
@@ -3603,16 +4062,19 @@ mDNSlocal void SendQueries(mDNS *const m)
     mDNSs32 maxExistingQuestionInterval = 0;
     const NetworkInterfaceInfo *intf = GetFirstActiveInterface(m->HostInterfaces);
     CacheRecord *KnownAnswerList = mDNSNULL;
+    DNSQuestion *SendList = mDNSNULL;
+    DNSQuestion **SendListTail = &SendList;
+    DNSQuestion **sq;
 
     // 1. If time for a query, work out what we need to do
 
     // We're expecting to send a query anyway, so see if any expiring cache records are close enough
     // to their NextRequiredQuery to be worth batching them together with this one
-    FORALL_CACHERECORDS(slot, cg, cr)
+    FORALL_REFRESH_DUE_CACHERECORDS(slot, cg, cr)
     {
-        if (cr->CRActiveQuestion && cr->UnansweredQueries < MaxUnansweredQueries)
+        if (CacheRecordNeedsRefresh(cr))
         {
-            if (m->timenow + TicksTTL(cr)/50 - cr->NextRequiredQuery >= 0)
+            if (m->timenow - NextCacheRefreshTime(cr) >= 0)
             {
                 debugf("Sending %d%% cache expiration query for %s", 80 + 5 * cr->UnansweredQueries, CRDisplayString(m, cr));
                 q = cr->CRActiveQuestion;
@@ -3624,14 +4086,16 @@ mDNSlocal void SendQueries(mDNS *const m)
                     q->LastQTime = m->timenow - q->ThisQInterval;
                     cr->UnansweredQueries++;
                     m->mDNSStats.CacheRefreshQueries++;
+                    SetNextQueryTime(m, q);
                 }
-                else if (q->SendQNow == mDNSNULL)
-                {
-                    q->SendQNow = cr->resrec.InterfaceID;
-                }
-                else if (q->SendQNow != cr->resrec.InterfaceID)
+                else
                 {
-                    q->SendQNow = mDNSInterfaceMark;
+                    if (q->SendQNow == mDNSNULL)
+                        q->SendQNow = cr->resrec.InterfaceID;
+                    else if (q->SendQNow != cr->resrec.InterfaceID)
+                        q->SendQNow = mDNSInterfaceMark;
+                    // Make sure the question scan below looks at this question's chain
+                    m->QuestionHashNextCheck[QuestionHashSlot(q->qnamehash)] = m->timenow;
                 }
 
                 // Indicate that this question was marked for sending
@@ -3644,16 +4108,10 @@ mDNSlocal void SendQueries(mDNS *const m)
         }
     }
 
-    // Scan our list of questions to see which:
-    //     *WideArea*  queries need to be sent
-    //     *unicast*   queries need to be sent
-    //     *multicast* queries we're definitely going to send
-    if (m->CurrentQuestion)
-        LogMsg("SendQueries ERROR m->CurrentQuestion already set: %##s (%s)", m->CurrentQuestion->qname.c, DNSTypeName(m->CurrentQuestion->qtype));
-    m->CurrentQuestion = m->Questions;
-    while (m->CurrentQuestion && m->CurrentQuestion != m->NewQuestions)
+    // Scan the question chains that have a question at least half-way to its next query to see which
+    // *multicast* queries we're definitely going to send. Questions on the other chains can't be due yet.
+    FORALL_CHECK_DUE_QUESTIONS(slot, q)
     {
-        q = m->CurrentQuestion;
         if (mDNSOpaque16IsZero(q->TargetQID) && TimeToSendThisQuestion(q, m->timenow))
         {
             //LogInfo("Time to send %##s (%s) %d", q->qname.c, DNSTypeName(q->qtype), m->timenow - NextQSendTime(q));
@@ -3661,101 +4119,107 @@ mDNSlocal void SendQueries(mDNS *const m)
             if (maxExistingQuestionInterval < q->ThisQInterval)
                 maxExistingQuestionInterval = q->ThisQInterval;
         }
-        // If m->CurrentQuestion wasn't modified out from under us, advance it now
-        // We can't do this at the start of the loop because uDNS_CheckCurrentQuestion() depends on having
-        // m->CurrentQuestion point to the right question
-        if (q == m->CurrentQuestion) m->CurrentQuestion = m->CurrentQuestion->next;
-    }
-    while (m->CurrentQuestion)
-    {
-        LogInfo("SendQueries question loop 1: Skipping NewQuestion %##s (%s)", m->CurrentQuestion->qname.c, DNSTypeName(m->CurrentQuestion->qtype));
-        m->CurrentQuestion = m->CurrentQuestion->next;
     }
-    m->CurrentQuestion = mDNSNULL;
 
-    // Scan our list of questions
+    // Scan the same chains
     // (a) to see if there are any more that are worth accelerating, and
-    // (b) to update the state variables for *all* the questions we're going to send
-    // Note: Don't set NextScheduledQuery until here, because uDNS_CheckCurrentQuestion in the loop above can add new questions to the list,
-    // which causes NextScheduledQuery to get (incorrectly) set to m->timenow. Setting it here is the right place, because the very
-    // next thing we do is scan the list and call SetNextQueryTime() for every question we find, so we know we end up with the right value.
+    // (b) to update the state variables for *all* the questions we're going to send, and put them on SendList
+    // Every question on these chains goes through SetNextQueryTime(), which works out the chain's deadlines afresh;
+    // the chains we skip have nothing to accelerate, and just contribute their QuestionHashNextQuery.
+    // We don't need to consider NewQuestions here because for those we'll set m->NextScheduledQuery in AnswerNewQuestion
     m->NextScheduledQuery = m->timenow + FutureTime;
-    for (q = m->Questions; q && q != m->NewQuestions; q=q->next)
-    {
-        if (mDNSOpaque16IsZero(q->TargetQID)
-            && (q->SendQNow || (ActiveQuestion(q) && q->ThisQInterval <= maxExistingQuestionInterval && AccelerateThisQuery(m,q))))
-        {
-            // If at least halfway to next query time, advance to next interval
-            // If less than halfway to next query time, then
-            // treat this as logically a repeat of the last transmission, without advancing the interval
-            if (m->timenow - (q->LastQTime + (q->ThisQInterval/2)) >= 0)
-            {
-                // If we have reached the answer threshold for this question, 
-                // don't send it again until MaxQuestionInterval unless:
-                //  one of its cached answers needs to be refreshed,
-                //  or it's the initial query for a kDNSServiceFlagsThresholdFinder mode browse.
-                if (q->BrowseThreshold
-                    && (q->CurrentAnswers >= q->BrowseThreshold)
-                    && (q->CachedAnswerNeedsUpdate == mDNSfalse)
-                    && !((q->flags & kDNSServiceFlagsThresholdFinder) && (q->ThisQInterval == InitialQuestionInterval)))
-                {
-                    q->SendQNow = mDNSNULL;
-                    q->ThisQInterval = MaxQuestionInterval;
-                    q->LastQTime = m->timenow;
-                    q->RequestUnicast = 0;
-                    LogInfo("SendQueries: (%s) %##s reached threshold of %d answers",
-                         DNSTypeName(q->qtype), q->qname.c, q->BrowseThreshold);
-                }
-                else
-                {
-                    // Mark this question for sending on all interfaces
-                    q->SendQNow = mDNSInterfaceMark;
-                    q->ThisQInterval *= QuestionIntervalStep;
-                }
+    for (slot = 0; slot < QUESTION_HASH_SLOTS; slot++)
+    {
+        if (m->timenow - m->QuestionHashNextCheck[slot] < 0)
+        {
+            if (m->NextScheduledQuery - m->QuestionHashNextQuery[slot] > 0)
+                m->NextScheduledQuery = m->QuestionHashNextQuery[slot];
+            continue;
+        }
+        m->QuestionHashNextCheck[slot] = m->timenow + FutureTime;
+        m->QuestionHashNextQuery[slot] = m->timenow + FutureTime;
+        for (q = m->QuestionHash[slot]; q && !q->InNewQuestions; q = q->NextInQHash)
+        {
+            if (mDNSOpaque16IsZero(q->TargetQID)
+                && (q->SendQNow || (ActiveQuestion(q) && q->ThisQInterval <= maxExistingQuestionInterval && AccelerateThisQuery(m,q))))
+            {
+                // If at least halfway to next query time, advance to next interval
+                // If less than halfway to next query time, then
+                // treat this as logically a repeat of the last transmission, without advancing the interval
+                if (m->timenow - (q->LastQTime + (q->ThisQInterval/2)) >= 0)
+                {
+                    // If we have reached the answer threshold for this question, 
+                    // don't send it again until MaxQuestionInterval unless:
+                    //  one of its cached answers needs to be refreshed,
+                    //  or it's the initial query for a kDNSServiceFlagsThresholdFinder mode browse.
+                    if (q->BrowseThreshold
+                        && (q->CurrentAnswers >= q->BrowseThreshold)
+                        && (q->CachedAnswerNeedsUpdate == mDNSfalse)
+                        && !((q->flags & kDNSServiceFlagsThresholdFinder) && (q->ThisQInterval == InitialQuestionInterval)))
+                    {
+                        q->SendQNow = mDNSNULL;
+                        q->ThisQInterval = MaxQuestionInterval;
+                        q->LastQTime = m->timenow;
+                        q->RequestUnicast = 0;
+                        LogInfo("SendQueries: (%s) %##s reached threshold of %d answers",
+                             DNSTypeName(q->qtype), q->qname.c, q->BrowseThreshold);
+                    }
+                    else
+                    {
+                        // Mark this question for sending on all interfaces
+                        q->SendQNow = mDNSInterfaceMark;
+                        q->ThisQInterval *= QuestionIntervalStep;
+                    }
 
-                debugf("SendQueries: %##s (%s) next interval %d seconds RequestUnicast = %d",
-                       q->qname.c, DNSTypeName(q->qtype), q->ThisQInterval / InitialQuestionInterval, q->RequestUnicast);
+                    debugf("SendQueries: %##s (%s) next interval %d seconds RequestUnicast = %d",
+                           q->qname.c, DNSTypeName(q->qtype), q->ThisQInterval / InitialQuestionInterval, q->RequestUnicast);
 
-                if (q->ThisQInterval > MaxQuestionInterval)
-                {
-                    q->ThisQInterval = MaxQuestionInterval;
+                    if (q->ThisQInterval > MaxQuestionInterval)
+                    {
+                        q->ThisQInterval = MaxQuestionInterval;
+                    }
+                    else if (mDNSOpaque16IsZero(q->TargetQID) && q->InterfaceID &&
+                             q->CurrentAnswers == 0 && q->ThisQInterval == InitialQuestionInterval * QuestionIntervalStep3 && !q->RequestUnicast &&
+                             !(RRTypeIsAddressType(q->qtype) && CacheHasAddressTypeForName(m, &q->qname, q->qnamehash)))
+                    {
+                        // Generally don't need to log this.
+                        // It's not especially noteworthy if a query finds no results -- this usually happens for domain
+                        // enumeration queries in the LL subdomain (e.g. "db._dns-sd._udp.0.0.254.169.in-addr.arpa")
+                        // and when there simply happen to be no instances of the service the client is looking
+                        // for (e.g. iTunes is set to look for RAOP devices, and the current network has none).
+                        debugf("SendQueries: Zero current answers for %##s (%s); will reconfirm antecedents",
+                               q->qname.c, DNSTypeName(q->qtype));
+                        // Sending third query, and no answers yet; time to begin doubting the source
+                        ReconfirmAntecedents(m, &q->qname, q->qnamehash, q->InterfaceID, 0);
+                    }
                 }
-                else if (mDNSOpaque16IsZero(q->TargetQID) && q->InterfaceID &&
-                         q->CurrentAnswers == 0 && q->ThisQInterval == InitialQuestionInterval * QuestionIntervalStep3 && !q->RequestUnicast &&
-                         !(RRTypeIsAddressType(q->qtype) && CacheHasAddressTypeForName(m, &q->qname, q->qnamehash)))
+
+                // Mark for sending. (If no active interfaces, then don't even try.)
+                q->SendOnAll = (q->SendQNow == mDNSInterfaceMark);
+                if (q->SendOnAll)
                 {
-                    // Generally don't need to log this.
-                    // It's not especially noteworthy if a query finds no results -- this usually happens for domain
-                    // enumeration queries in the LL subdomain (e.g. "db._dns-sd._udp.0.0.254.169.in-addr.arpa")
-                    // and when there simply happen to be no instances of the service the client is looking
-                    // for (e.g. iTunes is set to look for RAOP devices, and the current network has none).
-                    debugf("SendQueries: Zero current answers for %##s (%s); will reconfirm antecedents",
-                           q->qname.c, DNSTypeName(q->qtype));
-                    // Sending third query, and no answers yet; time to begin doubting the source
-                    ReconfirmAntecedents(m, &q->qname, q->qnamehash, q->InterfaceID, 0);
+                    q->SendQNow  = !intf ? mDNSNULL : (q->InterfaceID) ? q->InterfaceID : intf->InterfaceID;
+                    q->LastQTime = m->timenow;
                 }
-            }
 
-            // Mark for sending. (If no active interfaces, then don't even try.)
-            q->SendOnAll = (q->SendQNow == mDNSInterfaceMark);
-            if (q->SendOnAll)
-            {
-                q->SendQNow  = !intf ? mDNSNULL : (q->InterfaceID) ? q->InterfaceID : intf->InterfaceID;
-                q->LastQTime = m->timenow;
-            }
+                // If we recorded a duplicate suppression for this question less than half an interval ago,
+                // then we consider it recent enough that we don't need to do an identical query ourselves.
+                ExpireDupSuppressInfo(q->DupSuppress, m->timenow - q->ThisQInterval/2);
 
-            // If we recorded a duplicate suppression for this question less than half an interval ago,
-            // then we consider it recent enough that we don't need to do an identical query ourselves.
-            ExpireDupSuppressInfo(q->DupSuppress, m->timenow - q->ThisQInterval/2);
+                q->LastQTxTime      = m->timenow;
+                q->RecentAnswerPkts = 0;
+                if (q->RequestUnicast) q->RequestUnicast--;
+                q->CachedAnswerNeedsUpdate = mDNSfalse;     // Only the browse threshold check above needs it
 
-            q->LastQTxTime      = m->timenow;
-            q->RecentAnswerPkts = 0;
-            if (q->RequestUnicast) q->RequestUnicast--;
+                *SendListTail = q;
+                q->NextInSendList = mDNSNULL;
+                SendListTail = &q->NextInSendList;
+            }
+            // For all questions (not just the ones we're sending) check what the next scheduled event will be
+            SetNextQueryTime(m,q);
         }
-        // For all questions (not just the ones we're sending) check what the next scheduled event will be
-        // We don't need to consider NewQuestions here because for those we'll set m->NextScheduledQuery in AnswerNewQuestion
-        SetNextQueryTime(m,q);
     }
+    SendList = SortSendListByQuestionSerial(SendList);
 
     // 2. Scan our authoritative RR list to see what probes we might need to send
 
@@ -3864,7 +4328,9 @@ mDNSlocal void SendQueries(mDNS *const m)
             mDNSu32 answerforecast = OwnerRecordSpace + TraceRecordSpace;  // Start by assuming we'll need at least enough space to put the Owner+Tracer Option
 
             // Put query questions in this packet
-            for (q = m->Questions; q && q != m->NewQuestions; q=q->next)
+            // A question comes off SendList once it has gone out on every interface it's going out on,
+            // so each packet only looks at the questions still waiting
+            for (sq = &SendList; (q = *sq) != mDNSNULL; )
             {
                 if (mDNSOpaque16IsZero(q->TargetQID) && (q->SendQNow == intf->InterfaceID))
                 {
@@ -3899,6 +4365,8 @@ mDNSlocal void SendQueries(mDNS *const m)
                         }
                     }
                 }
+                if (q->SendQNow) sq = &q->NextInSendList;
+                else *sq = q->NextInSendList;
             }
 
             // Put probe questions in this packet
@@ -4081,15 +4549,26 @@ mDNSlocal void SendQueries(mDNS *const m)
     // for those records, but we can't because their interface isn't here any more, so to keep the
     // state machine ticking over we just pretend we did so.
     // If the interface does not come back in time, the cache record will expire naturally
-    FORALL_CACHERECORDS(slot, cg, cr)
+    // This is also where we work out the new rrcache_nextrefresh time for each slot we looked at above.
+    for (slot = 0; slot < CACHE_HASH_SLOTS; slot++)
     {
-        if (cr->CRActiveQuestion && cr->UnansweredQueries < MaxUnansweredQueries)
+        if (m->timenow - m->rrcache_nextrefresh[slot] < 0) continue;
+        m->rrcache_nextrefresh[slot] = m->timenow + FutureTime;
+        for (cg = m->rrcache_hash[slot]; cg; cg = cg->next)
         {
-            if (m->timenow + TicksTTL(cr)/50 - cr->NextRequiredQuery >= 0)
+            for (cr = cg->members; cr; cr = cr->next)
             {
-                cr->UnansweredQueries++;
-                cr->CRActiveQuestion->SendQNow = mDNSNULL;
-                SetNextCacheCheckTimeForRecord(m, cr);
+                if (CacheRecordNeedsRefresh(cr))
+                {
+                    if (m->timenow - NextCacheRefreshTime(cr) >= 0)
+                    {
+                        cr->UnansweredQueries++;
+                        cr->CRActiveQuestion->SendQNow = mDNSNULL;
+                        SetNextCacheCheckTimeForRecord(m, cr);
+                    }
+                    else if (m->rrcache_nextrefresh[slot] - NextCacheRefreshTime(cr) > 0)
+                        m->rrcache_nextrefresh[slot] = NextCacheRefreshTime(cr);
+                }
             }
         }
     }
@@ -4097,21 +4576,9 @@ mDNSlocal void SendQueries(mDNS *const m)
     // 4c. Debugging check: Make sure we sent all our planned questions
     // Do this AFTER the lingering cache records check above, because that will prevent spurious warnings for questions
     // we legitimately couldn't send because the interface is no longer available
-    for (q = m->Questions; q; q=q->next)
-    {
-        if (q->SendQNow)
-        {
-            DNSQuestion *x;
-            for (x = m->NewQuestions; x; x=x->next) if (x == q) break;  // Check if this question is a NewQuestion
-            // There will not be an active interface for questions applied to mDNSInterface_BLE
-            // so don't log the warning in that case.
-            if (q->InterfaceID != mDNSInterface_BLE)
-                LogInfo("SendQueries: No active interface %d to send %s question: %d %##s (%s)",
-                        IIDPrintable(q->SendQNow), x ? "new" : "old", IIDPrintable(q->InterfaceID), q->qname.c, DNSTypeName(q->qtype));
-            q->SendQNow = mDNSNULL;
-        }
-        q->CachedAnswerNeedsUpdate = mDNSfalse;
-    }
+    // Only the questions still on SendList, and any new question that a cache refresh above marked, can have SendQNow set
+    for (q = SendList; q; q = q->NextInSendList) FinishSendingQuestion(q);
+    for (q = m->NewQuestions; q; q = q->next) FinishSendingQuestion(q);
 }
 
 mDNSlocal void SendWakeup(mDNS *const m, mDNSInterfaceID InterfaceID, mDNSEthAddr *EthAddr, mDNSOpaque48 *password, mDNSBool unicastOnly)
@@ -4173,8 +4640,9 @@ mDNSlocal void ResetQuestionState(mDNS *const m, DNSQuestion *q)
     q->RequestUnicast   = 0;
 #if !MDNSRESPONDER_SUPPORTS(APPLE, QUERIER)
     // Reset unansweredQueries so that we don't penalize this server later when we
-    // start sending queries when the cache expires.
+    // start sending queries when the cache expires, and don't race this query any further.
     q->unansweredQueries = 0;
+    q->RaceNextTime      = 0;
 #endif
     debugf("ResetQuestionState: Set MaxQuestionInterval for %##s (%s)", q->qname.c, DNSTypeName(q->qtype));
 }
@@ -4250,6 +4718,17 @@ mDNSexport void AnswerCurrentQuestionWithResourceRecord(mDNS *const m, CacheReco
         if (!q->TimeoutQuestion || rr->resrec.RecordType != kDNSRecordTypePacketNegative || (m->timenow - q->StopTime < 0))
             return;
     }
+
+    if (AddRecord == QC_add) CacheLRUTouch(m, rr);
+
+    if (AddRecord == QC_add && q->MetricsStartTime)
+    {
+        // Whole seconds and the remainder are converted separately, so that "* 1000" can't overflow on a late answer
+        const mDNSu32 ticks = (mDNSu32)(m->timenow - q->MetricsStartTime);
+        mDNSMetricsHistogramAdd(&mDNS_Metrics.AnswerLatency,
+                                ticks / mDNSPlatformOneSecond * 1000 + ticks % mDNSPlatformOneSecond * 1000 / mDNSPlatformOneSecond);
+        q->MetricsStartTime = 0;
+    }
     
     //  Set the record to immortal if appropriate
     if (AddRecord == QC_add && Question_uDNS(q) && rr->resrec.RecordType != kDNSRecordTypePacketNegative &&
@@ -4428,16 +4907,18 @@ mDNSlocal void CacheRecordDeferredAdd(mDNS *const m, CacheRecord *cr)
     if (m->CurrentQuestion)
         LogMsg("CacheRecordDeferredAdd ERROR m->CurrentQuestion already set: %##s (%s)",
                m->CurrentQuestion->qname.c, DNSTypeName(m->CurrentQuestion->qtype));
-    m->CurrentQuestion = m->Questions;
-    while (m->CurrentQuestion && m->CurrentQuestion != m->NewQuestions)
+    m->CurrentQuestion = FirstQuestionForNameHash(m, cr->resrec.namehash);
+    m->CurrentQuestionByName = mDNStrue;
+    while (m->CurrentQuestion && !m->CurrentQuestion->InNewQuestions)
     {
         DNSQuestion *q = m->CurrentQuestion;
         if (CacheRecordAnswersQuestion(cr, q))
             AnswerCurrentQuestionWithResourceRecord(m, cr, QC_add);
         if (m->CurrentQuestion == q)    // If m->CurrentQuestion was not auto-advanced, do it ourselves now
-            m->CurrentQuestion = q->next;
+            m->CurrentQuestion = NextQuestionForNameHash(q);
     }
     m->CurrentQuestion = mDNSNULL;
+    m->CurrentQuestionByName = mDNSfalse;
 }
 
 mDNSlocal mDNSs32 CheckForSoonToExpireRecords(mDNS *const m, const domainname *const name, const mDNSu32 namehash)
@@ -4476,7 +4957,7 @@ mDNSlocal void CacheRecordAdd(mDNS *const m, CacheRecord *cr)
 
     // We stop when we get to NewQuestions -- if we increment their CurrentAnswers/LargeAnswers/UniqueAnswers
     // counters here we'll end up double-incrementing them when we do it again in AnswerNewQuestion().
-    for (q = m->Questions; q && q != m->NewQuestions; q=q->next)
+    for (q = FirstQuestionForNameHash(m, cr->resrec.namehash); q && !q->InNewQuestions; q = NextQuestionForNameHash(q))
     {
         if (CacheRecordAnswersQuestion(cr, q))
         {
@@ -4526,16 +5007,18 @@ mDNSlocal void CacheRecordAdd(mDNS *const m, CacheRecord *cr)
     {
         if (m->CurrentQuestion)
             LogMsg("CacheRecordAdd ERROR m->CurrentQuestion already set: %##s (%s)", m->CurrentQuestion->qname.c, DNSTypeName(m->CurrentQuestion->qtype));
-        m->CurrentQuestion = m->Questions;
-        while (m->CurrentQuestion && m->CurrentQuestion != m->NewQuestions)
+        m->CurrentQuestion = FirstQuestionForNameHash(m, cr->resrec.namehash);
+        m->CurrentQuestionByName = mDNStrue;
+        while (m->CurrentQuestion && !m->CurrentQuestion->InNewQuestions)
         {
             q = m->CurrentQuestion;
             if (CacheRecordAnswersQuestion(cr, q))
                 AnswerCurrentQuestionWithResourceRecord(m, cr, QC_add);
             if (m->CurrentQuestion == q)    // If m->CurrentQuestion was not auto-advanced, do it ourselves now
-                m->CurrentQuestion = q->next;
+                m->CurrentQuestion = NextQuestionForNameHash(q);
         }
         m->CurrentQuestion = mDNSNULL;
+        m->CurrentQuestionByName = mDNSfalse;
     }
 
     SetNextCacheCheckTimeForRecord(m, cr);
@@ -4556,7 +5039,8 @@ mDNSlocal void NoCacheAnswer(mDNS *const m, CacheRecord *cr)
     LogMsg("No cache space: Delivering non-cached result for %##s", m->rec.r.resrec.name->c);
     if (m->CurrentQuestion)
         LogMsg("NoCacheAnswer ERROR m->CurrentQuestion already set: %##s (%s)", m->CurrentQuestion->qname.c, DNSTypeName(m->CurrentQuestion->qtype));
-    m->CurrentQuestion = m->Questions;
+    m->CurrentQuestion = FirstQuestionForNameHash(m, cr->resrec.namehash);
+    m->CurrentQuestionByName = mDNStrue;
     // We do this for *all* questions, not stopping when we get to m->NewQuestions,
     // since we're not caching the record and we'll get no opportunity to do this later
     while (m->CurrentQuestion)
@@ -4565,9 +5049,10 @@ mDNSlocal void NoCacheAnswer(mDNS *const m, CacheRecord *cr)
         if (CacheRecordAnswersQuestion(cr, q))
             AnswerCurrentQuestionWithResourceRecord(m, cr, QC_addnocache);  // QC_addnocache means "don't expect remove events for this"
         if (m->CurrentQuestion == q)    // If m->CurrentQuestion was not auto-advanced, do it ourselves now
-            m->CurrentQuestion = q->next;
+            m->CurrentQuestion = NextQuestionForNameHash(q);
     }
     m->CurrentQuestion = mDNSNULL;
+    m->CurrentQuestionByName = mDNSfalse;
 }
 
 // CacheRecordRmv is only called from CheckCacheExpiration, which is called from mDNS_Execute.
@@ -4584,11 +5069,12 @@ mDNSlocal void CacheRecordRmv(mDNS *const m, CacheRecord *cr)
     if (m->CurrentQuestion)
         LogMsg("CacheRecordRmv ERROR m->CurrentQuestion already set: %##s (%s)",
                m->CurrentQuestion->qname.c, DNSTypeName(m->CurrentQuestion->qtype));
-    m->CurrentQuestion = m->Questions;
+    m->CurrentQuestion = FirstQuestionForNameHash(m, cr->resrec.namehash);
+    m->CurrentQuestionByName = mDNStrue;
 
     // We stop when we get to NewQuestions -- for new questions their CurrentAnswers/LargeAnswers/UniqueAnswers counters
     // will all still be zero because we haven't yet gone through the cache counting how many answers we have for them.
-    while (m->CurrentQuestion && m->CurrentQuestion != m->NewQuestions)
+    while (m->CurrentQuestion && !m->CurrentQuestion->InNewQuestions)
     {
         DNSQuestion *q = m->CurrentQuestion;
         // When a question enters suppressed state, we generate RMV events and generate a negative
@@ -4639,9 +5125,120 @@ mDNSlocal void CacheRecordRmv(mDNS *const m, CacheRecord *cr)
             }
         }
         if (m->CurrentQuestion == q)    // If m->CurrentQuestion was not auto-advanced, do it ourselves now
-            m->CurrentQuestion = q->next;
+            m->CurrentQuestion = NextQuestionForNameHash(q);
     }
     m->CurrentQuestion = mDNSNULL;
+    m->CurrentQuestionByName = mDNSfalse;
+}
+
+// ***************************************************************************
+#if COMPILER_LIKES_PRAGMA_MARK
+#pragma mark -
+#pragma mark - Cache Slab Allocator
+#endif
+
+// Every block carries a header recording its size class, so CacheSlabFree() doesn't need to be told the size.
+// (It can't be derived from the contents: CreateNewCacheEntry() overwrites the RData header, MaxRDLength included.)
+typedef union
+{
+    mDNSu32 sizeclass;                  // Index into rrcache_slab.classes, or CACHE_SLAB_CLASSES for the platform allocator
+    void   *align;                      // Keeps the block that follows pointer-aligned
+} CacheSlabHeader;
+
+#define CacheSlabBlockSize(C) ((mDNSu32)CACHE_SLAB_MIN_BLOCK << (C))
+
+// Allocates a new slab for class c and puts all of its blocks on the class's free list
+mDNSlocal mDNSBool CacheSlabRefill(mDNS *const m, const mDNSu32 c)
+{
+    CacheSlabAllocator *const sa = &m->rrcache_slab;
+    CacheSlabClass *const sc = &sa->classes[c];
+    const mDNSu32 stride = sizeof(CacheSlabHeader) + CacheSlabBlockSize(c);
+    mDNSu32 n = (CACHE_SLAB_SIZE - sizeof(CacheSlab)) / stride;
+    CacheSlab *slab;
+    mDNSu8 *p;
+
+    if (n == 0) n = 1;
+    slab = (CacheSlab *) mDNSPlatformMemAllocate(sizeof(CacheSlab) + n * stride);
+    if (!slab) return(mDNSfalse);
+    slab->next = sa->slabs;
+    sa->slabs  = slab;
+    sc->slabs++;
+    for (p = (mDNSu8 *)(slab + 1); n; n--, p += stride)
+    {
+        void *const block = p + sizeof(CacheSlabHeader);
+        ((CacheSlabHeader *)p)->sizeclass = c;
+        *(void **)block = sc->freelist;
+        sc->freelist = block;
+        sc->free++;
+    }
+    return(mDNStrue);
+}
+
+// Returns size bytes of uninitialized storage, or mDNSNULL if memory is exhausted
+mDNSlocal void *CacheSlabAllocate(mDNS *const m, const mDNSu32 size)
+{
+    CacheSlabAllocator *const sa = &m->rrcache_slab;
+    CacheSlabClass *sc;
+    mDNSu32 c = 0;
+    void *block;
+
+    sa->allocs++;
+    while (c < CACHE_SLAB_CLASSES && CacheSlabBlockSize(c) < size) c++;
+    if (c == CACHE_SLAB_CLASSES)
+    {
+        CacheSlabHeader *const h = (CacheSlabHeader *) mDNSPlatformMemAllocate(sizeof(CacheSlabHeader) + size);
+        if (!h) { sa->failures++; return(mDNSNULL); }
+        h->sizeclass = CACHE_SLAB_CLASSES;
+        sa->oversize++;
+        return(h + 1);
+    }
+
+    sc = &sa->classes[c];
+    if (sc->freelist) sa->reused++;
+    else if (!CacheSlabRefill(m, c)) { sa->failures++; return(mDNSNULL); }
+    block = sc->freelist;
+    sc->freelist = *(void **)block;
+    sc->free--;
+    sc->inuse++;
+    return(block);
+}
+
+mDNSlocal void CacheSlabFree(mDNS *const m, void *const block)
+{
+    CacheSlabAllocator *const sa = &m->rrcache_slab;
+    CacheSlabHeader *const h = (CacheSlabHeader *)block - 1;
+    CacheSlabClass *sc;
+
+    if (h->sizeclass >= CACHE_SLAB_CLASSES) { mDNSPlatformMemFree(h); return; }
+    sc = &sa->classes[h->sizeclass];
+#if MDNS_MALLOC_DEBUGGING >= 1
+    {
+        unsigned int i;
+        for (i=0; i<CacheSlabBlockSize(h->sizeclass); i++) ((char*)block)[i] = 0xFF;
+    }
+#endif
+    *(void **)block = sc->freelist;
+    sc->freelist = block;
+    sc->inuse--;
+    sc->free++;
+}
+
+// Returns all slabs to the platform allocator; only called once every cache record has been released
+mDNSlocal void CacheSlabFreeAll(mDNS *const m)
+{
+    CacheSlabAllocator *const sa = &m->rrcache_slab;
+    mDNSu32 c;
+
+    for (c = 0; c < CACHE_SLAB_CLASSES; c++)
+        if (sa->classes[c].inuse)
+            LogMsg("CacheSlabFreeAll: ERROR!! %u blocks of %u bytes still in use", sa->classes[c].inuse, CacheSlabBlockSize(c));
+    while (sa->slabs)
+    {
+        CacheSlab *const slab = sa->slabs;
+        sa->slabs = slab->next;
+        mDNSPlatformMemFree(slab);
+    }
+    mDNSPlatformMemZero(sa->classes, sizeof(sa->classes));
 }
 
 mDNSlocal void ReleaseCacheEntity(mDNS *const m, CacheEntity *e)
@@ -4653,6 +5250,7 @@ mDNSlocal void ReleaseCacheEntity(mDNS *const m, CacheEntity *e)
     e->next = m->rrcache_free;
     m->rrcache_free = e;
     m->rrcache_totalused--;
+    mDNSMetricsSet(mDNS_Metrics.CacheEntities, m->rrcache_totalused);
 }
 
 mDNSlocal void ReleaseCacheGroup(mDNS *const m, CacheGroup **cp)
@@ -4661,9 +5259,10 @@ mDNSlocal void ReleaseCacheGroup(mDNS *const m, CacheGroup **cp)
     //LogMsg("ReleaseCacheGroup:  Releasing CacheGroup for %p, %##s", (*cp)->name->c, (*cp)->name->c);
     if ((*cp)->rrcache_tail != &(*cp)->members)
         LogMsg("ERROR: (*cp)->members == mDNSNULL but (*cp)->rrcache_tail != &(*cp)->members)");
+    CacheIndexRemove(m, *cp);
     //if ((*cp)->name != (domainname*)((*cp)->namestorage))
     //  LogMsg("ReleaseCacheGroup: %##s, %p %p", (*cp)->name->c, (*cp)->name, (domainname*)((*cp)->namestorage));
-    if ((*cp)->name != (domainname*)((*cp)->namestorage)) mDNSPlatformMemFree((*cp)->name);
+    if ((*cp)->name != (domainname*)((*cp)->namestorage)) CacheSlabFree(m, (*cp)->name);
     (*cp)->name = mDNSNULL;
     *cp = (*cp)->next;          // Cut record from list
     ReleaseCacheEntity(m, e);
@@ -4677,7 +5276,7 @@ mDNSlocal void ReleaseAdditionalCacheRecords(mDNS *const m, CacheRecord **rp)
         *rp = (*rp)->next;          // Cut record from list
         if (rr->resrec.rdata && rr->resrec.rdata != (RData*)&rr->smallrdatastorage)
         {
-            mDNSPlatformMemFree(rr->resrec.rdata);
+            CacheSlabFree(m, rr->resrec.rdata);
             rr->resrec.rdata = mDNSNULL;
         }
         // NSEC or SOA records that are not added to the CacheGroup do not share the name
@@ -4685,7 +5284,7 @@ mDNSlocal void ReleaseAdditionalCacheRecords(mDNS *const m, CacheRecord **rp)
         if (rr->resrec.name)
         {
             debugf("ReleaseAdditionalCacheRecords: freeing cached record %##s (%s)", rr->resrec.name->c, DNSTypeName(rr->resrec.rrtype));
-            mDNSPlatformMemFree((void *)rr->resrec.name);
+            CacheSlabFree(m, (void *)rr->resrec.name);
             rr->resrec.name = mDNSNULL;
         }
         // Don't count the NSEC3 records used by anonymous browse/reg
@@ -4702,7 +5301,8 @@ mDNSexport void ReleaseCacheRecord(mDNS *const m, CacheRecord *r)
     CacheGroup *cg;
 
     //LogMsg("ReleaseCacheRecord: Releasing %s", CRDisplayString(m, r));
-    if (r->resrec.rdata && r->resrec.rdata != (RData*)&r->smallrdatastorage) mDNSPlatformMemFree(r->resrec.rdata);
+    CacheLRURemove(m, r);
+    if (r->resrec.rdata && r->resrec.rdata != (RData*)&r->smallrdatastorage) CacheSlabFree(m, r->resrec.rdata);
     r->resrec.rdata = mDNSNULL;
 #if MDNSRESPONDER_SUPPORTS(APPLE, QUERIER)
     mdns_forget(&r->resrec.dnsservice);
@@ -4725,7 +5325,7 @@ mDNSexport void ReleaseCacheRecord(mDNS *const m, CacheRecord *r)
     if (r->resrec.name && cg && r->resrec.name != cg->name)
     {
         debugf("ReleaseCacheRecord: freeing %##s (%s)", r->resrec.name->c, DNSTypeName(r->resrec.rrtype));
-        mDNSPlatformMemFree((void *)r->resrec.name);
+        CacheSlabFree(m, (void *)r->resrec.name);
     }
     r->resrec.name = mDNSNULL;
 
@@ -4956,6 +5556,7 @@ mDNSlocal void AnswerNewQuestion(mDNS *const m)
     if (cg) CheckCacheExpiration(m, HashSlotFromNameHash(q->qnamehash), cg);
     if (m->NewQuestions != q) { LogInfo("AnswerNewQuestion: Question deleted while doing CheckCacheExpiration"); goto exit; }
     m->NewQuestions = q->next;
+    q->InNewQuestions = mDNSfalse;
     // Advance NewQuestions to the next *after* calling CheckCacheExpiration, because if we advance it first
     // then CheckCacheExpiration may give this question add/remove callbacks, and it's not yet ready for that.
     //
@@ -5059,6 +5660,12 @@ mDNSlocal void AnswerNewQuestion(mDNS *const m)
     // it's not remotely remarkable, and therefore unlikely to be of much help tracking down bugs.
     if (m->CurrentQuestion != q) { debugf("AnswerNewQuestion: Question deleted while giving cache answers"); goto exit; }
 
+    if (!q->Suppressed)
+    {
+        if (q->CurrentAnswers) mDNSMetricsAdd(mDNS_Metrics.CacheHits, 1);
+        else mDNSMetricsAdd(mDNS_Metrics.CacheMisses, 1);
+    }
+
 #if MDNSRESPONDER_SUPPORTS(APPLE, CACHE_ANALYTICS)
     dnssd_analytics_update_cache_request(mDNSOpaque16IsZero(q->TargetQID) ? CacheRequestType_multicast : CacheRequestType_unicast, CacheState_miss);
 #endif
@@ -5179,6 +5786,60 @@ mDNSlocal void AnswerNewLocalOnlyQuestion(mDNS *const m)
     m->CurrentRecord   = mDNSNULL;
 }
 
+// Frees one CacheEntity by releasing the least recently used record that is not answering an active question and not
+// on the CacheFlushRecords list. Records that are skipped move to the tail, so the next call does not look at them
+// again until every other record has had its turn; if the scan comes back round to the first skipped record,
+// nothing in the cache can be evicted. If that leaves the record's CacheGroup empty, it is released too, unless
+// it is PreserveCG.
+mDNSlocal void CacheLRUEvict(mDNS *const m, const CacheGroup *const PreserveCG)
+{
+    CacheLRU *const lru = &m->rrcache_lru;
+    const CacheRecord *firstkept = mDNSNULL;
+    CacheRecord *cr;
+
+    while ((cr = lru->head) != mDNSNULL && cr != firstkept)
+    {
+        CacheGroup *cg;
+        CacheGroup **cp;
+        CacheRecord **rp;
+
+        // Records that answer still-active questions are not candidates for recycling
+        // Records that are currently linked into the CacheFlushRecords list may not be recycled, or we'll crash
+        if (cr->CRActiveQuestion || cr->NextInCFList)
+        {
+            if (!firstkept) firstkept = cr;
+            lru->secondchances++;
+            CacheLRURemove(m, cr);
+            CacheLRUAppend(m, cr);
+            continue;
+        }
+
+        cg = CacheGroupForRecord(m, &cr->resrec);
+        rp = cg ? &cg->members : mDNSNULL;
+        while (rp && *rp && *rp != cr) rp = &(*rp)->next;
+        if (!rp || !*rp)
+        {
+            LogMsg("CacheLRUEvict: ERROR!! %s not found in its CacheGroup", CRDisplayString(m, cr));
+            CacheLRURemove(m, cr);
+            continue;
+        }
+
+        *rp = cr->next;                     // Cut record from list
+        if (cg->rrcache_tail == &cr->next) cg->rrcache_tail = rp;
+        ReleaseCacheRecord(m, cr);
+        lru->evictions++;
+        mDNSMetricsAdd(mDNS_Metrics.CacheEvictions, 1);
+
+        if (!cg->members && cg != PreserveCG)
+        {
+            for (cp = &m->rrcache_hash[HashSlotFromNameHash(cg->namehash)]; *cp && *cp != cg; cp = &(*cp)->next) continue;
+            if (*cp) ReleaseCacheGroup(m, cp);
+        }
+        return;
+    }
+    lru->failures++;
+}
+
 mDNSlocal CacheEntity *GetCacheEntity(mDNS *const m, const CacheGroup *const PreserveCG)
 {
     CacheEntity *e = mDNSNULL;
@@ -5199,8 +5860,8 @@ mDNSlocal CacheEntity *GetCacheEntity(mDNS *const m, const CacheGroup *const Pre
         // We don't want to be vulnerable to a malicious attacker flooding us with an infinite
         // number of bogus records so that we keep growing our cache until the machine runs out of memory.
         // To guard against this, if our cache grows above 512kB (approx 3168 records at 164 bytes each),
-        // and we're actively using less than 1/32 of that cache, then we purge all the unused records
-        // and recycle them, instead of allocating more memory.
+        // and we're actively using less than 1/32 of that cache, then we recycle the least recently used
+        // unused records, instead of allocating more memory.
         if (m->rrcache_size > 5000 && m->rrcache_size / 32 > m->rrcache_active)
         {
             LogRedact(MDNS_LOG_CATEGORY_DEFAULT, MDNS_LOG_INFO,
@@ -5215,41 +5876,8 @@ mDNSlocal CacheEntity *GetCacheEntity(mDNS *const m, const CacheGroup *const Pre
         }
     }
 
-    // If we still have no free records, recycle all the records we can.
-    // Enumerating the entire cache is moderately expensive, so when we do it, we reclaim all the records we can in one pass.
-    if (!m->rrcache_free)
-    {
-        mDNSu32 oldtotalused = m->rrcache_totalused;
-        mDNSu32 slot;
-        for (slot = 0; slot < CACHE_HASH_SLOTS; slot++)
-        {
-            CacheGroup **cp = &m->rrcache_hash[slot];
-            while (*cp)
-            {
-                CacheRecord **rp = &(*cp)->members;
-                while (*rp)
-                {
-                    // Records that answer still-active questions are not candidates for recycling
-                    // Records that are currently linked into the CacheFlushRecords list may not be recycled, or we'll crash
-                    if ((*rp)->CRActiveQuestion || (*rp)->NextInCFList)
-                        rp=&(*rp)->next;
-                    else
-                    {
-                        CacheRecord *rr = *rp;
-                        *rp = (*rp)->next;          // Cut record from list
-                        ReleaseCacheRecord(m, rr);
-                    }
-                }
-                if ((*cp)->rrcache_tail != rp)
-                    verbosedebugf("GetFreeCacheRR: Updating rrcache_tail[%lu] from %p to %p", slot, (*cp)->rrcache_tail, rp);
-                (*cp)->rrcache_tail = rp;
-                if ((*cp)->members || (*cp)==PreserveCG) cp=&(*cp)->next;
-                else ReleaseCacheGroup(m, cp);
-            }
-        }
-        LogRedact(MDNS_LOG_CATEGORY_DEFAULT, MDNS_LOG_INFO, "GetCacheEntity recycled %d records to reduce cache from %d to %d",
-                  oldtotalused - m->rrcache_totalused, oldtotalused, m->rrcache_totalused);
-    }
+    // If we still have no free records, evict the least recently used record we can
+    if (!m->rrcache_free) CacheLRUEvict(m, PreserveCG);
 
     if (m->rrcache_free)    // If there are records in the free list, take one
     {
@@ -5262,6 +5890,7 @@ mDNSlocal CacheEntity *GetCacheEntity(mDNS *const m, const CacheGroup *const Pre
             else if (m->rrcache_report < 1000) m->rrcache_report += 100;
             else m->rrcache_report += 1000;
         }
+        mDNSMetricsSet(mDNS_Metrics.CacheEntities, m->rrcache_totalused);
         mDNSPlatformMemZero(e, sizeof(*e));
     }
 
@@ -5278,8 +5907,12 @@ mDNSlocal CacheRecord *GetCacheRecord(mDNS *const m, CacheGroup *cg, mDNSu16 RDL
         r->resrec.rdata = (RData*)&r->smallrdatastorage;    // By default, assume we're usually going to be using local storage
         if (RDLength > InlineCacheRDSize)           // If RDLength is too big, allocate extra storage
         {
-            r->resrec.rdata = (RData*) mDNSPlatformMemAllocateClear(sizeofRDataHeader + RDLength);
-            if (r->resrec.rdata) r->resrec.rdata->MaxRDLength = r->resrec.rdlength = RDLength;
+            r->resrec.rdata = (RData*) CacheSlabAllocate(m, sizeofRDataHeader + RDLength);
+            if (r->resrec.rdata)
+            {
+                mDNSPlatformMemZero(r->resrec.rdata, sizeofRDataHeader + RDLength);
+                r->resrec.rdata->MaxRDLength = r->resrec.rdlength = RDLength;
+            }
             else { ReleaseCacheEntity(m, (CacheEntity*)r); r = mDNSNULL; }
         }
     }
@@ -5296,7 +5929,7 @@ mDNSlocal CacheGroup *GetCacheGroup(mDNS *const m, const mDNSu32 slot, const Res
     cg->members      = mDNSNULL;
     cg->rrcache_tail = &cg->members;
     if (namelen > sizeof(cg->namestorage))
-        cg->name = (domainname *) mDNSPlatformMemAllocate(namelen);
+        cg->name = (domainname *) CacheSlabAllocate(m, namelen);
     else
         cg->name = (domainname*)cg->namestorage;
     if (!cg->name)
@@ -5309,6 +5942,7 @@ mDNSlocal CacheGroup *GetCacheGroup(mDNS *const m, const mDNSu32 slot, const Res
 
     if (CacheGroupForRecord(m, rr)) LogMsg("GetCacheGroup: Already have CacheGroup for %##s", rr->name->c);
     m->rrcache_hash[slot] = cg;
+    CacheIndexInsert(m, cg);
     if (CacheGroupForRecord(m, rr) != cg) LogMsg("GetCacheGroup: Not finding CacheGroup for %##s", rr->name->c);
 
     return(cg);
@@ -5518,6 +6152,9 @@ mDNSexport mDNSs32 mDNS_Execute(mDNS *const m)
             debugf("m->NextCacheCheck %4d checked, next in %d", numchecked, m->NextCacheCheck - m->timenow);
         }
 
+        // Continue moving the cache name index into its new, larger table if a resize is in progress
+        CacheIndexMigrate(m, CACHE_INDEX_MIGRATE_STEP);
+
         if (m->timenow - m->NextScheduledSPS >= 0)
         {
             m->NextScheduledSPS = m->timenow + FutureTime;
@@ -5949,7 +6586,7 @@ mDNSexport void mDNSCoreRestartQuestion(mDNS *const m, DNSQuestion *q)
         q->LastQTime        = m->timenow - q->ThisQInterval;
         q->RecentAnswerPkts = 0;
         ExpireDupSuppressInfo(q->DupSuppress, m->timenow);
-        m->NextScheduledQuery = m->timenow;
+        SetNextQueryTime(m, q);
     }
 }
 
@@ -7268,12 +7905,13 @@ mDNSexport mDNSs32 mDNSCoreIntervalToNextWake(mDNS *const m, mDNSs32 now, mDNSNe
 
 #define MustSendRecord(RR) ((RR)->NR_AnswerTo || (RR)->NR_AdditionalTo)
 
-mDNSlocal mDNSu8 *GenerateUnicastResponse(const DNSMessage *const query, const mDNSu8 *const end,
+mDNSlocal mDNSu8 *GenerateUnicastResponse(DNSMessageView *const view,
                                           const mDNSInterfaceID InterfaceID, mDNSBool LegacyQuery, DNSMessage *const response, AuthRecord *ResponseRecords)
 {
+    const DNSMessage *const query    = view->msg;
     mDNSu8          *responseptr     = response->data;
     const mDNSu8    *const limit     = response->data + sizeof(response->data);
-    const mDNSu8    *ptr             = query->data;
+    const mDNSu8    *ptr;
     AuthRecord  *rr;
     mDNSu32 maxttl = (!InterfaceID) ? mDNSMaximumUnicastTTLSeconds : mDNSMaximumMulticastTTLSeconds;
     int i;
@@ -7290,7 +7928,7 @@ mDNSlocal mDNSu8 *GenerateUnicastResponse(const DNSMessage *const query, const m
         for (i=0; i<query->h.numQuestions; i++)                     // For each question...
         {
             DNSQuestion q;
-            ptr = getQuestion(query, ptr, end, InterfaceID, &q);    // get the question...
+            ptr = GetViewQuestion(view, i, InterfaceID, &q);        // get the question...
             if (!ptr) return(mDNSNULL);
 
             for (rr=ResponseRecords; rr; rr=rr->NextResponse)       // and search our list of proposed answers
@@ -7389,7 +8027,7 @@ mDNSlocal mDNSBool PacketRecordMatches(const AuthRecord *const rr, const CacheRe
 mDNSlocal mDNSBool MatchDependentOn(const mDNS *const m, const CacheRecord *const pktrr, const AuthRecord *const master)
 {
     const AuthRecord *r1;
-    for (r1 = m->ResourceRecords; r1; r1=r1->next)
+    for (r1 = FirstRecordForNameHash(m, pktrr->resrec.namehash); r1; r1 = NextRecordForNameHash(r1))
     {
         if (PacketRecordMatches(r1, pktrr, master)) return(mDNStrue);
     }
@@ -7407,7 +8045,7 @@ mDNSlocal mDNSBool MatchDependentOn(const mDNS *const m, const CacheRecord *cons
 mDNSlocal const AuthRecord *FindRRSet(const mDNS *const m, const CacheRecord *const pktrr)
 {
     const AuthRecord *rr;
-    for (rr = m->ResourceRecords; rr; rr=rr->next)
+    for (rr = FirstRecordForNameHash(m, pktrr->resrec.namehash); rr; rr = NextRecordForNameHash(rr))
     {
         if (IdenticalResourceRecord(&rr->resrec, &pktrr->resrec))
         {
@@ -7457,12 +8095,12 @@ mDNSlocal void ResolveSimultaneousProbe(mDNS *const m, const DNSMessage *const q
                                         DNSQuestion *q, AuthRecord *our)
 {
     int i;
-    const mDNSu8 *ptr = LocateAuthorities(query, end);
+    DNSMessageView *const view = GetMessageView(m, query, end);
     mDNSBool FoundUpdate = mDNSfalse;
 
     for (i = 0; i < query->h.numAuthorities; i++)
     {
-        ptr = GetLargeResourceRecord(m, query, ptr, end, q->InterfaceID, kDNSRecordTypePacketAuth, &m->rec);
+        const mDNSu8 *const ptr = GetViewRecord(m, view, query->h.numAnswers + i, q->InterfaceID, kDNSRecordTypePacketAuth, &m->rec);
         if (!ptr) break;
         if (m->rec.r.resrec.RecordType != kDNSRecordTypePacketNegative && CacheRecordAnswersQuestion(&m->rec.r, q))
         {
@@ -7506,7 +8144,7 @@ exit:
     m->rec.r.resrec.RecordType = 0;     // Clear RecordType to show we're not still using it
 }
 
-mDNSlocal CacheRecord *FindIdenticalRecordInCache(const mDNS *const m, const ResourceRecord *const pktrr)
+mDNSlocal CacheRecord *FindIdenticalRecordInCache(mDNS *const m, const ResourceRecord *const pktrr)
 {
     CacheGroup *cg = CacheGroupForRecord(m, pktrr);
     CacheRecord *rr;
@@ -7646,18 +8284,19 @@ mDNSlocal mDNSu8 *ProcessQuery(mDNS *const m, const DNSMessage *const query, con
     DNSQuestion **dqp                = &DupQuestions;
     mDNSs32 delayresponse      = 0;
     mDNSBool SendLegacyResponse = mDNSfalse;
+    DNSMessageView *const view       = GetMessageView(m, query, end);
     const mDNSu8 *ptr;
     mDNSu8       *responseptr        = mDNSNULL;
     AuthRecord   *rr;
-    int i;
+    int i, opt;
 
     // ***
     // *** 1. Look in Additional Section for an OPT record
     // ***
-    ptr = LocateOptRR(query, end, DNSOpt_OwnerData_ID_Space);
-    if (ptr)
+    opt = LocateViewOptRR(view, DNSOpt_OwnerData_ID_Space);
+    if (opt >= 0)
     {
-        ptr = GetLargeResourceRecord(m, query, ptr, end, InterfaceID, kDNSRecordTypePacketAdd, &m->rec);
+        ptr = GetViewRecord(m, view, (mDNSu32)opt, InterfaceID, kDNSRecordTypePacketAdd, &m->rec);
         if (ptr && m->rec.r.resrec.RecordType != kDNSRecordTypePacketNegative && m->rec.r.resrec.rrtype == kDNSType_OPT)
         {
             const rdataOPT *opt;
@@ -7677,14 +8316,13 @@ mDNSlocal mDNSu8 *ProcessQuery(mDNS *const m, const DNSMessage *const query, con
     // ***
     // *** 2. Parse Question Section and mark potential answers
     // ***
-    ptr = query->data;
     for (i=0; i<query->h.numQuestions; i++)                     // For each question...
     {
         mDNSBool QuestionNeedsMulticastResponse;
         int NumAnswersForThisQuestion = 0;
         AuthRecord *NSECAnswer = mDNSNULL;
         DNSQuestion pktq, *q;
-        ptr = getQuestion(query, ptr, end, InterfaceID, &pktq); // get the question...
+        ptr = GetViewQuestion(view, i, InterfaceID, &pktq);     // get the question...
         if (!ptr) goto exit;
 
         // The only queries that *need* a multicast response are:
@@ -7711,13 +8349,15 @@ mDNSlocal mDNSu8 *ProcessQuery(mDNS *const m, const DNSMessage *const query, con
         // Also note: we just mark potential answer records here, without trying to build the
         // "ResponseRecords" list, because we don't want to risk user callbacks deleting records
         // from that list while we're in the middle of trying to build it.
+        // Only records with the question's name can answer it, so we walk just that RecordHash chain.
         if (m->CurrentRecord)
             LogMsg("ProcessQuery ERROR m->CurrentRecord already set %s", ARDisplayString(m, m->CurrentRecord));
-        m->CurrentRecord = m->ResourceRecords;
+        m->CurrentRecordByName = mDNStrue;
+        m->CurrentRecord = FirstRecordForNameHash(m, pktq.qnamehash);
         while (m->CurrentRecord)
         {
             rr = m->CurrentRecord;
-            m->CurrentRecord = rr->next;
+            m->CurrentRecord = NextRecordForNameHash(rr);
             if (AnyTypeRecordAnswersQuestion(rr, &pktq) && (QueryWasMulticast || QueryWasLocalUnicast || rr->AllowRemoteQuery))
             {
                 m->mDNSStats.MatchingAnswersForQueries++;
@@ -7759,6 +8399,7 @@ mDNSlocal mDNSu8 *ProcessQuery(mDNS *const m, const DNSMessage *const query, con
                 }
             }
         }
+        m->CurrentRecordByName = mDNSfalse;
 
         if (NumAnswersForThisQuestion == 0 && NSECAnswer)
         {
@@ -7806,7 +8447,7 @@ mDNSlocal mDNSu8 *ProcessQuery(mDNS *const m, const DNSMessage *const query, con
             // We only do this for non-truncated queries. Right now it would be too complicated to try
             // to keep track of duplicate suppression state between multiple packets, especially when we
             // can't guarantee to receive all of the Known Answer packets that go with a particular query.
-            for (q = m->Questions; q; q=q->next)
+            for (q = FirstQuestionForNameHash(m, pktq.qnamehash); q; q = NextQuestionForNameHash(q))
             {
                 if (ActiveQuestion(q) && m->timenow - q->LastQTxTime > mDNSPlatformOneSecond / 4)
                 {
@@ -7828,9 +8469,17 @@ mDNSlocal mDNSu8 *ProcessQuery(mDNS *const m, const DNSMessage *const query, con
     // ***
     // *** 3. Now we can safely build the list of marked answers
     // ***
-    for (rr = m->ResourceRecords; rr; rr=rr->next)              // Now build our list of potential answers
-        if (rr->NR_AnswerTo)                                    // If we marked the record...
-            AddRecordToResponseList(&nrp, rr, mDNSNULL);        // ... add it to the list
+    // Every record we marked has the name of one of the questions, so walk the questions again
+    // and collect the marked records from their RecordHash chains.
+    for (i=0; i<query->h.numQuestions; i++)
+    {
+        DNSQuestion pktq;
+        ptr = GetViewQuestion(view, i, InterfaceID, &pktq);
+        if (!ptr) break;
+        for (rr = FirstRecordForNameHash(m, pktq.qnamehash); rr; rr = NextRecordForNameHash(rr))
+            if (rr->NR_AnswerTo)                                // If we marked the record...
+                AddRecordToResponseList(&nrp, rr, mDNSNULL);    // ... add it to the list
+    }
 
     // ***
     // *** 4. Add additional records
@@ -7844,7 +8493,7 @@ mDNSlocal mDNSu8 *ProcessQuery(mDNS *const m, const DNSMessage *const query, con
     {
         // Get the record...
         CacheRecord *ourcacherr;
-        ptr = GetLargeResourceRecord(m, query, ptr, end, InterfaceID, kDNSRecordTypePacketAns, &m->rec);
+        ptr = GetViewRecord(m, view, i, InterfaceID, kDNSRecordTypePacketAns, &m->rec);
         if (!ptr) goto exit;
         if (m->rec.r.resrec.RecordType != kDNSRecordTypePacketNegative)
         {
@@ -8045,7 +8694,7 @@ mDNSlocal mDNSu8 *ProcessQuery(mDNS *const m, const DNSMessage *const query, con
     // *** 9. If query is from a legacy client, or from a new client requesting a unicast reply, then generate a unicast response too
     // ***
     if (SendLegacyResponse)
-        responseptr = GenerateUnicastResponse(query, end, InterfaceID, LegacyQuery, response, ResponseRecords);
+        responseptr = GenerateUnicastResponse(view, InterfaceID, LegacyQuery, response, ResponseRecords);
 
 exit:
     m->rec.r.resrec.RecordType = 0;     // Clear RecordType to show we're not still using it
@@ -8172,7 +8821,7 @@ mDNSlocal DNSQuestion *ExpectingUnicastResponseForQuestion(const mDNS *const m,
     const mDNSOpaque16 id, const DNSQuestion *const question, mDNSBool tcp)
 {
     DNSQuestion *q;
-    for (q = m->Questions; q; q=q->next)
+    for (q = FirstQuestionForNameHash(m, question->qnamehash); q; q = NextQuestionForNameHash(q))
     {
         if (!tcp && !q->LocalSocket) continue;
         if (mDNSSameIPPort(tcp ? q->tcpSrcPort : q->LocalSocket->port, port)       &&
@@ -8199,7 +8848,7 @@ mDNSlocal DNSQuestion *ExpectingUnicastResponseForRecord(mDNS *const m,
     DNSQuestion *q;
     (void)id;
 
-    for (q = m->Questions; q; q=q->next)
+    for (q = FirstQuestionForNameHash(m, rr->resrec.namehash); q; q = NextQuestionForNameHash(q))
     {
         if (!q->DuplicateOf && ResourceRecordAnswersUnicastResponse(&rr->resrec, q))
         {
@@ -8291,6 +8940,8 @@ mDNSexport CacheRecord *CreateNewCacheEntry(mDNS *const m, const mDNSu32 slot, C
 
         rr->next = mDNSNULL;                    // Clear 'next' pointer
         rr->soa  = mDNSNULL;
+        rr->NextInLRU = mDNSNULL;               // Not on m->rrcache_lru until it is added to the CacheGroup
+        rr->PrevInLRU = mDNSNULL;
 
         if (sourceAddress)
             rr->sourceAddress = *sourceAddress;
@@ -8311,13 +8962,14 @@ mDNSexport CacheRecord *CreateNewCacheEntry(mDNS *const m, const mDNSu32 slot, C
         {
             *(cg->rrcache_tail) = rr;               // Append this record to tail of cache slot list
             cg->rrcache_tail = &(rr->next);         // Advance tail pointer
+            CacheLRUAppend(m, rr);
             CacheRecordAdd(m, rr);  // CacheRecordAdd calls SetNextCacheCheckTimeForRecord(m, rr); for us
         }
         else
         {
             // Can't use the "cg->name" if we are not adding to the cache as the
             // CacheGroup may be released anytime if it is empty
-            domainname *name = (domainname *) mDNSPlatformMemAllocate(DomainNameLength(cg->name));
+            domainname *name = (domainname *) CacheSlabAllocate(m, DomainNameLength(cg->name));
             if (name)
             {
                 AssignDomainName(name, cg->name);
@@ -8358,6 +9010,7 @@ mDNSlocal void RefreshCacheRecord(mDNS *const m, CacheRecord *rr, mDNSu32 ttl)
     rr->TimeRcvd             = m->timenow;
     rr->resrec.rroriginalttl = ttl;
     rr->UnansweredQueries = 0;
+    CacheLRUTouch(m, rr);
     if (rr->resrec.mortality != Mortality_Mortal) rr->resrec.mortality = Mortality_Immortal;
     SetNextCacheCheckTimeForRecord(m, rr);
 }
@@ -8446,13 +9099,14 @@ mDNSlocal void mDNSCoreReceiveNoUnicastAnswers(mDNS *const m, const DNSMessage *
     const uDNS_LLQType LLQType)
 {
     int i;
+    DNSMessageView *const view = GetMessageView(m, response, end);
     const mDNSu8 *ptr   = response->data;
     CacheRecord *SOARecord = mDNSNULL;
 
     for (i = 0; i < response->h.numQuestions && ptr && ptr < end; i++)
     {
         DNSQuestion q;
-        ptr = getQuestion(response, ptr, end, InterfaceID, &q);
+        ptr = GetViewQuestion(view, i, InterfaceID, &q);
         if (ptr)
         {
             DNSQuestion *qptr;
@@ -8555,6 +9209,7 @@ mDNSlocal void mDNSCoreReceiveNoUnicastAnswers(mDNS *const m, const DNSMessage *
                     int repeat = 0;
                     const domainname *name = &q.qname;
                     mDNSu32 hash = q.qnamehash;
+                    const mDNSu8 *soaptr;   // Not ptr, which the question loop is still using
 
                     // Special case for our special Microsoft Active Directory "local SOA" check.
                     // Some cheap home gateways don't include an SOA record in the authority section when
@@ -8565,10 +9220,10 @@ mDNSlocal void mDNSCoreReceiveNoUnicastAnswers(mDNS *const m, const DNSMessage *
                     if (q.qtype == kDNSType_SOA && SameDomainName(&q.qname, &localdomain)) negttl = 60 * 60 * 24;
 
                     // If we're going to make (or update) a negative entry, then look for the appropriate TTL from the SOA record
-                    if (response->h.numAuthorities && (ptr = LocateAuthorities(response, end)) != mDNSNULL)
+                    if (response->h.numAuthorities)
                     {
-                        ptr = GetLargeResourceRecord(m, response, ptr, end, InterfaceID, kDNSRecordTypePacketAuth, &m->rec);
-                        if (ptr && m->rec.r.resrec.RecordType != kDNSRecordTypePacketNegative && m->rec.r.resrec.rrtype == kDNSType_SOA)
+                        soaptr = GetViewRecord(m, view, response->h.numAnswers, InterfaceID, kDNSRecordTypePacketAuth, &m->rec);
+                        if (soaptr && m->rec.r.resrec.RecordType != kDNSRecordTypePacketNegative && m->rec.r.resrec.rrtype == kDNSType_SOA)
                         {
                             CacheGroup *cgSOA = CacheGroupForRecord(m, &m->rec.r.resrec);
                             const rdataSOA *const soa = (const rdataSOA *)m->rec.r.resrec.rdata->u.data;
@@ -8783,7 +9438,7 @@ mDNSexport CacheRecord* mDNSCoreReceiveCacheCheck(mDNS *const m, const DNSMessag
                     if (!(cr->resrec.RecordType & kDNSRecordTypePacketUniqueMask))
                     {
                         DNSQuestion *q;
-                        for (q = m->Questions; q; q=q->next)
+                        for (q = FirstQuestionForNameHash(m, cr->resrec.namehash); q; q = NextQuestionForNameHash(q))
                         {
                             if (CacheRecordAnswersQuestion(cr, q))
                                 q->UniqueAnswers++;
@@ -8848,7 +9503,7 @@ mDNSexport CacheRecord* mDNSCoreReceiveCacheCheck(mDNS *const m, const DNSMessag
                     // true for records like A etc. but not for PTR.
                     if (cr->resrec.RecordType & kDNSRecordTypePacketUniqueMask)
                     {
-                        for (q = m->Questions; q; q=q->next)
+                        for (q = FirstQuestionForNameHash(m, cr->resrec.namehash); q; q = NextQuestionForNameHash(q))
                         {
                             if (!q->DuplicateOf && !q->LongLived &&
                                 ActiveQuestion(q) && CacheRecordAnswersQuestion(cr, q))
@@ -8936,6 +9591,7 @@ mDNSlocal void mDNSCoreReceiveResponse(mDNS *const m, const DNSMessage *const re
     int firstauthority  =                   response->h.numAnswers;
     int firstadditional = firstauthority  + response->h.numAuthorities;
     int totalrecords    = firstadditional + response->h.numAdditionals;
+    DNSMessageView *const view = GetMessageView(m, response, end);
     const mDNSu8 *ptr   = response->data;
 #if !MDNSRESPONDER_SUPPORTS(APPLE, QUERIER)
     DNSServer *uDNSServer = mDNSNULL;
@@ -9005,7 +9661,7 @@ mDNSlocal void mDNSCoreReceiveResponse(mDNS *const m, const DNSMessage *const re
     // 2. If this is an LLQ response, we handle it much the same
     // Otherwise, this is a authoritative uDNS answer, so arrange for any stale records to be purged
     if (ResponseMCast || LLQType == uDNS_LLQ_Events)
-        ptr = LocateAnswers(response, end);
+        ptr = LocateViewAnswers(view);
     // Otherwise, for one-shot queries, any answers in our cache that are not also contained
     // in this response packet are immediately deemed to be invalid.
     else
@@ -9039,7 +9695,7 @@ mDNSlocal void mDNSCoreReceiveResponse(mDNS *const m, const DNSMessage *const re
             DNSQuestion q;
             DNSQuestion *qptr;
             mDNSBool expectingResponse;
-            ptr = getQuestion(response, ptr, end, InterfaceID, &q);
+            ptr = GetViewQuestion(view, i, InterfaceID, &q);
             if (!ptr)
             {
                 continue;
@@ -9060,6 +9716,14 @@ mDNSlocal void mDNSCoreReceiveResponse(mDNS *const m, const DNSMessage *const re
             {
                 continue;
             }
+#if !MDNSRESPONDER_SUPPORTS(APPLE, QUERIER)
+            // If the query was raced across several servers, only the first one to answer is listened to
+            if (dstaddr && !uDNS_UnicastRaceResponse(m, qptr, srcaddr, srcport, failure))
+            {
+                returnEarly = mDNStrue;
+                continue;
+            }
+#endif
             if (!failure)
             {
                 CacheRecord *cr;
@@ -9130,7 +9794,7 @@ mDNSlocal void mDNSCoreReceiveResponse(mDNS *const m, const DNSMessage *const re
         const mDNSu8 RecordType =
             (i < firstauthority ) ? (mDNSu8)kDNSRecordTypePacketAns  :
             (i < firstadditional) ? (mDNSu8)kDNSRecordTypePacketAuth : (mDNSu8)kDNSRecordTypePacketAdd;
-        ptr = GetLargeResourceRecord(m, response, ptr, end, InterfaceID, RecordType, &m->rec);
+        ptr = GetViewRecord(m, view, i, InterfaceID, RecordType, &m->rec);
         if (!ptr) goto exit;        // Break out of the loop and clean up our CacheFlushRecords list before exiting
 
         if (m->rec.r.resrec.RecordType == kDNSRecordTypePacketNegative)
@@ -9310,11 +9974,13 @@ mDNSlocal void mDNSCoreReceiveResponse(mDNS *const m, const DNSMessage *const re
         {
             if (m->CurrentRecord)
                 LogMsg("mDNSCoreReceiveResponse ERROR m->CurrentRecord already set %s", ARDisplayString(m, m->CurrentRecord));
-            m->CurrentRecord = m->ResourceRecords;
+            // PacketRRMatchesSignature requires the same name, so only that RecordHash chain can hold a match
+            m->CurrentRecordByName = mDNStrue;
+            m->CurrentRecord = FirstRecordForNameHash(m, m->rec.r.resrec.namehash);
             while (m->CurrentRecord)
             {
                 AuthRecord *rr = m->CurrentRecord;
-                m->CurrentRecord = rr->next;
+                m->CurrentRecord = NextRecordForNameHash(rr);
                 // We accept all multicast responses, and unicast responses resulting from queries we issued
                 // For other unicast responses, this code accepts them only for responses with an
                 // (apparently) local source address that pertain to a record of our own that's in probing state
@@ -9445,6 +10111,7 @@ mDNSlocal void mDNSCoreReceiveResponse(mDNS *const m, const DNSMessage *const re
                     }
                 }
             }
+            m->CurrentRecordByName = mDNSfalse;
         }
 
         if (!AcceptableResponse)
@@ -9680,7 +10347,7 @@ exit:
                     if (r2->resrec.mortality == Mortality_Ghost)
                     {
                         DNSQuestion * q;
-                        for (q = m->Questions; q; q=q->next)
+                        for (q = FirstQuestionForNameHash(m, r2->resrec.namehash); q; q = NextQuestionForNameHash(q))
                         {
                             if (!q->LongLived && ActiveQuestion(q) &&
                                 CacheRecordAnswersQuestion(r2, q) &&
@@ -10253,7 +10920,9 @@ mDNSlocal void mDNSCoreReceiveUpdate(mDNS *const m,
     mDNSu8 *p = m->omsg.data;
     OwnerOptData owner = zeroOwner;     // Need to zero this, so we'll know if this Update packet was missing its Owner option
     mDNSu32 updatelease = 0;
+    DNSMessageView *const view = GetMessageView(m, msg, end);
     const mDNSu8 *ptr;
+    int optrr;
 
     LogSPS("Received Update from %#-15a:%-5d to %#-15a:%-5d on 0x%p with "
            "%2d Question%s %2d Answer%s %2d Authorit%s %2d Additional%s %d bytes",
@@ -10268,10 +10937,10 @@ mDNSlocal void mDNSCoreReceiveUpdate(mDNS *const m,
     if (mDNS_PacketLoggingEnabled)
         DumpPacket(mStatus_NoError, mDNSfalse, "UDP", srcaddr, srcport, dstaddr, dstport, msg, end, InterfaceID);
 
-    ptr = LocateOptRR(msg, end, DNSOpt_LeaseData_Space + DNSOpt_OwnerData_ID_Space);
-    if (ptr)
+    optrr = LocateViewOptRR(view, DNSOpt_LeaseData_Space + DNSOpt_OwnerData_ID_Space);
+    if (optrr >= 0)
     {
-        ptr = GetLargeResourceRecord(m, msg, ptr, end, 0, kDNSRecordTypePacketAdd, &m->rec);
+        ptr = GetViewRecord(m, view, (mDNSu32)optrr, 0, kDNSRecordTypePacketAdd, &m->rec);
         if (ptr && m->rec.r.resrec.RecordType != kDNSRecordTypePacketNegative && m->rec.r.resrec.rrtype == kDNSType_OPT)
         {
             const rdataOPT *o;
@@ -10319,7 +10988,7 @@ mDNSlocal void mDNSCoreReceiveUpdate(mDNS *const m,
         if (updatelease > 0x40000000UL / mDNSPlatformOneSecond)
             updatelease = 0x40000000UL / mDNSPlatformOneSecond;
 
-        ptr = LocateAuthorities(msg, end);
+        ptr = msg->data;
 
         // Clear any stale TCP keepalive records that may exist
         ClearKeepaliveProxyRecords(m, &owner, m->DuplicateRecords, InterfaceID);
@@ -10327,7 +10996,7 @@ mDNSlocal void mDNSCoreReceiveUpdate(mDNS *const m,
 
         for (i = 0; i < msg->h.mDNS_numUpdates && ptr && ptr < end; i++)
         {
-            ptr = GetLargeResourceRecord(m, msg, ptr, end, InterfaceID, kDNSRecordTypePacketAuth, &m->rec);
+            ptr = GetViewRecord(m, view, msg->h.mDNS_numPrereqs + i, InterfaceID, kDNSRecordTypePacketAuth, &m->rec);
             if (ptr && m->rec.r.resrec.RecordType != kDNSRecordTypePacketNegative)
             {
                 mDNSu16 RDLengthMem = GetRDLengthMem(&m->rec.r.resrec);
@@ -10554,13 +11223,15 @@ mDNSexport void mDNSCoreReceiveForQuerier(mDNS *const m, DNSMessage *const msg,
     SwapDNSHeaderBytes(msg);
     mDNS_Lock(m);
     mDNSCoreReceiveResponse(m, msg, end, mDNSNULL, zeroIPPort, mDNSNULL, zeroIPPort, querier, dnsservice, mDNSNULL);
+    m->rxview.msg = mDNSNULL;
     mDNS_Unlock(m);
 }
 #endif
 
-mDNSexport void mDNSCoreReceive(mDNS *const m, DNSMessage *const msg, const mDNSu8 *const end,
-                                const mDNSAddr *const srcaddr, const mDNSIPPort srcport, const mDNSAddr *dstaddr, const mDNSIPPort dstport,
-                                const mDNSInterfaceID InterfaceID)
+// view is the caller's DNSMessageView of msg, or NULL to have GetMessageView() parse it when it's needed
+mDNSlocal void ReceiveMessage(mDNS *const m, DNSMessage *const msg, const mDNSu8 *const end, DNSMessageView *const view,
+                              const mDNSAddr *const srcaddr, const mDNSIPPort srcport, const mDNSAddr *dstaddr, const mDNSIPPort dstport,
+                              const mDNSInterfaceID InterfaceID)
 {
     mDNSInterfaceID ifid = InterfaceID;
     const mDNSu8 *const pkt = (mDNSu8 *)msg;
@@ -10620,6 +11291,7 @@ mDNSexport void mDNSCoreReceive(mDNS *const m, DNSMessage *const msg, const mDNS
     if (!mDNSAddressIsValid(srcaddr)) { debugf("mDNSCoreReceive ignoring packet from %#a", srcaddr); return; }
 
     mDNS_Lock(m);
+    m->rxparsed = view;
     m->PktNum++;
     if (mDNSOpaque16IsZero(msg->h.id))
     {
@@ -10675,6 +11347,8 @@ mDNSexport void mDNSCoreReceive(mDNS *const m, DNSMessage *const msg, const mDNS
             }
         }
     }
+    m->rxview.msg = mDNSNULL;   // The buffer may hold another message next time
+    m->rxparsed   = mDNSNULL;
     // Packet reception often causes a change to the task list:
     // 1. Inbound queries can cause us to need to send responses
     // 2. Conflicing response packets received from other hosts can cause us to need to send defensive responses
@@ -10683,6 +11357,22 @@ mDNSexport void mDNSCoreReceive(mDNS *const m, DNSMessage *const msg, const mDNS
     mDNS_Unlock(m);
 }
 
+mDNSexport void mDNSCoreReceive(mDNS *const m, DNSMessage *const msg, const mDNSu8 *const end,
+                                const mDNSAddr *const srcaddr, const mDNSIPPort srcport, const mDNSAddr *dstaddr, const mDNSIPPort dstport,
+                                const mDNSInterfaceID InterfaceID)
+{
+    ReceiveMessage(m, msg, end, mDNSNULL, srcaddr, srcport, dstaddr, dstport, InterfaceID);
+}
+
+// The platform layer has already parsed msg, perhaps on another thread, with ParseReceivedDNSMessage(). The core
+// uses that view instead of parsing msg again, so all that's left to do here is act on it.
+mDNSexport void mDNSCoreReceiveParsed(mDNS *const m, DNSMessage *const msg, const mDNSu8 *const end, DNSMessageView *const view,
+                                      const mDNSAddr *const srcaddr, const mDNSIPPort srcport,
+                                      const mDNSAddr *dstaddr, const mDNSIPPort dstport, const mDNSInterfaceID InterfaceID)
+{
+    ReceiveMessage(m, msg, end, view, srcaddr, srcport, dstaddr, dstport, InterfaceID);
+}
+
 // ***************************************************************************
 #if COMPILER_LIKES_PRAGMA_MARK
 #pragma mark -
@@ -10718,8 +11408,8 @@ mDNSlocal DNSQuestion *FindDuplicateQuestion(const mDNS *const m, const DNSQuest
     // Note: A question can only be marked as a duplicate of one that occurs *earlier* in the list.
     // This prevents circular references, where two questions are each marked as a duplicate of the other.
     // Accordingly, we break out of the loop when we get to 'question', because there's no point searching
-    // further in the list.
-    for (q = m->Questions; q && (q != question); q = q->next)
+    // further in the list. Duplicates have the same name, so only the questions with this qnamehash are checked.
+    for (q = FirstQuestionForNameHash(m, question->qnamehash); q && (q != question); q = NextQuestionForNameHash(q))
     {
         if (!SameQuestionKind(q, question))                             continue;
         if (q->qnamehash          != question->qnamehash)               continue;
@@ -10758,8 +11448,9 @@ mDNSlocal void UpdateQuestionDuplicates(mDNS *const m, DNSQuestion *const questi
         return;
     }
 
-    for (q = m->Questions; q; q=q->next)        // Scan our list of questions
-        if (q->DuplicateOf == question)         // To see if any questions were referencing this as their duplicate
+    // Scan the questions with the same name to see if any were referencing this as their duplicate
+    for (q = FirstQuestionForNameHash(m, question->qnamehash); q; q = NextQuestionForNameHash(q))
+        if (q->DuplicateOf == question)
         {
             q->DuplicateOf = first;
             if (!first)
@@ -10796,6 +11487,9 @@ mDNSlocal void UpdateQuestionDuplicates(mDNS *const m, DNSQuestion *const questi
 #if !MDNSRESPONDER_SUPPORTS(APPLE, QUERIER)
                 q->LocalSocket       = question->LocalSocket;
                 // No need to close old q->LocalSocket first -- duplicate questions can't have their own sockets
+                // A query waiting on a pooled TCP connection has the same QID, so the answer is q's now
+                q->tcpConn           = question->tcpConn;
+                q->tcpSrcPort        = question->tcpSrcPort;
 #endif
 
                 q->state             = question->state;
@@ -10807,6 +11501,7 @@ mDNSlocal void UpdateQuestionDuplicates(mDNS *const m, DNSQuestion *const questi
 
 #if !MDNSRESPONDER_SUPPORTS(APPLE, QUERIER)
                 question->LocalSocket = mDNSNULL;
+                question->tcpConn    = mDNSNULL;
 #endif
                 question->nta        = mDNSNULL;    // If we've got a GetZoneData in progress, transfer it to the newly active question
                 //  question->tcp        = mDNSNULL;
@@ -11046,73 +11741,172 @@ mDNSlocal mDNSBool DNSServerMatch(DNSServer *d, mDNSInterfaceID InterfaceID, mDN
     return mDNSfalse;
 }
 
+#define MAX_DOMAIN_LABELS (MAX_DOMAIN_NAME / 2)  // Every label takes at least two bytes
+
+mDNSlocal mDNSu32 DomainLabelHashValue(const domainlabel *const label)
+{
+    mDNSu32 sum = 0;
+    int i;
+    for (i = 1; i <= label->c[0]; i++)
+    {
+        const mDNSu8 c = label->c[i];
+        sum = (sum << 5) - sum + (mDNSIsUpperCase(c) ? c + 'a' - 'A' : c);
+    }
+    return(sum);
+}
+
+mDNSlocal void FreeDNSServerTrie(DNSServerTrieNode *node)
+{
+    while (node)
+    {
+        DNSServerTrieNode *const next = node->sibling;
+        FreeDNSServerTrie(node->children);
+        mDNSPlatformMemFree(node);
+        node = next;
+    }
+}
+
+mDNSlocal DNSServerTrieNode *DNSServerTrieChild(const DNSServerTrieNode *const node, const domainlabel *const label, mDNSu32 labelhash)
+{
+    DNSServerTrieNode *child;
+    for (child = node->children; child; child = child->sibling)
+        if (child->labelhash == labelhash && SameDomainLabel(child->label.c, label->c)) break;
+    return(child);
+}
+
+// Sets *labels to the start of each of name's labels, and returns how many there are
+mDNSlocal int GetDomainLabels(const domainname *const name, const domainlabel **labels)
+{
+    const mDNSu8 *ptr = name->c;
+    int count = 0;
+    while (*ptr && count < MAX_DOMAIN_LABELS)
+    {
+        labels[count++] = (const domainlabel *)ptr;
+        ptr += 1 + *ptr;
+    }
+    return(count);
+}
+
+mDNSlocal void BuildDNSServerTrie(mDNS *const m)
+{
+    DNSServer *curr;
+    int index = 0;
+
+    FreeDNSServerTrie(m->DNSServerTrie);
+    m->DNSServerTrieStale = mDNSfalse;
+    m->DNSServerTrie = (DNSServerTrieNode *)mDNSPlatformMemAllocateClear(sizeof(*m->DNSServerTrie));
+    if (!m->DNSServerTrie) { LogMsg("BuildDNSServerTrie: ERROR!! - malloc"); m->DNSServerTrieStale = mDNStrue; return; }
+
+    for (curr = m->DNSServers; curr; curr = curr->next)
+    {
+        const domainlabel *labels[MAX_DOMAIN_LABELS];
+        DNSServerTrieNode *node = m->DNSServerTrie;
+        DNSServer **p;
+        int i;
+
+        curr->nextInDomain = mDNSNULL;
+        curr->index = -1;
+        // Servers that will soon be deleted aren't numbered, so that the numbering doesn't change when they go
+        if (curr->flags & DNSServerFlag_Delete) continue;
+        curr->index = index++;
+
+        for (i = GetDomainLabels(&curr->domain, labels) - 1; i >= 0; i--)
+        {
+            const mDNSu32 labelhash = DomainLabelHashValue(labels[i]);
+            DNSServerTrieNode *child = DNSServerTrieChild(node, labels[i], labelhash);
+            if (!child)
+            {
+                child = (DNSServerTrieNode *)mDNSPlatformMemAllocateClear(sizeof(*child));
+                if (!child) { LogMsg("BuildDNSServerTrie: ERROR!! - malloc"); m->DNSServerTrieStale = mDNStrue; return; }
+                child->labelhash = labelhash;
+                mDNSPlatformMemCopy(&child->label, labels[i], 1 + labels[i]->c[0]);
+                child->sibling = node->children;
+                node->children = child;
+            }
+            node = child;
+        }
+        for (p = &node->servers; *p; p = &(*p)->nextInDomain) {}
+        *p = curr;
+    }
+}
+
+// Fills in path with the trie nodes for each domain that name ends in, from the root down, and returns how many
+// there are. Only the nodes that have servers are interesting, but the intermediate ones are cheap to include.
+mDNSlocal int DNSServerTriePath(mDNS *const m, const domainname *const name, DNSServerTrieNode **path)
+{
+    const domainlabel *labels[MAX_DOMAIN_LABELS];
+    DNSServerTrieNode *node;
+    int depth = 0, i;
+
+    if (m->DNSServerTrieStale || !m->DNSServerTrie) BuildDNSServerTrie(m);
+    node = m->DNSServerTrie;
+    if (!node) return(0);
+
+    path[depth++] = node;
+    for (i = name ? GetDomainLabels(name, labels) - 1 : -1; i >= 0; i--)
+    {
+        node = DNSServerTrieChild(node, labels[i], DomainLabelHashValue(labels[i]));
+        if (!node) break;
+        path[depth++] = node;
+    }
+    return(depth);
+}
+
 // Sets all the Valid DNS servers for a question
 mDNSexport mDNSu32 SetValidDNSServers(mDNS *m, DNSQuestion *question)
 {
-    int bestmatchlen = -1, namecount = CountLabels(&question->qname);
+    DNSServerTrieNode *path[MAX_DOMAIN_LABELS + 1];
+    int depth = DNSServerTriePath(m, &question->qname, path);
     DNSServer *curr;
-    int bettermatch, currcount;
-    int index = 0;
     mDNSu32 timeout = 0;
     mDNSBool DEQuery;
+    mDNSBool found = mDNSfalse;
 
     question->validDNSServers = zeroOpaque128;
     DEQuery = DomainEnumQuery(&question->qname);
-    for (curr = m->DNSServers; curr; curr = curr->next)
-    {
-        debugf("SetValidDNSServers: Parsing DNS server Address %#a (Domain %##s), Scope: %d", &curr->addr, curr->domain.c, curr->scopeType);
-        // skip servers that will soon be deleted
-        if (curr->flags & DNSServerFlag_Delete)
-        {
-            debugf("SetValidDNSServers: Delete set for index %d, DNS server %#a (Domain %##s), scoped %d", index, &curr->addr, curr->domain.c, curr->scopeType);
-            continue;
-        }
 
-        // This happens normally when you unplug the interface where we reset the interfaceID to mDNSInterface_Any for all
-        // the DNS servers whose scope match the interfaceID. Few seconds later, we also receive the updated DNS configuration.
-        // But any questions that has mDNSInterface_Any scope that are started/restarted before we receive the update
-        // (e.g., CheckSuppressUnusableQuestions is called when interfaces are deregistered with the core) should not
-        // match the scoped entries by mistake.
-        //
-        // Note: DNS configuration change will help pick the new dns servers but currently it does not affect the timeout
+    // Forget any race in progress; the servers it went to may be about to be freed
+    question->RaceCount    = 0;
+    question->RaceWinner   = 0;
+    question->RaceNextTime = 0;
 
-        // Skip DNSServers that are InterfaceID Scoped but have no valid interfaceid set OR DNSServers that are ServiceID Scoped but have no valid serviceid set
-        if (((curr->scopeType == kScopeInterfaceID) && (curr->interface == mDNSInterface_Any)) ||
-            ((curr->scopeType == kScopeServiceID) && (curr->serviceID <= 0)))
+    // The servers for the longest domain that the name ends in, and that have any servers the question can use, are
+    // all equally good matches; set the bits for all of them
+    while (depth > 0 && !found)
+    {
+        for (curr = path[--depth]->servers; curr; curr = curr->nextInDomain)
         {
-            LogInfo("SetValidDNSServers: ScopeType[%d] Skipping DNS server %#a (Domain %##s) Interface:[%p] Serviceid:[%d]",
-                (int)curr->scopeType, &curr->addr, curr->domain.c, curr->interface, curr->serviceID);
-            continue;
-        }
+            debugf("SetValidDNSServers: Parsing DNS server Address %#a (Domain %##s), Scope: %d", &curr->addr, curr->domain.c, curr->scopeType);
 
-        currcount = CountLabels(&curr->domain);
-        if ((!DEQuery || !curr->isCell) && DNSServerMatch(curr, question->InterfaceID, question->ServiceID))
-        {
-            bettermatch = BetterMatchForName(&question->qname, namecount, &curr->domain, currcount, bestmatchlen);
+            // This happens normally when you unplug the interface where we reset the interfaceID to mDNSInterface_Any for all
+            // the DNS servers whose scope match the interfaceID. Few seconds later, we also receive the updated DNS configuration.
+            // But any questions that has mDNSInterface_Any scope that are started/restarted before we receive the update
+            // (e.g., CheckSuppressUnusableQuestions is called when interfaces are deregistered with the core) should not
+            // match the scoped entries by mistake.
+            //
+            // Note: DNS configuration change will help pick the new dns servers but currently it does not affect the timeout
 
-            // If we found a better match (bettermatch == 1) then clear all the bits
-            // corresponding to the old DNSServers that we have may set before and start fresh.
-            // If we find an equal match, then include that DNSServer also by setting the corresponding
-            // bit
-            if ((bettermatch == 1) || (bettermatch == 0))
+            // Skip DNSServers that are InterfaceID Scoped but have no valid interfaceid set OR DNSServers that are ServiceID Scoped but have no valid serviceid set
+            if (((curr->scopeType == kScopeInterfaceID) && (curr->interface == mDNSInterface_Any)) ||
+                ((curr->scopeType == kScopeServiceID) && (curr->serviceID <= 0)))
+            {
+                LogInfo("SetValidDNSServers: ScopeType[%d] Skipping DNS server %#a (Domain %##s) Interface:[%p] Serviceid:[%d]",
+                    (int)curr->scopeType, &curr->addr, curr->domain.c, curr->interface, curr->serviceID);
+                continue;
+            }
+
+            if ((!DEQuery || !curr->isCell) && DNSServerMatch(curr, question->InterfaceID, question->ServiceID))
             {
-                bestmatchlen = currcount;
-                if (bettermatch)
-                {
-                    debugf("SetValidDNSServers: Resetting all the bits");
-                    question->validDNSServers = zeroOpaque128;
-                    timeout = 0;
-                }
                 debugf("SetValidDNSServers: question %##s Setting the bit for DNS server Address %#a (Domain %##s), Scoped:%d index %d,"
-                       " Timeout %d, interface %p", question->qname.c, &curr->addr, curr->domain.c, curr->scopeType, index, curr->timeout,
+                       " Timeout %d, interface %p", question->qname.c, &curr->addr, curr->domain.c, curr->scopeType, curr->index, curr->timeout,
                        curr->interface);
                 timeout += curr->timeout;
                 if (DEQuery)
                     debugf("DomainEnumQuery: Question %##s, DNSServer %#a, cell %d", question->qname.c, &curr->addr, curr->isCell);
-                bit_set_opaque128(question->validDNSServers, index);
+                bit_set_opaque128(question->validDNSServers, curr->index);
+                found = mDNStrue;
             }
         }
-        index++;
     }
     question->noServerResponse = 0;
 
@@ -11125,76 +11919,52 @@ mDNSexport mDNSu32 SetValidDNSServers(mDNS *m, DNSQuestion *question)
 // Get the Best server that matches a name. If you find penalized servers, look for the one
 // that will come out of the penalty box soon
 mDNSlocal DNSServer *GetBestServer(mDNS *m, const domainname *name, mDNSInterfaceID InterfaceID, mDNSs32 ServiceID, mDNSOpaque128 validBits,
-    int *selected, mDNSBool nameMatch)
+    int *selected)
 {
+    DNSServerTrieNode *path[MAX_DOMAIN_LABELS + 1];
+    int depth = DNSServerTriePath(m, name, path);
     DNSServer *curmatch = mDNSNULL;
-    int bestmatchlen = -1, namecount = name ? CountLabels(name) : 0;
     DNSServer *curr;
     mDNSs32 bestPenaltyTime, currPenaltyTime;
-    int bettermatch, currcount;
-    int index = 0;
-    int currindex = -1;
 
     debugf("GetBestServer: ValidDNSServer bits  0x%x%x", validBits.l[1], validBits.l[0]);
     bestPenaltyTime = DNSSERVER_PENALTY_TIME + 1;
-    for (curr = m->DNSServers; curr; curr = curr->next)
-    {
-        // skip servers that will soon be deleted
-        if (curr->flags & DNSServerFlag_Delete)
-        {
-            debugf("GetBestServer: Delete set for index %d, DNS server %#a (Domain %##s), scoped %d", index, &curr->addr, curr->domain.c, curr->scopeType);
-            continue;
-        }
-
-        // Check if this is a valid DNSServer
-        if (!bit_get_opaque64(validBits, index))
-        {
-            debugf("GetBestServer: continuing for index %d", index);
-            index++;
-            continue;
-        }
-
-        currcount = CountLabels(&curr->domain);
-        currPenaltyTime = PenaltyTimeForServer(m, curr);
-
-        debugf("GetBestServer: Address %#a (Domain %##s), PenaltyTime(abs) %d, PenaltyTime(rel) %d",
-               &curr->addr, curr->domain.c, curr->penaltyTime, currPenaltyTime);
 
-        // If there are multiple best servers for a given question, we will pick the first one
-        // if none of them are penalized. If some of them are penalized in that list, we pick
-        // the least penalized one. BetterMatchForName walks through all best matches and
-        // "currPenaltyTime < bestPenaltyTime" check lets us either pick the first best server
-        // in the list when there are no penalized servers and least one among them
-        // when there are some penalized servers.
-
-        if (DNSServerMatch(curr, InterfaceID, ServiceID))
+    // The best servers are those for the longest domain that the name ends in, and that have any valid servers.
+    // SetValidDNSServers only sets the bits for the servers of one domain, so for a question this is the same as
+    // considering every valid server.
+    while (depth > 0 && !curmatch)
+    {
+        for (curr = path[--depth]->servers; curr; curr = curr->nextInDomain)
         {
+            // Check if this is a valid DNSServer
+            if (!bit_get_opaque64(validBits, curr->index))
+            {
+                debugf("GetBestServer: continuing for index %d", curr->index);
+                continue;
+            }
 
-            // If we know that all the names are already equally good matches, then skip calling BetterMatchForName.
-            // This happens when we initially walk all the DNS servers and set the validity bit on the question.
-            // Actually we just need PenaltyTime match, but for the sake of readability we just skip the expensive
-            // part and still do some redundant steps e.g., InterfaceID match
-
-            if (nameMatch)
-                bettermatch = BetterMatchForName(name, namecount, &curr->domain, currcount, bestmatchlen);
-            else
-                bettermatch = 0;
+            currPenaltyTime = PenaltyTimeForServer(m, curr);
 
-            // If we found a better match (bettermatch == 1) then we don't need to
-            // compare penalty times. But if we found an equal match, then we compare
-            // the penalty times to pick a better match
+            debugf("GetBestServer: Address %#a (Domain %##s), PenaltyTime(abs) %d, PenaltyTime(rel) %d",
+                   &curr->addr, curr->domain.c, curr->penaltyTime, currPenaltyTime);
 
-            if ((bettermatch == 1) || ((bettermatch == 0) && currPenaltyTime < bestPenaltyTime))
+            // If there are multiple best servers for a given question, we will pick the first one
+            // if none of them are penalized. If some of them are penalized in that list, we pick
+            // the least penalized one. The "currPenaltyTime < bestPenaltyTime" check lets us either
+            // pick the first best server in the list when there are no penalized servers and least
+            // one among them when there are some penalized servers. When racing, the one that has
+            // been answering fastest goes first among equally penalized servers.
+            if (DNSServerMatch(curr, InterfaceID, ServiceID) &&
+                (currPenaltyTime < bestPenaltyTime ||
+                 (UnicastRaceServers > 1 && curmatch && currPenaltyTime == bestPenaltyTime && curr->srtt < curmatch->srtt)))
             {
-                currindex = index;
                 curmatch = curr;
-                bestmatchlen = currcount;
                 bestPenaltyTime = currPenaltyTime;
             }
         }
-        index++;
     }
-    if (selected) *selected = currindex;
+    if (selected) *selected = curmatch ? curmatch->index : -1;
     return curmatch;
 }
 
@@ -11213,7 +11983,7 @@ mDNSlocal DNSServer *GetServerForName(mDNS *m, const domainname *name, mDNSInter
     // By passing in all ones, we make sure that every DNS server is considered
     allValid.l[0] = allValid.l[1] = allValid.l[2] = allValid.l[3] = 0xFFFFFFFF;
 
-    curmatch = GetBestServer(m, name, InterfaceID, ServiceID, allValid, mDNSNULL, mDNStrue);
+    curmatch = GetBestServer(m, name, InterfaceID, ServiceID, allValid, mDNSNULL);
 
     if (curmatch != mDNSNULL)
         LogInfo("GetServerForName: DNS server %#a:%d (Penalty Time Left %d) (Scope %s:%p) for %##s", &curmatch->addr,
@@ -11242,7 +12012,7 @@ mDNSexport DNSServer *GetServerForQuestion(mDNS *m, DNSQuestion *question)
 
     if (!mDNSOpaque128IsZero(&question->validDNSServers))
     {
-        curmatch = GetBestServer(m, name, InterfaceID, question->ServiceID, question->validDNSServers, &currindex, mDNSfalse);
+        curmatch = GetBestServer(m, name, InterfaceID, question->ServiceID, question->validDNSServers, &currindex);
         if (currindex != -1)
             bit_clr_opaque128(question->validDNSServers, currindex);
     }
@@ -11695,6 +12465,9 @@ mDNSlocal void InitDNSConfig(mDNS *const m, DNSQuestion *const question)
     question->validDNSServers     = zeroOpaque128;
     question->triedAllServersOnce = mDNSfalse;
     question->noServerResponse    = mDNSfalse;
+    question->RaceCount           = 0;
+    question->RaceWinner          = 0;
+    question->RaceNextTime        = 0;
 #endif
     question->StopTime            = (question->TimeoutQuestion) ? question->StopTime : 0;
 #if MDNSRESPONDER_SUPPORTS(APPLE, METRICS)
@@ -11783,6 +12556,7 @@ mDNSlocal void InitCommonState(mDNS *const m, DNSQuestion *const question)
     question->LastAnswerPktNum  = m->PktNum;
     question->RecentAnswerPkts  = 0;
     question->CurrentAnswers    = 0;
+    question->MetricsStartTime  = NonZeroTime(m->timenow);
 
 #if APPLE_OSX_mDNSResponder
 
@@ -11897,6 +12671,9 @@ mDNSlocal void InitWABState(DNSQuestion *const question)
     question->servAddr          = zeroAddr;
     question->servPort          = zeroIPPort;
     question->tcp               = mDNSNULL;
+#if !MDNSRESPONDER_SUPPORTS(APPLE, QUERIER)
+    question->tcpConn           = mDNSNULL;
+#endif
     question->NoAnswer          = NoAnswer_Normal;
 }
 
@@ -12032,6 +12809,12 @@ mDNSexport mStatus mDNS_StartQuery_internal(mDNS *const m, DNSQuestion *const qu
         return(mStatus_AlreadyRegistered);
     }
     *q = question;
+    if (!LocalOnlyOrP2PInterface(question->InterfaceID))
+    {
+        question->qnamehash = DomainNameHashValue(&question->qname);
+        question->InNewQuestions = mDNStrue;
+        QuestionHashInsert(m, question);
+    }
 
     // Intialize the question. The only ordering constraint we have today is that
     // InitDNSSECProxyState should be called after the DNS server is selected (in
@@ -12097,6 +12880,8 @@ mDNSexport mStatus mDNS_StartQuery_internal(mDNS *const m, DNSQuestion *const qu
         }
     }
 
+    mDNSMetricsAdd(mDNS_Metrics.QuestionsStarted, 1);
+    mDNSMetricsAdd(mDNS_Metrics.QuestionsActive, 1);
     return(mStatus_NoError);
 }
 
@@ -12127,7 +12912,11 @@ mDNSexport mStatus mDNS_StopQuery_internal(mDNS *const m, DNSQuestion *const que
     if (LocalOnlyOrP2PInterface(question->InterfaceID))
         qp = &m->LocalOnlyQuestions;
     while (*qp && *qp != question) qp=&(*qp)->next;
-    if (*qp) *qp = (*qp)->next;
+    if (*qp)
+    {
+        *qp = (*qp)->next;
+        if (!LocalOnlyOrP2PInterface(question->InterfaceID)) QuestionHashRemove(m, question);
+    }
     else
     {
 #if !ForceAlerts
@@ -12136,6 +12925,7 @@ mDNSexport mStatus mDNS_StopQuery_internal(mDNS *const m, DNSQuestion *const que
         LogFatalError("mDNS_StopQuery_internal: Question %##s (%s) not found in active list", question->qname.c, DNSTypeName(question->qtype));
         return(mStatus_BadReferenceErr);
     }
+    mDNSMetricsAdd(mDNS_Metrics.QuestionsActive, -1);
 
 #if MDNSRESPONDER_SUPPORTS(APPLE, BONJOUR_ON_DEMAND)
     if (!LocalOnlyOrP2PInterface(question->InterfaceID) && mDNSOpaque16IsZero(question->TargetQID))
@@ -12194,7 +12984,7 @@ mDNSexport mStatus mDNS_StopQuery_internal(mDNS *const m, DNSQuestion *const que
             // CRActiveQuestion replacement. If there are no such questions, but there's at least one unsuppressed inactive
             // question that is answered by this cache record, then use an inactive one to not forgo generating RMV events
             // via CacheRecordRmv() when the cache record expires.
-            for (q = m->Questions; q && (q != m->NewQuestions); q = q->next)
+            for (q = FirstQuestionForNameHash(m, cr->resrec.namehash); q && !q->InNewQuestions; q = NextQuestionForNameHash(q))
             {
                 if (!q->DuplicateOf && !q->Suppressed && CacheRecordAnswersQuestion(cr, q))
                 {
@@ -12223,7 +13013,7 @@ mDNSexport mStatus mDNS_StopQuery_internal(mDNS *const m, DNSQuestion *const que
     {
         debugf("mDNS_StopQuery_internal: Just deleted the currently active question: %##s (%s)",
                question->qname.c, DNSTypeName(question->qtype));
-        m->CurrentQuestion = question->next;
+        m->CurrentQuestion = m->CurrentQuestionByName ? NextQuestionForNameHash(question) : question->next;
     }
 
     if (m->NewQuestions == question)
@@ -12244,6 +13034,8 @@ mDNSexport mStatus mDNS_StopQuery_internal(mDNS *const m, DNSQuestion *const que
 
     // Take care not to trash question->next until *after* we've updated m->CurrentQuestion and m->NewQuestions
     question->next = mDNSNULL;
+    question->NextInQHash = mDNSNULL;
+    question->InNewQuestions = mDNSfalse;
 
     // LogMsg("mDNS_StopQuery_internal: Question %##s (%s) removed", question->qname.c, DNSTypeName(question->qtype));
 
@@ -12253,6 +13045,9 @@ mDNSexport mStatus mDNS_StopQuery_internal(mDNS *const m, DNSQuestion *const que
     // invalid before we even use it. By making sure that we update m->CurrentQuestion and m->NewQuestions if necessary
     // *first*, then they're all ready to be updated a second time if necessary when we cancel our GetZoneData query.
     if (question->tcp) { DisposeTCPConn(question->tcp); question->tcp = mDNSNULL; }
+#if !MDNSRESPONDER_SUPPORTS(APPLE, QUERIER)
+    uDNS_CancelTCPQuery(m, question);
+#endif
     if (question->LocalSocket) { mDNSPlatformUDPClose(question->LocalSocket); question->LocalSocket = mDNSNULL; }
 #if MDNSRESPONDER_SUPPORTS(APPLE, QUERIER)
     Querier_HandleStoppedDNSQuestion(question);
@@ -14563,6 +15358,13 @@ mDNSlocal mStatus mDNS_InitStorage(mDNS *const m, mDNS_PlatformSupport *const p,
     m->LocalOnlyQuestions      = mDNSNULL;
     m->NewLocalOnlyQuestions   = mDNSNULL;
     m->RestartQuestion         = mDNSNULL;
+    mDNSPlatformMemZero(m->QuestionHash, sizeof(m->QuestionHash));
+    for (slot = 0; slot < QUESTION_HASH_SLOTS; slot++)
+    {
+        m->QuestionHashNextCheck[slot] = timenow + FutureTime;
+        m->QuestionHashNextQuery[slot] = timenow + FutureTime;
+    }
+    m->CurrentQuestionByName   = mDNSfalse;
     m->rrcache_size            = 0;
     m->rrcache_totalused       = 0;
     m->rrcache_active          = 0;
@@ -14573,7 +15375,12 @@ mDNSlocal mStatus mDNS_InitStorage(mDNS *const m, mDNS_PlatformSupport *const p,
     {
         m->rrcache_hash[slot]      = mDNSNULL;
         m->rrcache_nextcheck[slot] = timenow + FutureTime;;
+        m->rrcache_nextrefresh[slot] = timenow + FutureTime;
     }
+    mDNSPlatformMemZero(&m->rrcache_index, sizeof(m->rrcache_index));
+    mDNSPlatformMemZero(&m->rrcache_slab, sizeof(m->rrcache_slab));
+    mDNSPlatformMemZero(&m->rrcache_lru, sizeof(m->rrcache_lru));
+    m->rrcache_lru.tail = &m->rrcache_lru.head;
 
     mDNS_GrowCache_internal(m, rrcachestorage, rrcachesize);
     m->rrauth.rrauth_free            = mDNSNULL;
@@ -14595,6 +15402,8 @@ mDNSlocal mStatus mDNS_InitStorage(mDNS *const m, mDNS_PlatformSupport *const p,
     m->NewLocalRecords         = mDNSNULL;
     m->NewLocalOnlyRecords     = mDNSfalse;
     m->CurrentRecord           = mDNSNULL;
+    mDNSPlatformMemZero(m->RecordHash, sizeof(m->RecordHash));
+    m->CurrentRecordByName     = mDNSfalse;
     m->HostInterfaces          = mDNSNULL;
     m->ProbeFailTime           = 0;
     m->NumFailedProbes         = 0;
@@ -14606,6 +15415,8 @@ mDNSlocal mStatus mDNS_InitStorage(mDNS *const m, mDNS_PlatformSupport *const p,
 
 #if !MDNSRESPONDER_SUPPORTS(APPLE, QUERIER)
     m->DNSServers               = mDNSNULL;
+    m->DNSServerTrie            = mDNSNULL;
+    m->DNSServerTrieStale       = mDNStrue;
 #endif
 
     m->Router                   = zeroAddr;
@@ -14812,6 +15623,9 @@ mDNSlocal void SetConfigState(mDNS *const m, mDNSBool delete)
     DNSServer *ptr;
 #endif
 
+#if !MDNSRESPONDER_SUPPORTS(APPLE, QUERIER)
+    m->DNSServerTrieStale = mDNStrue;
+#endif
     if (delete)
     {
 #if !MDNSRESPONDER_SUPPORTS(APPLE, QUERIER)
@@ -15032,6 +15846,7 @@ mDNSexport mStatus uDNS_SetupDNSConfig(mDNS *const m)
 
         q->Suppressed = ShouldSuppressUnicastQuery(q, s);
         q->unansweredQueries = 0;
+        uDNS_CancelTCPQuery(m, q);
         q->TargetQID = mDNS_NewMessageID(m);
         if (!q->Suppressed) ActivateUnicastQuery(m, q, mDNStrue);
     }
@@ -15155,7 +15970,9 @@ mDNSexport mStatus uDNS_SetupDNSConfig(mDNS *const m)
             ptr = *p;
             *p = (*p)->next;
             LogInfo("uDNS_SetupDNSConfig: Deleting server %p %#a:%d (%##s)", ptr, &ptr->addr, mDNSVal16(ptr->port), ptr->domain.c);
+            uDNS_CloseTCPConns(m, ptr);
             mDNSPlatformMemFree(ptr);
+            m->DNSServerTrieStale = mDNStrue;
         }
         else
         {
@@ -15397,6 +16214,8 @@ mDNSexport void mDNS_FinalExit(mDNS *const m)
             ReleaseCacheGroup(m, &m->rrcache_hash[slot]);
         }
     }
+    CacheIndexFree(m);
+    CacheSlabFreeAll(m);
     debugf("mDNS_FinalExit: RR Cache was using %ld records, %lu active", rrcache_totalused, rrcache_active);
     if (rrcache_active != m->rrcache_active)
         LogMsg("*** ERROR *** rrcache_totalused %lu; rrcache_active %lu != m->rrcache_active %lu", rrcache_totalused, rrcache_active, m->rrcache_active);
@@ -15413,11 +16232,16 @@ mDNSexport void mDNS_FinalExit(mDNS *const m)
                 DNSServer* nextns = ns->next;
 
                 debugf("mDNS_FinalExit:  Deleting DNSServers %p %##s %#a:%u", ns, ns->domain.c, &ns->addr, mDNSVal16(ns->port));
+#if !MDNSRESPONDER_SUPPORTS(APPLE, QUERIER)
+                uDNS_CloseTCPConns(m, ns);
+#endif
                 mDNSPlatformMemFree(ns);
                 ns = nextns;
             }
             m->DNSServers = mDNSNULL;
         }
+        FreeDNSServerTrie(m->DNSServerTrie);
+        m->DNSServerTrie = mDNSNULL;
     }
 
     {
@@ -542,6 +542,48 @@ typedef struct
     mDNSu8 data[AbsoluteMaxDNSMessageData]; // 40 (IPv6) + 8 (UDP) + 12 (DNS header) + 8940 (data) = 9000
 } DNSMessage;
 
+// A received message is walked once, by ParseDNSMessage(), into a DNSMessageView that records where each question and
+// resource record starts. The receive path then goes straight to the entry it wants, instead of skipping from the
+// start of the message every time it needs a section, the OPT record, or the questions again. Entries are numbered
+// in message order: questions first, then answers, authorities and additionals. Messages with more than
+// kDNSMessageViewMaxEntries entries are indexed as far as they fit; the rest is found by skipping from there.
+//
+// Parsing a view needs nothing from the core, so a platform layer that reads datagrams on other threads can build it
+// there with ParseReceivedDNSMessage() and hand it in with mDNSCoreReceiveParsed(). That also decompresses the owner
+// names into space[], and unpacks the rdata of the common record types there with its length and hash, so that the
+// core only has to copy them. Whatever doesn't fit in space[] is left for the core to do as the entry is used.
+#define kDNSMessageViewMaxEntries 256
+#define kDNSMessageViewSpace      8192
+#define kDNSMessageViewNone       0xFFFF
+
+typedef struct
+{
+    const mDNSu8 *ptr;                      // Start of the question or record
+    mDNSu16 fixed;                          // Length of its owner name in the message: its type follows
+    mDNSu16 name;                           // Offset of its decompressed owner name in space[], or kDNSMessageViewNone
+    mDNSu32 namehash;                       // DomainNameHashValue() of that name
+    mDNSu16 rdata;                          // Offset of its unpacked rdata in space[], or kDNSMessageViewNone
+    mDNSu16 rdlength;                       // The rest are as SetNewRData() sets them, if rdata is set
+    mDNSu16 rdestimate;
+    mDNSu32 rdatahash;
+} DNSMessageViewEntry;
+
+typedef struct
+{
+    const DNSMessage *msg;                  // The message this is a view of, or NULL
+    const mDNSu8 *end;
+    mDNSu16 numQuestions;                   // The counts from the header, in host byte order
+    mDNSu16 numAnswers;
+    mDNSu16 numAuthorities;
+    mDNSu16 numAdditionals;
+    mDNSu32 total;                          // Questions and records the header says there are
+    mDNSu32 numEntries;                     // Entries indexed: stops at the first malformed one, or when entries[] is full
+    mDNSu32 walkIndex;                      // Entry beyond entries[] last found by skipping, which walk describes
+    DNSMessageViewEntry walk;
+    DNSMessageViewEntry entries[kDNSMessageViewMaxEntries];
+    mDNSu32 space[kDNSMessageViewSpace / sizeof(mDNSu32)];  // Names and rdata; mDNSu32 so that the rdata is aligned
+} DNSMessageView;
+
 typedef struct tcpInfo_t
 {
     mDNS             *m;
@@ -1251,6 +1293,11 @@ typedef mDNSu32 DNSServerFlags;
 #define DNSServerFlag_Unreachable   (1U << 1)
 #endif
 
+// Most servers a unicast question is sent to at once when UnicastRaceServers is set
+#define MAX_UNICAST_RACE 4
+
+typedef struct DNSTCPConn DNSTCPConn;
+
 typedef struct DNSServer
 {
     struct DNSServer *next;
@@ -1262,6 +1309,8 @@ typedef struct DNSServer
     ScopeType scopeType;        // See the ScopeType enum above
     mDNSu32 timeout;            // timeout value for questions
     mDNSu32 resGroupID;         // ID of the resolver group that contains this DNSServer
+    mDNSs32 srtt;               // Smoothed response time in ticks; 0 until the server has been timed
+    mDNSs32 rttvar;             // Mean deviation of the response time in ticks
     mDNSIPPort port;            // DNS server's port number.
     mDNSBool usableA;           // True if A query results are usable over the interface, i.e., interface has IPv4.
     mDNSBool usableAAAA;        // True if AAAA query results are usable over the interface, i.e., interface has IPv6.
@@ -1269,8 +1318,46 @@ typedef struct DNSServer
     mDNSBool isExpensive;       // True if the interface to this server is expensive.
     mDNSBool isConstrained;     // True if the interface to this server is constrained.
     mDNSBool isCLAT46;          // True if the interface to this server supports CLAT46.
+    int index;                  // Position among the servers not flagged for deletion; the bit in validDNSServers
+    struct DNSServer *nextInDomain; // Next server for the same domain, in list order (see DNSServerTrieNode)
+    DNSTCPConn *tcpConns;       // Open connections for queries that have to go over TCP
+    mDNSu32 tcpConnsOpened;     // TCP connections opened to this server
+    mDNSu32 tcpQueries;         // Queries sent to it over those connections
     domainname domain;          // name->server matching for "split dns"
 } DNSServer;
+
+// A persistent TCP connection to a unicast DNS server, shared by the questions whose answers didn't fit in a UDP
+// response (RFC 7766). Queries are pipelined: each one is written as soon as the connection is up, without
+// waiting for the answers to earlier ones, and answers are matched to questions by message ID in whatever
+// order they arrive. A connection with no queries outstanding is closed after DNS_TCP_IDLE_TIMEOUT.
+struct DNSTCPConn
+{
+    DNSTCPConn *next;           // Next connection to the same server
+    mDNS *m;
+    DNSServer *server;
+    TCPSocket *sock;
+    mDNSIPPort SrcPort;         // Our end of the connection; the tcpSrcPort of the questions that use it
+    mDNSBool connected;
+    mDNSu16 pending;            // Questions waiting for an answer on this connection
+    mDNSu32 replies;            // Answers read from it
+    mDNSs32 idleSince;          // When pending last dropped to zero
+    mDNSu16 replylen;
+    mDNSu32 nread;              // Bytes of the current answer read so far, including its two-byte length
+    DNSMessage *reply;
+};
+
+// The servers' domains, as a tree of labels read from the right, so that the servers for the longest domain
+// that a name ends in can be found by following the name's labels rather than by comparing it with every domain.
+// The root node is the root domain. Rebuilt from m->DNSServers when DNSServerTrieStale is set.
+typedef struct DNSServerTrieNode DNSServerTrieNode;
+struct DNSServerTrieNode
+{
+    DNSServerTrieNode *children;    // First child
+    DNSServerTrieNode *sibling;     // Next child of the same parent
+    DNSServer *servers;             // Servers for exactly this domain, linked through nextInDomain
+    mDNSu32 labelhash;              // Case-insensitive hash of label
+    domainlabel label;
+};
 #endif
 
 #define kNegativeRecordType_Unspecified 0 // Initializer of ResourceRecord didn't specify why the record is negative.
@@ -1428,6 +1515,7 @@ struct AuthRecord_struct
     mDNSs32 KATimeExpire;               // In platform time units: time to send keepalive packet for the proxy record
 
     // Field Group 3: Transient state for Authoritative Records
+    AuthRecord     *NextInRHash;        // Next record in the same m->RecordHash chain, in m->ResourceRecords order
     mDNSs32 ProbingConflictCount;       // Number of conflicting records observed during probing.
     mDNSs32 LastConflictPktNum;         // Number of the last received packet that caused a probing conflict.
     mDNSu8 Acknowledged;                // Set if we've given the success callback to the client
@@ -1445,6 +1533,7 @@ struct AuthRecord_struct
 #endif
     mDNSInterfaceID ImmedAdditional;    // Hint that we might want to also send this record, just to be helpful
     mDNSInterfaceID SendRNow;           // The interface this query is being sent on right now
+    AuthRecord     *NextSendR;          // Next record SendResponses has something to send for, in m->ResourceRecords order
     mDNSv4Addr v4Requester;             // Recent v4 query for this record, or all-ones if more than one recent query
     mDNSv6Addr v6Requester;             // Recent v6 query for this record, or all-ones if more than one recent query
     AuthRecord     *NextResponse;       // Link to the next element in the chain of responses to generate
@@ -1533,34 +1622,38 @@ typedef struct ARListElem
     AuthRecord ar;          // Note: Must be last element of structure, to accomodate oversized AuthRecords
 } ARListElem;
 
+// The fields that CheckCacheExpiration() and SendQueries() read for every record they walk come first, followed by
+// resrec, which starts with mortality and rroriginalttl. On 64-bit they all fall within the first 44 bytes, where they
+// used to be spread over the first 104. Fields only used when a record is received, answered from or logged follow,
+// and the rdata storage comes last.
 struct CacheRecord_struct
 {
     CacheRecord    *next;               // Next in list; first element of structure for efficiency reasons
-    ResourceRecord resrec;              // 36 bytes when compiling for 32-bit; 48 when compiling for 64-bit (now 44/64)
-
-    // Transient state for Cache Records
-    CacheRecord    *NextInKAList;       // Link to the next element in the chain of known answers to send
     mDNSs32 TimeRcvd;                   // In platform time units
-    mDNSs32 DelayDelivery;              // Set if we want to defer delivery of this answer to local clients
     mDNSs32 NextRequiredQuery;          // In platform time units
-#if MDNSRESPONDER_SUPPORTS(APPLE, CACHE_ANALYTICS)
-    mDNSs32 LastCachedAnswerTime;       // Last time this record was used as an answer from the cache (before a query)
-                                        // In platform time units
-#else
-    // Extra four bytes here (on 64bit)
-#endif
-    DNSQuestion    *CRActiveQuestion;   // Points to an active question referencing this answer. Can never point to a NewQuestion.
-    mDNSs32 LastUnansweredTime;         // In platform time units; last time we incremented UnansweredQueries
+    mDNSs32 DelayDelivery;              // Set if we want to defer delivery of this answer to local clients
     mDNSu8  UnansweredQueries;          // Number of times we've issued a query for this record without getting an answer
     mDNSOpaque16 responseFlags;         // Second 16 bit in the DNS response
+    DNSQuestion    *CRActiveQuestion;   // Points to an active question referencing this answer. Can never point to a NewQuestion.
+    ResourceRecord resrec;              // 36 bytes when compiling for 32-bit; 48 when compiling for 64-bit (now 44/64)
+
+    // Transient state for Cache Records
+    CacheRecord    *NextInKAList;       // Link to the next element in the chain of known answers to send
     CacheRecord    *NextInCFList;       // Set if this is in the list of records we just received with the cache flush bit set
+    CacheRecord    *NextInLRU;          // Next (more recently used) record in m->rrcache_lru
+    CacheRecord   **PrevInLRU;          // Whatever points to this record in m->rrcache_lru; mDNSNULL if not on the list
     CacheRecord    *soa;                // SOA record to return for proxy questions
 #if MDNSRESPONDER_SUPPORTS(APPLE, DNSSECv2)
     void *denial_of_existence_records;  // denial_of_existence_records_t
 #endif // MDNSRESPONDER_SUPPORTS(APPLE, DNSSECv2)
+    mDNSs32 LastUnansweredTime;         // In platform time units; last time we incremented UnansweredQueries
+#if MDNSRESPONDER_SUPPORTS(APPLE, CACHE_ANALYTICS)
+    mDNSs32 LastCachedAnswerTime;       // Last time this record was used as an answer from the cache (before a query)
+                                        // In platform time units
+#endif
 
     mDNSAddr sourceAddress;             // node from which we received this record
-    // Size to here is 76 bytes when compiling 32-bit; 104 bytes when compiling 64-bit (now 160 bytes for 64-bit)
+    // Size to here is 152 bytes when compiling for 64-bit
     RData_small smallrdatastorage;      // Storage for small records is right here (4 bytes header + 68 bytes data = 72 bytes)
 };
 
@@ -1736,6 +1829,14 @@ typedef mDNSu8 AllowExpiredState;
 #define HMAC_IPAD   0x36
 #define HMAC_OPAD   0x5c
 #define MD5_LEN     16
+#define SHA256_LEN  32
+
+// TSIG algorithms (RFC 8945) a DomainAuthInfo's key may be used with
+enum
+{
+    TSIG_Alg_HMAC_MD5    = 0,
+    TSIG_Alg_HMAC_SHA256 = 1
+};
 
 // Internal data structure to maintain authentication information
 typedef struct DomainAuthInfo
@@ -1746,9 +1847,10 @@ typedef struct DomainAuthInfo
     domainname keyname;
     domainname hostname;
     mDNSIPPort port;
-    char b64keydata[32];
-    mDNSu8 keydata_ipad[HMAC_LEN];              // padded key for inner hash rounds
-    mDNSu8 keydata_opad[HMAC_LEN];              // padded key for outer hash rounds
+    mDNSu8 algorithm;                       // TSIG_Alg_HMAC_MD5 unless set before calling mDNS_SetSecretForDomain
+    char b64keydata[48];
+    mDNSu32 keystate_ipad[8];               // hash state after the padded key for inner hash rounds
+    mDNSu32 keystate_opad[8];               // hash state after the padded key for outer hash rounds
 } DomainAuthInfo;
 
 // Note: Within an mDNSQuestionCallback mDNS all API calls are legal except mDNS_Init(), mDNS_Exit(), mDNS_Execute()
@@ -1834,6 +1936,8 @@ struct DNSQuestion_struct
     // Internal state fields. These are used internally by mDNSCore; the client layer needn't be concerned with them.
     DNSQuestion          *next;
     mDNSu32 qnamehash;
+    DNSQuestion          *NextInQHash;      // Next question in the same m->QuestionHash chain, in m->Questions order
+    mDNSBool InNewQuestions;                // Set from mDNS_StartQuery_internal until AnswerNewQuestion moves past it
     mDNSs32 DelayAnswering;                 // Set if we want to defer answering this question until the cache settles
     mDNSs32 LastQTime;                      // Last scheduled transmission of this Q on *all* applicable interfaces
     mDNSs32 ThisQInterval;                  // LastQTime + ThisQInterval is the next scheduled transmission of this Q
@@ -1855,6 +1959,8 @@ struct DNSQuestion_struct
     DNSQuestion          *NextInDQList;
     DupSuppressInfo DupSuppress[DupSuppressInfoSize];
     mDNSInterfaceID SendQNow;               // The interface this query is being sent on right now
+    DNSQuestion          *NextInSendList;   // Next question SendQueries is sending this time round
+    mDNSu32 QuestionSerial;                 // Increases along m->Questions, so SendQueries can put questions in list order
     mDNSBool SendOnAll;                     // Set if we're sending this question on all active interfaces
     mDNSBool CachedAnswerNeedsUpdate;       // See SendQueries().  Set if we're sending this question 
                                             // because a cached answer needs to be refreshed.
@@ -1867,6 +1973,7 @@ struct DNSQuestion_struct
     mDNSu8 WakeOnResolveCount;              // Number of wakes that should be sent on resolve
     mDNSBool InitialCacheMiss;              // True after the question cannot be answered from the cache
     mDNSs32 StopTime;                       // Time this question should be stopped by giving them a negative answer
+    mDNSs32 MetricsStartTime;               // When the question was started; zero once its first answer has been timed
 
     // Wide Area fields. These are used internally by the uDNS core (Unicast)
     UDPSocket            *LocalSocket;
@@ -1882,6 +1989,11 @@ struct DNSQuestion_struct
     mDNSu16 noServerResponse;               // At least one server did not respond.
     mDNSBool triedAllServersOnce;           // True if all DNS servers have been tried once.
     mDNSu8 unansweredQueries;               // The number of unanswered queries to this server
+    mDNSu8 RaceCount;                       // Servers the current query has gone to, qDNSServer first
+    mDNSu8 RaceWinner;                      // 1 + index in RaceServers of the server that answered first, or 0
+    mDNSs32 RaceNextTime;                   // When to send the query to one more server; 0 if not racing
+    DNSServer *RaceServers[MAX_UNICAST_RACE];
+    mDNSs32 RaceSendTime[MAX_UNICAST_RACE]; // When the query went to each of them; 0 once timed, or if it can't be
 #endif
     AllowExpiredState allowExpired;         // Allow expired answers state (see enum AllowExpired_None, etc. above)
 
@@ -1891,6 +2003,9 @@ struct DNSQuestion_struct
     struct tcpInfo_t *tcp;
     mDNSIPPort tcpSrcPort;                  // Local Port TCP packet received on;need this as tcp struct is disposed
                                             // by tcpCallback before calling into mDNSCoreReceive
+#if !MDNSRESPONDER_SUPPORTS(APPLE, QUERIER)
+    DNSTCPConn *tcpConn;                    // Pooled connection the query went out on, or is waiting to go out on
+#endif
     mDNSu8 NoAnswer;                        // Set if we want to suppress answers until tunnel setup has completed
 #if !MDNSRESPONDER_SUPPORTS(APPLE, QUERIER)
     mDNSBool Restart;                       // This question should be restarted soon.
@@ -2118,6 +2233,103 @@ typedef void mDNSCallback (mDNS *const m, mStatus result);
 #define CACHE_HASH_SLOTS 499
 #endif
 
+// Every question in m->Questions is also on one of QUESTION_HASH_SLOTS chains chosen by its qnamehash.
+// Each chain keeps the relative order of m->Questions, so code looking for the questions that a record
+// answers can walk just the questions with that name and still visit them in the usual order.
+// Each chain also has the deadlines SendQueries uses to skip the questions that aren't near their next query
+// (QuestionHashNextCheck[] and QuestionHashNextQuery[]).
+#ifndef QUESTION_HASH_SLOTS
+#define QUESTION_HASH_SLOTS 499
+#endif
+
+// Likewise every record in m->ResourceRecords is on one of RECORD_HASH_SLOTS chains chosen by its namehash,
+// so answering a query or checking a packet record for conflicts only looks at our records with that name.
+#ifndef RECORD_HASH_SLOTS
+#define RECORD_HASH_SLOTS 499
+#endif
+
+// The CACHE_HASH_SLOTS buckets are used to schedule and perform cache expiration checks (rrcache_nextcheck[])
+// and to find the records whose refresh queries are due (rrcache_nextrefresh[]).
+// Looking up a CacheGroup by name goes through a separate open-addressing index, which grows with the cache
+// so that probe sequences stay short no matter how many names are cached.
+#ifndef CACHE_INDEX_MIN_SLOTS
+#define CACHE_INDEX_MIN_SLOTS 512           // Initial index size; must be a power of two
+#endif
+#ifndef CACHE_INDEX_MIGRATE_STEP
+#define CACHE_INDEX_MIGRATE_STEP 256        // Old index slots moved to the new index per mDNS_Execute() call
+#endif
+
+typedef struct
+{
+    mDNSu32     namehash;
+    CacheGroup *cg;                         // mDNSNULL if the slot is empty
+} CacheIndexSlot;
+
+typedef struct
+{
+    CacheIndexSlot *slots;                  // Current table, linear probing, capacity is a power of two
+    mDNSu32 capacity;
+    mDNSu32 count;                          // Number of CacheGroups in slots
+    CacheIndexSlot *oldslots;               // Table being drained into slots after a resize, or mDNSNULL
+    mDNSu32 oldcapacity;
+    mDNSu32 oldcount;                       // Number of CacheGroups still in oldslots
+    mDNSu32 migrated;                       // Next oldslots entry to move
+    mDNSu32 lookups;                        // Statistics: lookups, total probes, longest probe sequence, resizes
+    mDNSu32 probes;                         // lookups and probes are halved together before probes would wrap
+    mDNSu32 maxprobe;
+    mDNSu32 resizes;
+} CacheIndex;
+
+// Out-of-line storage for cache records (rdata bigger than InlineCacheRDSize, and CacheGroup names too long for
+// namestorage) comes from per-size-class free lists, refilled a slab of CACHE_SLAB_SIZE bytes at a time.
+// Freed blocks go back on their class's free list rather than to the platform allocator, so steady-state cache churn
+// makes no mDNSPlatformMemAllocate()/mDNSPlatformMemFree() calls. Like the CacheEntity storage, slabs are kept until
+// mDNS_FinalExit(). Requests bigger than the largest class go straight to the platform allocator.
+#ifndef CACHE_SLAB_SIZE
+#define CACHE_SLAB_SIZE 8192
+#endif
+#define CACHE_SLAB_MIN_BLOCK 128            // Usable size of the smallest class; each class doubles the previous one
+#define CACHE_SLAB_CLASSES 5                // 128, 256, 512, 1024, 2048
+
+typedef struct CacheSlab_struct CacheSlab;
+struct CacheSlab_struct
+{
+    CacheSlab *next;
+};
+
+typedef struct
+{
+    void   *freelist;                       // Free blocks, linked through their first word
+    mDNSu32 inuse;                          // Blocks currently handed out
+    mDNSu32 free;                           // Blocks on freelist
+    mDNSu32 slabs;                          // Slabs carved up for this class
+} CacheSlabClass;
+
+typedef struct
+{
+    CacheSlab *slabs;                       // Every slab allocated, so mDNS_FinalExit() can release them
+    CacheSlabClass classes[CACHE_SLAB_CLASSES];
+    mDNSu32 allocs;                         // Statistics: allocations, those served from a free list,
+    mDNSu32 reused;                         // those too big for any class, and failures
+    mDNSu32 oversize;
+    mDNSu32 failures;
+} CacheSlabAllocator;
+
+// Every CacheRecord linked into a CacheGroup is also on m->rrcache_lru, least recently used first. A record moves to
+// the tail when it is added, refreshed, or delivered to a question. When the free list runs dry, GetCacheEntity()
+// evicts from the head instead of sweeping every bucket; records that still answer an active question, or that
+// are on the CacheFlushRecords list, get a second chance and are moved to the tail without being evicted.
+typedef struct
+{
+    CacheRecord  *head;                     // Least recently used
+    CacheRecord **tail;                     // Where the next record is appended
+    mDNSu32 count;                          // Records on the list
+    mDNSu32 hits;                           // Statistics: records moved to the tail on use, records evicted,
+    mDNSu32 evictions;                      // records given a second chance, and eviction attempts that
+    mDNSu32 secondchances;                  // found nothing to evict
+    mDNSu32 failures;
+} CacheLRU;
+
 enum
 {
     SleepState_Awake = 0,
@@ -2148,10 +2360,75 @@ typedef struct
     mDNSu32 CacheRefreshQueries;            // Number of queries that we sent for refreshing cache
     mDNSu32 CacheRefreshed;                 // Number of times the cache was refreshed due to a response
     mDNSu32 WakeOnResolves;                 // Number of times we did a wake on resolve
+    mDNSu32 RecvBatches;                    // Wakeups in which the platform layer read one or more datagrams in a batch
+    mDNSu32 RecvBatchPackets;               // Datagrams read in those batches
+    mDNSu32 RecvBatchMax;                   // Largest number of datagrams read in one batch
+    mDNSu32 SendBatches;                    // Batches of queued multicast datagrams flushed by the platform layer
+    mDNSu32 SendBatchPackets;               // Datagrams sent in those batches
+    mDNSu32 SendBatchMax;                   // Largest number of datagrams sent in one batch
 } mDNSStatistics;
 
 extern void LogMDNSStatisticsToFD(int fd, mDNS *const m);
 
+// Live metrics. Unlike mDNSStatistics these live outside the mDNS object and are updated with relaxed atomic
+// operations, so the platform layer's receive threads can count into them, and a reader can take them at any time
+// without the mDNS lock. Each value is read atomically, but a read of several of them isn't a consistent snapshot.
+// Histogram bucket 0 counts zero, bucket n counts values in [2^(n-1), 2^n), and the last bucket counts everything larger.
+#define mDNSMetricsHistogramBuckets 17
+#define mDNSMetricsMaxInterfaces    16      // Interfaces counted separately; packets on any others only count in the totals
+
+typedef struct
+{
+    mDNSu32 count;
+    mDNSu32 max;
+    mDNSu32 buckets[mDNSMetricsHistogramBuckets];
+} mDNSMetricsHistogram;
+
+typedef struct
+{
+    mDNSu32 ifindex;                        // Platform interface index this slot counts for; zero while unclaimed
+    mDNSu32 PacketsIn;
+    mDNSu32 PacketsOut;
+    mDNSu32 BytesIn;
+    mDNSu32 BytesOut;
+} mDNSMetricsInterface;
+
+typedef struct
+{
+    mDNSu32 PacketsIn;                      // Datagrams read by the platform layer, on any socket
+    mDNSu32 PacketsOut;                     // Datagrams sent by the platform layer
+    mDNSu32 BytesIn;
+    mDNSu32 BytesOut;
+    mDNSu32 QuestionsStarted;               // Questions started, including internal ones and restarts
+    mDNSu32 QuestionsActive;                // Gauge: questions currently started
+    mDNSu32 CacheHits;                      // New questions that found at least one answer in the cache
+    mDNSu32 CacheMisses;                    // New questions that found none
+    mDNSu32 CacheEvictions;                 // Cache records recycled to make room for new ones
+    mDNSu32 CacheEntities;                  // Gauge: cache records and groups in use
+    mDNSMetricsHistogram AnswerLatency;     // ms from starting a question until its first answer from the cache or network
+    mDNSMetricsInterface Interfaces[mDNSMetricsMaxInterfaces];
+} mDNSMetrics;
+
+extern mDNSMetrics mDNS_Metrics;
+
+#if defined(__GNUC__) || defined(__clang__)
+#define mDNSMetricsAdd(X, N)    ((void)__atomic_fetch_add(&(X), (mDNSu32)(N), __ATOMIC_RELAXED))
+#define mDNSMetricsSet(X, V)    __atomic_store_n(&(X), (mDNSu32)(V), __ATOMIC_RELAXED)
+#define mDNSMetricsGet(X)       __atomic_load_n(&(X), __ATOMIC_RELAXED)
+// Sets X to V if it is E and returns true; otherwise stores X's value in E and returns false
+#define mDNSMetricsCAS(X, E, V) __atomic_compare_exchange_n(&(X), &(E), (mDNSu32)(V), 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+#else
+// Without the atomic builtins the metrics must only be updated on the thread that runs the core
+#define mDNSMetricsAdd(X, N)    ((void)((X) += (mDNSu32)(N)))
+#define mDNSMetricsSet(X, V)    ((X) = (mDNSu32)(V))
+#define mDNSMetricsGet(X)       (X)
+#define mDNSMetricsCAS(X, E, V) ((X) == (E) ? ((X) = (mDNSu32)(V), mDNStrue) : ((E) = (X), mDNSfalse))
+#endif
+
+extern void mDNSMetricsHistogramAdd(mDNSMetricsHistogram *const h, const mDNSu32 value);
+extern void mDNSMetricsCountPacket(const mDNSu32 ifindex, const mDNSBool outgoing, const mDNSu32 bytes);
+extern mDNSu32 mDNSMetricsFormat(char *const buffer, const mDNSu32 buflen);
+
 // Time constant (~= 260 hours ~= 10 days and 21 hours) used to set
 // various time values to a point well into the future.
 #define FutureTime   0x38000000
@@ -2234,6 +2511,11 @@ struct mDNS_struct
     DNSQuestion *LocalOnlyQuestions;    // Questions with InterfaceID set to mDNSInterface_LocalOnly or mDNSInterface_P2P
     DNSQuestion *NewLocalOnlyQuestions; // Fresh local-only or P2P questions not yet answered
     DNSQuestion *RestartQuestion;       // Questions that are being restarted (stop followed by start)
+    DNSQuestion *QuestionHash[QUESTION_HASH_SLOTS]; // m->Questions chained by qnamehash
+    mDNSs32 QuestionHashNextCheck[QUESTION_HASH_SLOTS]; // Earliest time a multicast question on this chain is half-way to its next query
+    mDNSs32 QuestionHashNextQuery[QUESTION_HASH_SLOTS]; // Earliest time a multicast question on this chain is due to be sent
+    mDNSBool CurrentQuestionByName;     // m->CurrentQuestion is walking a QuestionHash chain rather than m->Questions
+    mDNSu32 NextQuestionSerial;         // QuestionSerial for the next question added to m->Questions
     mDNSu32 rrcache_size;               // Total number of available cache entries
     mDNSu32 rrcache_totalused;          // Number of cache entries currently occupied
     mDNSu32 rrcache_totalused_unicast;  // Number of cache entries currently occupied by unicast
@@ -2242,6 +2524,10 @@ struct mDNS_struct
     CacheEntity *rrcache_free;
     CacheGroup *rrcache_hash[CACHE_HASH_SLOTS];
     mDNSs32 rrcache_nextcheck[CACHE_HASH_SLOTS];
+    mDNSs32 rrcache_nextrefresh[CACHE_HASH_SLOTS];  // Earliest time a record in this slot is due a refresh query
+    CacheIndex rrcache_index;           // Name lookup index over all the CacheGroups in rrcache_hash
+    CacheSlabAllocator rrcache_slab;    // Storage for oversized rdata and long CacheGroup names
+    CacheLRU rrcache_lru;               // Eviction order of the CacheRecords in rrcache_hash
 
     AuthHash rrauth;
 
@@ -2264,6 +2550,8 @@ struct mDNS_struct
     AuthRecord *DuplicateRecords;       // Records currently 'on hold' because they are duplicates of existing records
     AuthRecord *NewLocalRecords;        // Fresh AuthRecords (public) not yet delivered to our local-only questions
     AuthRecord *CurrentRecord;          // Next AuthRecord about to be examined
+    AuthRecord *RecordHash[RECORD_HASH_SLOTS]; // m->ResourceRecords chained by namehash
+    mDNSBool CurrentRecordByName;       // m->CurrentRecord is walking a RecordHash chain rather than m->ResourceRecords
     mDNSBool NewLocalOnlyRecords;       // Fresh AuthRecords (local only) not yet delivered to our local questions
     NetworkInterfaceInfo *HostInterfaces;
     mDNSs32 ProbeFailTime;
@@ -2277,6 +2565,8 @@ struct mDNS_struct
 
 #if !MDNSRESPONDER_SUPPORTS(APPLE, QUERIER)
     DNSServer        *DNSServers;           // list of DNS servers
+    DNSServerTrieNode *DNSServerTrie;       // DNSServers by domain
+    mDNSBool          DNSServerTrieStale;   // Set whenever DNSServers, or the servers' delete flags, change
 #endif
     McastResolver    *McastResolvers;       // list of Mcast Resolvers
 
@@ -2372,6 +2662,8 @@ struct mDNS_struct
     union { DNSMessage m; void *p; } imsg;  // Incoming message received from wire
     DNSMessage omsg;                        // Outgoing message we're building
     LargeCacheRecord rec;                   // Resource Record extracted from received message
+    DNSMessageView rxview;                  // Index of the message mDNSCoreReceive() is processing; see GetMessageView()
+    DNSMessageView *rxparsed;               // Index mDNSCoreReceiveParsed() was given for it, if any
 
 #ifndef MaxMsg
     #define MaxMsg 512
@@ -2446,6 +2738,7 @@ extern const mDNSOpaque64 zeroOpaque64;
 extern const mDNSOpaque128 zeroOpaque128;
     
 extern mDNSBool StrictUnicastOrdering;
+extern mDNSu32 UnicastRaceServers;
 
 #define localdomain           (*(const domainname *)"\x5" "local")
 #define DeviceInfoName        (*(const domainname *)"\xC" "_device-info" "\x4" "_tcp")
@@ -2892,7 +3185,8 @@ extern mDNSBool mDNSAddrIPv4FromMappedIPv6(mDNSv6Addr *in, mDNSv4Addr *out);
 // mDNS_SetSecretForDomain tells the core to authenticate (via TSIG with an HMAC_MD5 hash of the shared secret)
 // when dynamically updating a given zone (and its subdomains).  The key used in authentication must be in
 // domain name format.  The shared secret must be a null-terminated base64 encoded string.  A minimum size of
-// 16 bytes (128 bits) is recommended for an MD5 hash as per RFC 2485.
+// 16 bytes (128 bits) is recommended for an MD5 hash as per RFC 2485.  To use HMAC_SHA256 instead, set
+// info->algorithm to TSIG_Alg_HMAC_SHA256 first; a 32 byte secret is then recommended as per RFC 8945.
 // Calling this routine multiple times for a zone replaces previously entered values.  Call with a NULL key
 // to disable authentication for the zone.  A non-NULL autoTunnelPrefix means this is an AutoTunnel domain,
 // and the value is prepended to the IPSec identifier (used for key lookup)
@@ -2938,7 +3232,7 @@ extern McastResolver *mDNS_AddMcastResolver(mDNS *const m, const domainname *d,
 
 // Routines called by the core, exported by DNSDigest.c
 
-// Convert an arbitrary base64 encoded key key into an HMAC key (stored in AuthInfo struct)
+// Convert an arbitrary base64 encoded key key into an HMAC key for info->algorithm (stored in AuthInfo struct)
 extern mDNSs32 DNSDigest_ConstructHMACKeyfromBase64(DomainAuthInfo *info, const char *b64key);
 
 // sign a DNS message.  The message must be complete, with all values in network byte order.  end points to the end
@@ -3186,6 +3480,7 @@ extern void     LNT_ClearState(mDNS *const m);
 // (on platforms like OT that allow asynchronous initialization of the networking stack).
 //
 // mDNSCoreReceive() is called when a UDP packet is received
+// mDNSCoreReceiveParsed() does the same for a packet the caller has already run through ParseReceivedDNSMessage()
 //
 // mDNSCoreMachineSleep() is called when the machine sleeps or wakes
 // (This refers to heavyweight laptop-style sleep/wake that disables network access,
@@ -3209,6 +3504,9 @@ extern void     mDNSCoreInitComplete(mDNS *const m, mStatus result);
 extern void     mDNSCoreReceive(mDNS *const m, DNSMessage *const msg, const mDNSu8 *const end,
                                 const mDNSAddr *const srcaddr, const mDNSIPPort srcport,
                                 const mDNSAddr *dstaddr, const mDNSIPPort dstport, const mDNSInterfaceID InterfaceID);
+extern void     mDNSCoreReceiveParsed(mDNS *const m, DNSMessage *const msg, const mDNSu8 *const end, DNSMessageView *const view,
+                                      const mDNSAddr *const srcaddr, const mDNSIPPort srcport,
+                                      const mDNSAddr *dstaddr, const mDNSIPPort dstport, const mDNSInterfaceID InterfaceID);
 #if MDNSRESPONDER_SUPPORTS(APPLE, QUERIER)
 extern void     mDNSCoreReceiveForQuerier(mDNS *m, DNSMessage *msg, const mDNSu8 *end, mdns_querier_t querier, mdns_dns_service_t service);
 #endif
@@ -3243,7 +3541,7 @@ extern void     mDNSCoreReceiveRawPacket  (mDNS *const m, const mDNSu8 *const p,
 extern mDNSBool mDNSAddrIsDNSMulticast(const mDNSAddr *ip);
 
 extern CacheRecord *CreateNewCacheEntry(mDNS *const m, const mDNSu32 slot, CacheGroup *cg, mDNSs32 delay, mDNSBool Add, const mDNSAddr *sourceAddress);
-extern CacheGroup *CacheGroupForName(const mDNS *const m, const mDNSu32 namehash, const domainname *const name);
+extern CacheGroup *CacheGroupForName(mDNS *const m, const mDNSu32 namehash, const domainname *const name);
 extern void ReleaseCacheRecord(mDNS *const m, CacheRecord *r);
 extern void ScheduleNextCacheCheckTime(mDNS *const m, const mDNSu32 slot, const mDNSs32 event);
 extern void SetNextCacheCheckTimeForRecord(mDNS *const m, CacheRecord *const rr);
@@ -3524,14 +3822,14 @@ struct CompileTimeAssertionChecks_mDNS
     char sizecheck_RDataBody           [(sizeof(RDataBody)            ==   264) ? 1 : -1];
     char sizecheck_ResourceRecord      [(sizeof(ResourceRecord)       <=    72) ? 1 : -1];
     char sizecheck_AuthRecord          [(sizeof(AuthRecord)           <=  1176) ? 1 : -1];
-    char sizecheck_CacheRecord         [(sizeof(CacheRecord)          <=   232) ? 1 : -1];
-    char sizecheck_CacheGroup          [(sizeof(CacheGroup)           <=   232) ? 1 : -1];
+    char sizecheck_CacheRecord         [(sizeof(CacheRecord)          <=   224) ? 1 : -1];
+    char sizecheck_CacheGroup          [(sizeof(CacheGroup)           <=   224) ? 1 : -1];
     char sizecheck_DNSQuestion         [(sizeof(DNSQuestion)          <=  1216) ? 1 : -1];
     char sizecheck_ZoneData            [(sizeof(ZoneData)             <=  2048) ? 1 : -1];
     char sizecheck_NATTraversalInfo    [(sizeof(NATTraversalInfo)     <=   200) ? 1 : -1];
     char sizecheck_HostnameInfo        [(sizeof(HostnameInfo)         <=  3050) ? 1 : -1];
 #if !MDNSRESPONDER_SUPPORTS(APPLE, QUERIER)
-    char sizecheck_DNSServer           [(sizeof(DNSServer)            <=   328) ? 1 : -1];
+    char sizecheck_DNSServer           [(sizeof(DNSServer)            <=   360) ? 1 : -1];
 #endif
     char sizecheck_NetworkInterfaceInfo[(sizeof(NetworkInterfaceInfo) <=  9000) ? 1 : -1];
     char sizecheck_ServiceRecordSet    [(sizeof(ServiceRecordSet)     <=  4760) ? 1 : -1];
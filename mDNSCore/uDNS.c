@@ -56,6 +56,10 @@ mDNSexport SearchListElem *SearchList = mDNSNULL;
 // The value can be set to true by the Platform code e.g., MacOSX uses the plist mechanism
 mDNSBool StrictUnicastOrdering = mDNSfalse;
 
+// Set by the Platform code to race each unicast query across up to this many equally good servers (see
+// SendUnicastRaceQuery). 0 or 1 sends each query to one server at a time.
+mDNSu32 UnicastRaceServers = 0;
+
 extern mDNS mDNSStorage;
 
 // We keep track of the number of unicast DNS servers and log a message when we exceed 64.
@@ -226,6 +230,7 @@ mDNSexport DNSServer *mDNS_AddDNSServer(mDNS *const m, const domainname *domain,
     }
     if (server)
     {
+        m->DNSServerTrieStale = mDNStrue;
         server->penaltyTime = 0;
         // We always update the ID (not just when we allocate a new instance) because we want
         // all the resGroupIDs for a particular domain to match.
@@ -367,6 +372,135 @@ end:
 
     }
 }
+
+// Folds one response time into the server's smoothed response time and its mean deviation, the same way TCP does
+// (RFC 6298): gains of 1/8 and 1/4, with the first sample setting the deviation to half of itself.
+mDNSlocal void UpdateDNSServerRTT(DNSServer *const server, mDNSs32 sample)
+{
+    if (sample < 1) sample = 1;     // So that a server that has been timed never looks untimed
+    if (!server->srtt)
+    {
+        server->srtt   = sample;
+        server->rttvar = sample / 2;
+    }
+    else
+    {
+        const mDNSs32 delta = (sample > server->srtt) ? sample - server->srtt : server->srtt - sample;
+        server->rttvar += (delta - server->rttvar) / 4;
+        server->srtt   += (sample - server->srtt) / 8;
+    }
+}
+
+mDNSexport mDNSs32 DNSServerRTO(const DNSServer *const server)
+{
+    mDNSs32 rto;
+
+    if (!server->srtt) return 0;
+    rto = server->srtt + ((4 * server->rttvar > 1) ? 4 * server->rttvar : 1);
+    if (rto < MIN_UCAST_RTO) rto = MIN_UCAST_RTO;
+    if (rto > MAX_UCAST_RTO) rto = MAX_UCAST_RTO;
+    return rto;
+}
+
+// Called each time uDNS_CheckCurrentQuestion sends q to q->qDNSServer. The answer to a retransmission isn't timed,
+// since we can't tell which transmission it answers.
+mDNSlocal void StartUnicastRace(mDNS *const m, DNSQuestion *const q, mDNSBool retransmission)
+{
+    q->RaceServers[0]  = q->qDNSServer;
+    q->RaceSendTime[0] = retransmission ? 0 : NonZeroTime(m->timenow);
+    q->RaceCount       = 1;
+    q->RaceWinner      = 0;
+    q->RaceNextTime    = (UnicastRaceServers > 1 && !q->LongLived) ? NonZeroTime(m->timenow + UNICAST_RACE_STAGGER) : 0;
+}
+
+// When racing, a query that has gone to q->qDNSServer also goes to the next best valid server every
+// UNICAST_RACE_STAGGER until one of them answers, to at most UnicastRaceServers servers in all. It is the same query
+// from the same socket, so whichever answer arrives first answers the question, and uDNS_UnicastRaceResponse drops the
+// later ones. Each server the query goes to uses up its bit in validDNSServers, just as if we had failed over to it,
+// so the usual retry and penalty logic carries on with the servers that are left.
+mDNSlocal void SendUnicastRaceQuery(mDNS *const m, DNSQuestion *const q)
+{
+    const mDNSu32 width = (UnicastRaceServers < MAX_UNICAST_RACE) ? UnicastRaceServers : MAX_UNICAST_RACE;
+    DNSServer *server;
+    DNSQuestion *qptr;
+    mDNSu8 *end;
+
+    q->RaceNextTime = 0;
+    if (q->RaceWinner || q->RaceCount >= width || !q->LocalSocket) return;
+
+    server = GetServerForQuestion(m, q);
+    if (!server) return;
+    for (qptr = q->next; qptr; qptr = qptr->next)
+        if (qptr->DuplicateOf == q) qptr->validDNSServers = q->validDNSServers;
+
+    InitializeDNSMessage(&m->omsg.h, q->TargetQID, uQueryFlags);
+    end = putQuestion(&m->omsg, m->omsg.data, m->omsg.data + AbsoluteMaxDNSMessageData, &q->qname, q->qtype, q->qclass);
+    if (end > m->omsg.data &&
+        mDNSSendDNSMessage(m, &m->omsg, end, server->interface, mDNSNULL, q->LocalSocket, &server->addr, server->port,
+                           mDNSNULL, q->UseBackgroundTraffic) == mStatus_NoError)
+    {
+        LogRedact(MDNS_LOG_CATEGORY_DEFAULT, MDNS_LOG_INFO,
+                  "[R%u->Q%u] SendUnicastRaceQuery: Also sent " PRI_DM_NAME " (" PUB_S ") to " PRI_IP_ADDR ":%d",
+                  q->request_id, mDNSVal16(q->TargetQID), DM_NAME_PARAM(&q->qname), DNSTypeName(q->qtype), &server->addr,
+                  mDNSVal16(server->port));
+        q->RaceServers[q->RaceCount]  = server;
+        q->RaceSendTime[q->RaceCount] = NonZeroTime(m->timenow);
+        q->RaceCount++;
+    }
+    if (q->RaceCount < width) q->RaceNextTime = NonZeroTime(m->timenow + UNICAST_RACE_STAGGER);
+}
+
+// Called for each UDP response that matches q, before its records are cached. Times the server that sent it, and
+// if this is the first answer since the query went out, makes that server q's server so the records are tagged
+// with it. The servers that haven't answered yet are charged the time they've had so far, so that slow or silent
+// servers sort after faster ones when racing.
+mDNSexport mDNSBool uDNS_UnicastRaceResponse(mDNS *const m, DNSQuestion *const q, const mDNSAddr *const srcaddr,
+                                             const mDNSIPPort srcport, mDNSBool failure)
+{
+    int i, j;
+
+    for (i = 0; i < q->RaceCount; i++)
+    {
+        const DNSServer *const server = q->RaceServers[i];
+        if (server && mDNSSameAddress(&server->addr, srcaddr) && mDNSSameIPPort(server->port, srcport)) break;
+    }
+    if (i == q->RaceCount) return mDNStrue;
+
+    if (q->RaceWinner && q->RaceWinner != i + 1) return mDNSfalse;
+
+    if (q->RaceSendTime[i])
+    {
+        UpdateDNSServerRTT(q->RaceServers[i], m->timenow - q->RaceSendTime[i]);
+        q->RaceSendTime[i] = 0;
+    }
+
+    // PenalizeDNSServer penalizes q->qDNSServer, so an error from one of the other servers is just dropped;
+    // the rest of the race, or the usual retries, carry on without it
+    if (failure) return (q->RaceServers[i] == q->qDNSServer);
+
+    if (!q->RaceWinner)
+    {
+        q->RaceWinner   = (mDNSu8)(i + 1);
+        q->RaceNextTime = 0;
+        for (j = 0; j < q->RaceCount; j++)
+        {
+            if (q->RaceSendTime[j])
+            {
+                UpdateDNSServerRTT(q->RaceServers[j], m->timenow - q->RaceSendTime[j]);
+                q->RaceSendTime[j] = 0;
+            }
+        }
+        if (q->RaceServers[i] != q->qDNSServer)
+        {
+            LogRedact(MDNS_LOG_CATEGORY_DEFAULT, MDNS_LOG_INFO,
+                      "[R%u->Q%u] uDNS_UnicastRaceResponse: " PRI_IP_ADDR ":%d answered " PRI_DM_NAME " (" PUB_S ") first",
+                      q->request_id, mDNSVal16(q->TargetQID), &q->RaceServers[i]->addr, mDNSVal16(q->RaceServers[i]->port),
+                      DM_NAME_PARAM(&q->qname), DNSTypeName(q->qtype));
+            DNSServerChangeForQuestion(m, q, q->RaceServers[i]);
+        }
+    }
+    return mDNStrue;
+}
 #endif // !MDNSRESPONDER_SUPPORTS(APPLE, QUERIER)
 
 // ***************************************************************************
@@ -446,7 +580,8 @@ mDNSexport mStatus mDNS_SetSecretForDomain(mDNS *m, DomainAuthInfo *info,
     DomainAuthInfo **p = &m->AuthInfoList;
     if (!info || !b64keydata) { LogMsg("mDNS_SetSecretForDomain: ERROR: info %p b64keydata %p", info, b64keydata); return(mStatus_BadParamErr); }
 
-    LogInfo("mDNS_SetSecretForDomain: domain %##s key %##s", domain->c, keyname->c);
+    LogInfo("mDNS_SetSecretForDomain: domain %##s key %##s %s", domain->c, keyname->c,
+            info->algorithm == TSIG_Alg_HMAC_SHA256 ? "hmac-sha256" : "hmac-md5");
 
     AssignDomainName(&info->domain,  domain);
     AssignDomainName(&info->keyname, keyname);
@@ -1162,7 +1297,7 @@ mDNSexport uDNS_LLQType uDNS_recvLLQResponse(mDNS *const m, const DNSMessage *co
                                              const mDNSAddr *const srcaddr, const mDNSIPPort srcport, DNSQuestion **matchQuestion)
 {
     DNSQuestion pktQ, *q;
-    if (msg->h.numQuestions && getQuestion(msg, msg->data, end, 0, &pktQ))
+    if (msg->h.numQuestions && GetViewQuestion(GetMessageView(m, msg, end), 0, 0, &pktQ))
     {
         const rdataOPT *opt = GetLLQOptData(m, msg, end);
 
@@ -1610,6 +1745,259 @@ mDNSexport void DisposeTCPConn(struct tcpInfo_t *tcp)
     mDNSPlatformMemFree(tcp);
 }
 
+#if !MDNSRESPONDER_SUPPORTS(APPLE, QUERIER)
+mDNSlocal void DNSTCPConnCallback(TCPSocket *sock, void *context, mDNSBool ConnectionEstablished, mStatus err);
+
+// Lock must be held
+mDNSlocal mStatus SendTCPConnQuery(mDNS *const m, DNSTCPConn *const conn, DNSQuestion *const q)
+{
+    mDNSu8 *end;
+    mStatus err;
+
+    InitializeDNSMessage(&m->omsg.h, q->TargetQID, uQueryFlags);
+    end = putQuestion(&m->omsg, m->omsg.data, m->omsg.data + AbsoluteMaxDNSMessageData, &q->qname, q->qtype, q->qclass);
+    if (!end) return(mStatus_UnknownErr);
+    err = mDNSSendDNSMessage(m, &m->omsg, end, mDNSInterface_Any, conn->sock, mDNSNULL, &conn->server->addr,
+                             conn->server->port, q->AuthInfo, mDNSfalse);
+    if (err) return(err);
+
+    conn->server->tcpQueries++;
+    // As in tcpCallback, now the query has gone over TCP, wait at least 256 seconds before retrying
+    q->LastQTime = m->timenow;
+    if (q->ThisQInterval < (256 * mDNSPlatformOneSecond))
+        q->ThisQInterval = (256 * mDNSPlatformOneSecond);
+    SetNextQueryTime(m, q);
+    return(mStatus_NoError);
+}
+
+// Lock must be held
+mDNSlocal DNSTCPConn *OpenDNSTCPConn(mDNS *const m, DNSServer *const server)
+{
+    DNSTCPConn *conn;
+    mStatus err;
+
+    conn = (DNSTCPConn *) mDNSPlatformMemAllocateClear(sizeof(*conn));
+    if (!conn) { LogMsg("ERROR: OpenDNSTCPConn - memallocate failed"); return(mDNSNULL); }
+    conn->sock = mDNSPlatformTCPSocket(kTCPSocketFlags_Zero, server->addr.type, &conn->SrcPort, mDNSNULL, mDNSfalse);
+    if (!conn->sock) { LogMsg("OpenDNSTCPConn: unable to create TCP socket"); mDNSPlatformMemFree(conn); return(mDNSNULL); }
+    conn->m         = m;
+    conn->server    = server;
+    conn->idleSince = m->timenow;
+
+    err = mDNSPlatformTCPConnect(conn->sock, &server->addr, server->port, server->interface, DNSTCPConnCallback, conn);
+    if (err == mStatus_ConnEstablished) conn->connected = mDNStrue;
+    else if (err != mStatus_ConnPending)
+    {
+        LogInfo("OpenDNSTCPConn: connection to %#a:%d failed", &server->addr, mDNSVal16(server->port));
+        mDNSPlatformTCPCloseConnection(conn->sock);
+        mDNSPlatformMemFree(conn);
+        return(mDNSNULL);
+    }
+    conn->next       = server->tcpConns;
+    server->tcpConns = conn;
+    server->tcpConnsOpened++;
+    return(conn);
+}
+
+mDNSlocal mDNSBool QueueTCPConnQuery(mDNS *const m, DNSQuestion *const q, DNSServer *const server);
+
+// Lock must be held. If the server had answered on conn, it most likely closed it because it had been idle or had
+// served enough queries, which RFC 7766 lets it do, so when requeue is set the queries still waiting go out again
+// on another connection. Otherwise they're left to the questions' normal retries.
+mDNSlocal void CloseDNSTCPConn(mDNS *const m, DNSTCPConn *const conn, mDNSBool requeue)
+{
+    DNSServer *const server = conn->server;
+    DNSTCPConn **p;
+    DNSQuestion *q;
+
+    for (p = &server->tcpConns; *p && *p != conn; p = &(*p)->next) continue;
+    if (*p) *p = conn->next;
+
+    for (q = m->Questions; q; q = q->next)
+    {
+        if (q->tcpConn == conn)
+        {
+            q->tcpConn = mDNSNULL;
+            if (requeue) QueueTCPConnQuery(m, q, server);
+        }
+    }
+
+    mDNSPlatformTCPCloseConnection(conn->sock);
+    if (conn->reply) mDNSPlatformMemFree(conn->reply);
+    mDNSPlatformMemFree(conn);
+}
+
+// Lock must be held. Puts q's query on the least busy of the server's connections, opening another if they're all
+// busy or there are none. Returns false if there was no connection to put it on.
+mDNSlocal mDNSBool QueueTCPConnQuery(mDNS *const m, DNSQuestion *const q, DNSServer *const server)
+{
+    DNSTCPConn *conn, *best = mDNSNULL;
+    int count = 0;
+
+    uDNS_CancelTCPQuery(m, q);
+    for (conn = server->tcpConns; conn; conn = conn->next)
+    {
+        if (!best || conn->pending < best->pending) best = conn;
+        count++;
+    }
+    if (!best || (best->pending >= DNS_TCP_MAX_PIPELINE && count < DNS_TCP_MAX_CONNS))
+    {
+        conn = OpenDNSTCPConn(m, server);
+        if (conn) best = conn;
+    }
+    if (!best) return(mDNSfalse);
+
+    q->tcpConn    = best;
+    q->tcpSrcPort = best->SrcPort;
+    best->pending++;
+    // If the connection is still being set up, DNSTCPConnCallback sends the query once it's done
+    if (best->connected && SendTCPConnQuery(m, best, q) != mStatus_NoError)
+        CloseDNSTCPConn(m, best, best->replies > 0);
+    return(q->tcpConn != mDNSNULL);
+}
+
+mDNSexport void uDNS_CancelTCPQuery(mDNS *const m, DNSQuestion *const q)
+{
+    DNSTCPConn *const conn = q->tcpConn;
+
+    if (!conn) return;
+    q->tcpConn = mDNSNULL;
+    if (conn->pending && --conn->pending == 0)
+    {
+        conn->idleSince = m->timenow;
+        if (m->NextuDNSEvent - (conn->idleSince + DNS_TCP_IDLE_TIMEOUT) > 0)
+            m->NextuDNSEvent = conn->idleSince + DNS_TCP_IDLE_TIMEOUT;
+    }
+}
+
+mDNSexport void uDNS_CloseTCPConns(mDNS *const m, DNSServer *const server)
+{
+    while (server->tcpConns) CloseDNSTCPConn(m, server->tcpConns, mDNSfalse);
+}
+
+// Closes the server's connections that have been idle for DNS_TCP_IDLE_TIMEOUT, and schedules the next check
+mDNSlocal void CloseIdleTCPConns(mDNS *const m, DNSServer *const server)
+{
+    DNSTCPConn *conn = server->tcpConns;
+
+    while (conn)
+    {
+        DNSTCPConn *const next = conn->next;
+        if (!conn->pending)
+        {
+            const mDNSs32 closeTime = conn->idleSince + DNS_TCP_IDLE_TIMEOUT;
+            if (m->timenow - closeTime >= 0) CloseDNSTCPConn(m, conn, mDNSfalse);
+            else if (m->NextuDNSEvent - closeTime > 0) m->NextuDNSEvent = closeTime;
+        }
+        conn = next;
+    }
+}
+
+// Sends the queries that were waiting for the connection to be set up, then reads the answers, one per call, and
+// hands each one to mDNSCoreReceive.
+mDNSlocal void DNSTCPConnCallback(TCPSocket *sock, void *context, mDNSBool ConnectionEstablished, mStatus err)
+{
+    DNSTCPConn *const conn = (DNSTCPConn *)context;
+    mDNS *const m = conn->m;
+    mDNSBool closed = mDNSfalse;
+    DNSQuestion *q;
+    long n;
+
+    mDNS_Lock(m);
+
+    if (err)
+    {
+        LogInfo("DNSTCPConnCallback: connection to %#a:%d failed %d", &conn->server->addr, mDNSVal16(conn->server->port), err);
+        CloseDNSTCPConn(m, conn, mDNSfalse);
+        goto exit;
+    }
+
+    if (ConnectionEstablished)
+    {
+        conn->connected = mDNStrue;
+        for (q = m->Questions; q; q = q->next)
+        {
+            if (q->tcpConn == conn && SendTCPConnQuery(m, conn, q) != mStatus_NoError)
+            {
+                CloseDNSTCPConn(m, conn, mDNSfalse);
+                break;
+            }
+        }
+        goto exit;
+    }
+
+    if (conn->nread < 2)        // First read the two-byte length preceeding the DNS message
+    {
+        mDNSu8 *const lenptr = (mDNSu8 *)&conn->replylen;
+        n = mDNSPlatformReadTCP(sock, lenptr + conn->nread, 2 - conn->nread, &closed);
+        if (n < 0 || closed)
+        {
+            // Closing a connection with nothing outstanding is normal; otherwise retry what's outstanding
+            if (n < 0) LogMsg("ERROR: DNSTCPConnCallback - attempt to read message length failed (%d)", n);
+            CloseDNSTCPConn(m, conn, conn->replies > 0);
+            goto exit;
+        }
+        conn->nread += n;
+        if (conn->nread < 2) goto exit;
+
+        conn->replylen = (mDNSu16)((mDNSu16)lenptr[0] << 8 | lenptr[1]);
+        if (conn->replylen < sizeof(DNSMessageHeader))
+        {
+            LogMsg("ERROR: DNSTCPConnCallback - length too short (%d bytes)", conn->replylen);
+            CloseDNSTCPConn(m, conn, mDNSfalse);
+            goto exit;
+        }
+        conn->reply = (DNSMessage *) mDNSPlatformMemAllocate(conn->replylen);
+        if (!conn->reply)
+        {
+            LogMsg("ERROR: DNSTCPConnCallback - malloc failed");
+            CloseDNSTCPConn(m, conn, mDNSfalse);
+            goto exit;
+        }
+    }
+
+    n = mDNSPlatformReadTCP(sock, (mDNSu8 *)conn->reply + (conn->nread - 2), conn->replylen - (conn->nread - 2), &closed);
+    if (n < 0 || closed)
+    {
+        LogMsg("ERROR: DNSTCPConnCallback - read returned %d%s", n, closed ? " (closed)" : "");
+        CloseDNSTCPConn(m, conn, conn->replies > 0);
+        goto exit;
+    }
+    conn->nread += n;
+
+    if ((conn->nread - 2) == conn->replylen)
+    {
+        DNSMessage *const reply = conn->reply;
+        const mDNSu8 *const end = (mDNSu8 *)reply + conn->replylen;
+        const mDNSAddr Addr = conn->server->addr;
+        const mDNSIPPort Port = conn->server->port;
+        const mDNSIPPort SrcPort = conn->SrcPort;
+
+        conn->reply    = mDNSNULL;
+        conn->nread    = 0;
+        conn->replylen = 0;
+        conn->replies++;
+        for (q = m->Questions; q; q = q->next)
+        {
+            if (q->tcpConn == conn && mDNSSameOpaque16(q->TargetQID, reply->h.id))
+            {
+                uDNS_CancelTCPQuery(m, q);
+                break;
+            }
+        }
+        mDNS_Unlock(m);
+
+        mDNSCoreReceive(m, reply, end, &Addr, Port, mDNSNULL, SrcPort, 0);
+        // USE CAUTION HERE: Invoking mDNSCoreReceive may have caused the environment to change
+        mDNSPlatformMemFree(reply);
+        return;
+    }
+
+exit:
+    mDNS_Unlock(m);
+}
+#endif // !MDNSRESPONDER_SUPPORTS(APPLE, QUERIER)
+
 // Lock must be held
 mDNSexport void startLLQHandshake(mDNS *m, DNSQuestion *q)
 {
@@ -2175,6 +2563,8 @@ mDNSlocal mStatus UnlinkResourceRecord(mDNS *const m, AuthRecord *const rr)
     {
         *list = rr->next;
         rr->next = mDNSNULL;
+        RecordHashRemove(m, rr);
+        rr->NextInRHash = mDNSNULL;
 
         // Temporary workaround to cancel any active NAT mapping operation
         if (rr->NATinfo.clientContext)
@@ -4483,7 +4873,14 @@ mDNSlocal void uDNS_HandleLLQState(mDNS *const m, DNSQuestion *q)
 mDNSlocal void uDNS_CheckCurrentQuestion(mDNS *const m)
 {
     DNSQuestion *q = m->CurrentQuestion;
-    if (m->timenow - NextQSendTime(q) < 0) return;
+    if (m->timenow - NextQSendTime(q) < 0)
+    {
+#if !MDNSRESPONDER_SUPPORTS(APPLE, QUERIER)
+        if (q->RaceNextTime && m->timenow - q->RaceNextTime >= 0)
+            SendUnicastRaceQuery(m, q);
+#endif
+        return;
+    }
 
     if (q->LongLived)
     {
@@ -4549,6 +4946,7 @@ mDNSlocal void uDNS_CheckCurrentQuestion(mDNS *const m)
             mDNSu8 *end;
             mStatus err = mStatus_NoError;
             mDNSOpaque16 HeaderFlags = uQueryFlags;
+            const mDNSBool retransmission = (q->unansweredQueries != 0);
 
             InitializeDNSMessage(&m->omsg.h, q->TargetQID, HeaderFlags);
             end = putQuestion(&m->omsg, m->omsg.data, m->omsg.data + AbsoluteMaxDNSMessageData, &q->qname, q->qtype, q->qclass);
@@ -4644,12 +5042,25 @@ mDNSlocal void uDNS_CheckCurrentQuestion(mDNS *const m)
             {
                 if (err != mStatus_TransientErr)   // if it is not a transient error backoff and DO NOT flood queries unnecessarily
                 {
+                    const mDNSs32 rto = (q->LongLived || q->triedAllServersOnce) ? 0 : DNSServerRTO(q->qDNSServer);
+
                     // If all DNS Servers are not responding, then we back-off using the multiplier UDNSBackOffMultiplier(*2).
                     // Only increase interval if send succeeded
-
-                    q->ThisQInterval = q->ThisQInterval * UDNSBackOffMultiplier;
-                    if ((q->ThisQInterval > 0) && (q->ThisQInterval < MinQuestionInterval))  // We do not want to retx within 1 sec
-                        q->ThisQInterval = MinQuestionInterval;
+                    //
+                    // Until we've been through all the servers once, a server whose response times we know gets asked
+                    // again after about as long as it usually takes to answer, doubling each time it doesn't, so that a
+                    // nearby server is retried (and given up on) quickly and one on a slow link isn't asked too often.
+                    // LLQ polls keep their own schedule.
+                    if (rto)
+                    {
+                        q->ThisQInterval = rto << ((q->unansweredQueries < 4) ? q->unansweredQueries : 4);
+                    }
+                    else
+                    {
+                        q->ThisQInterval = q->ThisQInterval * UDNSBackOffMultiplier;
+                        if ((q->ThisQInterval > 0) && (q->ThisQInterval < MinQuestionInterval))  // We do not want to retx within 1 sec
+                            q->ThisQInterval = MinQuestionInterval;
+                    }
 
                     q->unansweredQueries++;
                     if (q->ThisQInterval > MAX_UCAST_POLL_INTERVAL)
@@ -4664,6 +5075,7 @@ mDNSlocal void uDNS_CheckCurrentQuestion(mDNS *const m)
                     debugf("uDNS_CheckCurrentQuestion: Increased ThisQInterval to %d for %##s (%s), cell %d", q->ThisQInterval, q->qname.c, DNSTypeName(q->qtype), q->qDNSServer->isCell);
                 }
                 q->LastQTime = m->timenow;
+                if (err == mStatus_NoError) StartUnicastRace(m, q, retransmission);
             }
             SetNextQueryTime(m, q);
         }
@@ -4975,6 +5387,8 @@ mDNSexport void uDNS_Tasks(mDNS *const m)
             if (m->NextuDNSEvent - d->penaltyTime > 0)
                 m->NextuDNSEvent = d->penaltyTime;
         }
+    for (d = m->DNSServers; d; d = d->next)
+        if (d->tcpConns) CloseIdleTCPConns(m, d);
 #endif
 
     if (m->CurrentQuestion)
@@ -4991,8 +5405,14 @@ mDNSexport void uDNS_Tasks(mDNS *const m)
         {
             uDNS_CheckCurrentQuestion(m);
             if (q == m->CurrentQuestion)
+            {
                 if (m->NextuDNSEvent - NextQSendTime(q) > 0)
                     m->NextuDNSEvent = NextQSendTime(q);
+#if !MDNSRESPONDER_SUPPORTS(APPLE, QUERIER)
+                if (q->RaceNextTime && m->NextuDNSEvent - q->RaceNextTime > 0)
+                    m->NextuDNSEvent = q->RaceNextTime;
+#endif
+            }
         }
         // If m->CurrentQuestion wasn't modified out from under us, advance it now
         // We can't do this at the start of the loop because uDNS_CheckCurrentQuestion()
@@ -5557,10 +5977,27 @@ mDNSexport domainname  *uDNS_GetNextSearchDomain(mDNSInterfaceID InterfaceID, in
 
 mDNSexport void uDNS_RestartQuestionAsTCP(mDNS *m, DNSQuestion *const q, const mDNSAddr *const srcaddr, const mDNSIPPort srcport)
 {
-    // Don't reuse TCP connections. We might have failed over to a different DNS server
-    // while the first TCP connection is in progress. We need a new TCP connection to the
-    // new DNS server. So, always try to establish a new connection.
+#if !MDNSRESPONDER_SUPPORTS(APPLE, QUERIER)
+    DNSServer *server = q->qDNSServer;
+#endif
+
     if (q->tcp) { DisposeTCPConn(q->tcp); q->tcp = mDNSNULL; }
+
+#if !MDNSRESPONDER_SUPPORTS(APPLE, QUERIER)
+    // Ordinary queries share the pooled connections of the server that sent the truncated response. We might have
+    // failed over to a different DNS server since the query went out, so look for it if it isn't q's server.
+    if (!server || !mDNSSameAddress(&server->addr, srcaddr) || !mDNSSameIPPort(server->port, srcport))
+    {
+        for (server = m->DNSServers; server; server = server->next)
+        {
+            if (!(server->flags & DNSServerFlag_Delete) && mDNSSameAddress(&server->addr, srcaddr) &&
+                mDNSSameIPPort(server->port, srcport)) break;
+        }
+    }
+    if (server && !q->LongLived && QueueTCPConnQuery(m, q, server)) return;
+#endif
+
+    // LLQs, and queries to a server we no longer know, get a connection of their own
     q->tcp = MakeTCPConn(m, mDNSNULL, mDNSNULL, kTCPSocketFlags_Zero, srcaddr, srcport, mDNSNULL, q, mDNSNULL);
 }
 
@@ -40,6 +40,12 @@ extern "C" {
 #define RESPONSE_WINDOW (60 * mDNSPlatformOneSecond)         // require server responses within one minute of request
 #define MAX_UCAST_UNANSWERED_QUERIES 2                       // number of unanswered queries from any one uDNS server before trying another server
 #define DNSSERVER_PENALTY_TIME (60 * mDNSPlatformOneSecond)  // number of seconds for which new questions don't pick this server
+#define UNICAST_RACE_STAGGER (mDNSPlatformOneSecond / 4)     // when racing servers, wait this long for an answer before asking the next
+#define MIN_UCAST_RTO (mDNSPlatformOneSecond / 4)            // bounds on the wait for an answer from a server that has been timed
+#define MAX_UCAST_RTO (3 * mDNSPlatformOneSecond)
+#define DNS_TCP_MAX_CONNS 2                                  // most pooled TCP connections to one server
+#define DNS_TCP_MAX_PIPELINE 16                              // outstanding queries on one before another is opened
+#define DNS_TCP_IDLE_TIMEOUT (10 * mDNSPlatformOneSecond)    // close a pooled connection after this long with nothing outstanding
 
 // On some interfaces, we want to delay the first retransmission to a minimum of 2 seconds
 // rather than the default (1 second).
@@ -129,6 +135,7 @@ extern mStatus uDNS_UpdateRecord(mDNS *m, AuthRecord *rr);
 extern void SetNextQueryTime(mDNS *const m, const DNSQuestion *const q);
 extern mStatus mDNS_Register_internal(mDNS *const m, AuthRecord *const rr);
 extern mStatus mDNS_Deregister_internal(mDNS *const m, AuthRecord *const rr, mDNS_Dereg_type drt);
+extern void RecordHashRemove(mDNS *const m, AuthRecord *const rr);
 extern mStatus mDNS_StartQuery_internal(mDNS *const m, DNSQuestion *const question);
 extern mStatus mDNS_StopQuery_internal(mDNS *const m, DNSQuestion *const question);
 extern mStatus mDNS_StartNATOperation_internal(mDNS *const m, NATTraversalInfo *traversal);
@@ -159,7 +166,16 @@ extern void uDNS_StartWABQueries(mDNS *const m, int queryType);
 extern void uDNS_StopWABQueries(mDNS *const m, int queryType);
 extern domainname      *uDNS_GetNextSearchDomain(mDNSInterfaceID InterfaceID, int *searchIndex, mDNSBool ignoreDotLocal);
     
+// How long to wait for an answer from server before asking again, from its response times; 0 if it hasn't been timed
+extern mDNSs32 DNSServerRTO(const DNSServer *const server);
+// Returns false if a unicast response that matches q should be ignored because another server won the race
+extern mDNSBool uDNS_UnicastRaceResponse(mDNS *const m, DNSQuestion *const q, const mDNSAddr *const srcaddr,
+                                         const mDNSIPPort srcport, mDNSBool failure);
 extern void uDNS_RestartQuestionAsTCP(mDNS *m, DNSQuestion *const q, const mDNSAddr *const srcaddr, const mDNSIPPort srcport);
+// Stops waiting for an answer to q on its pooled TCP connection, if it has one
+extern void uDNS_CancelTCPQuery(mDNS *const m, DNSQuestion *const q);
+// Closes the server's pooled TCP connections, before the server is freed
+extern void uDNS_CloseTCPConns(mDNS *const m, DNSServer *const server);
 
 typedef enum
 {
@@ -0,0 +1,181 @@
+/* -*- Mode: C; tab-width: 4; c-file-style: "bsd"; c-basic-offset: 4; fill-column: 108; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (c) 2002-2019 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * File:        ClientBench.c
+ * Contains:    Measures what client operations cost against a running daemon.
+ *
+ * ClientBench starts a number of browse or query operations through the client library, as an application that
+ * browses for and resolves many services would, and reports how long starting and stopping them took. Given the
+ * daemon's process ID, it also reports how much the daemon's resident memory and open descriptors grew per
+ * operation, read from /proc. The memory is only measured on the first round, since the daemon's allocator reuses
+ * what the first round freed, so run it against a freshly started daemon. All the operations ask for the same
+ * thing, so the daemon does the same mDNS work however many there are, and what's measured is the cost of the
+ * operations and their connections.
+ *
+ * With -shared, the operations share one connection to the daemon (see DNSSD_SHARED_CONNECTION in
+ * dnssd_clientstub.c) rather than opening one each.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#include "dns_sd.h"
+
+static void DNSSD_API BrowseReply(DNSServiceRef sdRef, DNSServiceFlags flags, uint32_t interfaceIndex,
+                                  DNSServiceErrorType errorCode, const char *serviceName, const char *regtype,
+                                  const char *replyDomain, void *context)
+{
+    (void)sdRef; (void)flags; (void)interfaceIndex; (void)errorCode;
+    (void)serviceName; (void)regtype; (void)replyDomain; (void)context;
+}
+
+static void DNSSD_API QueryReply(DNSServiceRef sdRef, DNSServiceFlags flags, uint32_t interfaceIndex,
+                                 DNSServiceErrorType errorCode, const char *fullname, uint16_t rrtype,
+                                 uint16_t rrclass, uint16_t rdlen, const void *rdata, uint32_t ttl, void *context)
+{
+    (void)sdRef; (void)flags; (void)interfaceIndex; (void)errorCode; (void)fullname;
+    (void)rrtype; (void)rrclass; (void)rdlen; (void)rdata; (void)ttl; (void)context;
+}
+
+static double Now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1e6 + ts.tv_nsec / 1e3);
+}
+
+// Resident memory of the process in kilobytes, or -1 if it can't be read
+static long DaemonRSS(long pid)
+{
+    char path[64], line[256];
+    long kb = -1;
+    FILE *f;
+
+    snprintf(path, sizeof(path), "/proc/%ld/status", pid);
+    f = fopen(path, "r");
+    if (!f) return(-1);
+    while (fgets(line, sizeof(line), f))
+        if (sscanf(line, "VmRSS: %ld", &kb) == 1) break;
+    fclose(f);
+    return(kb);
+}
+
+// Open descriptors of the process, or -1 if they can't be listed
+static long DaemonFDs(long pid)
+{
+    char path[64];
+    struct dirent *e;
+    long n = 0;
+    DIR *d;
+
+    snprintf(path, sizeof(path), "/proc/%ld/fd", pid);
+    d = opendir(path);
+    if (!d) return(-1);
+    while ((e = readdir(d)) != NULL)
+        if (e->d_name[0] != '.') n++;
+    closedir(d);
+    return(n);
+}
+
+static void usage(const char *progname)
+{
+    fprintf(stderr, "Usage: %s [options]\n", progname);
+    fprintf(stderr, "Starts and stops client operations against the running daemon and times them.\n");
+    fprintf(stderr, "  -n count     operations to run at once (default 500)\n");
+    fprintf(stderr, "  -rounds n    times to start and stop them (default 5)\n");
+    fprintf(stderr, "  -op type     browse or query (default browse)\n");
+    fprintf(stderr, "  -shared      share one connection to the daemon between the operations\n");
+    fprintf(stderr, "  -p pid       the daemon's process ID, to report its memory and descriptors per operation\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *const progname = strrchr(argv[0], '/') ? strrchr(argv[0], '/') + 1 : argv[0];
+    int count = 500, rounds = 5, browse = 1, shared, r, i, a;
+    const char *env;
+    long pid = 0;
+    double startUs = 0, stopUs = 0;
+    long rssGrowth = 0, fdGrowth = 0;
+    DNSServiceRef *refs;
+
+    for (a = 1; a < argc; a++)
+    {
+        const int hasArg = (a + 1 < argc);
+        if      (hasArg && !strcmp(argv[a], "-n"))      count  = atoi(argv[++a]);
+        else if (hasArg && !strcmp(argv[a], "-rounds")) rounds = atoi(argv[++a]);
+        else if (hasArg && !strcmp(argv[a], "-op"))     { a++; if (!strcmp(argv[a], "query")) browse = 0; else if (strcmp(argv[a], "browse")) { usage(progname); return(1); } }
+        else if (hasArg && !strcmp(argv[a], "-p"))      pid    = atol(argv[++a]);
+        else if (!strcmp(argv[a], "-shared"))           setenv("DNSSD_SHARED_CONNECTION", "1", 1);
+        else { usage(progname); return(1); }
+    }
+    if (count < 1 || rounds < 1) { usage(progname); return(1); }
+    env = getenv("DNSSD_SHARED_CONNECTION");
+    shared = (env && env[0] && strcmp(env, "0") != 0);
+
+    refs = (DNSServiceRef *)calloc((size_t)count, sizeof(*refs));
+    if (!refs) return(1);
+
+    for (r = 0; r < rounds; r++)
+    {
+        long rss0, fds0;
+        double t0, t1;
+
+        // The daemon tears down stopped operations after we've returned, so let it finish the last round's
+        if (pid) usleep(200000);
+        rss0 = pid ? DaemonRSS(pid) : -1;
+        fds0 = pid ? DaemonFDs(pid) : -1;
+
+        t0 = Now();
+        for (i = 0; i < count; i++)
+        {
+            DNSServiceErrorType err;
+            if (browse) err = DNSServiceBrowse(&refs[i], 0, 0, "_clientbench._tcp", "local.", BrowseReply, NULL);
+            else err = DNSServiceQueryRecord(&refs[i], 0, 0, "clientbench.local.", kDNSServiceType_TXT, kDNSServiceClass_IN, QueryReply, NULL);
+            if (err) { fprintf(stderr, "Operation %d failed: %d\n", i, err); return(1); }
+        }
+        t1 = Now();
+        startUs += t1 - t0;
+
+        if (pid)
+        {
+            const long rss1 = DaemonRSS(pid), fds1 = DaemonFDs(pid);
+            if (rss0 < 0 || rss1 < 0 || fds0 < 0 || fds1 < 0) { fprintf(stderr, "Cannot read /proc/%ld\n", pid); return(1); }
+            if (r == 0) rssGrowth = rss1 - rss0;
+            fdGrowth  += fds1 - fds0;
+        }
+
+        t0 = Now();
+        for (i = 0; i < count; i++) DNSServiceRefDeallocate(refs[i]);
+        t1 = Now();
+        stopUs += t1 - t0;
+    }
+
+    printf("%d %s operations, %d rounds, %s\n", count, browse ? "browse" : "query", rounds,
+           shared ? "one shared connection" : "one connection per operation");
+    printf("Start:  %8.1f us per operation\n", startUs / rounds / count);
+    printf("Stop:   %8.1f us per operation\n", stopUs / rounds / count);
+    if (pid)
+    {
+        printf("Daemon: %8.0f bytes of resident memory per operation, first round\n", rssGrowth * 1024.0 / count);
+        printf("Daemon: %8.2f descriptors per operation\n", (double)fdGrowth / rounds / count);
+    }
+    free(refs);
+    return(0);
+}
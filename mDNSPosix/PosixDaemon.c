@@ -0,0 +1,252 @@
+/* -*- Mode: C; tab-width: 4; c-file-style: "bsd"; c-basic-offset: 4; fill-column: 108; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (c) 2003-2019 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * File:        PosixDaemon.c
+ * Contains:    main & associated Application layer for mDNSResponder on Linux.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "mDNSEmbeddedAPI.h"
+#include "mDNSPosix.h"
+#include "uds_daemon.h"
+
+// Allocate the initial cache statically; the core asks for more through mStatus_GrowCache as it fills
+#define RR_CACHE_SIZE 500
+static CacheEntity gRRCache[RR_CACHE_SIZE];
+static mDNS_PlatformSupport PlatformStorage;
+
+// SIGUSR1 also writes the client request statistics here, one "key=value" line per histogram
+#define REQUEST_STATS_PATH "/var/run/mdnsd.requests"
+
+// With -binarydump, SIGUSR1 writes a binary state dump here in place of the text one on stderr ("dns-sd -Y" reads it)
+#define BINARY_DUMP_PATH "/var/run/mdnsd.state"
+static mDNSBool BinaryDump = mDNSfalse;
+
+mDNSlocal void mDNS_StatusCallback(mDNS *const m, mStatus result)
+{
+    if (result == mStatus_NoError)
+    {
+        // On successful registration of dot-local mDNS host name, daemon may want to check if
+        // any name conflict and automatic renaming took place, and if so, record the newly negotiated
+        // name in persistent storage for next time. It should also inform the user of the name change.
+        // On Mac OS X we store the current dot-local mDNS host name in the SCPreferences store,
+        // and notify the user with a CFUserNotification.
+    }
+    else if (result == mStatus_ConfigChanged)
+    {
+        udsserver_handle_configchange(m);
+    }
+    else if (result == mStatus_GrowCache)
+    {
+        // Allocate another chunk of cache storage
+        CacheEntity *storage = (CacheEntity *)mDNSPlatformMemAllocateClear(sizeof(CacheEntity) * RR_CACHE_SIZE);
+        if (storage) mDNS_GrowCache(m, storage, RR_CACHE_SIZE);
+    }
+}
+
+// %%% Reconfigure() probably belongs in the platform support layer (mDNSPosix.c), not the daemon code
+// -- all client layers running on top of mDNSPosix.c need to handle network configuration changes,
+// not only the Unix Domain Socket Daemon
+
+mDNSlocal void Reconfigure(mDNS *m)
+{
+    mDNSPlatformPosixRefreshInterfaceList(m);
+    mDNS_ConfigChanged(m);
+}
+
+mDNSlocal void ParseCmdLineArgs(int argc, char **argv)
+{
+    int i;
+    for (i = 1; i < argc; i++)
+    {
+        if (0 == strcmp(argv[i], "-debug")) mDNS_DebugMode = mDNStrue;
+        else if (0 == strcmp(argv[i], "-threads") && i + 1 < argc) mDNSPosixSetReceiveThreads(atoi(argv[++i]));
+        else if (0 == strcmp(argv[i], "-race") && i + 1 < argc) UnicastRaceServers = (mDNSu32)atoi(argv[++i]);
+        else if (0 == strcmp(argv[i], "-binarydump")) BinaryDump = mDNStrue;
+        else { printf("Usage: %s [-debug] [-threads n] [-race n] [-binarydump]\n", argv[0]); break; }
+    }
+
+    if (!mDNS_DebugMode)
+    {
+        int result = daemon(0, 0);
+        if (result != 0) { LogMsg("Could not run as daemon - exiting"); exit(result); }
+    }
+}
+
+mDNSlocal void DumpStateLog(void)
+// Dump a little log of what we've been up to.
+{
+    int fd;
+
+    if (BinaryDump)
+    {
+        // Not O_TRUNC, which would cut short a dump that's still being written; the file is truncated once the
+        // new dump has started, before anything is written to it
+        fd = open(BINARY_DUMP_PATH, O_WRONLY | O_CREAT, 0644);
+        if (fd < 0) LogMsg("DumpStateLog: could not open %s: %s", BINARY_DUMP_PATH, strerror(errno));
+        else if (udsserver_state_dump_start(fd) != mStatus_NoError)
+        {
+            LogMsg("DumpStateLog: a state dump is already being written");
+            close(fd);
+        }
+        else if (ftruncate(fd, 0) != 0) LogMsg("DumpStateLog: could not truncate %s: %s", BINARY_DUMP_PATH, strerror(errno));
+    }
+    else
+    {
+        LogMsg("---- BEGIN STATE LOG ----");
+        udsserver_info_dump_to_fd(STDERR_FILENO);
+        LogMsg("----  END STATE LOG  ----");
+    }
+
+    fd = open(REQUEST_STATS_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) { LogMsg("DumpStateLog: could not open %s: %s", REQUEST_STATS_PATH, strerror(errno)); return; }
+    udsserver_request_stats_dump_to_fd(fd);
+    close(fd);
+}
+
+mDNSlocal mStatus MainLoop(mDNS *m) // Loop until we quit.
+{
+    sigset_t signals;
+    mDNSBool gotData = mDNSfalse;
+
+    mDNSPosixListenForSignalInEventLoop(SIGINT);
+    mDNSPosixListenForSignalInEventLoop(SIGTERM);
+    mDNSPosixListenForSignalInEventLoop(SIGUSR1);
+    mDNSPosixListenForSignalInEventLoop(SIGUSR2);
+    mDNSPosixListenForSignalInEventLoop(SIGPIPE);
+    mDNSPosixListenForSignalInEventLoop(SIGHUP);
+
+    for (; ;)
+    {
+        // Work out how long we expect to sleep before the next scheduled task
+        struct timeval timeout;
+        mDNSs32 ticks;
+
+        // Only idle if we didn't find any data the last time around
+        if (!gotData)
+        {
+            mDNSs32 nextTimerEvent = mDNS_Execute(m);
+            nextTimerEvent = udsserver_idle(nextTimerEvent);
+            ticks = nextTimerEvent - mDNS_TimeNow(m);
+            if (ticks < 1) ticks = 1;
+        }
+        else    // otherwise call EventLoop again with 0 timemout
+            ticks = 0;
+
+        timeout.tv_sec = ticks / mDNSPlatformOneSecond;
+        timeout.tv_usec = (ticks % mDNSPlatformOneSecond) * 1000000 / mDNSPlatformOneSecond;
+
+        (void) mDNSPosixRunEventLoopOnce(m, &timeout, &signals, &gotData);
+
+        if (sigismember(&signals, SIGHUP )) Reconfigure(m);
+        if (sigismember(&signals, SIGUSR1)) DumpStateLog();
+        if (sigismember(&signals, SIGUSR2))
+        {
+            mDNS_LoggingEnabled = mDNS_LoggingEnabled ? 0 : 1;
+            LogMsg("SIGUSR2: Detailed logging %s", mDNS_LoggingEnabled ? "enabled" : "disabled");
+        }
+        // SIGPIPE happens when we try to write to a dead client; death should be detected soon in request_callback() and cleaned up.
+        if (sigismember(&signals, SIGPIPE)) LogMsg("Received SIGPIPE - ignoring");
+        if (sigismember(&signals, SIGINT) || sigismember(&signals, SIGTERM)) break;
+    }
+    return EINTR;
+}
+
+int main(int argc, char **argv)
+{
+    mStatus err;
+
+    ParseCmdLineArgs(argc, argv);
+
+    LogMsg("%s starting", argv[0]);
+
+    err = mDNS_Init(&mDNSStorage, &PlatformStorage, gRRCache, RR_CACHE_SIZE, mDNS_Init_AdvertiseLocalAddresses,
+                    mDNS_StatusCallback, mDNS_Init_NoInitCallbackContext);
+
+    if (mStatus_NoError == err)
+        err = udsserver_init(mDNSNULL, 0);
+
+    if (mStatus_NoError == err)
+        err = MainLoop(&mDNSStorage);
+
+    LogMsg("%s stopping", argv[0]);
+
+    if (udsserver_exit() < 0)
+        LogMsg("ExitCallback: udsserver_exit failed");
+
+    mDNS_StartExit(&mDNSStorage);
+
+    // Keep running until the goodbye packets have gone out and the core has finished its own shutdown work
+    for (; ;)
+    {
+        struct timeval timeout;
+        sigset_t signals;
+        mDNSBool gotData;
+        const mDNSs32 now = mDNS_TimeNow(&mDNSStorage);
+        mDNSs32 ticks;
+
+        if (mDNS_ExitNow(&mDNSStorage, now)) break;
+        ticks = mDNS_Execute(&mDNSStorage) - now;
+        if (ticks < 1) ticks = 1;
+        if (ticks > mDNSPlatformOneSecond) ticks = mDNSPlatformOneSecond;
+        timeout.tv_sec  = ticks / mDNSPlatformOneSecond;
+        timeout.tv_usec = (ticks % mDNSPlatformOneSecond) * 1000000 / mDNSPlatformOneSecond;
+        (void) mDNSPosixRunEventLoopOnce(&mDNSStorage, &timeout, &signals, &gotData);
+    }
+
+    mDNS_FinalExit(&mDNSStorage);
+
+    if (err == EINTR) err = mStatus_NoError;
+    return err;
+}
+
+//		uds_daemon support		////////////////////////////////////////////////////////////
+
+mStatus udsSupportAddFDToEventLoop(int fd, udsEventCallback callback, void *context, void **platform_data)
+/* Support routine for uds_daemon.c */
+{
+    // Depends on the fact that udsEventCallback == mDNSPosixEventCallback
+    (void) platform_data;
+    return mDNSPosixAddFDToEventLoop(fd, callback, context);
+}
+
+int udsSupportReadFD(dnssd_sock_t fd, char *buf, int len, int flags, void *platform_data)
+{
+    (void) platform_data;
+    return (int)recv(fd, buf, (size_t)len, flags);
+}
+
+mStatus udsSupportRemoveFDFromEventLoop(int fd, void *platform_data)        // Note: This also CLOSES the file descriptor
+{
+    mStatus err = mDNSPosixRemoveFDFromEventLoop(fd);
+    (void) platform_data;
+    close(fd);
+    return err;
+}
+
+mDNSexport void RecordUpdatedNiceLabel(mDNSs32 delay)
+{
+    (void)delay;
+}
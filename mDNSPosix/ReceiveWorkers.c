@@ -0,0 +1,394 @@
+/* -*- Mode: C; tab-width: 4; c-file-style: "bsd"; c-basic-offset: 4; fill-column: 108; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (c) 2002-2019 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * File:        ReceiveWorkers.c
+ * Contains:    Receive worker threads that feed datagrams to the thread running the mDNS core.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "mDNSEmbeddedAPI.h"
+#include "DNSCommon.h"
+#include "ReceiveWorkers.h"
+
+// ***************************************************************************
+// Structures
+
+typedef struct WorkerSource WorkerSource;
+struct WorkerSource
+{
+    WorkerSource *next;
+    int fd;
+    int ifindex;
+    ReceiveWorkersReadFn readfn;
+};
+
+typedef struct
+{
+    pthread_t thread;
+    pthread_mutex_t lock;               // Held while reading from a source, and while the source list changes
+    int epollfd;
+    WorkerSource *sources;
+} ReceiveWorker;
+
+// ***************************************************************************
+// Globals
+
+#define kMaxReceiveWorkers  32
+#define kWorkerReadBatch    16          // Datagrams a worker asks for in one read
+#define kWorkerEventBatch   16          // Ready descriptors fetched per epoll_wait() call
+#define kMaxQueuedDatagrams 1024        // Datagrams waiting for the core thread before new ones are dropped (25 KB each)
+
+mDNSlocal ReceiveWorker gWorkers[kMaxReceiveWorkers];
+mDNSlocal int gNumWorkers;
+mDNSlocal int gStopFD  = -1;            // Readable once the workers should exit
+mDNSlocal int gReadyFD = -1;            // Readable while gQueue is non-empty
+
+// gQueueLock protects the queue, the free list and the statistics. Datagrams are allocated with malloc() rather
+// than mDNSPlatformMemAllocate() because the workers must not call into the platform layer. For the same reason
+// they don't log: they count failures in gStats, and the core thread logs them in ReceiveWorkersTake().
+mDNSlocal pthread_mutex_t gQueueLock = PTHREAD_MUTEX_INITIALIZER;
+mDNSlocal ReceivedDatagram *gQueue;
+mDNSlocal ReceivedDatagram **gQueueTail = &gQueue;
+mDNSlocal mDNSu32 gQueueCount;
+mDNSlocal ReceivedDatagram *gFreeDatagrams;
+mDNSlocal ReceiveWorkersStats gStats;
+mDNSlocal mDNSu32 gErrorsLogged;        // gStats.Errors already logged; only used on the core thread
+
+// ***************************************************************************
+// Functions
+
+#if COMPILER_LIKES_PRAGMA_MARK
+#pragma mark ***** Queue
+#endif
+
+// Fills batch with up to max datagrams, from the free list where possible. Returns how many it got.
+mDNSlocal int AllocDatagrams(ReceivedDatagram **batch, int max)
+{
+    int n;
+    pthread_mutex_lock(&gQueueLock);
+    for (n = 0; n < max && gFreeDatagrams; n++)
+    {
+        batch[n] = gFreeDatagrams;
+        gFreeDatagrams = gFreeDatagrams->next;
+    }
+    pthread_mutex_unlock(&gQueueLock);
+    for (; n < max; n++)
+    {
+        batch[n] = (ReceivedDatagram *)malloc(sizeof(ReceivedDatagram));
+        if (!batch[n]) break;
+    }
+    return(n);
+}
+
+// The core drops these itself without looking at any state, so there's no point making the core thread do it
+mDNSlocal mDNSBool DatagramLooksValid(const ReceivedDatagram *const d)
+{
+    if (d->truncated) return(mDNSfalse);
+    if (!mDNSAddressIsValid(&d->srcAddr)) return(mDNSfalse);
+    return(mDNStrue);
+}
+
+// Queues the first n datagrams in batch that pass the checks, and puts everything else back on the free list
+mDNSlocal void QueueDatagrams(ReceivedDatagram **batch, int n, int allocated)
+{
+    mDNSBool wasEmpty;
+    int i;
+
+    pthread_mutex_lock(&gQueueLock);
+    wasEmpty = (gQueue == mDNSNULL);
+    if (n > 0)
+    {
+        gStats.Batches++;
+        gStats.Datagrams += (mDNSu32)n;
+        if ((mDNSu32)n > gStats.BatchMax) gStats.BatchMax = (mDNSu32)n;
+    }
+    for (i = 0; i < allocated; i++)
+    {
+        ReceivedDatagram *const d = batch[i];
+        if (i < n && !DatagramLooksValid(d)) gStats.Rejected++;
+        else if (i < n && gQueueCount >= kMaxQueuedDatagrams) gStats.Overflows++;
+        else if (i < n)
+        {
+            d->next = mDNSNULL;
+            *gQueueTail = d;
+            gQueueTail = &d->next;
+            gQueueCount++;
+            continue;
+        }
+        d->next = gFreeDatagrams;
+        gFreeDatagrams = d;
+    }
+    if (wasEmpty && gQueue)     // The core thread clears gReadyFD when it takes the queue
+    {
+        const uint64_t one = 1;
+        if (write(gReadyFD, &one, sizeof(one)) < 0 && errno != EAGAIN) { gStats.Errors++; gStats.LastError = errno; }
+    }
+    pthread_mutex_unlock(&gQueueLock);
+}
+
+// Records a failure on a worker thread, and wakes the core thread so that it logs it
+mDNSlocal void NoteWorkerError(int err)
+{
+    const uint64_t one = 1;
+    pthread_mutex_lock(&gQueueLock);
+    gStats.Errors++;
+    gStats.LastError = err;
+    (void)write(gReadyFD, &one, sizeof(one));    // If this fails too, the next datagram wakes the core thread
+    pthread_mutex_unlock(&gQueueLock);
+}
+
+mDNSexport ReceivedDatagram *ReceiveWorkersTake(void)
+{
+    ReceivedDatagram *list;
+    uint64_t count;
+    int readError = 0;
+    mDNSu32 errors;
+    int lastError;
+
+    pthread_mutex_lock(&gQueueLock);
+    list        = gQueue;
+    gQueue      = mDNSNULL;
+    gQueueTail  = &gQueue;
+    gQueueCount = 0;
+    if (gReadyFD >= 0 && read(gReadyFD, &count, sizeof(count)) < 0 && errno != EAGAIN) readError = errno;
+    errors    = gStats.Errors;
+    lastError = gStats.LastError;
+    pthread_mutex_unlock(&gQueueLock);
+
+    if (readError) LogMsg("ReceiveWorkersTake: read failed %d (%s)", readError, strerror(readError));
+    if (errors != gErrorsLogged)
+    {
+        LogMsg("ReceiveWorkers: %u errors on the worker threads, the last %d (%s)", errors - gErrorsLogged,
+               lastError, strerror(lastError));
+        gErrorsLogged = errors;
+    }
+    return(list);
+}
+
+mDNSexport void ReceiveWorkersRelease(ReceivedDatagram *list)
+{
+    pthread_mutex_lock(&gQueueLock);
+    while (list)
+    {
+        ReceivedDatagram *const d = list;
+        list = d->next;
+        d->next = gFreeDatagrams;
+        gFreeDatagrams = d;
+    }
+    pthread_mutex_unlock(&gQueueLock);
+}
+
+mDNSexport void ReceiveWorkersGetStats(ReceiveWorkersStats *stats)
+{
+    pthread_mutex_lock(&gQueueLock);
+    *stats = gStats;
+    pthread_mutex_unlock(&gQueueLock);
+}
+
+#if COMPILER_LIKES_PRAGMA_MARK
+#pragma mark ***** Workers
+#endif
+
+mDNSlocal void ServiceSource(ReceiveWorker *const w, int fd)
+{
+    ReceivedDatagram *batch[kWorkerReadBatch];
+    const int allocated = AllocDatagrams(batch, kWorkerReadBatch);
+    const WorkerSource *s;
+    int n = 0, err = 0, i;
+
+    if (!allocated) return;
+    pthread_mutex_lock(&w->lock);
+    for (s = w->sources; s && s->fd != fd; s = s->next) continue;
+    if (s) n = s->readfn(fd, s->ifindex, batch, allocated);    // s is null if fd was removed after epoll_wait returned
+    if (n < 0) err = errno;
+    pthread_mutex_unlock(&w->lock);
+    if (err) NoteWorkerError(err);
+
+    // Parsed here, with no locks held, so that the core thread only has to act on what's in the message
+    for (i = 0; i < n; i++)
+        if (DatagramLooksValid(batch[i]))
+            ParseReceivedDNSMessage(&batch[i]->view, &batch[i]->msg.m, (mDNSu8 *)&batch[i]->msg.m + batch[i]->len);
+    QueueDatagrams(batch, n, allocated);
+}
+
+mDNSlocal void *WorkerMain(void *context)
+{
+    ReceiveWorker *const w = (ReceiveWorker *)context;
+    struct epoll_event events[kWorkerEventBatch];
+
+    for (; ;)
+    {
+        const int n = epoll_wait(w->epollfd, events, kWorkerEventBatch, -1);
+        int i;
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            NoteWorkerError(errno);
+            return(mDNSNULL);
+        }
+        for (i = 0; i < n; i++)
+        {
+            if (events[i].data.fd == gStopFD) return(mDNSNULL);
+            ServiceSource(w, events[i].data.fd);
+        }
+    }
+}
+
+mDNSexport int ReceiveWorkersStart(int threads)
+{
+    sigset_t all, saved;
+    int i;
+
+    if (gNumWorkers) return(gReadyFD);
+    if (threads < 1) return(-1);
+    if (threads > kMaxReceiveWorkers) threads = kMaxReceiveWorkers;
+
+    gStopFD  = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    gReadyFD = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (gStopFD < 0 || gReadyFD < 0) goto fail;
+
+    // The workers start with every signal blocked, so that signals the event loop reads through its signalfd
+    // are never taken, and dropped, by a worker instead
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &saved);
+    for (i = 0; i < threads; i++)
+    {
+        ReceiveWorker *const w = &gWorkers[i];
+        struct epoll_event ev;
+
+        mDNSPlatformMemZero(w, sizeof(*w));
+        pthread_mutex_init(&w->lock, mDNSNULL);
+        w->epollfd = epoll_create1(EPOLL_CLOEXEC);
+        if (w->epollfd < 0) goto fail;
+        mDNSPlatformMemZero(&ev, sizeof(ev));
+        ev.events  = EPOLLIN;
+        ev.data.fd = gStopFD;
+        if (epoll_ctl(w->epollfd, EPOLL_CTL_ADD, gStopFD, &ev) < 0 ||
+            pthread_create(&w->thread, mDNSNULL, WorkerMain, w) != 0)
+        {
+            close(w->epollfd);
+            pthread_sigmask(SIG_SETMASK, &saved, mDNSNULL);
+            goto fail;
+        }
+        gNumWorkers++;
+    }
+    pthread_sigmask(SIG_SETMASK, &saved, mDNSNULL);
+    return(gReadyFD);
+
+fail:
+    LogMsg("ReceiveWorkersStart: could not start %d threads %d (%s)", threads, errno, strerror(errno));
+    ReceiveWorkersStop();
+    return(-1);
+}
+
+mDNSexport void ReceiveWorkersStop(void)
+{
+    const uint64_t one = 1;
+    int i;
+
+    if (gNumWorkers && write(gStopFD, &one, sizeof(one)) < 0)
+        LogMsg("ReceiveWorkersStop: write failed %d (%s)", errno, strerror(errno));
+    for (i = 0; i < gNumWorkers; i++)
+    {
+        ReceiveWorker *const w = &gWorkers[i];
+        pthread_join(w->thread, mDNSNULL);
+        while (w->sources)
+        {
+            WorkerSource *const s = w->sources;
+            w->sources = s->next;
+            free(s);
+        }
+        close(w->epollfd);
+        pthread_mutex_destroy(&w->lock);
+    }
+    gNumWorkers = 0;
+
+    ReceiveWorkersRelease(ReceiveWorkersTake());
+    while (gFreeDatagrams)
+    {
+        ReceivedDatagram *const d = gFreeDatagrams;
+        gFreeDatagrams = d->next;
+        free(d);
+    }
+    if (gStopFD  >= 0) { close(gStopFD);  gStopFD  = -1; }
+    if (gReadyFD >= 0) { close(gReadyFD); gReadyFD = -1; }
+}
+
+mDNSexport mDNSBool ReceiveWorkersRunning(void)
+{
+    return(gNumWorkers != 0);
+}
+
+mDNSexport mStatus ReceiveWorkersAddFD(int fd, int ifindex, ReceiveWorkersReadFn readfn)
+{
+    ReceiveWorker *w;
+    WorkerSource *s;
+    struct epoll_event ev;
+
+    if (!gNumWorkers) return(mStatus_NotInitializedErr);
+    s = (WorkerSource *)malloc(sizeof(*s));
+    if (!s) return(mStatus_NoMemoryErr);
+    s->fd      = fd;
+    s->ifindex = ifindex;
+    s->readfn  = readfn;
+
+    // All the sockets for one interface go to the same worker, so its datagrams stay in order
+    w = &gWorkers[(ifindex < 0 ? 0 : ifindex) % gNumWorkers];
+    mDNSPlatformMemZero(&ev, sizeof(ev));
+    ev.events  = EPOLLIN;
+    ev.data.fd = fd;
+    pthread_mutex_lock(&w->lock);
+    if (epoll_ctl(w->epollfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+        pthread_mutex_unlock(&w->lock);
+        LogMsg("ReceiveWorkersAddFD: epoll_ctl %d failed %d (%s)", fd, errno, strerror(errno));
+        free(s);
+        return(mStatus_UnknownErr);
+    }
+    s->next = w->sources;
+    w->sources = s;
+    pthread_mutex_unlock(&w->lock);
+    return(mStatus_NoError);
+}
+
+mDNSexport void ReceiveWorkersRemoveFD(int fd)
+{
+    int i;
+    for (i = 0; i < gNumWorkers; i++)
+    {
+        ReceiveWorker *const w = &gWorkers[i];
+        WorkerSource **p;
+        pthread_mutex_lock(&w->lock);
+        for (p = &w->sources; *p && (*p)->fd != fd; p = &(*p)->next) continue;
+        if (*p)
+        {
+            WorkerSource *const s = *p;
+            *p = s->next;
+            epoll_ctl(w->epollfd, EPOLL_CTL_DEL, fd, mDNSNULL);
+            free(s);
+        }
+        pthread_mutex_unlock(&w->lock);
+    }
+}
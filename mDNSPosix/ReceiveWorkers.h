@@ -0,0 +1,86 @@
+/* -*- Mode: C; tab-width: 4; c-file-style: "bsd"; c-basic-offset: 4; fill-column: 108; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (c) 2002-2019 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ReceiveWorkers_h
+#define __ReceiveWorkers_h
+
+#include "mDNSEmbeddedAPI.h"
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+// Receive worker threads take the system calls, control message decoding, the checks that don't need any core
+// state and the parsing of the DNS message off the thread that runs the core. Each descriptor belongs to one worker,
+// chosen by its interface index, so datagrams from one interface are queued in the order they arrived. The core
+// thread takes the queue when the event descriptor becomes readable and hands each datagram, with the view the
+// worker parsed, to mDNSCoreReceiveParsed(). The workers never touch the mDNS structure, so everything the core
+// does with the message is still serialised on one thread.
+
+typedef struct ReceivedDatagram ReceivedDatagram;
+struct ReceivedDatagram
+{
+    ReceivedDatagram *next;
+    mDNSAddr srcAddr;
+    mDNSIPPort srcPort;
+    mDNSAddr dstAddr;
+    mDNSIPPort dstPort;
+    int ifindex;                        // Interface the datagram arrived on, or -1 if the reader couldn't tell
+    mDNSBool truncated;                 // Didn't fit in msg; dropped by the worker
+    mDNSu32 len;
+    union { DNSMessage m; void *p; } msg;    // Aligned the same way as m->imsg
+    DNSMessageView view;                // Parsed by the worker with ParseReceivedDNSMessage(), once it's queued
+};
+
+// Reads up to max datagrams from fd into batch[0..max-1], filling in everything but next. Returns the number read,
+// 0 if there was nothing to read, or -1 with errno set on error. Called on a worker thread, so it must not touch the
+// core or log; the error is reported from the core thread.
+typedef int (*ReceiveWorkersReadFn)(int fd, int ifindex, ReceivedDatagram **batch, int max);
+
+typedef struct
+{
+    mDNSu32 Datagrams;                  // Read by the workers
+    mDNSu32 Batches;                    // Reads that returned one or more datagrams
+    mDNSu32 BatchMax;                   // Most datagrams returned by one read
+    mDNSu32 Rejected;                   // Truncated, too short, or from an invalid source address
+    mDNSu32 Overflows;                  // Dropped because the core thread had fallen too far behind
+    mDNSu32 Errors;                     // Reads, waits and notifications that failed on a worker thread
+    int LastError;                      // errno of the most recent of those
+} ReceiveWorkersStats;
+
+// Starts the worker threads. Returns the descriptor that becomes readable when datagrams are waiting, or -1.
+extern int ReceiveWorkersStart(int threads);
+extern void ReceiveWorkersStop(void);
+extern mDNSBool ReceiveWorkersRunning(void);
+
+extern mStatus ReceiveWorkersAddFD(int fd, int ifindex, ReceiveWorkersReadFn readfn);
+
+// Once this returns, no worker is reading from fd, so it can be closed
+extern void ReceiveWorkersRemoveFD(int fd);
+
+// Takes everything queued so far, oldest first, and clears the event descriptor. Returns NULL if nothing is waiting.
+// Called on the core thread, which also logs any errors the workers have recorded since the last call.
+extern ReceivedDatagram *ReceiveWorkersTake(void);
+extern void ReceiveWorkersRelease(ReceivedDatagram *list);
+
+extern void ReceiveWorkersGetStats(ReceiveWorkersStats *stats);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,1704 @@
+/* -*- Mode: C; tab-width: 4; c-file-style: "bsd"; c-basic-offset: 4; fill-column: 108; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (c) 2002-2019 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * File:        ReplayBench.c
+ * Contains:    Deterministic replay harness for measuring mDNSCoreReceive throughput.
+ *
+ * ReplayBench links mDNSCore against a stub platform layer that has no sockets and a simulated clock. It
+ * feeds mDNSCoreReceive either the mDNS packets from a pcap capture or a synthetic stream of service
+ * announcements and queries. It then reports throughput, per-packet latency percentiles, cache occupancy
+ * and allocator activity. The stream and the clock are deterministic, so runs on the same tree can be
+ * compared directly. Only the time spent inside mDNSCoreReceive is counted as packet latency. The time
+ * spent in mDNS_Execute between packets is reported separately.
+ *
+ * With -threads, packets go through one datagram socket pair per interface instead, and are read either on
+ * the main thread or by receive worker threads (see ReceiveWorkers.h), to measure how the receive path scales.
+ * The order of packets from different interfaces then depends on the workers, so only the totals are comparable.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE                     // For recvmmsg()
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "mDNSEmbeddedAPI.h"
+#include "DNSCommon.h"
+#include "uDNS.h"
+#include "ReceiveWorkers.h"
+
+//*************************************************************************************************************
+// Types and structures
+
+struct mDNS_PlatformSupport_struct
+{
+    int unused;                         // The stub platform keeps no per-instance state
+};
+
+struct UDPSocket_struct
+{
+    mDNSIPPort port;                    // MUST BE FIRST FIELD -- mDNSCoreReceive expects every UDPSocket_struct to begin with mDNSIPPort port
+};
+
+// One packet of the input stream, in simulated milliseconds from the start of the replay
+typedef struct
+{
+    mDNSs32 when;
+    mDNSAddr src;
+    mDNSAddr dst;
+    mDNSIPPort srcport;
+    int intf;                           // Index into gInterfaces
+    mDNSu32 len;
+    mDNSu8 *data;
+} BenchPacket;
+
+// In socket mode each datagram carries the addresses the core needs ahead of the message itself
+typedef struct
+{
+    mDNSAddr src;
+    mDNSAddr dst;
+    mDNSIPPort srcport;
+} BenchWireHeader;
+
+// Allocations are prefixed with their size so that live and peak bytes can be reported
+typedef union { size_t size; void *p; double d; } AllocHeader;
+
+//*************************************************************************************************************
+// Constants
+
+#define kMaxInterfaces      8
+#define kMaxServiceTypes    64
+#define kWarmupMilliseconds (10 * 1000)     // Long enough for probing and announcing to finish
+#define kSimulatedUTCBase   1600000000      // Arbitrary but fixed, so record expiry is reproducible
+#define kBenchRecvBatch     16              // Datagrams read per recvmmsg() call in socket mode
+
+//*************************************************************************************************************
+// Globals
+
+mDNS mDNSStorage;                           // mDNS core uses this to store its globals
+static mDNS_PlatformSupport PlatformStorage;      // Stores this platform's globals
+mDNSexport const char ProgramName[] = "ReplayBench";
+mDNSexport mDNSs32 mDNSPlatformOneSecond = 1000;
+
+static mDNSs32 gSimNow;                     // The simulated clock, in milliseconds
+static mDNSu32 gSeed = 1;
+static mDNSBool gVerbose = mDNSfalse;
+
+static NetworkInterfaceInfo gInterfaces[kMaxInterfaces];
+static int gNumInterfaces = 1;
+
+static mDNSu32 gCacheChunk   = 500;         // Cache entities added each time the core asks for more
+static mDNSu32 gCacheLimit   = 0;           // Stop growing the cache at this many entities; 0 means no limit
+
+static mDNSu32 gPacketsSent;                // Sends that the stub platform swallowed
+static mDNSu32 gBytesSent;
+static mDNSu32 gAnswersDelivered;           // Add and remove events delivered to the browse questions
+static mDNSu32 gRecordsRegistered;          // Records of our own that queries may be answered from
+
+static int gReceiveThreads = -1;            // Socket mode with this many receive workers; -1 calls mDNSCoreReceive directly
+static double gReceiveCPUNs;                // Socket mode: CPU time the main thread spent in mDNSCoreReceive
+static int gSendFD[kMaxInterfaces];         // Socket mode: the replay writes to these...
+static int gRecvFD[kMaxInterfaces];         // ...and the core's side reads from these
+
+static mDNSu32 gAllocCalls, gFreeCalls;
+static size_t gLiveBytes, gPeakBytes;
+static mDNSu32 gLiveAllocs, gPeakAllocs;
+
+//*************************************************************************************************************
+// Stub platform layer
+
+mDNSexport mStatus mDNSPlatformInit(mDNS *const m)
+{
+    MakeDomainLabelFromLiteralString(&m->hostlabel, "replaybench");
+    m->nicelabel = m->hostlabel;
+    mDNS_SetFQDN(m);
+    mDNSCoreInitComplete(m, mStatus_NoError);
+    return(mStatus_NoError);
+}
+
+mDNSexport void mDNSPlatformClose(mDNS *const m)
+{
+    (void)m;    // Unused
+}
+
+mDNSexport mStatus mDNSPlatformSendUDP(const mDNS *const m, const void *const msg, const mDNSu8 *const end,
+                                       mDNSInterfaceID InterfaceID, UDPSocket *src, const mDNSAddr *dst,
+                                       mDNSIPPort dstport, mDNSBool useBackgroundTrafficClass)
+{
+    (void)m; (void)InterfaceID; (void)src; (void)dst; (void)dstport; (void)useBackgroundTrafficClass;  // Unused
+    gPacketsSent++;
+    gBytesSent += (mDNSu32)(end - (const mDNSu8 *)msg);
+    return(mStatus_NoError);
+}
+
+mDNSexport void mDNSPlatformLock(const mDNS *const m)
+{
+    (void)m;    // Unused
+}
+
+mDNSexport void mDNSPlatformUnlock(const mDNS *const m)
+{
+    (void)m;    // Unused
+}
+
+mDNSexport mDNSu32 mDNSPlatformStrLCopy(void *dst, const void *src, mDNSu32 dstlen)
+{
+    const size_t srclen = strlen((const char *)src);
+    if (dstlen > 0)
+    {
+        const size_t n = (srclen < dstlen) ? srclen : (size_t)(dstlen - 1);
+        memcpy(dst, src, n);
+        ((char *)dst)[n] = '\0';
+    }
+    return((mDNSu32)srclen);
+}
+
+mDNSexport mDNSu32 mDNSPlatformStrLen(const void *src)
+{
+    return((mDNSu32)strlen((const char *)src));
+}
+
+mDNSexport void mDNSPlatformMemCopy(void *dst, const void *src, mDNSu32 len)
+{
+    memcpy(dst, src, len);
+}
+
+mDNSexport mDNSBool mDNSPlatformMemSame(const void *dst, const void *src, mDNSu32 len)
+{
+    return(memcmp(dst, src, len) == 0);
+}
+
+mDNSexport int mDNSPlatformMemCmp(const void *dst, const void *src, mDNSu32 len)
+{
+    return(memcmp(dst, src, len));
+}
+
+mDNSexport void mDNSPlatformMemZero(void *dst, mDNSu32 len)
+{
+    memset(dst, 0, len);
+}
+
+mDNSexport void mDNSPlatformQsort(void *base, int nel, int width, int (*compar)(const void *, const void *))
+{
+    qsort(base, (size_t)nel, (size_t)width, compar);
+}
+
+#if !MDNS_MALLOC_DEBUGGING
+mDNSexport void *mDNSPlatformMemAllocate(mDNSu32 len)
+{
+    AllocHeader *const h = (AllocHeader *)malloc(sizeof(AllocHeader) + len);
+    if (!h) return(mDNSNULL);
+    h->size = len;
+    gAllocCalls++;
+    gLiveAllocs++;
+    gLiveBytes += len;
+    if (gLiveAllocs > gPeakAllocs) gPeakAllocs = gLiveAllocs;
+    if (gLiveBytes  > gPeakBytes)  gPeakBytes  = gLiveBytes;
+    return(h + 1);
+}
+
+mDNSexport void *mDNSPlatformMemAllocateClear(mDNSu32 len)
+{
+    void *const mem = mDNSPlatformMemAllocate(len);
+    if (mem) memset(mem, 0, len);
+    return(mem);
+}
+
+mDNSexport void mDNSPlatformMemFree(void *mem)
+{
+    AllocHeader *h;
+    if (!mem) return;
+    h = (AllocHeader *)mem - 1;
+    gFreeCalls++;
+    gLiveAllocs--;
+    gLiveBytes -= h->size;
+    free(h);
+}
+#endif
+
+mDNSexport mDNSu32 mDNSPlatformRandomSeed(void)
+{
+    return(gSeed);
+}
+
+mDNSexport mStatus mDNSPlatformTimeInit(void)
+{
+    return(mStatus_NoError);
+}
+
+mDNSexport mDNSs32 mDNSPlatformRawTime(void)
+{
+    return(gSimNow);
+}
+
+mDNSexport mDNSs32 mDNSPlatformUTC(void)
+{
+    return(kSimulatedUTCBase + gSimNow / 1000);
+}
+
+mDNSexport mDNSs32 mDNSPlatformGetPID(void)
+{
+    return(0);
+}
+
+mDNSexport void mDNSPlatformWriteLogMsg(const char *ident, const char *buffer, mDNSLogLevel_t loglevel)
+{
+    (void)ident;    // Unused
+    (void)loglevel; // Unused
+    if (gVerbose) fprintf(stderr, "%s\n", buffer);
+}
+
+mDNSexport mDNSInterfaceID mDNSPlatformInterfaceIDfromInterfaceIndex(mDNS *const m, mDNSu32 ifindex)
+{
+    (void)m;    // Unused
+    if (ifindex == 0 || ifindex > (mDNSu32)gNumInterfaces) return(mDNSNULL);
+    return(gInterfaces[ifindex - 1].InterfaceID);
+}
+
+mDNSexport mDNSu32 mDNSPlatformInterfaceIndexfromInterfaceID(mDNS *const m, mDNSInterfaceID id, mDNSBool suppressNetworkChange)
+{
+    (void)m;                        // Unused
+    (void)suppressNetworkChange;    // Unused
+    return((mDNSu32)(uintptr_t)id);
+}
+
+mDNSexport mDNSBool mDNSPlatformInterfaceIsD2D(mDNSInterfaceID InterfaceID)
+{
+    (void)InterfaceID;  // Unused
+    return(mDNSfalse);
+}
+
+mDNSexport mDNSBool mDNSPlatformValidRecordForInterface(const AuthRecord *rr, mDNSInterfaceID InterfaceID)
+{
+    (void)rr; (void)InterfaceID;    // Unused
+    return(mDNStrue);
+}
+
+mDNSexport mDNSBool mDNSPlatformValidQuestionForInterface(DNSQuestion *q, const NetworkInterfaceInfo *intf)
+{
+    (void)q; (void)intf;            // Unused
+    return(mDNStrue);
+}
+
+mDNSexport mDNSBool mDNSPlatformSetDNSConfig(mDNSBool setservers, mDNSBool setsearch, domainname *const fqdn,
+                                             DNameListElem **RegDomains, DNameListElem **BrowseDomains, mDNSBool ackConfig)
+{
+    (void)setservers; (void)setsearch; (void)RegDomains; (void)BrowseDomains; (void)ackConfig;  // Unused
+    if (fqdn) fqdn->c[0] = 0;
+    return(mDNStrue);
+}
+
+mDNSexport mStatus mDNSPlatformGetPrimaryInterface(mDNSAddr *v4, mDNSAddr *v6, mDNSAddr *router)
+{
+    v4->type     = mDNSAddrType_None;
+    v6->type     = mDNSAddrType_None;
+    router->type = mDNSAddrType_None;
+    return(mStatus_NoError);
+}
+
+mDNSexport void mDNSPlatformDynDNSHostNameStatusChanged(const domainname *const dname, const mStatus status)
+{
+    (void)dname; (void)status;      // Unused
+}
+
+mDNSexport void mDNSPlatformSourceAddrForDest(mDNSAddr *const src, const mDNSAddr *const dst)
+{
+    (void)dst;  // Unused
+    src->type = mDNSAddrType_None;
+}
+
+mDNSexport UDPSocket *mDNSPlatformUDPSocket(const mDNSIPPort requestedport)
+{
+    UDPSocket *const sock = (UDPSocket *)mDNSPlatformMemAllocateClear(sizeof(*sock));
+    if (sock) sock->port = mDNSIPPortIsZero(requestedport) ? mDNSOpaque16fromIntVal((mDNSu16)(0xC000 + mDNSRandom(0x3FFF))) : requestedport;
+    return(sock);
+}
+
+mDNSexport void mDNSPlatformUDPClose(UDPSocket *sock)
+{
+    mDNSPlatformMemFree(sock);
+}
+
+mDNSexport TCPSocket *mDNSPlatformTCPSocket(TCPSocketFlags flags, mDNSAddr_Type addrtype, mDNSIPPort *port,
+                                            domainname *hostname, mDNSBool useBackgroundTrafficClass)
+{
+    (void)flags; (void)addrtype; (void)port; (void)hostname; (void)useBackgroundTrafficClass;  // Unused
+    return(mDNSNULL);
+}
+
+mDNSexport mStatus mDNSPlatformTCPConnect(TCPSocket *sock, const mDNSAddr *dst, mDNSOpaque16 dstport,
+                                          mDNSInterfaceID InterfaceID, TCPConnectionCallback callback, void *context)
+{
+    (void)sock; (void)dst; (void)dstport; (void)InterfaceID; (void)callback; (void)context;  // Unused
+    return(mStatus_UnsupportedErr);
+}
+
+mDNSexport void mDNSPlatformTCPCloseConnection(TCPSocket *sock)
+{
+    (void)sock; // Unused
+}
+
+mDNSexport long mDNSPlatformReadTCP(TCPSocket *sock, void *buf, unsigned long buflen, mDNSBool *closed)
+{
+    (void)sock; (void)buf; (void)buflen;    // Unused
+    *closed = mDNStrue;
+    return(-1);
+}
+
+mDNSexport long mDNSPlatformWriteTCP(TCPSocket *sock, const char *msg, unsigned long len)
+{
+    (void)sock; (void)msg; (void)len;       // Unused
+    return(-1);
+}
+
+mDNSexport int mDNSPlatformTCPGetFD(TCPSocket *sock)
+{
+    (void)sock; // Unused
+    return(-1);
+}
+
+mDNSexport void mDNSPlatformUpdateProxyList(const mDNSInterfaceID InterfaceID)
+{
+    (void)InterfaceID;  // Unused
+}
+
+mDNSexport void mDNSPlatformSetAllowSleep(mDNSBool allowSleep, const char *reason)
+{
+    (void)allowSleep; (void)reason;     // Unused
+}
+
+mDNSexport void mDNSPlatformSendWakeupPacket(mDNSInterfaceID InterfaceID, char *EthAddr, char *IPAddr, int iteration)
+{
+    (void)InterfaceID; (void)EthAddr; (void)IPAddr; (void)iteration;    // Unused
+}
+
+mDNSexport void mDNSPlatformSendRawPacket(const void *const msg, const mDNSu8 *const end, mDNSInterfaceID InterfaceID)
+{
+    (void)msg; (void)end; (void)InterfaceID;    // Unused
+}
+
+mDNSexport void mDNSPlatformSetLocalAddressCacheEntry(const mDNSAddr *const tpa, const mDNSEthAddr *const tha, mDNSInterfaceID InterfaceID)
+{
+    (void)tpa; (void)tha; (void)InterfaceID;    // Unused
+}
+
+mDNSexport void mDNSPlatformSendKeepalive(mDNSAddr *sadd, mDNSAddr *dadd, mDNSIPPort *lport, mDNSIPPort *rport, mDNSu32 seq, mDNSu32 ack, mDNSu16 win)
+{
+    (void)sadd; (void)dadd; (void)lport; (void)rport; (void)seq; (void)ack; (void)win;  // Unused
+}
+
+mDNSexport mStatus mDNSPlatformRetrieveTCPInfo(mDNSAddr *laddr, mDNSIPPort *lport, mDNSAddr *raddr, mDNSIPPort *rport, mDNSTCPInfo *mti)
+{
+    (void)laddr; (void)lport; (void)raddr; (void)rport; (void)mti;  // Unused
+    return(mStatus_UnsupportedErr);
+}
+
+mDNSexport mStatus mDNSPlatformGetRemoteMacAddr(mDNSAddr *raddr)
+{
+    (void)raddr;    // Unused
+    return(mStatus_UnsupportedErr);
+}
+
+mDNSexport mStatus mDNSPlatformStoreSPSMACAddr(mDNSAddr *spsaddr, char *ifname)
+{
+    (void)spsaddr; (void)ifname;    // Unused
+    return(mStatus_UnsupportedErr);
+}
+
+mDNSexport mStatus mDNSPlatformClearSPSData(void)
+{
+    return(mStatus_UnsupportedErr);
+}
+
+mDNSexport mStatus mDNSPlatformStoreOwnerOptRecord(char *ifname, DNSMessage *msg, int length)
+{
+    (void)ifname; (void)msg; (void)length;  // Unused
+    return(mStatus_UnsupportedErr);
+}
+
+mDNSexport void mDNSPlatformSetSocktOpt(void *sock, mDNSTransport_Type transType, mDNSAddr_Type addrType, const DNSQuestion *q)
+{
+    (void)sock; (void)transType; (void)addrType; (void)q;   // Unused
+}
+
+//*************************************************************************************************************
+// Simulated clock
+
+static mDNSs32 gNextEvent;                  // Simulated time of the next mDNS_Execute
+
+// The core keeps its own clock, offset from mDNSPlatformRawTime by m->timenow_adjust
+#define CoreTimeToSimTime(m, t) ((t) - (m)->timenow_adjust)
+
+// Moves the simulated clock forward to when, running mDNS_Execute each time it is due on the way
+static double AdvanceClock(mDNS *const m, mDNSs32 when)
+{
+    struct timespec t0, t1;
+    double elapsed = 0;
+
+    for (; ;)
+    {
+        if (gNextEvent - when > 0) break;
+        if (gNextEvent - gSimNow > 0) gSimNow = gNextEvent;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        gNextEvent = CoreTimeToSimTime(m, mDNS_Execute(m));
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        elapsed += (double)(t1.tv_sec - t0.tv_sec) * 1e9 + (double)(t1.tv_nsec - t0.tv_nsec);
+        // mDNS_Execute may ask to run again right now; let the clock move on before calling it again
+        if (gNextEvent - gSimNow <= 0) gNextEvent = gSimNow + 1;
+    }
+    if (when - gSimNow > 0) gSimNow = when;
+    return(elapsed);
+}
+
+//*************************************************************************************************************
+// Synthetic stream
+
+typedef struct
+{
+    mDNSu32 packets;
+    mDNSu32 instances;                  // Distinct service instances announced
+    mDNSu32 types;                      // Distinct service types
+    mDNSu32 queryPercent;               // Share of packets that are queries rather than responses
+    mDNSu32 intervalMicroseconds;       // Simulated time between packets
+    mDNSu32 records;                    // Host records we register ourselves; half the queries ask for one of them
+    mDNSu32 knownAnswers;               // PTR records in the known-answer list of each service type query
+} SyntheticParams;
+
+static mDNSu32 gRandomState;
+
+static mDNSu32 BenchRandom(mDNSu32 max)   // Returns 0..max-1; xorshift, so the stream depends only on the seed
+{
+    gRandomState ^= gRandomState << 13;
+    gRandomState ^= gRandomState >> 17;
+    gRandomState ^= gRandomState << 5;
+    return(max ? gRandomState % max : 0);
+}
+
+// Returns "_benchN._tcp", with ".local." appended if withDomain is set
+static void ServiceTypeName(domainname *const name, mDNSu32 type, mDNSBool withDomain)
+{
+    char buf[MAX_ESCAPED_DOMAIN_NAME];
+    snprintf(buf, sizeof(buf), "_bench%u._tcp%s", type, withDomain ? ".local." : "");
+    MakeDomainNameFromDNSNameString(name, buf);
+}
+
+// Returns "Instance N._benchT._tcp.local."
+static mDNSBool InstanceServiceName(domainname *const name, mDNSu32 instance, mDNSu32 type)
+{
+    domainname svctype;
+    domainlabel label;
+    char buf[64];
+    ServiceTypeName(&svctype, type, mDNSfalse);
+    snprintf(buf, sizeof(buf), "Instance %u", instance);
+    MakeDomainLabelFromLiteralString(&label, buf);
+    return(ConstructServiceName(name, &label, &svctype, &localdomain) != mDNSNULL);
+}
+
+static mDNSu8 *PutRRHeader(DNSMessage *const msg, mDNSu8 *ptr, const mDNSu8 *const limit, const domainname *const name, mDNSu16 rrtype,
+                           mDNSu16 rrclass, mDNSu32 ttl)
+{
+    ptr = putDomainNameAsLabels(msg, ptr, limit, name);
+    if (!ptr || ptr + 10 > limit) return(mDNSNULL);
+    ptr[0] = (mDNSu8)(rrtype  >> 8); ptr[1] = (mDNSu8)rrtype;
+    ptr[2] = (mDNSu8)(rrclass >> 8); ptr[3] = (mDNSu8)rrclass;
+    ptr[4] = (mDNSu8)(ttl >> 24); ptr[5] = (mDNSu8)(ttl >> 16); ptr[6] = (mDNSu8)(ttl >> 8); ptr[7] = (mDNSu8)ttl;
+    return(ptr + 8);                    // Caller fills in rdlength
+}
+
+static mDNSu8 *PutRData(mDNSu8 *ptr, const mDNSu8 *const limit, const mDNSu8 *const rdata, mDNSu16 rdlength)
+{
+    if (!ptr || ptr + 2 + rdlength > limit) return(mDNSNULL);
+    ptr[0] = (mDNSu8)(rdlength >> 8); ptr[1] = (mDNSu8)rdlength;
+    mDNSPlatformMemCopy(ptr + 2, rdata, rdlength);
+    return(ptr + 2 + rdlength);
+}
+
+// Builds an announcement for one service instance: PTR, SRV and TXT, plus the host's A record
+static mDNSu8 *BuildResponse(DNSMessage *const msg, mDNSu32 instance, mDNSu32 type)
+{
+    const mDNSu8 *const limit = msg->data + AbsoluteMaxDNSMessageData;
+    domainname svctype, svcname, host;
+    char buf[64];
+    mDNSu8 rdata[MAX_DOMAIN_NAME + 6];
+    mDNSu8 *ptr = msg->data;
+    mDNSu16 len;
+
+    if (!InstanceServiceName(&svcname, instance, type)) return(mDNSNULL);
+    ServiceTypeName(&svctype, type, mDNStrue);
+    snprintf(buf, sizeof(buf), "host-%u.local.", instance);
+    MakeDomainNameFromDNSNameString(&host, buf);
+
+    InitializeDNSMessage(&msg->h, zeroID, ResponseFlags);
+
+    // PTR (shared)
+    ptr = PutRRHeader(msg, ptr, limit, &svctype, kDNSType_PTR, kDNSClass_IN, 4500);
+    len = DomainNameLength(&svcname);
+    ptr = PutRData(ptr, limit, svcname.c, len);
+
+    // SRV (unique)
+    ptr = ptr ? PutRRHeader(msg, ptr, limit, &svcname, kDNSType_SRV, kDNSClass_IN | kDNSClass_UniqueRRSet, 120) : mDNSNULL;
+    len = DomainNameLength(&host);
+    rdata[0] = 0; rdata[1] = 0; rdata[2] = 0; rdata[3] = 0;
+    rdata[4] = (mDNSu8)((1024 + instance % 60000) >> 8); rdata[5] = (mDNSu8)(1024 + instance % 60000);
+    mDNSPlatformMemCopy(rdata + 6, host.c, len);
+    ptr = PutRData(ptr, limit, rdata, (mDNSu16)(6 + len));
+
+    // TXT (unique)
+    ptr = ptr ? PutRRHeader(msg, ptr, limit, &svcname, kDNSType_TXT, kDNSClass_IN | kDNSClass_UniqueRRSet, 4500) : mDNSNULL;
+    len = (mDNSu16)snprintf((char *)rdata + 1, sizeof(rdata) - 1, "id=%u", instance);
+    rdata[0] = (mDNSu8)len;
+    ptr = PutRData(ptr, limit, rdata, (mDNSu16)(len + 1));
+
+    // A (unique)
+    ptr = ptr ? PutRRHeader(msg, ptr, limit, &host, kDNSType_A, kDNSClass_IN | kDNSClass_UniqueRRSet, 120) : mDNSNULL;
+    rdata[0] = 10; rdata[1] = 1; rdata[2] = (mDNSu8)(instance >> 8); rdata[3] = (mDNSu8)instance;
+    ptr = PutRData(ptr, limit, rdata, 4);
+
+    if (!ptr) return(mDNSNULL);
+    msg->h.numAnswers = 4;
+    return(ptr);
+}
+
+// Builds a PTR query for a service type, listing the first instances of that type as known answers
+static mDNSu8 *BuildQuery(DNSMessage *const msg, const SyntheticParams *const params, mDNSu32 type)
+{
+    const mDNSu8 *const limit = msg->data + NormalMaxDNSMessageData;
+    domainname svctype, svcname;
+    mDNSu32 instance;
+    mDNSu8 *ptr;
+
+    ServiceTypeName(&svctype, type, mDNStrue);
+    InitializeDNSMessage(&msg->h, zeroID, QueryFlags);
+    ptr = putQuestion(msg, msg->data, limit, &svctype, kDNSType_PTR, kDNSClass_IN);
+    for (instance = type; ptr && msg->h.numAnswers < params->knownAnswers && instance < params->instances; instance += params->types)
+    {
+        mDNSu8 *const next = InstanceServiceName(&svcname, instance, type) ?
+            PutRRHeader(msg, ptr, limit, &svctype, kDNSType_PTR, kDNSClass_IN, 4500) : mDNSNULL;
+        if (!next) break;
+        ptr = PutRData(next, limit, svcname.c, DomainNameLength(&svcname));
+        msg->h.numAnswers++;
+    }
+    return(ptr);
+}
+
+// Returns "proxy-N.local.", the name of one of the records registered by RegisterRecords
+static void ProxyHostName(domainname *const name, mDNSu32 record)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "proxy-%u.local.", record);
+    MakeDomainNameFromDNSNameString(name, buf);
+}
+
+static mDNSu8 *BuildRecordQuery(DNSMessage *const msg, mDNSu32 record)
+{
+    domainname host;
+    mDNSu8 *ptr;
+
+    ProxyHostName(&host, record);
+    InitializeDNSMessage(&msg->h, zeroID, QueryFlags);
+    ptr = putQuestion(msg, msg->data, msg->data + AbsoluteMaxDNSMessageData, &host, kDNSType_A, kDNSClass_IN);
+    return(ptr);
+}
+
+// Converts the header counts to network byte order, as they would be on the wire
+static void SwapHeaderToWire(DNSMessage *const msg)
+{
+    mDNSu8 *const p = (mDNSu8 *)&msg->h.numQuestions;
+    const mDNSu16 counts[4] = { msg->h.numQuestions, msg->h.numAnswers, msg->h.numAuthorities, msg->h.numAdditionals };
+    int i;
+    for (i = 0; i < 4; i++) { p[i * 2] = (mDNSu8)(counts[i] >> 8); p[i * 2 + 1] = (mDNSu8)counts[i]; }
+}
+
+static BenchPacket *MakeSyntheticStream(const SyntheticParams *const params, mDNSu32 *count)
+{
+    BenchPacket *const pkts = (BenchPacket *)calloc(params->packets ? params->packets : 1, sizeof(BenchPacket));
+    DNSMessage msg;
+    mDNSu32 i;
+
+    if (!pkts) return(mDNSNULL);
+    gRandomState = gSeed ? gSeed : 1;
+    for (i = 0; i < params->packets; i++)
+    {
+        BenchPacket *const p = &pkts[i];
+        const mDNSu32 instance = BenchRandom(params->instances);
+        const mDNSu32 type = instance % params->types;
+        const mDNSBool query = BenchRandom(100) < params->queryPercent;
+        mDNSu8 *end;
+
+        if (!query)                                       end = BuildResponse(&msg, instance, type);
+        else if (params->records && BenchRandom(2) == 0)  end = BuildRecordQuery(&msg, BenchRandom(params->records));
+        else                                              end = BuildQuery(&msg, params, type);
+
+        if (!end) { fprintf(stderr, "Could not build synthetic packet %u\n", i); free(pkts); return(mDNSNULL); }
+        SwapHeaderToWire(&msg);
+        p->when                    = (mDNSs32)(((unsigned long long)i * params->intervalMicroseconds) / 1000);
+        p->intf                    = (int)(instance % (mDNSu32)gNumInterfaces);
+        p->src.type                = mDNSAddrType_IPv4;
+        p->src.ip.v4.b[0]          = 10;
+        p->src.ip.v4.b[1]          = (mDNSu8)p->intf;
+        p->src.ip.v4.b[2]          = (mDNSu8)(instance >> 8);
+        p->src.ip.v4.b[3]          = (mDNSu8)(2 + instance % 250);
+        p->dst                     = AllDNSLinkGroup_v4;
+        p->srcport                 = MulticastDNSPort;
+        p->len                     = (mDNSu32)(end - (mDNSu8 *)&msg);
+        p->data                    = (mDNSu8 *)malloc(p->len);
+        if (!p->data) { free(pkts); return(mDNSNULL); }
+        memcpy(p->data, &msg, p->len);
+    }
+    *count = params->packets;
+    return(pkts);
+}
+
+//*************************************************************************************************************
+// pcap input
+
+static mDNSu32 Read32(const mDNSu8 *p, mDNSBool swap)
+{
+    return(swap ? ((mDNSu32)p[0] << 24 | (mDNSu32)p[1] << 16 | (mDNSu32)p[2] << 8 | p[3])
+                : ((mDNSu32)p[3] << 24 | (mDNSu32)p[2] << 16 | (mDNSu32)p[1] << 8 | p[0]));
+}
+
+// Finds the IP header in one captured frame. Returns its offset, or -1 for link types and frames we don't handle.
+static int IPOffsetForFrame(mDNSu32 linktype, const mDNSu8 *frame, mDNSu32 caplen)
+{
+    int off;
+    mDNSu16 ethertype;
+
+    switch (linktype)
+    {
+    case 0:                         // BSD loopback: four-byte address family in host order
+        return(caplen >= 4 ? 4 : -1);
+    case 12: case 14: case 101:     // Raw IP
+        return(0);
+    case 113:                       // Linux cooked capture
+        if (caplen < 16) return(-1);
+        ethertype = (mDNSu16)(frame[14] << 8 | frame[15]);
+        off = 16;
+        break;
+    case 1:                         // Ethernet
+        if (caplen < 14) return(-1);
+        ethertype = (mDNSu16)(frame[12] << 8 | frame[13]);
+        off = 14;
+        while ((ethertype == 0x8100 || ethertype == 0x88A8) && (mDNSu32)off + 4 <= caplen)
+        {
+            ethertype = (mDNSu16)(frame[off + 2] << 8 | frame[off + 3]);
+            off += 4;
+        }
+        break;
+    default:
+        return(-1);
+    }
+    return((ethertype == 0x0800 || ethertype == 0x86DD) ? off : -1);
+}
+
+// Extracts a UDP datagram to or from port 5353. Returns mDNSfalse for anything else.
+static mDNSBool ParseFrame(mDNSu32 linktype, const mDNSu8 *frame, mDNSu32 caplen, BenchPacket *const p)
+{
+    const int ipoff = IPOffsetForFrame(linktype, frame, caplen);
+    const mDNSu8 *ip, *udp;
+    mDNSu32 iplen, udplen;
+
+    if (ipoff < 0 || (mDNSu32)ipoff >= caplen) return(mDNSfalse);
+    ip = frame + ipoff;
+    iplen = caplen - (mDNSu32)ipoff;
+
+    if ((ip[0] >> 4) == 4)
+    {
+        const mDNSu32 hl = (mDNSu32)(ip[0] & 0x0F) * 4;
+        if (iplen < 20 || hl < 20 || iplen < hl + 8 || ip[9] != 17) return(mDNSfalse);
+        if ((ip[6] & 0x3F) || ip[7]) return(mDNSfalse);     // Fragments
+        p->src.type = mDNSAddrType_IPv4;
+        p->dst.type = mDNSAddrType_IPv4;
+        memcpy(p->src.ip.v4.b, ip + 12, 4);
+        memcpy(p->dst.ip.v4.b, ip + 16, 4);
+        udp = ip + hl;
+    }
+    else if ((ip[0] >> 4) == 6)
+    {
+        if (iplen < 48 || ip[6] != 17) return(mDNSfalse);  // Extension headers are not followed
+        p->src.type = mDNSAddrType_IPv6;
+        p->dst.type = mDNSAddrType_IPv6;
+        memcpy(p->src.ip.v6.b, ip + 8,  16);
+        memcpy(p->dst.ip.v6.b, ip + 24, 16);
+        udp = ip + 40;
+    }
+    else
+        return(mDNSfalse);
+
+    udplen = (mDNSu32)(udp[4] << 8 | udp[5]);
+    if (udplen < 8 + sizeof(DNSMessageHeader) || udp + udplen > frame + caplen) return(mDNSfalse);
+    if ((udp[0] << 8 | udp[1]) != 5353 && (udp[2] << 8 | udp[3]) != 5353) return(mDNSfalse);
+    if (udplen - 8 > sizeof(DNSMessage)) return(mDNSfalse);
+
+    p->srcport.b[0] = udp[0];
+    p->srcport.b[1] = udp[1];
+    p->len  = udplen - 8;
+    p->data = (mDNSu8 *)malloc(p->len);
+    if (!p->data) return(mDNSfalse);
+    memcpy(p->data, udp + 8, p->len);
+    return(mDNStrue);
+}
+
+static BenchPacket *ReadPcap(const char *const path, mDNSu32 *count, mDNSu32 *skipped)
+{
+    FILE *const f = fopen(path, "rb");
+    mDNSu8 hdr[24], rec[16];
+    mDNSu8 *frame = mDNSNULL;
+    BenchPacket *pkts = mDNSNULL;
+    mDNSu32 n = 0, capacity = 0;
+    mDNSu32 magic, linktype, snaplen;
+    mDNSBool swap, nanosec;
+    mDNSBool haveFirst = mDNSfalse;
+    unsigned long long first = 0;
+
+    *count = 0;
+    *skipped = 0;
+    if (!f) { fprintf(stderr, "Cannot open %s\n", path); return(mDNSNULL); }
+    if (fread(hdr, 1, sizeof(hdr), f) != sizeof(hdr)) { fprintf(stderr, "%s: not a pcap file\n", path); goto fail; }
+
+    magic = Read32(hdr, mDNSfalse);
+    if      (magic == 0xA1B2C3D4) { swap = mDNSfalse; nanosec = mDNSfalse; }
+    else if (magic == 0xD4C3B2A1) { swap = mDNStrue;  nanosec = mDNSfalse; }
+    else if (magic == 0xA1B23C4D) { swap = mDNSfalse; nanosec = mDNStrue;  }
+    else if (magic == 0x4D3CB2A1) { swap = mDNStrue;  nanosec = mDNStrue;  }
+    else { fprintf(stderr, "%s: not a pcap file (pcapng is not supported)\n", path); goto fail; }
+    snaplen  = Read32(hdr + 16, swap);
+    linktype = Read32(hdr + 20, swap) & 0x0FFFFFFF;
+    if (snaplen == 0 || snaplen > 262144) snaplen = 262144;
+    frame = (mDNSu8 *)malloc(snaplen);
+    if (!frame) goto fail;
+
+    while (fread(rec, 1, sizeof(rec), f) == sizeof(rec))
+    {
+        const mDNSu32 sec    = Read32(rec,      swap);
+        const mDNSu32 frac   = Read32(rec + 4,  swap);
+        const mDNSu32 caplen = Read32(rec + 8,  swap);
+        unsigned long long usec;
+        BenchPacket p;
+
+        if (caplen > snaplen) { fprintf(stderr, "%s: corrupt record\n", path); break; }
+        if (fread(frame, 1, caplen, f) != caplen) break;
+
+        mDNSPlatformMemZero(&p, sizeof(p));
+        if (!ParseFrame(linktype, frame, caplen, &p)) { (*skipped)++; continue; }
+
+        usec = (unsigned long long)sec * 1000000 + (nanosec ? frac / 1000 : frac);
+        if (!haveFirst) { first = usec; haveFirst = mDNStrue; }
+        p.when = (mDNSs32)((usec >= first ? usec - first : 0) / 1000);
+        p.intf = 0;
+
+        if (n == capacity)
+        {
+            BenchPacket *const bigger = (BenchPacket *)realloc(pkts, (capacity ? capacity * 2 : 1024) * sizeof(BenchPacket));
+            if (!bigger) { free(p.data); break; }
+            pkts = bigger;
+            capacity = capacity ? capacity * 2 : 1024;
+        }
+        pkts[n++] = p;
+    }
+    free(frame);
+    fclose(f);
+    *count = n;
+    return(pkts);
+
+fail:
+    free(frame);
+    fclose(f);
+    return(mDNSNULL);
+}
+
+//*************************************************************************************************************
+// Core setup
+
+static void StatusCallback(mDNS *const m, mStatus result)
+{
+    if (result == mStatus_GrowCache && (!gCacheLimit || m->rrcache_size + gCacheChunk <= gCacheLimit))
+    {
+        CacheEntity *const storage = (CacheEntity *)mDNSPlatformMemAllocateClear(sizeof(CacheEntity) * gCacheChunk);
+        if (storage) mDNS_GrowCache(m, storage, gCacheChunk);
+    }
+}
+
+static void BrowseCallback(mDNS *const m, DNSQuestion *question, const ResourceRecord *const answer, QC_result AddRecord)
+{
+    (void)m; (void)question; (void)answer; (void)AddRecord;  // Unused
+    gAnswersDelivered++;
+}
+
+static mStatus RegisterInterfaces(mDNS *const m)
+{
+    int i;
+    for (i = 0; i < gNumInterfaces; i++)
+    {
+        NetworkInterfaceInfo *const intf = &gInterfaces[i];
+        mStatus err;
+        mDNSPlatformMemZero(intf, sizeof(*intf));
+        intf->InterfaceID         = (mDNSInterfaceID)(uintptr_t)(i + 1);
+        intf->ip.type             = mDNSAddrType_IPv4;
+        intf->ip.ip.v4.b[0]       = 10;
+        intf->ip.ip.v4.b[1]       = (mDNSu8)i;
+        intf->ip.ip.v4.b[3]       = 1;
+        intf->mask.type           = mDNSAddrType_IPv4;
+        intf->mask.ip.v4.NotAnInteger = 0;
+        intf->mask.ip.v4.b[0]     = 0xFF;
+        intf->mask.ip.v4.b[1]     = 0xFF;
+        intf->MAC.b[0]            = 0x02;
+        intf->MAC.b[5]            = (mDNSu8)(i + 1);
+        intf->Advertise           = mDNSfalse;
+        intf->McastTxRx           = mDNStrue;
+        intf->SupportsUnicastMDNSResponse = mDNStrue;
+        snprintf(intf->ifname, sizeof(intf->ifname), "sim%d", i);
+        err = mDNS_RegisterInterface(m, intf, NormalActivation);
+        if (err) return(err);
+    }
+    return(mStatus_NoError);
+}
+
+static mStatus StartBrowses(mDNS *const m, DNSQuestion *const questions, mDNSu32 types)
+{
+    mDNSu32 i;
+    for (i = 0; i < types; i++)
+    {
+        DNSQuestion *const q = &questions[i];
+        mStatus err;
+        mDNSPlatformMemZero(q, sizeof(*q));
+        q->InterfaceID      = mDNSInterface_Any;
+        q->qtype            = kDNSType_PTR;
+        q->qclass           = kDNSClass_IN;
+        q->QuestionCallback = BrowseCallback;
+        ServiceTypeName(&q->qname, i, mDNStrue);
+        err = mDNS_StartQuery(m, q);
+        if (err) return(err);
+    }
+    return(mStatus_NoError);
+}
+
+// Starts an SRV question for each of the first 'count' synthetic instances, as a resolve would
+static mStatus StartResolves(mDNS *const m, DNSQuestion *const questions, mDNSu32 count, mDNSu32 types)
+{
+    mDNSu32 i;
+    for (i = 0; i < count; i++)
+    {
+        DNSQuestion *const q = &questions[i];
+        mStatus err;
+        mDNSPlatformMemZero(q, sizeof(*q));
+        q->InterfaceID      = mDNSInterface_Any;
+        q->qtype            = kDNSType_SRV;
+        q->qclass           = kDNSClass_IN;
+        q->QuestionCallback = BrowseCallback;
+        if (!InstanceServiceName(&q->qname, i, i % types)) return(mStatus_BadParamErr);
+        err = mDNS_StartQuery(m, q);
+        if (err) return(err);
+    }
+    return(mStatus_NoError);
+}
+
+// Registers 'count' A records named "proxy-N.local.", standing in for the records a gateway proxies for its hosts
+static mStatus RegisterRecords(mDNS *const m, AuthRecord *const records, mDNSu32 count)
+{
+    mDNSu32 i;
+    for (i = 0; i < count; i++)
+    {
+        AuthRecord *const rr = &records[i];
+        mStatus err;
+        mDNS_SetupResourceRecord(rr, mDNSNULL, mDNSInterface_Any, kDNSType_A, 120, kDNSRecordTypeKnownUnique,
+                                 AuthRecordAny, mDNSNULL, mDNSNULL);
+        ProxyHostName(&rr->namestorage, i);
+        rr->resrec.rdata->u.ipv4.b[0] = 10;
+        rr->resrec.rdata->u.ipv4.b[1] = 2;
+        rr->resrec.rdata->u.ipv4.b[2] = (mDNSu8)(i >> 8);
+        rr->resrec.rdata->u.ipv4.b[3] = (mDNSu8)i;
+        err = mDNS_Register(m, rr);
+        if (err) return(err);
+    }
+    return(mStatus_NoError);
+}
+
+//*************************************************************************************************************
+// Split-DNS resolver selection
+
+#define kMaxResolvers 127                   // The core keeps at most 128 unicast DNS servers; one is the default
+
+// Returns "dN.vpnM.example.", the domain of the Nth split-DNS server. Servers 2N and 2N+1 share a domain.
+static void ResolverDomain(domainname *const name, mDNSu32 resolver)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "d%u.vpn%u.example.", resolver / 2, resolver % 8);
+    MakeDomainNameFromDNSNameString(name, buf);
+}
+
+// Adds a default server and 'count' split-DNS servers, as a VPN client's configuration would, and then picks a
+// server for 'lookups' questions, the way a unicast question does when it starts. One server in four is scoped to
+// the first interface, as are one question in four; one question in ten is for a name outside every split domain.
+static void RunResolverSelection(mDNS *const m, mDNSu32 count, mDNSu32 lookups)
+{
+    static DNSQuestion q;
+    struct timespec t0, t1;
+    mDNSu32 checksum = 0, unanswered = 0, i;
+    double ns;
+
+    mDNS_Lock(m);
+    for (i = 0; i <= count; i++)
+    {
+        const mDNSBool scoped = (i % 4 == 3);
+        domainname domain;
+        mDNSAddr addr;
+        addr.type = mDNSAddrType_IPv4;
+        addr.ip.v4.b[0] = 10;
+        addr.ip.v4.b[1] = 3;
+        addr.ip.v4.b[2] = (mDNSu8)(i >> 8);
+        addr.ip.v4.b[3] = (mDNSu8)i;
+        if (i == count) domain.c[0] = 0;
+        else ResolverDomain(&domain, i);
+        mDNS_AddDNSServer(m, &domain, scoped ? gInterfaces[0].InterfaceID : mDNSInterface_Any, 0, &addr, UnicastDNSPort,
+                          scoped ? kScopeInterfaceID : kScopeNone, DEFAULT_UDNS_TIMEOUT, mDNSfalse, mDNSfalse, mDNSfalse,
+                          mDNSfalse, 0, mDNStrue, mDNStrue, mDNSfalse);
+    }
+
+    q.qtype    = kDNSType_A;
+    q.qclass   = kDNSClass_IN;
+    q.ServiceID = -1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < lookups; i++)
+    {
+        const mDNSu32 resolver = BenchRandom(count);
+        DNSServer *server;
+        char buf[MAX_ESCAPED_DOMAIN_NAME];
+
+        if (BenchRandom(10) == 0) snprintf(buf, sizeof(buf), "host%u.elsewhere.example.", i);
+        else snprintf(buf, sizeof(buf), "host%u.d%u.vpn%u.example.", i, resolver / 2, resolver % 8);
+        MakeDomainNameFromDNSNameString(&q.qname, buf);
+        q.InterfaceID = (BenchRandom(4) == 0) ? gInterfaces[0].InterfaceID : mDNSInterface_Any;
+
+        SetValidDNSServers(m, &q);
+        server = GetServerForQuestion(m, &q);
+        if (server) checksum = checksum * 31 + (mDNSu32)(server->addr.ip.v4.b[2] << 8 | server->addr.ip.v4.b[3]);
+        else unanswered++;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    mDNS_Unlock(m);
+
+    ns = (double)(t1.tv_sec - t0.tv_sec) * 1e9 + (double)(t1.tv_nsec - t0.tv_nsec);
+    printf("Split-DNS servers              %u (+1 default)\n", count);
+    printf("Server selections              %u\n", lookups);
+    printf("Questions with no server       %u\n", unanswered);
+    printf("Selection checksum             %08x\n", checksum);
+    printf("Time per selection             %.0f ns\n", lookups ? ns / lookups : 0.0);
+}
+
+//*************************************************************************************************************
+// TSIG signing
+
+// Times DNSDigest_SignMessage, which signs every dynamic update and LLQ message sent with a key, on a message the
+// size of one service's announcement. The last message signed with each key is checked with DNSDigest_VerifyMessage.
+static mDNSBool RunSigning(mDNS *const m, mDNSu32 count)
+{
+    static const struct { mDNSu8 algorithm; const char *name; const char *b64key; } keys[] =
+    {
+        { TSIG_Alg_HMAC_MD5,    "hmac-md5",    "YmVuY2gtc2VjcmV0LWtleQ==" },                        // 16 bytes
+        { TSIG_Alg_HMAC_SHA256, "hmac-sha256", "YmVuY2gtc2VjcmV0LWtleS1mb3ItaG1hYy1zaGEyNTY=" }     // 32 bytes
+    };
+    static DNSMessage msg, signedMsg;
+    static LargeCacheRecord tsig;
+    static DomainAuthInfo info;
+    mDNSu8 *end;
+    mDNSu32 len, i, k;
+
+    end = BuildResponse(&msg, 1, 0);
+    if (!end) return(mDNSfalse);
+    len = (mDNSu32)(end - (mDNSu8 *)&msg);
+    msg.h.numAnswers = 0;
+    ((mDNSu8 *)&msg.h.numAnswers)[1] = 4;       // DNSDigest_SignMessage takes the header in network byte order
+
+    printf("Message signed                 %u bytes\n", len);
+    printf("Signatures                     %u per algorithm\n", count);
+    for (k = 0; k < sizeof(keys) / sizeof(keys[0]); k++)
+    {
+        struct timespec t0, t1;
+        const mDNSu8 *tsigEnd;
+        mDNSu16 rcode = 0, tcode = 0;
+        mDNSBool verified;
+        double ns;
+
+        mDNSPlatformMemZero(&info, sizeof(info));
+        info.algorithm = keys[k].algorithm;
+        MakeDomainNameFromDNSNameString(&info.keyname, "bench-key.example.");
+        if (DNSDigest_ConstructHMACKeyfromBase64(&info, keys[k].b64key) < 0) return(mDNSfalse);
+
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (i = 0; i < count; i++)
+        {
+            mDNSPlatformMemCopy(&signedMsg, &msg, len);
+            end = (mDNSu8 *)&signedMsg + len;
+            DNSDigest_SignMessage(&signedMsg, &end, &info, 0);
+            if (!end) return(mDNSfalse);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        ns = (double)(t1.tv_sec - t0.tv_sec) * 1e9 + (double)(t1.tv_nsec - t0.tv_nsec);
+
+        // The TSIG record follows the unsigned message; verifying expects it taken off the additional count
+        tsigEnd = GetLargeResourceRecord(m, &signedMsg, (mDNSu8 *)&signedMsg + len, end, mDNSInterface_Any,
+                                         kDNSRecordTypePacketAdd, &tsig);
+        signedMsg.h.numAdditionals = 0;
+        verified = tsigEnd == end && tsig.r.resrec.rrtype == kDNSType_TSIG &&
+                   DNSDigest_VerifyMessage(&signedMsg, (mDNSu8 *)&signedMsg + len, &tsig, &info, &rcode, &tcode);
+
+        printf("%-12s                   %.0f ns per signature, %.0f signatures/sec, %s\n", keys[k].name,
+               count ? ns / count : 0.0, ns > 0 ? count / (ns / 1e9) : 0.0, verified ? "verified" : "NOT VERIFIED");
+        if (!verified) return(mDNSfalse);
+    }
+    return(mDNStrue);
+}
+
+//*************************************************************************************************************
+// Domain name comparison
+
+#define kNameCorpus     2048                // Distinct service names compared
+#define kNamePairs      65536               // Pairs of names, reused until the requested count has been compared
+
+// The byte loop that SameDomainLabel() uses when DNSCommon.c is built with DOMAINNAME_SIMD_DISABLED
+static mDNSBool ByteLoopSameDomainLabel(const mDNSu8 *a, const mDNSu8 *b)
+{
+    const int len = *a++;
+    int i;
+    if (len > MAX_DOMAIN_LABEL || len != *b++) return(mDNSfalse);
+    for (i = 0; i < len; i++)
+    {
+        mDNSu8 ac = *a++;
+        mDNSu8 bc = *b++;
+        if (mDNSIsUpperCase(ac)) ac += 'a' - 'A';
+        if (mDNSIsUpperCase(bc)) bc += 'a' - 'A';
+        if (ac != bc) return(mDNSfalse);
+    }
+    return(mDNStrue);
+}
+
+static mDNSBool ByteLoopSameDomainName(const domainname *const d1, const domainname *const d2)
+{
+    const mDNSu8 *a = d1->c;
+    const mDNSu8 *b = d2->c;
+    while (*a || *b)
+    {
+        if (a + 1 + *a >= d1->c + MAX_DOMAIN_NAME || !ByteLoopSameDomainLabel(a, b)) return(mDNSfalse);
+        a += 1 + *a;
+        b += 1 + *b;
+    }
+    return(mDNStrue);
+}
+
+// Swaps the case of every letter in the name, which leaves it the same name
+static void SwapCase(domainname *const name)
+{
+    mDNSu8 *p;
+    for (p = name->c; *p; p += 1 + *p)
+    {
+        int i;
+        for (i = 1; i <= *p; i++)
+            if (mDNSIsLetter(p[i])) p[i] ^= 'a' - 'A';
+    }
+}
+
+// Changes one byte of one label, chosen at random, so that the name differs only there
+static void ChangeOneByte(domainname *const name)
+{
+    mDNSu8 *p = name->c;
+    mDNSu32 labels = CountLabels(name), i;
+    for (i = BenchRandom(labels); i > 0; i--) p += 1 + *p;
+    p[1 + BenchRandom(*p)] ^= 1;        // Case folding never touches the low bit, so the names no longer match
+}
+
+// Returns a name like "Living Room._airplay._tcp.local.", with " (N)" after the instance once the list runs out
+static mDNSBool ServiceNameForComparison(domainname *const name, mDNSu32 index)
+{
+    static const char *const instances[] =
+    {
+        "Living Room", "Kitchen", "Apple TV", "iPad", "Office Printer", "Bedroom Speaker", "Jane's MacBook Pro",
+        "Brother HL-L2350DW series", "HP LaserJet Pro MFP M428fdw (5C1A2B)", "EPSON ET-2850 Series",
+        "Samsung Smart TV (QN65Q80B)", "Philips Hue - 1A2B3C", "Chromecast Ultra", "7C2EBD0A1F34@Living Room",
+        "Synology DS920+", "Front Door Camera 0A3F"
+    };
+    static const char *const types[] =
+    {
+        "_airplay._tcp", "_raop._tcp", "_googlecast._tcp", "_ipp._tcp", "_ipps._tcp", "_printer._tcp", "_hap._tcp",
+        "_companion-link._tcp", "_smb._tcp", "_device-info._tcp", "_sleep-proxy._udp", "_spotify-connect._tcp"
+    };
+    const mDNSu32 numInstances = sizeof(instances) / sizeof(instances[0]);
+    const mDNSu32 numTypes     = sizeof(types) / sizeof(types[0]);
+    const mDNSu32 round        = index / (numInstances * numTypes);
+    domainname svctype;
+    domainlabel label;
+    char buf[MAX_DOMAIN_LABEL + 1];
+
+    if (round) snprintf(buf, sizeof(buf), "%s (%u)", instances[index % numInstances], round + 1);
+    else snprintf(buf, sizeof(buf), "%s", instances[index % numInstances]);
+    MakeDomainLabelFromLiteralString(&label, buf);
+    MakeDomainNameFromDNSNameString(&svctype, types[(index / numInstances) % numTypes]);
+    return(ConstructServiceName(name, &label, &svctype, &localdomain) != mDNSNULL);
+}
+
+// Checks SameDomainLabel against the byte loop for every label length, with each of the bytes around the letter
+// ranges at each position. Each label ends at the end of its allocation, so a vector load past it shows up
+// under AddressSanitizer.
+static mDNSu32 CheckLabelComparisons(void)
+{
+    static const mDNSu8 edges[] = { 0x00, '0', '@', 'A', 'M', 'Z', '[', '`', 'a', 'm', 'z', '{', 0x7F, 0x80, 0xC1, 0xDA, 0xFF };
+    mDNSu8 *const bufA = (mDNSu8 *)malloc(1 + MAX_DOMAIN_LABEL);
+    mDNSu8 *const bufB = (mDNSu8 *)malloc(1 + MAX_DOMAIN_LABEL);
+    mDNSu32 mismatches = 0;
+    int len, pos, i, j, k;
+
+    if (!bufA || !bufB) { free(bufA); free(bufB); return(1); }
+    for (len = 1; len <= MAX_DOMAIN_LABEL; len++)
+    {
+        mDNSu8 *const a = bufA + MAX_DOMAIN_LABEL - len;
+        mDNSu8 *const b = bufB + MAX_DOMAIN_LABEL - len;
+        for (pos = 1; pos <= len; pos++)
+        {
+            for (i = 0; i < (int)sizeof(edges); i++)
+            {
+                a[0] = b[0] = (mDNSu8)len;
+                for (j = 1; j <= len; j++) a[j] = (mDNSu8)"Ab-9zQ_x"[j % 8];
+                a[pos] = edges[i];
+                for (j = 1; j <= len; j++) b[j] = mDNSIsLetter(a[j]) ? (mDNSu8)(a[j] ^ ('a' - 'A')) : a[j];
+                for (k = 0; k < 3; k++)
+                {
+                    if (k == 1) b[pos] = (mDNSu8)(a[pos] ^ ('a' - 'A'));
+                    if (k == 2) b[pos] = (mDNSu8)(a[pos] ^ 1);
+                    if (SameDomainLabel(a, b) != ByteLoopSameDomainLabel(a, b)) mismatches++;
+                }
+            }
+        }
+    }
+    free(bufA);
+    free(bufB);
+    return(mismatches);
+}
+
+// Checks SameDomainName against the byte loop on pairs of realistic service names, then times 'count' calls of it.
+// A quarter of the pairs are copies of the same name, a quarter differ only in case, a quarter differ in one byte
+// and the rest are two names from the corpus.
+static mDNSBool RunNameComparison(mDNSu32 count)
+{
+    domainname *const names    = (domainname *)malloc(3 * kNameCorpus * sizeof(domainname));
+    mDNSu32    *const pairs    = (mDNSu32 *)malloc(2 * kNamePairs * sizeof(mDNSu32));
+    struct timespec t0, t1;
+    mDNSu32 equal = 0, mismatches, i;
+    double ns;
+
+    if (!names || !pairs) { free(names); free(pairs); return(mDNSfalse); }
+    gRandomState = gSeed ? gSeed : 1;
+    for (i = 0; i < kNameCorpus; i++)
+    {
+        if (!ServiceNameForComparison(&names[i], i)) { free(names); free(pairs); return(mDNSfalse); }
+        AssignDomainName(&names[kNameCorpus + i], &names[i]);
+        SwapCase(&names[kNameCorpus + i]);
+        AssignDomainName(&names[2 * kNameCorpus + i], &names[i]);
+        ChangeOneByte(&names[2 * kNameCorpus + i]);
+    }
+    for (i = 0; i < kNamePairs; i++)
+    {
+        const mDNSu32 first = BenchRandom(kNameCorpus);
+        pairs[2 * i] = first;
+        switch (i % 4)
+        {
+        case 0:  pairs[2 * i + 1] = first; break;
+        case 1:  pairs[2 * i + 1] = kNameCorpus + first; break;
+        case 2:  pairs[2 * i + 1] = 2 * kNameCorpus + first; break;
+        default: pairs[2 * i + 1] = BenchRandom(kNameCorpus); break;
+        }
+    }
+
+    mismatches = CheckLabelComparisons();
+    for (i = 0; i < kNamePairs; i++)
+    {
+        const domainname *const a = &names[pairs[2 * i]];
+        const domainname *const b = &names[pairs[2 * i + 1]];
+        if (SameDomainName(a, b) != ByteLoopSameDomainName(a, b)) mismatches++;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < count; i++)
+    {
+        const mDNSu32 *const p = &pairs[2 * (i % kNamePairs)];
+        equal += SameDomainName(&names[p[0]], &names[p[1]]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ns = (double)(t1.tv_sec - t0.tv_sec) * 1e9 + (double)(t1.tv_nsec - t0.tv_nsec);
+
+    printf("Names in corpus                %u, each also case-swapped and with one byte changed\n", kNameCorpus);
+    printf("Mismatches with byte loop      %u\n", mismatches);
+    printf("Comparisons                    %u\n", count);
+    printf("Names equal                    %u\n", equal);
+    printf("Time per SameDomainName        %.1f ns\n", count ? ns / count : 0.0);
+    free(names);
+    free(pairs);
+    return(mismatches == 0);
+}
+
+//*************************************************************************************************************
+// Socket mode
+
+static mDNSBool OpenSockets(void)
+{
+    int i;
+    for (i = 0; i < gNumInterfaces; i++)
+    {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) < 0)
+        {
+            fprintf(stderr, "socketpair failed: %s\n", strerror(errno));
+            return(mDNSfalse);
+        }
+        gSendFD[i] = fds[0];
+        gRecvFD[i] = fds[1];
+    }
+    return(mDNStrue);
+}
+
+// The ReceiveWorkersReadFn for the socket pairs; ifindex is the index into gInterfaces
+static int BenchReadBatch(int fd, int ifindex, ReceivedDatagram **batch, int max)
+{
+    BenchWireHeader hdr[kBenchRecvBatch];
+    struct mmsghdr msgs[kBenchRecvBatch];
+    struct iovec iov[kBenchRecvBatch][2];
+    int n, i;
+
+    if (max > kBenchRecvBatch) max = kBenchRecvBatch;
+    memset(msgs, 0, sizeof(msgs[0]) * (size_t)max);
+    for (i = 0; i < max; i++)
+    {
+        iov[i][0].iov_base = &hdr[i];
+        iov[i][0].iov_len  = sizeof(hdr[i]);
+        iov[i][1].iov_base = &batch[i]->msg.m;
+        iov[i][1].iov_len  = sizeof(batch[i]->msg.m);
+        msgs[i].msg_hdr.msg_iov    = iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 2;
+    }
+
+    n = recvmmsg(fd, msgs, (unsigned int)max, MSG_DONTWAIT, mDNSNULL);
+    if (n < 0) return((errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1);
+    for (i = 0; i < n; i++)
+    {
+        ReceivedDatagram *const d = batch[i];
+        d->srcAddr   = hdr[i].src;
+        d->srcPort   = hdr[i].srcport;
+        d->dstAddr   = hdr[i].dst;
+        d->dstPort   = MulticastDNSPort;
+        d->ifindex   = ifindex;
+        d->len       = msgs[i].msg_len > sizeof(hdr[i]) ? msgs[i].msg_len - (mDNSu32)sizeof(hdr[i]) : 0;
+        d->truncated = (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) ? mDNStrue : mDNSfalse;
+    }
+    return(n);
+}
+
+// Returns mDNSfalse if the socket is full and the packet must be sent again once the reader has caught up
+static mDNSBool SendPacket(const BenchPacket *const p)
+{
+    BenchWireHeader hdr;
+    struct iovec iov[2];
+    struct msghdr msg;
+
+    hdr.src     = p->src;
+    hdr.dst     = p->dst;
+    hdr.srcport = p->srcport;
+    iov[0].iov_base = &hdr;
+    iov[0].iov_len  = sizeof(hdr);
+    iov[1].iov_base = p->data;
+    iov[1].iov_len  = p->len;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov    = iov;
+    msg.msg_iovlen = 2;
+
+    if (sendmsg(gSendFD[p->intf], &msg, 0) >= 0) return(mDNStrue);
+    if (errno != EAGAIN && errno != EWOULDBLOCK) { fprintf(stderr, "sendmsg failed: %s\n", strerror(errno)); exit(1); }
+    return(mDNSfalse);
+}
+
+// Datagrams the workers queued come with the view they parsed; the ones the main thread reads are parsed by the core
+static mDNSu32 DeliverList(mDNS *const m, ReceivedDatagram *d, mDNSu32 *latency, mDNSu32 *delivered, double *receiveNs)
+{
+    mDNSu32 bytes = 0;
+    for (; d; d = d->next)
+    {
+        struct timespec t0, t1, c0, c1;
+        if (d->truncated) continue;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &c0);
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        mDNSCoreReceiveParsed(m, &d->msg.m, (mDNSu8 *)&d->msg.m + d->len, gReceiveThreads > 0 ? &d->view : mDNSNULL,
+                              &d->srcAddr, d->srcPort, &d->dstAddr, d->dstPort, gInterfaces[d->ifindex].InterfaceID);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &c1);
+        gReceiveCPUNs += (double)(c1.tv_sec - c0.tv_sec) * 1e9 + (double)(c1.tv_nsec - c0.tv_nsec);
+
+        if (CoreTimeToSimTime(m, m->NextScheduledEvent) - gNextEvent < 0)
+            gNextEvent = CoreTimeToSimTime(m, m->NextScheduledEvent);
+
+        latency[*delivered] = (mDNSu32)((t1.tv_sec - t0.tv_sec) * 1000000000L + (t1.tv_nsec - t0.tv_nsec));
+        *receiveNs += latency[*delivered];
+        (*delivered)++;
+        bytes += d->len;
+    }
+    return(bytes);
+}
+
+// Hands the core everything that has been received so far. With no workers the main thread reads the sockets
+// itself, into a batch of its own.
+static mDNSu32 Drain(mDNS *const m, mDNSu32 *latency, mDNSu32 *delivered, double *receiveNs)
+{
+    static ReceivedDatagram buffers[kBenchRecvBatch];
+    ReceivedDatagram *batch[kBenchRecvBatch];
+    mDNSu32 bytes = 0;
+    int i, n;
+
+    if (gReceiveThreads > 0)
+    {
+        ReceivedDatagram *const list = ReceiveWorkersTake();
+        bytes = DeliverList(m, list, latency, delivered, receiveNs);
+        ReceiveWorkersRelease(list);
+        return(bytes);
+    }
+
+    for (i = 0; i < kBenchRecvBatch; i++) batch[i] = &buffers[i];
+    for (i = 0; i < gNumInterfaces; i++)
+    {
+        while ((n = BenchReadBatch(gRecvFD[i], i, batch, kBenchRecvBatch)) > 0)
+        {
+            int j;
+            for (j = 0; j < n; j++) buffers[j].next = (j + 1 < n) ? &buffers[j + 1] : mDNSNULL;
+            bytes += DeliverList(m, buffers, latency, delivered, receiveNs);
+        }
+    }
+    return(bytes);
+}
+
+static void WaitForWorkers(int readyFD)
+{
+    struct pollfd pfd;
+    pfd.fd      = readyFD;
+    pfd.events  = POLLIN;
+    pfd.revents = 0;
+    (void)poll(&pfd, 1, 10);
+}
+
+//*************************************************************************************************************
+// Reporting
+
+static int CompareLatency(const void *a, const void *b)
+{
+    const mDNSu32 x = *(const mDNSu32 *)a, y = *(const mDNSu32 *)b;
+    return((x > y) - (x < y));
+}
+
+static mDNSu32 Percentile(const mDNSu32 *sorted, mDNSu32 n, double pct)
+{
+    if (!n) return(0);
+    return(sorted[(mDNSu32)((double)(n - 1) * pct / 100.0 + 0.5)]);
+}
+
+static void Report(const mDNS *const m, mDNSu32 *latency, mDNSu32 n, mDNSu32 skipped, double receiveNs, double executeNs,
+                   mDNSu32 bytes, mDNSs32 simulated, mDNSu32 allocsBefore)
+{
+    qsort(latency, n, sizeof(latency[0]), CompareLatency);
+
+    printf("Packets replayed               %u\n", n);
+    if (skipped) printf("Frames skipped                 %u\n", skipped);
+    printf("Bytes replayed                 %u\n", bytes);
+    printf("Simulated duration             %d.%03d s\n", simulated / 1000, simulated % 1000);
+    printf("Time in mDNSCoreReceive        %.3f ms\n", receiveNs / 1e6);
+    if (gReceiveThreads >= 0)   // Unlike the wall time, this leaves out time the workers had the CPU
+        printf("CPU in mDNSCoreReceive         %.3f ms (%.0f ns/packet)\n", gReceiveCPUNs / 1e6, n ? gReceiveCPUNs / n : 0.0);
+    printf("Time in mDNS_Execute           %.3f ms\n", executeNs / 1e6);
+    printf("Packets/sec (receive only)     %.0f\n", receiveNs > 0 ? n / (receiveNs / 1e9) : 0.0);
+    printf("Packets/sec (with execute)     %.0f\n", receiveNs + executeNs > 0 ? n / ((receiveNs + executeNs) / 1e9) : 0.0);
+    printf("Latency p50                    %u ns\n", Percentile(latency, n, 50));
+    printf("Latency p90                    %u ns\n", Percentile(latency, n, 90));
+    printf("Latency p99                    %u ns\n", Percentile(latency, n, 99));
+    printf("Latency p99.9                  %u ns\n", Percentile(latency, n, 99.9));
+    printf("Latency max                    %u ns\n", n ? latency[n - 1] : 0);
+    printf("Cache entities                 %u\n", m->rrcache_size);
+    printf("Cache records in use           %u\n", m->rrcache_totalused);
+    printf("Cache records active           %u\n", m->rrcache_active);
+    printf("Records registered             %u\n", gRecordsRegistered);
+    printf("Answers delivered              %u\n", gAnswersDelivered);
+    printf("Packets sent                   %u (%u bytes)\n", gPacketsSent, gBytesSent);
+    printf("Allocations during replay      %u\n", gAllocCalls - allocsBefore);
+    printf("Allocations live/peak          %u / %u\n", gLiveAllocs, gPeakAllocs);
+    printf("Allocated bytes live/peak      %lu / %lu\n", (unsigned long)gLiveBytes, (unsigned long)gPeakBytes);
+}
+
+// Makes every cache slot due for its expiration check and its refresh queries, then runs mDNS_Execute so that it
+// walks the whole cache, passes times over. The clock doesn't move, so after the first pass nothing expires and
+// no more refresh queries are due, and the passes only measure the walks.
+static void RunCacheScans(mDNS *const m, mDNSu32 passes)
+{
+    double ns = 0;
+    mDNSu32 i, slot;
+
+    for (i = 0; i < passes; i++)
+    {
+        const mDNSs32 now = mDNS_TimeNow(m);
+        struct timespec t0, t1;
+
+        for (slot = 0; slot < CACHE_HASH_SLOTS; slot++)
+        {
+            m->rrcache_nextcheck[slot]   = now;
+            m->rrcache_nextrefresh[slot] = now;
+        }
+        m->NextCacheCheck     = now;
+        m->NextScheduledQuery = now;
+        m->NextScheduledEvent = now;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        mDNS_Execute(m);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        ns += (double)(t1.tv_sec - t0.tv_sec) * 1e9 + (double)(t1.tv_nsec - t0.tv_nsec);
+    }
+    printf("Cache entity size              %u bytes\n", (unsigned)sizeof(CacheEntity));
+    printf("Full cache scans               %u\n", passes);
+    printf("Time per full cache scan       %.1f us (%.1f ns per record)\n", passes ? ns / passes / 1e3 : 0.0,
+           passes && m->rrcache_totalused ? ns / passes / m->rrcache_totalused : 0.0);
+}
+
+//*************************************************************************************************************
+// Main
+
+static void usage(const char *progname)
+{
+    fprintf(stderr, "Usage: %s [options] [capture.pcap]\n", progname);
+    fprintf(stderr, "Replays a pcap file, or a synthetic stream if no file is given, into mDNSCoreReceive.\n");
+    fprintf(stderr, "  -n <packets>     Synthetic packets to generate (default 100000)\n");
+    fprintf(stderr, "  -names <n>       Distinct synthetic service instances (default 2000)\n");
+    fprintf(stderr, "  -types <n>       Distinct synthetic service types, max %d (default 16)\n", kMaxServiceTypes);
+    fprintf(stderr, "  -q <percent>     Share of synthetic packets that are queries (default 20)\n");
+    fprintf(stderr, "  -interval <us>   Simulated time between synthetic packets (default 1000)\n");
+    fprintf(stderr, "  -i <n>           Simulated interfaces, max %d (default 1)\n", kMaxInterfaces);
+    fprintf(stderr, "  -cache <n>       Cache entities allocated at a time (default 500)\n");
+    fprintf(stderr, "  -maxcache <n>    Stop growing the cache at this many entities (default: no limit)\n");
+    fprintf(stderr, "  -nobrowse        Don't start browse questions for the synthetic service types\n");
+    fprintf(stderr, "  -resolves <n>    Also start SRV questions for the first n synthetic instances (default 0)\n");
+    fprintf(stderr, "  -records <n>     Register n A records of our own, and ask for them in half the queries (default 0)\n");
+    fprintf(stderr, "  -ka <n>          Put up to n PTR records in the known-answer list of service type queries (default 0)\n");
+    fprintf(stderr, "  -seed <n>        Random seed for the stream and the core (default 1)\n");
+    fprintf(stderr, "  -resolvers <n>   Instead of replaying, add n split-DNS servers, max %d, and time picking a server\n", kMaxResolvers);
+    fprintf(stderr, "                   for as many questions as there would have been packets\n");
+    fprintf(stderr, "  -sign <n>        Instead of replaying, time signing n messages with each TSIG algorithm\n");
+    fprintf(stderr, "  -namecmp <n>     Instead of replaying, check SameDomainName against the byte loop and time n calls\n");
+    fprintf(stderr, "  -scan <n>        After replaying, time n passes of mDNS_Execute over the whole cache\n");
+    fprintf(stderr, "  -threads <n>     Deliver packets through sockets read by n receive worker threads, or by the\n");
+    fprintf(stderr, "                   main thread if n is 0 (default: call mDNSCoreReceive directly)\n");
+    fprintf(stderr, "  -v               Show core log messages\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *const progname = strrchr(argv[0], '/') ? strrchr(argv[0], '/') + 1 : argv[0];
+    SyntheticParams params = { 100000, 2000, 16, 20, 1000, 0, 0 };
+    const char *pcapPath = mDNSNULL;
+    mDNSBool browse = mDNStrue;
+    static DNSQuestion questions[kMaxServiceTypes];
+    DNSQuestion *resolves = mDNSNULL;
+    mDNSu32 numResolves = 0;
+    AuthRecord *records = mDNSNULL;
+    CacheEntity *initialCache;
+    BenchPacket *pkts;
+    mDNSu32 count = 0, skipped = 0, bytes = 0, allocsBefore, i;
+    mDNSu32 *latency;
+    double receiveNs = 0, executeNs = 0;
+    mDNSs32 start;
+    struct timespec wall0, wall1;
+    int readyFD = -1;
+    mDNSu32 numResolvers = 0;
+    mDNSu32 numSignatures = 0;
+    mDNSu32 numNameComparisons = 0;
+    mDNSu32 scans = 0;
+    mStatus err;
+    int a;
+
+    for (a = 1; a < argc; a++)
+    {
+        const mDNSBool hasArg = (a + 1 < argc);
+        if      (hasArg && !strcmp(argv[a], "-n"))        params.packets              = (mDNSu32)strtoul(argv[++a], mDNSNULL, 0);
+        else if (hasArg && !strcmp(argv[a], "-names"))    params.instances            = (mDNSu32)strtoul(argv[++a], mDNSNULL, 0);
+        else if (hasArg && !strcmp(argv[a], "-types"))    params.types                = (mDNSu32)strtoul(argv[++a], mDNSNULL, 0);
+        else if (hasArg && !strcmp(argv[a], "-q"))        params.queryPercent         = (mDNSu32)strtoul(argv[++a], mDNSNULL, 0);
+        else if (hasArg && !strcmp(argv[a], "-interval")) params.intervalMicroseconds = (mDNSu32)strtoul(argv[++a], mDNSNULL, 0);
+        else if (hasArg && !strcmp(argv[a], "-i"))        gNumInterfaces              = atoi(argv[++a]);
+        else if (hasArg && !strcmp(argv[a], "-cache"))    gCacheChunk                 = (mDNSu32)strtoul(argv[++a], mDNSNULL, 0);
+        else if (hasArg && !strcmp(argv[a], "-maxcache")) gCacheLimit                 = (mDNSu32)strtoul(argv[++a], mDNSNULL, 0);
+        else if (hasArg && !strcmp(argv[a], "-seed"))     gSeed                       = (mDNSu32)strtoul(argv[++a], mDNSNULL, 0);
+        else if (hasArg && !strcmp(argv[a], "-resolves")) numResolves                 = (mDNSu32)strtoul(argv[++a], mDNSNULL, 0);
+        else if (hasArg && !strcmp(argv[a], "-records"))  params.records              = (mDNSu32)strtoul(argv[++a], mDNSNULL, 0);
+        else if (hasArg && !strcmp(argv[a], "-ka"))       params.knownAnswers         = (mDNSu32)strtoul(argv[++a], mDNSNULL, 0);
+        else if (hasArg && !strcmp(argv[a], "-threads"))  gReceiveThreads             = atoi(argv[++a]);
+        else if (hasArg && !strcmp(argv[a], "-resolvers")) numResolvers               = (mDNSu32)strtoul(argv[++a], mDNSNULL, 0);
+        else if (hasArg && !strcmp(argv[a], "-sign"))     numSignatures               = (mDNSu32)strtoul(argv[++a], mDNSNULL, 0);
+        else if (hasArg && !strcmp(argv[a], "-namecmp"))  numNameComparisons          = (mDNSu32)strtoul(argv[++a], mDNSNULL, 0);
+        else if (hasArg && !strcmp(argv[a], "-scan"))     scans                       = (mDNSu32)strtoul(argv[++a], mDNSNULL, 0);
+        else if (!strcmp(argv[a], "-nobrowse"))           browse = mDNSfalse;
+        else if (!strcmp(argv[a], "-v"))                  gVerbose = mDNStrue;
+        else if (argv[a][0] != '-' && !pcapPath)          pcapPath = argv[a];
+        else { usage(progname); return(1); }
+    }
+    if (gNumInterfaces < 1 || gNumInterfaces > kMaxInterfaces || params.types < 1 || params.types > kMaxServiceTypes ||
+        params.instances < 1 || params.queryPercent > 100 || gCacheChunk < 1 || gReceiveThreads < -1 ||
+        numResolvers > kMaxResolvers)
+    {
+        usage(progname);
+        return(1);
+    }
+
+    initialCache = (CacheEntity *)mDNSPlatformMemAllocateClear(sizeof(CacheEntity) * gCacheChunk);
+    err = mDNS_Init(&mDNSStorage, &PlatformStorage, initialCache, gCacheChunk, mDNS_Init_DontAdvertiseLocalAddresses,
+                    StatusCallback, mDNS_Init_NoInitCallbackContext);
+    if (!err) err = RegisterInterfaces(&mDNSStorage);
+    if (!err && browse && !pcapPath) err = StartBrowses(&mDNSStorage, questions, params.types);
+    if (!err && numResolves)
+    {
+        resolves = (DNSQuestion *)calloc(numResolves, sizeof(DNSQuestion));
+        err = resolves ? StartResolves(&mDNSStorage, resolves, numResolves, params.types) : mStatus_NoMemoryErr;
+    }
+    if (!err && params.records)
+    {
+        records = (AuthRecord *)calloc(params.records, sizeof(AuthRecord));
+        err = records ? RegisterRecords(&mDNSStorage, records, params.records) : mStatus_NoMemoryErr;
+        if (!err) gRecordsRegistered = params.records;
+    }
+    if (err) { fprintf(stderr, "Core setup failed %d\n", err); return(1); }
+
+    if (numResolvers)
+    {
+        gRandomState = gSeed ? gSeed : 1;
+        RunResolverSelection(&mDNSStorage, numResolvers, params.packets);
+        return(0);
+    }
+
+    if (numSignatures)
+    {
+        if (!RunSigning(&mDNSStorage, numSignatures)) { fprintf(stderr, "Signing failed\n"); return(1); }
+        return(0);
+    }
+
+    if (numNameComparisons)
+    {
+        if (!RunNameComparison(numNameComparisons)) { fprintf(stderr, "Name comparison failed\n"); return(1); }
+        return(0);
+    }
+
+    // Build the whole stream before the replay starts so that parsing the input is not part of the measurement
+    pkts = pcapPath ? ReadPcap(pcapPath, &count, &skipped) : MakeSyntheticStream(&params, &count);
+    if (!pkts) return(1);
+    latency = (mDNSu32 *)calloc(count ? count : 1, sizeof(mDNSu32));
+    if (!latency) return(1);
+
+    if (gReceiveThreads >= 0)
+    {
+        if (!OpenSockets()) return(1);
+        if (gReceiveThreads > 0)
+        {
+            readyFD = ReceiveWorkersStart(gReceiveThreads);
+            if (readyFD < 0) { fprintf(stderr, "Could not start %d receive threads\n", gReceiveThreads); return(1); }
+            for (a = 0; a < gNumInterfaces; a++)
+                if (ReceiveWorkersAddFD(gRecvFD[a], a, BenchReadBatch)) { fprintf(stderr, "ReceiveWorkersAddFD failed\n"); return(1); }
+        }
+    }
+
+    // Let interface activation, probing and the initial queries run their course before measuring
+    gNextEvent = gSimNow;
+    AdvanceClock(&mDNSStorage, gSimNow + kWarmupMilliseconds);
+    start = gSimNow;
+    allocsBefore = gAllocCalls;
+    clock_gettime(CLOCK_MONOTONIC, &wall0);
+
+    if (gReceiveThreads >= 0)
+    {
+        ReceiveWorkersStats stats;
+        mDNSu32 delivered = 0;
+
+        for (i = 0; i < count; i++)
+        {
+            executeNs += AdvanceClock(&mDNSStorage, start + pkts[i].when);
+            while (!SendPacket(&pkts[i]))
+            {
+                if (readyFD >= 0) WaitForWorkers(readyFD);
+                bytes += Drain(&mDNSStorage, latency, &delivered, &receiveNs);
+            }
+            bytes += Drain(&mDNSStorage, latency, &delivered, &receiveNs);
+        }
+
+        // Wait for the workers to finish with whatever is still in the sockets
+        for (; ;)
+        {
+            ReceiveWorkersGetStats(&stats);
+            if (readyFD < 0 || delivered + stats.Rejected + stats.Overflows >= count) break;
+            if (readyFD >= 0) WaitForWorkers(readyFD);
+            bytes += Drain(&mDNSStorage, latency, &delivered, &receiveNs);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &wall1);
+
+        Report(&mDNSStorage, latency, delivered, skipped, receiveNs, executeNs, bytes, gSimNow - start, allocsBefore);
+        printf("Receive threads                %d\n", gReceiveThreads);
+        if (stats.Rejected || stats.Overflows) printf("Rejected/overflowed            %u / %u\n", stats.Rejected, stats.Overflows);
+        printf("Wall time                      %.3f ms\n", ((double)(wall1.tv_sec - wall0.tv_sec) * 1e9 + (double)(wall1.tv_nsec - wall0.tv_nsec)) / 1e6);
+        printf("Packets/sec (wall)             %.0f\n", delivered / ((double)(wall1.tv_sec - wall0.tv_sec) + (double)(wall1.tv_nsec - wall0.tv_nsec) / 1e9));
+
+        if (readyFD >= 0) ReceiveWorkersStop();
+        for (a = 0; a < gNumInterfaces; a++) { close(gSendFD[a]); close(gRecvFD[a]); }
+        for (i = 0; i < count; i++) free(pkts[i].data);
+        free(pkts);
+        free(latency);
+        return(0);
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        const BenchPacket *const p = &pkts[i];
+        const NetworkInterfaceInfo *const intf = &gInterfaces[p->intf];
+        struct timespec t0, t1;
+
+        executeNs += AdvanceClock(&mDNSStorage, start + p->when);
+
+        // mDNSCoreReceive works on the message in place, so every packet gets a fresh copy
+        mDNSPlatformMemCopy(&mDNSStorage.imsg.m, p->data, p->len);
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        mDNSCoreReceive(&mDNSStorage, &mDNSStorage.imsg.m, (mDNSu8 *)&mDNSStorage.imsg.m + p->len, &p->src, p->srcport,
+                        &p->dst, MulticastDNSPort, intf->InterfaceID);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+
+        // A received packet can bring work forward, such as a response to a query
+        if (CoreTimeToSimTime(&mDNSStorage, mDNSStorage.NextScheduledEvent) - gNextEvent < 0)
+            gNextEvent = CoreTimeToSimTime(&mDNSStorage, mDNSStorage.NextScheduledEvent);
+
+        latency[i] = (mDNSu32)((t1.tv_sec - t0.tv_sec) * 1000000000L + (t1.tv_nsec - t0.tv_nsec));
+        receiveNs += latency[i];
+        bytes += p->len;
+    }
+
+    Report(&mDNSStorage, latency, count, skipped, receiveNs, executeNs, bytes, gSimNow - start, allocsBefore);
+    if (scans) RunCacheScans(&mDNSStorage, scans);
+
+    for (i = 0; i < count; i++) free(pkts[i].data);
+    free(pkts);
+    free(latency);
+    return(0);
+}
@@ -0,0 +1,1725 @@
+/* -*- Mode: C; tab-width: 4; c-file-style: "bsd"; c-basic-offset: 4; fill-column: 108; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (c) 2002-2019 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Platform support for Linux. Sockets are non-blocking and watched with a single epoll instance;
+ * interface changes arrive over a netlink socket on the same event loop.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE                    // For struct in6_pktinfo
+#endif
+
+#include "mDNSEmbeddedAPI.h"           // Defines the interface provided to the client layer above
+#include "DNSCommon.h"
+#include "uDNS.h"
+#include "PlatformCommon.h"
+#include "mDNSPosix.h"                 // Defines the specific types needed to run mDNS on this platform
+#include "ReceiveWorkers.h"
+#include "dns_sd.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <ifaddrs.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/random.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_packet.h>
+
+// ***************************************************************************
+// Structures
+
+struct TCPSocket_struct
+{
+    TCPSocketFlags flags;               // MUST BE FIRST FIELD -- mDNSCore expects every TCPSocket_struct to begin with TCPSocketFlags flags
+    int fd;
+    mDNSBool connected;                 // Cleared while a non-blocking connect is in progress
+    TCPConnectionCallback callback;
+    void *context;
+};
+
+struct UDPSocket_struct
+{
+    mDNSIPPort port;                    // MUST BE FIRST FIELD -- mDNSCoreReceive expects every UDPSocket_struct to begin with mDNSIPPort port
+    int fd4;                            // Bound to port; -1 if IPv4 is unavailable
+    int fd6;                            // Bound to port; -1 if IPv6 is unavailable
+};
+
+// Receive buffers are aligned the same way as m->imsg
+typedef union { DNSMessage m; void *p; } RecvBatchBuffer;
+
+// A multicast datagram waiting to be flushed with sendmmsg()
+typedef struct
+{
+    int fd;
+    int ifindex;
+    socklen_t tolen;
+    struct sockaddr_storage to;
+    mDNSu32 len;
+    mDNSu8 data[sizeof(DNSMessage)];
+} QueuedDatagram;
+
+typedef struct PosixEventSource PosixEventSource;
+struct PosixEventSource
+{
+    PosixEventSource *next;
+    int fd;
+    mDNSPosixEventCallback callback;
+    void *context;
+    mDNSu32 events;                     // EPOLLIN, plus EPOLLOUT while a TCP connect is in progress
+    mDNSBool removed;                   // Removed during dispatch; freed once the current batch is done
+};
+
+// ***************************************************************************
+// Globals (for debugging)
+
+extern mDNS mDNSStorage;
+
+mDNSexport mDNSs32 mDNSPlatformOneSecond = 1000;    // Use milliseconds as the quantum of time
+
+#define kEventLoopBatch 64              // Ready descriptors fetched per epoll_wait() call
+#define kRecvBatch      16              // Datagrams read per recvmmsg() call
+#define kSendBatch      32              // Multicast datagrams queued before a forced flush
+
+mDNSlocal int gEventLoopFD = -1;
+mDNSlocal PosixEventSource *gEventSources;
+mDNSlocal PosixEventSource *gEventSourcesRemoved;
+mDNSlocal mDNSBool gEventDispatching;
+mDNSlocal int gSignalFD = -1;
+mDNSlocal sigset_t gEventSignalSet;     // Signals delivered through gSignalFD
+mDNSlocal sigset_t gEventSignals;       // Signals received during the current mDNSPosixRunEventLoopOnce()
+mDNSlocal QueuedDatagram gSendQueue[kSendBatch];
+mDNSlocal int gSendQueueCount;
+mDNSlocal int gReceiveThreads;          // Receive worker threads to start in mDNSPlatformInit(); 0 for none
+mDNSlocal int gReceiveReadyFD = -1;     // Readable when the receive workers have queued datagrams
+
+// ***************************************************************************
+// Functions
+
+#if COMPILER_LIKES_PRAGMA_MARK
+#pragma mark ***** Send Queue
+#endif
+
+// Multicast datagrams sent while the core is running are queued rather than sent one sendto() at a time, and the
+// queue is flushed before the event loop next sleeps. An announcement or goodbye burst in SendResponses() or
+// SendQueries() then costs one sendmmsg() per socket instead of one system call per packet per interface.
+// Unicast datagrams are always sent immediately, because the core acts on the result of those sends.
+
+mDNSlocal void FlushSendQueue(mDNS *const m)
+{
+    struct mmsghdr msgs[kSendBatch];
+    struct iovec iov[kSendBatch];
+    const QueuedDatagram *batch[kSendBatch];
+    mDNSBool flushed[kSendBatch];
+    int i, j;
+
+    if (gSendQueueCount == 0) return;
+    mDNSPlatformMemZero(flushed, sizeof(flushed));
+
+    // sendmmsg() works on a single descriptor, so send each socket's datagrams as one batch, keeping their order
+    for (i = 0; i < gSendQueueCount; i++)
+    {
+        const int fd = gSendQueue[i].fd;
+        int count = 0, off = 0;
+
+        if (flushed[i]) continue;
+        for (j = i; j < gSendQueueCount; j++)
+        {
+            QueuedDatagram *const q = &gSendQueue[j];
+            if (flushed[j] || q->fd != fd) continue;
+            flushed[j] = mDNStrue;
+            iov[count].iov_base = q->data;
+            iov[count].iov_len  = q->len;
+            mDNSPlatformMemZero(&msgs[count], sizeof(msgs[count]));
+            msgs[count].msg_hdr.msg_name    = &q->to;
+            msgs[count].msg_hdr.msg_namelen = q->tolen;
+            msgs[count].msg_hdr.msg_iov     = &iov[count];
+            msgs[count].msg_hdr.msg_iovlen  = 1;
+            batch[count] = q;
+            count++;
+        }
+
+        while (off < count)
+        {
+            const int sent = sendmmsg(fd, &msgs[off], (unsigned int)(count - off), 0);
+            if (sent > 0)
+            {
+                m->mDNSStats.SendBatches++;
+                m->mDNSStats.SendBatchPackets += (mDNSu32)sent;
+                if ((mDNSu32)sent > m->mDNSStats.SendBatchMax) m->mDNSStats.SendBatchMax = (mDNSu32)sent;
+                for (j = off; j < off + sent; j++) mDNSMetricsCountPacket((mDNSu32)batch[j]->ifindex, mDNStrue, batch[j]->len);
+                off += sent;
+                continue;
+            }
+            // The datagram at off failed. An interface that has just gone away can fail sends until netlink tells
+            // us about it, and a full socket buffer drops the datagram just as the network might; log anything else.
+            if (errno != EADDRNOTAVAIL && errno != ENODEV && errno != ENETDOWN && errno != ENETUNREACH &&
+                errno != EHOSTUNREACH && errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS)
+                LogMsg("FlushSendQueue: sendmmsg(%d) failed %d (%s)", fd, errno, strerror(errno));
+            off++;
+        }
+    }
+    gSendQueueCount = 0;
+}
+
+mDNSlocal void QueueDatagram(int fd, int ifindex, const void *const msg, mDNSu32 len, const struct sockaddr *const to, socklen_t tolen)
+{
+    QueuedDatagram *q;
+
+    if (gSendQueueCount == kSendBatch) FlushSendQueue(&mDNSStorage);
+    q = &gSendQueue[gSendQueueCount++];
+    q->fd      = fd;
+    q->ifindex = ifindex;
+    q->tolen   = tolen;
+    q->len     = len;
+    mDNSPlatformMemCopy(&q->to, to, tolen);
+    mDNSPlatformMemCopy(q->data, msg, len);
+}
+
+#if COMPILER_LIKES_PRAGMA_MARK
+#pragma mark ***** Event Loop
+#endif
+
+mDNSlocal mStatus EventLoopInit(void)
+{
+    if (gEventLoopFD >= 0) return(mStatus_NoError);
+    gEventLoopFD = epoll_create1(EPOLL_CLOEXEC);
+    if (gEventLoopFD < 0)
+    {
+        LogMsg("EventLoopInit: epoll_create1 failed %d (%s)", errno, strerror(errno));
+        return(mStatus_UnknownErr);
+    }
+    sigemptyset(&gEventSignalSet);
+    sigemptyset(&gEventSignals);
+    return(mStatus_NoError);
+}
+
+mDNSlocal PosixEventSource *EventLoopFind(int fd)
+{
+    PosixEventSource *src;
+    for (src = gEventSources; src; src = src->next)
+        if (src->fd == fd) return(src);
+    return(mDNSNULL);
+}
+
+mDNSlocal mStatus EventLoopAdd(int fd, mDNSu32 events, mDNSPosixEventCallback callback, void *context)
+{
+    struct epoll_event ev;
+    PosixEventSource *src;
+    mStatus err = EventLoopInit();
+
+    if (err) return(err);
+    if (EventLoopFind(fd)) return(mStatus_AlreadyRegistered);
+
+    src = (PosixEventSource *)mDNSPlatformMemAllocateClear(sizeof(*src));
+    if (!src) return(mStatus_NoMemoryErr);
+    src->fd       = fd;
+    src->callback = callback;
+    src->context  = context;
+    src->events   = events;
+
+    mDNSPlatformMemZero(&ev, sizeof(ev));
+    ev.events   = events;
+    ev.data.ptr = src;
+    if (epoll_ctl(gEventLoopFD, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+        LogMsg("EventLoopAdd: epoll_ctl ADD %d failed %d (%s)", fd, errno, strerror(errno));
+        mDNSPlatformMemFree(src);
+        return(mStatus_UnknownErr);
+    }
+    src->next = gEventSources;
+    gEventSources = src;
+    return(mStatus_NoError);
+}
+
+mDNSlocal mStatus EventLoopSetEvents(int fd, mDNSu32 events)
+{
+    struct epoll_event ev;
+    PosixEventSource *const src = EventLoopFind(fd);
+
+    if (!src) return(mStatus_BadReferenceErr);
+    if (src->events == events) return(mStatus_NoError);
+    mDNSPlatformMemZero(&ev, sizeof(ev));
+    ev.events   = events;
+    ev.data.ptr = src;
+    if (epoll_ctl(gEventLoopFD, EPOLL_CTL_MOD, fd, &ev) < 0)
+    {
+        LogMsg("EventLoopSetEvents: epoll_ctl MOD %d failed %d (%s)", fd, errno, strerror(errno));
+        return(mStatus_UnknownErr);
+    }
+    src->events = events;
+    return(mStatus_NoError);
+}
+
+mDNSexport mStatus mDNSPosixAddFDToEventLoop(int fd, mDNSPosixEventCallback callback, void *context)
+{
+    return(EventLoopAdd(fd, EPOLLIN, callback, context));
+}
+
+// Does not close fd
+mDNSexport mStatus mDNSPosixRemoveFDFromEventLoop(int fd)
+{
+    PosixEventSource **p = &gEventSources;
+    PosixEventSource *src;
+
+    while (*p && (*p)->fd != fd) p = &(*p)->next;
+    if (!*p) return(mStatus_BadReferenceErr);
+    src = *p;
+    *p = src->next;
+
+    epoll_ctl(gEventLoopFD, EPOLL_CTL_DEL, fd, mDNSNULL);
+
+    // Events already fetched for this source may still be waiting to be dispatched, so if we're in the
+    // middle of a dispatch pass the record has to stay valid until the pass is finished
+    if (gEventDispatching)
+    {
+        src->removed = mDNStrue;
+        src->next = gEventSourcesRemoved;
+        gEventSourcesRemoved = src;
+    }
+    else
+        mDNSPlatformMemFree(src);
+    return(mStatus_NoError);
+}
+
+mDNSlocal void SignalFDReady(int fd, void *context)
+{
+    struct signalfd_siginfo si;
+    (void)context;  // Unused
+
+    while (read(fd, &si, sizeof(si)) == (ssize_t)sizeof(si))
+        sigaddset(&gEventSignals, (int)si.ssi_signo);
+}
+
+mDNSlocal mStatus UpdateSignalFD(void)
+{
+    mStatus err = EventLoopInit();
+    int fd;
+
+    if (err) return(err);
+    fd = signalfd(gSignalFD, &gEventSignalSet, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd < 0)
+    {
+        LogMsg("UpdateSignalFD: signalfd failed %d (%s)", errno, strerror(errno));
+        return(mStatus_UnknownErr);
+    }
+    if (gSignalFD < 0)
+    {
+        gSignalFD = fd;
+        err = mDNSPosixAddFDToEventLoop(gSignalFD, SignalFDReady, mDNSNULL);
+    }
+    return(err);
+}
+
+// Signals handled by the event loop are blocked, and reported by mDNSPosixRunEventLoopOnce() instead
+mDNSexport mStatus mDNSPosixListenForSignalInEventLoop(int signum)
+{
+    sigset_t block;
+    mStatus err = EventLoopInit();
+
+    if (err) return(err);
+    sigaddset(&gEventSignalSet, signum);
+    sigemptyset(&block);
+    sigaddset(&block, signum);
+    if (sigprocmask(SIG_BLOCK, &block, mDNSNULL) < 0) return(mStatus_UnknownErr);
+    return(UpdateSignalFD());
+}
+
+mDNSexport mStatus mDNSPosixIgnoreSignalInEventLoop(int signum)
+{
+    sigset_t unblock;
+    mStatus err = EventLoopInit();
+
+    if (err) return(err);
+    sigdelset(&gEventSignalSet, signum);
+    sigemptyset(&unblock);
+    sigaddset(&unblock, signum);
+    if (sigprocmask(SIG_UNBLOCK, &unblock, mDNSNULL) < 0) return(mStatus_UnknownErr);
+    return(UpdateSignalFD());
+}
+
+mDNSexport mStatus mDNSPosixRunEventLoopOnce(mDNS *m, const struct timeval *pTimeout, sigset_t *pSignalsReceived,
+                                             mDNSBool *pDataDispatched)
+{
+    struct epoll_event events[kEventLoopBatch];
+    int timeout = -1;
+    int n, i;
+    mStatus err = EventLoopInit();
+
+    if (err) return(err);
+    if (pTimeout)
+    {
+        // Round up, so that we don't wake a fraction of a millisecond early and spin until the event is due
+        long long ms = (long long)pTimeout->tv_sec * 1000 + (pTimeout->tv_usec + 999) / 1000;
+        timeout = (ms > 0x7FFFFFFF) ? 0x7FFFFFFF : (ms < 0) ? 0 : (int)ms;
+    }
+
+    sigemptyset(&gEventSignals);
+    *pDataDispatched = mDNSfalse;
+
+    // Anything the core queued since we last slept goes out before we sleep again
+    FlushSendQueue(m);
+
+    n = epoll_wait(gEventLoopFD, events, kEventLoopBatch, timeout);
+    if (n < 0)
+    {
+        if (errno != EINTR)
+        {
+            LogMsg("mDNSPosixRunEventLoopOnce: epoll_wait failed %d (%s)", errno, strerror(errno));
+            return(mStatus_UnknownErr);
+        }
+        n = 0;
+    }
+
+    gEventDispatching = mDNStrue;
+    for (i = 0; i < n; i++)
+    {
+        PosixEventSource *const src = (PosixEventSource *)events[i].data.ptr;
+        if (src->removed) continue;
+        if (src->callback != SignalFDReady) *pDataDispatched = mDNStrue;
+        src->callback(src->fd, src->context);
+    }
+    gEventDispatching = mDNSfalse;
+
+    while (gEventSourcesRemoved)
+    {
+        PosixEventSource *const src = gEventSourcesRemoved;
+        gEventSourcesRemoved = src->next;
+        mDNSPlatformMemFree(src);
+    }
+
+    if (m->p->interfacesChanged) mDNSPlatformPosixRefreshInterfaceList(m);
+
+    *pSignalsReceived = gEventSignals;
+    return(mStatus_NoError);
+}
+
+#if COMPILER_LIKES_PRAGMA_MARK
+#pragma mark ***** Packet Reception
+#endif
+
+mDNSlocal void SockAddrTomDNSAddr(const struct sockaddr *const sa, mDNSAddr *ipAddr, mDNSIPPort *ipPort)
+{
+    switch (sa->sa_family)
+    {
+    case AF_INET:
+    {
+        const struct sockaddr_in *const sin = (const struct sockaddr_in *)sa;
+        ipAddr->type                 = mDNSAddrType_IPv4;
+        ipAddr->ip.v4.NotAnInteger   = sin->sin_addr.s_addr;
+        if (ipPort) ipPort->NotAnInteger = sin->sin_port;
+        break;
+    }
+    case AF_INET6:
+    {
+        const struct sockaddr_in6 *const sin6 = (const struct sockaddr_in6 *)sa;
+        ipAddr->type  = mDNSAddrType_IPv6;
+        ipAddr->ip.v6 = *(const mDNSv6Addr *)&sin6->sin6_addr;
+        if (ipPort) ipPort->NotAnInteger = sin6->sin6_port;
+        break;
+    }
+    default:
+        ipAddr->type = mDNSAddrType_None;
+        if (ipPort) ipPort->NotAnInteger = 0;
+        break;
+    }
+}
+
+mDNSlocal PosixNetworkInterface *InterfaceForIndex(mDNS *const m, int index)
+{
+    NetworkInterfaceInfo *intf;
+    for (intf = m->HostInterfaces; intf; intf = intf->next)
+        if (((PosixNetworkInterface *)intf)->index == index) return((PosixNetworkInterface *)intf);
+    return(mDNSNULL);
+}
+
+// Takes the destination address and the arrival interface from the IP_PKTINFO or IPV6_PKTINFO control message,
+// leaving them unchanged if there isn't one
+mDNSlocal void GetPacketInfo(const struct msghdr *const msg, mDNSAddr *const destAddr, int *const ifindex)
+{
+    struct cmsghdr *cmsg;
+    for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR((struct msghdr *)msg, cmsg))
+    {
+        if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO)
+        {
+            const struct in_pktinfo *const pi = (const struct in_pktinfo *)CMSG_DATA(cmsg);
+            destAddr->type               = mDNSAddrType_IPv4;
+            destAddr->ip.v4.NotAnInteger = pi->ipi_addr.s_addr;
+            *ifindex                     = pi->ipi_ifindex;
+        }
+        else if (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_PKTINFO)
+        {
+            const struct in6_pktinfo *const pi6 = (const struct in6_pktinfo *)CMSG_DATA(cmsg);
+            destAddr->type  = mDNSAddrType_IPv6;
+            destAddr->ip.v6 = *(const mDNSv6Addr *)&pi6->ipi6_addr;
+            *ifindex        = (int)pi6->ipi6_ifindex;
+        }
+    }
+}
+
+// Hands one received datagram to the core. For the 5353 sockets the InterfaceID comes from the packet info
+// rather than from the socket, because unicast datagrams to port 5353 are delivered to whichever of the
+// interface sockets the kernel chooses. Datagrams on the unicast sockets are delivered with InterfaceID zero,
+// which is how the core expects to see unicast DNS responses. view is the receive worker's parse of the datagram,
+// or NULL if it was read on this thread.
+mDNSlocal void DeliverDatagram(mDNS *const m, DNSMessage *const pkt, size_t packetLen, DNSMessageView *const view,
+                               const mDNSAddr *const senderAddr, const mDNSIPPort senderPort,
+                               const mDNSAddr *const destAddr, const mDNSIPPort destPort, int ifindex, mDNSBool multicastSocket)
+{
+    mDNSInterfaceID InterfaceID = mDNSNULL;
+
+    if (multicastSocket)
+    {
+        const PosixNetworkInterface *const intf = InterfaceForIndex(m, ifindex);
+        if (!intf)
+        {
+            debugf("DeliverDatagram: dropping packet from %#a on unregistered interface %d", senderAddr, ifindex);
+            return;
+        }
+        InterfaceID = intf->coreIntf.InterfaceID;
+    }
+
+    mDNSCoreReceiveParsed(m, pkt, (mDNSu8 *)pkt + packetLen, view, senderAddr, senderPort, destAddr, destPort, InterfaceID);
+}
+
+mDNSlocal void ReceiveDatagram(mDNS *const m, DNSMessage *const pkt, const struct msghdr *const msg, size_t packetLen,
+                               mDNSAddr destAddr, const mDNSIPPort destPort, mDNSBool multicastSocket)
+{
+    mDNSAddr senderAddr;
+    mDNSIPPort senderPort;
+    int ifindex = -1;
+
+    if (msg->msg_flags & MSG_TRUNC)
+    {
+        debugf("ReceiveDatagram: dropping truncated %d-byte datagram", (int)packetLen);
+        return;
+    }
+
+    SockAddrTomDNSAddr((const struct sockaddr *)msg->msg_name, &senderAddr, &senderPort);
+    GetPacketInfo(msg, &destAddr, &ifindex);
+    mDNSMetricsCountPacket(ifindex > 0 ? (mDNSu32)ifindex : 0, mDNSfalse, (mDNSu32)packetLen);
+    DeliverDatagram(m, pkt, packetLen, mDNSNULL, &senderAddr, senderPort, &destAddr, destPort, ifindex, multicastSocket);
+}
+
+// Drains up to kRecvBatch datagrams from fd with a single recvmmsg() and then hands them to the core in order.
+// Anything left over makes the descriptor ready again, so the next epoll_wait() returns at once.
+mDNSlocal void SocketDataReady(mDNS *const m, int fd, mDNSBool multicastSocket)
+{
+    static RecvBatchBuffer buffers[kRecvBatch];
+    static struct sockaddr_storage from[kRecvBatch];
+    static mDNSu8 control[kRecvBatch][256];
+    struct mmsghdr msgs[kRecvBatch];
+    struct iovec iov[kRecvBatch];
+    struct sockaddr_storage local;
+    socklen_t len = sizeof(local);
+    mDNSAddr destAddr;
+    mDNSIPPort destPort;
+    int n, i;
+
+    for (i = 0; i < kRecvBatch; i++)
+    {
+        iov[i].iov_base = &buffers[i].m;
+        iov[i].iov_len  = sizeof(buffers[i].m);
+        mDNSPlatformMemZero(&msgs[i], sizeof(msgs[i]));
+        msgs[i].msg_hdr.msg_name       = &from[i];
+        msgs[i].msg_hdr.msg_namelen    = sizeof(from[i]);
+        msgs[i].msg_hdr.msg_iov        = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen     = 1;
+        msgs[i].msg_hdr.msg_control    = control[i];
+        msgs[i].msg_hdr.msg_controllen = sizeof(control[i]);
+    }
+
+    n = recvmmsg(fd, msgs, kRecvBatch, MSG_DONTWAIT, mDNSNULL);
+    if (n < 0)
+    {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNREFUSED)
+            LogMsg("SocketDataReady: recvmmsg on %d failed %d (%s)", fd, errno, strerror(errno));
+        return;
+    }
+    if (n == 0) return;
+
+    m->mDNSStats.RecvBatches++;
+    m->mDNSStats.RecvBatchPackets += (mDNSu32)n;
+    if ((mDNSu32)n > m->mDNSStats.RecvBatchMax) m->mDNSStats.RecvBatchMax = (mDNSu32)n;
+
+    // The destination port is the same for the whole batch; the destination address comes from the packet info
+    destAddr.type = mDNSAddrType_None;
+    destPort      = zeroIPPort;
+    if (getsockname(fd, (struct sockaddr *)&local, &len) == 0) SockAddrTomDNSAddr((struct sockaddr *)&local, &destAddr, &destPort);
+
+    for (i = 0; i < n; i++)
+        ReceiveDatagram(m, &buffers[i].m, &msgs[i].msg_hdr, msgs[i].msg_len, destAddr, destPort, multicastSocket);
+}
+
+mDNSlocal void MulticastSocketReady(int fd, void *context)
+{
+    SocketDataReady((mDNS *)context, fd, mDNStrue);
+}
+
+mDNSlocal void UnicastSocketReady(int fd, void *context)
+{
+    SocketDataReady((mDNS *)context, fd, mDNSfalse);
+}
+
+// With receive workers, the 5353 sockets are read on the worker threads. This is the reader they use; it runs on
+// a worker thread, so it only decodes the datagrams. The worker parses them, and DeliverDatagram() does the rest.
+mDNSlocal int ReadMulticastBatch(int fd, int ifindex, ReceivedDatagram **batch, int max)
+{
+    struct mmsghdr msgs[kRecvBatch];
+    struct iovec iov[kRecvBatch];
+    struct sockaddr_storage from[kRecvBatch];
+    mDNSu8 control[kRecvBatch][256];
+    struct sockaddr_storage local;
+    socklen_t len = sizeof(local);
+    mDNSAddr destAddr;
+    mDNSIPPort destPort;
+    int n, i;
+
+    if (max > kRecvBatch) max = kRecvBatch;
+    for (i = 0; i < max; i++)
+    {
+        iov[i].iov_base = &batch[i]->msg.m;
+        iov[i].iov_len  = sizeof(batch[i]->msg.m);
+        mDNSPlatformMemZero(&msgs[i], sizeof(msgs[i]));
+        msgs[i].msg_hdr.msg_name       = &from[i];
+        msgs[i].msg_hdr.msg_namelen    = sizeof(from[i]);
+        msgs[i].msg_hdr.msg_iov        = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen     = 1;
+        msgs[i].msg_hdr.msg_control    = control[i];
+        msgs[i].msg_hdr.msg_controllen = sizeof(control[i]);
+    }
+
+    n = recvmmsg(fd, msgs, (unsigned int)max, MSG_DONTWAIT, mDNSNULL);
+    if (n < 0) return((errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNREFUSED) ? 0 : -1);
+
+    destAddr.type = mDNSAddrType_None;
+    destPort      = zeroIPPort;
+    if (n > 0 && getsockname(fd, (struct sockaddr *)&local, &len) == 0) SockAddrTomDNSAddr((struct sockaddr *)&local, &destAddr, &destPort);
+
+    for (i = 0; i < n; i++)
+    {
+        ReceivedDatagram *const d = batch[i];
+        d->len       = msgs[i].msg_len;
+        d->truncated = (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) ? mDNStrue : mDNSfalse;
+        d->dstAddr   = destAddr;
+        d->dstPort   = destPort;
+        d->ifindex   = ifindex;
+        SockAddrTomDNSAddr((const struct sockaddr *)&from[i], &d->srcAddr, &d->srcPort);
+        GetPacketInfo(&msgs[i].msg_hdr, &d->dstAddr, &d->ifindex);
+        if (!d->truncated) mDNSMetricsCountPacket(d->ifindex > 0 ? (mDNSu32)d->ifindex : 0, mDNSfalse, d->len);
+    }
+    return(n);
+}
+
+mDNSlocal void ReceiveWorkersReady(int fd, void *context)
+{
+    mDNS *const m = (mDNS *)context;
+    ReceivedDatagram *const list = ReceiveWorkersTake();
+    ReceivedDatagram *d;
+    mDNSu32 n = 0;
+    (void)fd;   // Unused
+
+    for (d = list; d; d = d->next)
+    {
+        DeliverDatagram(m, &d->msg.m, d->len, &d->view, &d->srcAddr, d->srcPort, &d->dstAddr, d->dstPort, d->ifindex, mDNStrue);
+        n++;
+    }
+    ReceiveWorkersRelease(list);
+
+    if (n)
+    {
+        m->mDNSStats.RecvBatches++;
+        m->mDNSStats.RecvBatchPackets += n;
+        if (n > m->mDNSStats.RecvBatchMax) m->mDNSStats.RecvBatchMax = n;
+    }
+}
+
+mDNSexport void mDNSPosixSetReceiveThreads(int threads)
+{
+    gReceiveThreads = threads;
+}
+
+#if COMPILER_LIKES_PRAGMA_MARK
+#pragma mark ***** Socket Setup
+#endif
+
+mDNSlocal void CloseSocket(int *fd)
+{
+    if (*fd < 0) return;
+    FlushSendQueue(&mDNSStorage);   // The queue may hold datagrams for this socket, such as goodbyes
+    mDNSPosixRemoveFDFromEventLoop(*fd);
+    ReceiveWorkersRemoveFD(*fd);
+    close(*fd);
+    *fd = -1;
+}
+
+// Opens a UDP socket of the given family bound to port, with packet info enabled. If port is zero the kernel
+// picks one and it is returned in *port.
+mDNSlocal int OpenUDPSocket(int family, mDNSIPPort *port, mDNSBool reuse)
+{
+    const int on = 1;
+    const int ttl = 255;
+    int fd = socket(family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_UDP);
+    union { struct sockaddr sa; struct sockaddr_in sin; struct sockaddr_in6 sin6; } addr;
+    socklen_t len;
+
+    if (fd < 0)
+    {
+        if (errno != EAFNOSUPPORT) LogMsg("OpenUDPSocket: socket failed %d (%s)", errno, strerror(errno));
+        return(-1);
+    }
+    if (reuse && setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0) goto fail;
+
+    mDNSPlatformMemZero(&addr, sizeof(addr));
+    if (family == AF_INET)
+    {
+        if (setsockopt(fd, IPPROTO_IP, IP_PKTINFO, &on, sizeof(on)) < 0) goto fail;
+        if (setsockopt(fd, IPPROTO_IP, IP_TTL, &ttl, sizeof(ttl)) < 0) goto fail;
+        addr.sin.sin_family = AF_INET;
+        addr.sin.sin_port   = port->NotAnInteger;
+        len = sizeof(addr.sin);
+    }
+    else
+    {
+        if (setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &on, sizeof(on)) < 0) goto fail;
+        if (setsockopt(fd, IPPROTO_IPV6, IPV6_RECVPKTINFO, &on, sizeof(on)) < 0) goto fail;
+        if (setsockopt(fd, IPPROTO_IPV6, IPV6_UNICAST_HOPS, &ttl, sizeof(ttl)) < 0) goto fail;
+        addr.sin6.sin6_family = AF_INET6;
+        addr.sin6.sin6_port   = port->NotAnInteger;
+        len = sizeof(addr.sin6);
+    }
+    if (bind(fd, &addr.sa, len) < 0) goto fail;
+    if (mDNSIPPortIsZero(*port))
+    {
+        if (getsockname(fd, &addr.sa, &len) < 0) goto fail;
+        port->NotAnInteger = (family == AF_INET) ? addr.sin.sin_port : addr.sin6.sin6_port;
+    }
+    return(fd);
+
+fail:
+    if (errno != EADDRINUSE) LogMsg("OpenUDPSocket: family %d port %d failed %d (%s)", family, mDNSVal16(*port), errno, strerror(errno));
+    close(fd);
+    return(-1);
+}
+
+// Opens the 5353 socket for one interface. The socket joins the mDNS group on that interface only and, with
+// IP_MULTICAST_ALL cleared, receives only the multicast traffic for its own memberships, so a packet arriving on
+// one interface is not also delivered to the sockets of every other interface.
+mDNSlocal int OpenMulticastSocket(int family, int index)
+{
+    const int on = 1, off = 0;
+    const int ttl = 255;
+    mDNSIPPort port = MulticastDNSPort;
+    int fd = OpenUDPSocket(family, &port, mDNStrue);
+
+    if (fd < 0) return(-1);
+    if (family == AF_INET)
+    {
+        struct ip_mreqn mreq;
+        mDNSPlatformMemZero(&mreq, sizeof(mreq));
+        mreq.imr_multiaddr.s_addr = AllDNSLinkGroup_v4.ip.v4.NotAnInteger;
+        mreq.imr_ifindex          = index;
+#ifdef IP_MULTICAST_ALL
+        setsockopt(fd, IPPROTO_IP, IP_MULTICAST_ALL, &off, sizeof(off));
+#endif
+        if (setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) goto fail;
+        if (setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &mreq, sizeof(mreq)) < 0) goto fail;
+        if (setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0) goto fail;
+        if (setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &on, sizeof(on)) < 0) goto fail;
+    }
+    else
+    {
+        struct ipv6_mreq mreq6;
+        const unsigned int ifindex = (unsigned int)index;
+        mDNSPlatformMemZero(&mreq6, sizeof(mreq6));
+        mDNSPlatformMemCopy(&mreq6.ipv6mr_multiaddr, &AllDNSLinkGroup_v6.ip.v6, sizeof(mreq6.ipv6mr_multiaddr));
+        mreq6.ipv6mr_interface = ifindex;
+#ifdef IPV6_MULTICAST_ALL
+        setsockopt(fd, IPPROTO_IPV6, IPV6_MULTICAST_ALL, &off, sizeof(off));
+#endif
+        if (setsockopt(fd, IPPROTO_IPV6, IPV6_JOIN_GROUP, &mreq6, sizeof(mreq6)) < 0) goto fail;
+        if (setsockopt(fd, IPPROTO_IPV6, IPV6_MULTICAST_IF, &ifindex, sizeof(ifindex)) < 0) goto fail;
+        if (setsockopt(fd, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &ttl, sizeof(ttl)) < 0) goto fail;
+        if (setsockopt(fd, IPPROTO_IPV6, IPV6_MULTICAST_LOOP, &on, sizeof(on)) < 0) goto fail;
+    }
+    (void)off;
+    return(fd);
+
+fail:
+    LogMsg("OpenMulticastSocket: family %d interface %d failed %d (%s)", family, index, errno, strerror(errno));
+    close(fd);
+    return(-1);
+}
+
+#if COMPILER_LIKES_PRAGMA_MARK
+#pragma mark ***** Interface Management
+#endif
+
+mDNSlocal int *MulticastSocketFor(PosixNetworkInterface *intf)
+{
+    return((intf->coreIntf.ip.type == mDNSAddrType_IPv4) ? &intf->multicastSocket4 : &intf->multicastSocket6);
+}
+
+// Returns the interface record that owns the 5353 socket for this interface index and address family
+mDNSlocal PosixNetworkInterface *SocketOwnerFor(mDNS *const m, int index, mDNSAddr_Type type)
+{
+    NetworkInterfaceInfo *i;
+    for (i = m->HostInterfaces; i; i = i->next)
+    {
+        PosixNetworkInterface *const intf = (PosixNetworkInterface *)i;
+        if (intf->index == index && intf->coreIntf.ip.type == type && intf->aliasIntf == intf) return(intf);
+    }
+    return(mDNSNULL);
+}
+
+mDNSlocal void FreeInterface(PosixNetworkInterface *intf)
+{
+    CloseSocket(&intf->multicastSocket4);
+    CloseSocket(&intf->multicastSocket6);
+    mDNSPlatformMemFree(intf);
+}
+
+mDNSlocal void TearDownInterface(mDNS *const m, PosixNetworkInterface *intf)
+{
+    NetworkInterfaceInfo *i;
+
+    mDNS_DeregisterInterface(m, &intf->coreIntf, NormalActivation);
+    debugf("TearDownInterface: %s %#a", intf->coreIntf.ifname, &intf->coreIntf.ip);
+
+    // If other addresses of this family remain on the interface, hand our socket to one of them
+    if (intf->aliasIntf == intf)
+    {
+        PosixNetworkInterface *heir = mDNSNULL;
+        for (i = m->HostInterfaces; i; i = i->next)
+        {
+            PosixNetworkInterface *const other = (PosixNetworkInterface *)i;
+            if (other->aliasIntf != intf) continue;
+            if (!heir)
+            {
+                heir = other;
+                *MulticastSocketFor(heir) = *MulticastSocketFor(intf);
+                *MulticastSocketFor(intf) = -1;
+            }
+            other->aliasIntf = heir;
+        }
+    }
+    FreeInterface(intf);
+}
+
+mDNSlocal void GetMACAddress(const struct ifaddrs *const list, const char *const name, mDNSEthAddr *mac)
+{
+    const struct ifaddrs *ifa;
+    mDNSPlatformMemZero(mac, sizeof(*mac));
+    for (ifa = list; ifa; ifa = ifa->ifa_next)
+        if (ifa->ifa_addr && ifa->ifa_addr->sa_family == AF_PACKET && !strcmp(ifa->ifa_name, name))
+        {
+            const struct sockaddr_ll *const sll = (const struct sockaddr_ll *)ifa->ifa_addr;
+            if (sll->sll_halen == sizeof(mac->b)) mDNSPlatformMemCopy(mac->b, sll->sll_addr, sizeof(mac->b));
+            return;
+        }
+}
+
+mDNSlocal mStatus SetupOneInterface(mDNS *const m, const struct ifaddrs *const list, const struct ifaddrs *const ifa,
+                                    int index, const mDNSAddr *const ip)
+{
+    PosixNetworkInterface *intf;
+    PosixNetworkInterface *owner;
+    mStatus err;
+
+    intf = (PosixNetworkInterface *)mDNSPlatformMemAllocateClear(sizeof(*intf));
+    if (!intf) return(mStatus_NoMemoryErr);
+    intf->index            = index;
+    intf->multicastSocket4 = -1;
+    intf->multicastSocket6 = -1;
+    intf->seen             = mDNStrue;
+
+    intf->coreIntf.InterfaceID = (mDNSInterfaceID)(uintptr_t)index;
+    intf->coreIntf.ip          = *ip;
+    if (ifa->ifa_netmask) SockAddrTomDNSAddr(ifa->ifa_netmask, &intf->coreIntf.mask, mDNSNULL);
+    GetMACAddress(list, ifa->ifa_name, &intf->coreIntf.MAC);
+    mDNSPlatformStrLCopy(intf->coreIntf.ifname, ifa->ifa_name, sizeof(intf->coreIntf.ifname));
+    intf->coreIntf.Advertise                   = m->AdvertiseLocalAddresses;
+    intf->coreIntf.McastTxRx                   = mDNStrue;
+    intf->coreIntf.Loopback                    = (ifa->ifa_flags & IFF_LOOPBACK) ? mDNStrue : mDNSfalse;
+    intf->coreIntf.SupportsUnicastMDNSResponse = mDNStrue;
+
+    owner = SocketOwnerFor(m, index, ip->type);
+    if (owner)
+        intf->aliasIntf = owner;
+    else
+    {
+        int *const fd = MulticastSocketFor(intf);
+        *fd = OpenMulticastSocket((ip->type == mDNSAddrType_IPv4) ? AF_INET : AF_INET6, index);
+        if (*fd < 0) { mDNSPlatformMemFree(intf); return(mStatus_UnknownErr); }
+        if (ReceiveWorkersRunning()) err = ReceiveWorkersAddFD(*fd, index, ReadMulticastBatch);
+        else err = mDNSPosixAddFDToEventLoop(*fd, MulticastSocketReady, m);
+        if (err) { close(*fd); mDNSPlatformMemFree(intf); return(err); }
+        intf->aliasIntf = intf;
+    }
+
+    err = mDNS_RegisterInterface(m, &intf->coreIntf, NormalActivation);
+    if (err)
+    {
+        LogMsg("SetupOneInterface: mDNS_RegisterInterface %s %#a failed %d", ifa->ifa_name, ip, err);
+        FreeInterface(intf);
+        return(err);
+    }
+    debugf("SetupOneInterface: %s %#a index %d%s", intf->coreIntf.ifname, ip, index, owner ? " (alias)" : "");
+    return(mStatus_NoError);
+}
+
+mDNSlocal mDNSBool UsableInterface(const struct ifaddrs *const ifa, mDNSBool includeLoopback)
+{
+    if (!ifa->ifa_addr) return(mDNSfalse);
+    if (ifa->ifa_addr->sa_family != AF_INET && ifa->ifa_addr->sa_family != AF_INET6) return(mDNSfalse);
+    if (!(ifa->ifa_flags & IFF_UP)) return(mDNSfalse);
+    if (ifa->ifa_flags & IFF_LOOPBACK) return(includeLoopback);
+    if (!(ifa->ifa_flags & IFF_MULTICAST)) return(mDNSfalse);
+    if (ifa->ifa_flags & IFF_POINTOPOINT) return(mDNSfalse);
+    return(mDNStrue);
+}
+
+mDNSlocal mStatus AddInterfacesFromList(mDNS *const m, const struct ifaddrs *const list, mDNSBool includeLoopback, int *count)
+{
+    const struct ifaddrs *ifa;
+    mStatus firstErr = mStatus_NoError;
+
+    for (ifa = list; ifa; ifa = ifa->ifa_next)
+    {
+        NetworkInterfaceInfo *i;
+        mDNSAddr ip;
+        int index;
+
+        if (!UsableInterface(ifa, includeLoopback)) continue;
+        index = (int)if_nametoindex(ifa->ifa_name);
+        if (index <= 0) continue;
+        SockAddrTomDNSAddr(ifa->ifa_addr, &ip, mDNSNULL);
+
+        for (i = m->HostInterfaces; i; i = i->next)
+        {
+            PosixNetworkInterface *const intf = (PosixNetworkInterface *)i;
+            if (intf->index == index && mDNSSameAddress(&intf->coreIntf.ip, &ip)) break;
+        }
+        if (i)
+        {
+            ((PosixNetworkInterface *)i)->seen = mDNStrue;
+            (*count)++;
+        }
+        else
+        {
+            const mStatus err = SetupOneInterface(m, list, ifa, index, &ip);
+            if (!err) (*count)++;
+            else if (!firstErr) firstErr = err;
+        }
+    }
+    return(firstErr);
+}
+
+// Brings m->HostInterfaces into line with the addresses currently configured. Addresses that are still
+// present are left registered, so an unrelated change does not make the core re-probe and re-announce
+// everything. The loopback interface is used only when there is nothing else.
+mDNSexport mStatus mDNSPlatformPosixRefreshInterfaceList(mDNS *const m)
+{
+    struct ifaddrs *list;
+    NetworkInterfaceInfo *i;
+    int count = 0;
+    mStatus err;
+
+    m->p->interfacesChanged = mDNSfalse;
+    if (getifaddrs(&list) < 0)
+    {
+        LogMsg("mDNSPlatformPosixRefreshInterfaceList: getifaddrs failed %d (%s)", errno, strerror(errno));
+        return(mStatus_UnknownErr);
+    }
+
+    for (i = m->HostInterfaces; i; i = i->next) ((PosixNetworkInterface *)i)->seen = mDNSfalse;
+
+    err = AddInterfacesFromList(m, list, mDNSfalse, &count);
+    if (count == 0) err = AddInterfacesFromList(m, list, mDNStrue, &count);
+
+    i = m->HostInterfaces;
+    while (i)
+    {
+        PosixNetworkInterface *const intf = (PosixNetworkInterface *)i;
+        i = i->next;
+        if (!intf->seen) TearDownInterface(m, intf);
+    }
+
+    freeifaddrs(list);
+    return(err);
+}
+
+mDNSlocal void NetlinkReady(int fd, void *context)
+{
+    mDNS *const m = (mDNS *)context;
+    mDNSu8 buf[8192];
+    ssize_t len;
+
+    while ((len = recv(fd, buf, sizeof(buf), 0)) != 0)
+    {
+        const struct nlmsghdr *nlh;
+        if (len < 0)
+        {
+            if (errno == ENOBUFS) { m->p->interfacesChanged = mDNStrue; continue; }  // Lost messages; rescan to be safe
+            if (errno != EAGAIN && errno != EWOULDBLOCK) LogMsg("NetlinkReady: recv failed %d (%s)", errno, strerror(errno));
+            break;
+        }
+        for (nlh = (const struct nlmsghdr *)buf; NLMSG_OK(nlh, (size_t)len); nlh = NLMSG_NEXT(nlh, len))
+        {
+            if (nlh->nlmsg_type == RTM_NEWLINK || nlh->nlmsg_type == RTM_DELLINK ||
+                nlh->nlmsg_type == RTM_NEWADDR || nlh->nlmsg_type == RTM_DELADDR)
+                m->p->interfacesChanged = mDNStrue;
+        }
+    }
+}
+
+mDNSlocal int OpenNetlinkSocket(void)
+{
+    struct sockaddr_nl snl;
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE);
+
+    if (fd < 0)
+    {
+        LogMsg("OpenNetlinkSocket: socket failed %d (%s)", errno, strerror(errno));
+        return(-1);
+    }
+    mDNSPlatformMemZero(&snl, sizeof(snl));
+    snl.nl_family = AF_NETLINK;
+    snl.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
+    if (bind(fd, (struct sockaddr *)&snl, sizeof(snl)) < 0)
+    {
+        LogMsg("OpenNetlinkSocket: bind failed %d (%s)", errno, strerror(errno));
+        close(fd);
+        return(-1);
+    }
+    return(fd);
+}
+
+mDNSlocal void GetHostLabel(domainlabel *const label)
+{
+    char name[256];
+    char *dot;
+
+    label->c[0] = 0;
+    if (gethostname(name, sizeof(name)) < 0) return;
+    name[sizeof(name) - 1] = 0;
+    dot = strchr(name, '.');
+    if (dot) *dot = 0;
+    if (name[0]) MakeDomainLabelFromLiteralString(label, name);
+}
+
+#if COMPILER_LIKES_PRAGMA_MARK
+#pragma mark ***** Platform Init and Close
+#endif
+
+mDNSexport mStatus mDNSPlatformInit(mDNS *const m)
+{
+    mDNSIPPort port;
+    mStatus err;
+
+    m->p->unicastSocket4 = -1;
+    m->p->unicastSocket6 = -1;
+    m->p->netlinkSocket  = -1;
+    m->p->interfacesChanged = mDNSfalse;
+
+    err = EventLoopInit();
+    if (err) return(err);
+
+    GetHostLabel(&m->hostlabel);
+    if (m->hostlabel.c[0] == 0) MakeDomainLabelFromLiteralString(&m->hostlabel, "Linux");
+    m->nicelabel = m->hostlabel;
+    mDNS_SetFQDN(m);
+
+    // Sockets for unicast traffic the core sends without a UDPSocket of its own
+    port = zeroIPPort;
+    m->p->unicastSocket4 = OpenUDPSocket(AF_INET, &port, mDNSfalse);
+    if (m->p->unicastSocket4 >= 0) mDNSPosixAddFDToEventLoop(m->p->unicastSocket4, UnicastSocketReady, m);
+    port = zeroIPPort;
+    m->p->unicastSocket6 = OpenUDPSocket(AF_INET6, &port, mDNSfalse);
+    if (m->p->unicastSocket6 >= 0) mDNSPosixAddFDToEventLoop(m->p->unicastSocket6, UnicastSocketReady, m);
+
+    m->p->netlinkSocket = OpenNetlinkSocket();
+    if (m->p->netlinkSocket >= 0) mDNSPosixAddFDToEventLoop(m->p->netlinkSocket, NetlinkReady, m);
+
+    // If the workers can't be started, the 5353 sockets are read on this thread as usual
+    if (gReceiveThreads > 0)
+    {
+        gReceiveReadyFD = ReceiveWorkersStart(gReceiveThreads);
+        if (gReceiveReadyFD >= 0 && mDNSPosixAddFDToEventLoop(gReceiveReadyFD, ReceiveWorkersReady, m) != mStatus_NoError)
+        {
+            ReceiveWorkersStop();
+            gReceiveReadyFD = -1;
+        }
+        if (gReceiveReadyFD >= 0) LogInfo("mDNSPlatformInit: reading the mDNS sockets on %d threads", gReceiveThreads);
+    }
+
+    err = mDNSPlatformPosixRefreshInterfaceList(m);
+
+    // We don't do asynchronous initialization on this platform, so the core is ready as soon as the
+    // interfaces are registered
+    mDNSCoreInitComplete(m, err);
+    return(err);
+}
+
+mDNSexport void mDNSPlatformClose(mDNS *const m)
+{
+    while (m->HostInterfaces) TearDownInterface(m, (PosixNetworkInterface *)m->HostInterfaces);
+    if (gReceiveReadyFD >= 0)
+    {
+        mDNSPosixRemoveFDFromEventLoop(gReceiveReadyFD);
+        ReceiveWorkersStop();
+        gReceiveReadyFD = -1;
+    }
+    CloseSocket(&m->p->unicastSocket4);
+    CloseSocket(&m->p->unicastSocket6);
+    CloseSocket(&m->p->netlinkSocket);
+}
+
+#if COMPILER_LIKES_PRAGMA_MARK
+#pragma mark ***** UDP
+#endif
+
+mDNSexport mStatus mDNSPlatformSendUDP(const mDNS *const m, const void *const msg, const mDNSu8 *const end,
+                                       mDNSInterfaceID InterfaceID, UDPSocket *src, const mDNSAddr *dst,
+                                       mDNSIPPort dstPort, mDNSBool useBackgroundTrafficClass)
+{
+    union { struct sockaddr sa; struct sockaddr_in sin; struct sockaddr_in6 sin6; } to;
+    const int index = (int)(uintptr_t)InterfaceID;
+    socklen_t tolen;
+    int fd = -1;
+    ssize_t sent;
+    (void)useBackgroundTrafficClass;    // Unused
+
+    mDNSPlatformMemZero(&to, sizeof(to));
+    if (dst->type == mDNSAddrType_IPv4)
+    {
+        to.sin.sin_family      = AF_INET;
+        to.sin.sin_port        = dstPort.NotAnInteger;
+        to.sin.sin_addr.s_addr = dst->ip.v4.NotAnInteger;
+        tolen = sizeof(to.sin);
+    }
+    else if (dst->type == mDNSAddrType_IPv6)
+    {
+        to.sin6.sin6_family   = AF_INET6;
+        to.sin6.sin6_port     = dstPort.NotAnInteger;
+        to.sin6.sin6_scope_id = (uint32_t)index;   // Needed for link-local destinations
+        mDNSPlatformMemCopy(&to.sin6.sin6_addr, &dst->ip.v6, sizeof(to.sin6.sin6_addr));
+        tolen = sizeof(to.sin6);
+    }
+    else
+    {
+        LogMsg("mDNSPlatformSendUDP: dst is not an IPv4 or IPv6 address (type=%d)", dst->type);
+        return(mStatus_BadParamErr);
+    }
+
+    if (src)
+        fd = (dst->type == mDNSAddrType_IPv4) ? src->fd4 : src->fd6;
+    else if (InterfaceID)
+    {
+        PosixNetworkInterface *const owner = SocketOwnerFor((mDNS *)m, index, dst->type);
+        if (owner) fd = (dst->type == mDNSAddrType_IPv4) ? owner->multicastSocket4 : owner->multicastSocket6;
+    }
+    else
+        fd = (dst->type == mDNSAddrType_IPv4) ? m->p->unicastSocket4 : m->p->unicastSocket6;
+
+    if (fd < 0) return(mStatus_BadParamErr);
+
+    if (!src && InterfaceID && mDNSAddressIsAllDNSLinkGroup(dst) && (size_t)(end - (const mDNSu8 *)msg) <= sizeof(gSendQueue[0].data))
+    {
+        QueueDatagram(fd, index, msg, (mDNSu32)(end - (const mDNSu8 *)msg), &to.sa, tolen);
+        return(mStatus_NoError);
+    }
+
+    sent = sendto(fd, msg, (size_t)(end - (const mDNSu8 *)msg), 0, &to.sa, tolen);
+    if (sent < 0)
+    {
+        // Don't report EHOSTDOWN (i.e. ARP failure), ENETDOWN, or no route to host for unicast destinations
+        if (!mDNSAddressIsAllDNSLinkGroup(dst) &&
+            (errno == EHOSTDOWN || errno == ENETDOWN || errno == EHOSTUNREACH || errno == ENETUNREACH))
+            return(mStatus_TransientErr);
+        // An interface that has just gone away can fail sends until netlink tells us about it
+        if (errno == EADDRNOTAVAIL || errno == ENODEV || errno == ENETDOWN) return(mStatus_TransientErr);
+        LogMsg("mDNSPlatformSendUDP: sendto(%d) to %#a:%d failed %d (%s)", fd, dst, mDNSVal16(dstPort), errno, strerror(errno));
+        return(mStatus_UnknownErr);
+    }
+    mDNSMetricsCountPacket((mDNSu32)index, mDNStrue, (mDNSu32)sent);
+    return(mStatus_NoError);
+}
+
+mDNSexport UDPSocket *mDNSPlatformUDPSocket(const mDNSIPPort requestedport)
+{
+    mDNS *const m = &mDNSStorage;
+    UDPSocket *sock;
+    int i;
+
+    sock = (UDPSocket *)mDNSPlatformMemAllocateClear(sizeof(*sock));
+    if (!sock) return(mDNSNULL);
+    sock->fd4 = -1;
+    sock->fd6 = -1;
+
+    // Try at most 10000 times to get a unique random port. The kernel doesn't do cryptographically strong random
+    // port allocation, so we do it ourselves here.
+    for (i = 0; i < 10000; i++)
+    {
+        mDNSIPPort port = requestedport;
+        if (mDNSIPPortIsZero(requestedport)) port = mDNSOpaque16fromIntVal((mDNSu16)(0xC000 + mDNSRandom(0x3FFF)));
+        sock->fd4 = OpenUDPSocket(AF_INET, &port, mDNSfalse);
+        if (sock->fd4 < 0 && errno == EADDRINUSE && mDNSIPPortIsZero(requestedport)) continue;
+        sock->port = port;
+        sock->fd6 = OpenUDPSocket(AF_INET6, &port, mDNSfalse);
+        break;
+    }
+    if (sock->fd4 < 0 && sock->fd6 < 0)
+    {
+        LogMsg("mDNSPlatformUDPSocket: unable to open a socket for port %d", mDNSVal16(requestedport));
+        mDNSPlatformMemFree(sock);
+        return(mDNSNULL);
+    }
+    if (sock->fd4 >= 0) mDNSPosixAddFDToEventLoop(sock->fd4, UnicastSocketReady, m);
+    if (sock->fd6 >= 0) mDNSPosixAddFDToEventLoop(sock->fd6, UnicastSocketReady, m);
+    return(sock);
+}
+
+mDNSexport void mDNSPlatformUDPClose(UDPSocket *sock)
+{
+    CloseSocket(&sock->fd4);
+    CloseSocket(&sock->fd6);
+    mDNSPlatformMemFree(sock);
+}
+
+mDNSexport mDNSu16 mDNSPlatformGetUDPPort(UDPSocket *sock)
+{
+    return(mDNSVal16(sock->port));
+}
+
+#if COMPILER_LIKES_PRAGMA_MARK
+#pragma mark ***** TCP
+#endif
+
+mDNSlocal void TCPSocketReady(int fd, void *context)
+{
+    TCPSocket *const sock = (TCPSocket *)context;
+    (void)fd;   // Unused
+
+    if (!sock->connected)
+    {
+        int soerr = 0;
+        socklen_t len = sizeof(soerr);
+        if (getsockopt(sock->fd, SOL_SOCKET, SO_ERROR, &soerr, &len) < 0) soerr = errno;
+        sock->connected = mDNStrue;
+        EventLoopSetEvents(sock->fd, EPOLLIN);
+        if (soerr) LogInfo("TCPSocketReady: connect on %d failed %d (%s)", sock->fd, soerr, strerror(soerr));
+        sock->callback(sock, sock->context, mDNStrue, soerr ? mStatus_ConnFailed : mStatus_NoError);
+    }
+    else
+        sock->callback(sock, sock->context, mDNSfalse, mStatus_NoError);
+}
+
+mDNSexport TCPSocket *mDNSPlatformTCPSocket(TCPSocketFlags flags, mDNSAddr_Type addrtype, mDNSIPPort *port,
+                                            domainname *hostname, mDNSBool useBackgroundTrafficClass)
+{
+    TCPSocket *sock;
+    mDNSIPPort outTcpPort;
+    int fd = -1;
+    (void)hostname;                     // Unused
+    (void)useBackgroundTrafficClass;    // Unused
+
+    if (flags & kTCPSocketFlags_UseTLS)
+    {
+        LogMsg("mDNSPlatformTCPSocket: TLS is not supported on this platform");
+        return(mDNSNULL);
+    }
+    if (!mDNSPosixTCPSocketSetup(&fd, addrtype, port, &outTcpPort) || fd < 0)
+    {
+        if (fd >= 0) close(fd);
+        return(mDNSNULL);
+    }
+    if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK) < 0 || fcntl(fd, F_SETFD, FD_CLOEXEC) < 0)
+    {
+        LogMsg("mDNSPlatformTCPSocket: fcntl failed %d (%s)", errno, strerror(errno));
+        close(fd);
+        return(mDNSNULL);
+    }
+
+    sock = (TCPSocket *)mDNSPlatformMemAllocateClear(sizeof(*sock));
+    if (!sock) { close(fd); return(mDNSNULL); }
+    sock->flags = flags;
+    sock->fd    = fd;
+    return(sock);
+}
+
+mDNSexport TCPSocket *mDNSPlatformTCPAccept(TCPSocketFlags flags, int fd)
+{
+    TCPSocket *sock;
+
+    if (flags & kTCPSocketFlags_UseTLS) return(mDNSNULL);
+    sock = (TCPSocket *)mDNSPlatformMemAllocateClear(sizeof(*sock));
+    if (!sock) return(mDNSNULL);
+    sock->flags     = flags;
+    sock->fd        = fd;
+    sock->connected = mDNStrue;
+    return(sock);
+}
+
+mDNSexport mStatus mDNSPlatformTCPConnect(TCPSocket *sock, const mDNSAddr *dst, mDNSOpaque16 dstport,
+                                          mDNSInterfaceID InterfaceID, TCPConnectionCallback callback, void *context)
+{
+    union { struct sockaddr sa; struct sockaddr_in sin; struct sockaddr_in6 sin6; } addr;
+    socklen_t len;
+    mStatus err;
+
+    sock->callback = callback;
+    sock->context  = context;
+
+    mDNSPlatformMemZero(&addr, sizeof(addr));
+    if (dst->type == mDNSAddrType_IPv4)
+    {
+        addr.sin.sin_family      = AF_INET;
+        addr.sin.sin_port        = dstport.NotAnInteger;
+        addr.sin.sin_addr.s_addr = dst->ip.v4.NotAnInteger;
+        len = sizeof(addr.sin);
+    }
+    else if (dst->type == mDNSAddrType_IPv6)
+    {
+        addr.sin6.sin6_family   = AF_INET6;
+        addr.sin6.sin6_port     = dstport.NotAnInteger;
+        addr.sin6.sin6_scope_id = (uint32_t)(uintptr_t)InterfaceID;
+        mDNSPlatformMemCopy(&addr.sin6.sin6_addr, &dst->ip.v6, sizeof(addr.sin6.sin6_addr));
+        len = sizeof(addr.sin6);
+    }
+    else
+        return(mStatus_BadParamErr);
+
+    if (InterfaceID)
+    {
+        char ifname[IF_NAMESIZE];
+        if (if_indextoname((unsigned int)(uintptr_t)InterfaceID, ifname) &&
+            setsockopt(sock->fd, SOL_SOCKET, SO_BINDTODEVICE, ifname, (socklen_t)strlen(ifname)) < 0)
+            LogInfo("mDNSPlatformTCPConnect: SO_BINDTODEVICE %s failed %d (%s)", ifname, errno, strerror(errno));
+    }
+
+    if (connect(sock->fd, &addr.sa, len) == 0)
+    {
+        sock->connected = mDNStrue;
+        err = EventLoopAdd(sock->fd, EPOLLIN, TCPSocketReady, sock);
+        return(err ? err : mStatus_ConnEstablished);
+    }
+    if (errno != EINPROGRESS)
+    {
+        LogInfo("mDNSPlatformTCPConnect: connect to %#a:%d failed %d (%s)", dst, mDNSVal16(dstport), errno, strerror(errno));
+        return(mStatus_ConnFailed);
+    }
+    // Wait for the socket to become writable, which is how a non-blocking connect reports completion
+    err = EventLoopAdd(sock->fd, EPOLLOUT, TCPSocketReady, sock);
+    return(err ? err : mStatus_ConnPending);
+}
+
+mDNSexport void mDNSPlatformTCPCloseConnection(TCPSocket *sock)
+{
+    if (!sock) return;
+    CloseSocket(&sock->fd);
+    mDNSPlatformMemFree(sock);
+}
+
+mDNSexport long mDNSPlatformReadTCP(TCPSocket *sock, void *buf, unsigned long buflen, mDNSBool *closed)
+{
+    return(mDNSPosixReadTCP(sock->fd, buf, buflen, closed));
+}
+
+mDNSexport long mDNSPlatformWriteTCP(TCPSocket *sock, const char *msg, unsigned long len)
+{
+    return(mDNSPosixWriteTCP(sock->fd, msg, len));
+}
+
+mDNSexport int mDNSPlatformTCPGetFD(TCPSocket *sock)
+{
+    return(sock->fd);
+}
+
+#if COMPILER_LIKES_PRAGMA_MARK
+#pragma mark ***** Interface Index Mapping
+#endif
+
+mDNSexport mDNSInterfaceID mDNSPlatformInterfaceIDfromInterfaceIndex(mDNS *const m, mDNSu32 ifindex)
+{
+    if (ifindex == kDNSServiceInterfaceIndexLocalOnly) return(mDNSInterface_LocalOnly);
+    if (ifindex == kDNSServiceInterfaceIndexP2P)       return(mDNSInterface_P2P);
+    if (ifindex == kDNSServiceInterfaceIndexBLE)       return(mDNSInterface_BLE);
+    if (ifindex == kDNSServiceInterfaceIndexAny)       return(mDNSNULL);
+    if (!InterfaceForIndex(m, (int)ifindex)) return(mDNSNULL);
+    return((mDNSInterfaceID)(uintptr_t)ifindex);
+}
+
+mDNSexport mDNSu32 mDNSPlatformInterfaceIndexfromInterfaceID(mDNS *const m, mDNSInterfaceID id, mDNSBool suppressNetworkChange)
+{
+    (void)m;                        // Unused
+    (void)suppressNetworkChange;    // Unused
+
+    if (id == mDNSInterface_LocalOnly) return((mDNSu32)kDNSServiceInterfaceIndexLocalOnly);
+    if (id == mDNSInterface_P2P)       return((mDNSu32)kDNSServiceInterfaceIndexP2P);
+    if (id == mDNSInterface_BLE)       return((mDNSu32)kDNSServiceInterfaceIndexBLE);
+    // The InterfaceID is the kernel interface index, so this also works for interfaces that have just been
+    // removed, which lets remove events report the old index
+    return((mDNSu32)(uintptr_t)id);
+}
+
+mDNSexport mDNSBool mDNSPlatformInterfaceIsD2D(mDNSInterfaceID InterfaceID)
+{
+    (void)InterfaceID;  // Unused
+    return(mDNSfalse);
+}
+
+mDNSexport mDNSBool mDNSPlatformValidRecordForInterface(const AuthRecord *rr, mDNSInterfaceID InterfaceID)
+{
+    (void)rr;           // Unused
+    (void)InterfaceID;  // Unused
+    return(mDNStrue);
+}
+
+mDNSexport mDNSBool mDNSPlatformValidQuestionForInterface(DNSQuestion *q, const NetworkInterfaceInfo *intf)
+{
+    (void)q;            // Unused
+    (void)intf;         // Unused
+    return(mDNStrue);
+}
+
+#if COMPILER_LIKES_PRAGMA_MARK
+#pragma mark ***** DNS Configuration
+#endif
+
+// Reads nameserver and search/domain lines from /etc/resolv.conf
+mDNSlocal void ParseResolvConf(mDNS *const m, mDNSBool setservers, mDNSBool setsearch)
+{
+    char line[512];
+    FILE *f = fopen("/etc/resolv.conf", "r");
+
+    if (!f) return;
+    while (fgets(line, sizeof(line), f))
+    {
+        char *save = mDNSNULL;
+        char *keyword = strtok_r(line, " \t\r\n", &save);
+        char *value;
+
+        if (!keyword || keyword[0] == '#' || keyword[0] == ';') continue;
+        if (setservers && !strcmp(keyword, "nameserver"))
+        {
+            mDNSAddr addr;
+            struct in_addr in4;
+            struct in6_addr in6;
+            char *pct;
+
+            value = strtok_r(mDNSNULL, " \t\r\n", &save);
+            if (!value) continue;
+            pct = strchr(value, '%');   // Scoped addresses are not supported; use the unscoped address
+            if (pct) *pct = 0;
+            if (inet_pton(AF_INET, value, &in4) == 1)
+            {
+                addr.type = mDNSAddrType_IPv4;
+                addr.ip.v4.NotAnInteger = in4.s_addr;
+            }
+            else if (inet_pton(AF_INET6, value, &in6) == 1)
+            {
+                addr.type = mDNSAddrType_IPv6;
+                mDNSPlatformMemCopy(&addr.ip.v6, &in6, sizeof(addr.ip.v6));
+            }
+            else continue;
+            mDNS_AddDNSServer(m, mDNSNULL, mDNSInterface_Any, 0, &addr, UnicastDNSPort, kScopeNone, DEFAULT_UDNS_TIMEOUT,
+                              mDNSfalse, mDNSfalse, mDNSfalse, mDNSfalse, 0, mDNStrue, mDNStrue, mDNSfalse);
+        }
+        else if (setsearch && (!strcmp(keyword, "search") || !strcmp(keyword, "domain")))
+        {
+            while ((value = strtok_r(mDNSNULL, " \t\r\n", &save)) != mDNSNULL)
+                mDNS_AddSearchDomain_CString(value, mDNSNULL);
+        }
+    }
+    fclose(f);
+}
+
+mDNSexport mDNSBool mDNSPlatformSetDNSConfig(mDNSBool setservers, mDNSBool setsearch, domainname *const fqdn,
+                                             DNameListElem **RegDomains, DNameListElem **BrowseDomains, mDNSBool ackConfig)
+{
+    mDNS *const m = &mDNSStorage;
+    (void)RegDomains;       // Unused
+    (void)BrowseDomains;    // Unused
+    (void)ackConfig;        // Unused
+
+    if (fqdn) fqdn->c[0] = 0;
+    ParseResolvConf(m, setservers, setsearch);
+    return(mDNStrue);
+}
+
+// Finds the interface that carries the IPv4 default route, and returns its primary IPv4 and IPv6 addresses
+mDNSexport mStatus mDNSPlatformGetPrimaryInterface(mDNSAddr *v4, mDNSAddr *v6, mDNSAddr *router)
+{
+    mDNS *const m = &mDNSStorage;
+    char line[256];
+    char ifname[IF_NAMESIZE + 1];
+    FILE *f;
+    int index = 0;
+    NetworkInterfaceInfo *i;
+
+    v4->type = mDNSAddrType_None;
+    v6->type = mDNSAddrType_None;
+    router->type = mDNSAddrType_None;
+
+    f = fopen("/proc/net/route", "r");
+    if (!f) return(mStatus_UnknownErr);
+    while (fgets(line, sizeof(line), f))
+    {
+        unsigned int dest, gateway;
+        if (sscanf(line, "%16s %x %x", ifname, &dest, &gateway) == 3 && dest == 0)
+        {
+            router->type = mDNSAddrType_IPv4;
+            router->ip.v4.NotAnInteger = gateway;
+            index = (int)if_nametoindex(ifname);
+            break;
+        }
+    }
+    fclose(f);
+    if (!index) return(mStatus_NoError);
+
+    for (i = m->HostInterfaces; i; i = i->next)
+    {
+        if (((PosixNetworkInterface *)i)->index != index) continue;
+        if (i->ip.type == mDNSAddrType_IPv4 && v4->type == mDNSAddrType_None) *v4 = i->ip;
+        if (i->ip.type == mDNSAddrType_IPv6 && v6->type == mDNSAddrType_None && !mDNSv6AddressIsLinkLocal(&i->ip.ip.v6)) *v6 = i->ip;
+    }
+    return(mStatus_NoError);
+}
+
+mDNSexport void mDNSPlatformDynDNSHostNameStatusChanged(const domainname *const dname, const mStatus status)
+{
+    (void)dname;    // Unused
+    (void)status;   // Unused
+}
+
+#if COMPILER_LIKES_PRAGMA_MARK
+#pragma mark ***** Locking, Strings, Memory, Time
+#endif
+
+// The daemon is single-threaded: everything, including the uds_daemon clients, runs from the event loop
+mDNSexport void mDNSPlatformLock(const mDNS *const m)
+{
+    (void)m;    // Unused
+}
+
+mDNSexport void mDNSPlatformUnlock(const mDNS *const m)
+{
+    (void)m;    // Unused
+}
+
+mDNSexport mDNSu32 mDNSPlatformStrLCopy(void *dst, const void *src, mDNSu32 dstlen)
+{
+    const size_t srclen = strlen((const char *)src);
+    if (dstlen > 0)
+    {
+        const size_t n = (srclen < dstlen) ? srclen : (size_t)(dstlen - 1);
+        memcpy(dst, src, n);
+        ((char *)dst)[n] = '\0';
+    }
+    return((mDNSu32)srclen);
+}
+
+mDNSexport mDNSu32 mDNSPlatformStrLen(const void *src)
+{
+    return((mDNSu32)strlen((const char *)src));
+}
+
+mDNSexport void mDNSPlatformMemCopy(void *dst, const void *src, mDNSu32 len)
+{
+    memcpy(dst, src, len);
+}
+
+mDNSexport mDNSBool mDNSPlatformMemSame(const void *dst, const void *src, mDNSu32 len)
+{
+    return(memcmp(dst, src, len) == 0);
+}
+
+mDNSexport int mDNSPlatformMemCmp(const void *dst, const void *src, mDNSu32 len)
+{
+    return(memcmp(dst, src, len));
+}
+
+mDNSexport void mDNSPlatformMemZero(void *dst, mDNSu32 len)
+{
+    memset(dst, 0, len);
+}
+
+mDNSexport void mDNSPlatformQsort(void *base, int nel, int width, int (*compar)(const void *, const void *))
+{
+    qsort(base, (size_t)nel, (size_t)width, compar);
+}
+
+#if !MDNS_MALLOC_DEBUGGING
+mDNSexport void *mDNSPlatformMemAllocate(mDNSu32 len)
+{
+    return(malloc(len));
+}
+
+mDNSexport void *mDNSPlatformMemAllocateClear(mDNSu32 len)
+{
+    return(calloc(1, len));
+}
+
+mDNSexport void mDNSPlatformMemFree(void *mem)
+{
+    free(mem);
+}
+#endif
+
+mDNSexport mDNSu32 mDNSPlatformRandomSeed(void)
+{
+    mDNSu32 seed;
+    if (getrandom(&seed, sizeof(seed), GRND_NONBLOCK) == (ssize_t)sizeof(seed)) return(seed);
+    return((mDNSu32)time(mDNSNULL) ^ ((mDNSu32)getpid() << 16));
+}
+
+mDNSexport mStatus mDNSPlatformTimeInit(void)
+{
+    // No special setup is required on Posix -- we just use CLOCK_MONOTONIC
+    return(mStatus_NoError);
+}
+
+// mDNSPlatformRawTime must not go backwards when the wall clock is set, so it is derived from CLOCK_MONOTONIC.
+// It is allowed to wrap; the core only ever compares times by subtraction.
+mDNSexport mDNSs32 mDNSPlatformRawTime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return((mDNSs32)((mDNSu32)ts.tv_sec * 1000U + (mDNSu32)(ts.tv_nsec / 1000000)));
+}
+
+mDNSexport mDNSs32 mDNSPlatformUTC(void)
+{
+    return((mDNSs32)time(mDNSNULL));
+}
+
+mDNSexport mDNSs32 mDNSPlatformGetPID(void)
+{
+    return((mDNSs32)getpid());
+}
+
+mDNSexport void mDNSPlatformFormatTime(unsigned long te, mDNSu8 *buf, int bufsize)
+{
+    time_t t = (time_t)te;
+    struct tm tm;
+    if (bufsize <= 0) return;
+    buf[0] = 0;
+    if (localtime_r(&t, &tm)) strftime((char *)buf, (size_t)bufsize, "%Y-%m-%d %H:%M:%S", &tm);
+}
+
+#if COMPILER_LIKES_PRAGMA_MARK
+#pragma mark ***** Unsupported Features
+#endif
+
+// Sleep proxy, wake-on-LAN, keepalive offload and raw packet access are not implemented on this platform
+
+mDNSexport void mDNSPlatformUpdateProxyList(const mDNSInterfaceID InterfaceID)
+{
+    (void)InterfaceID;  // Unused
+}
+
+mDNSexport void mDNSPlatformSetAllowSleep(mDNSBool allowSleep, const char *reason)
+{
+    (void)allowSleep;   // Unused
+    (void)reason;       // Unused
+}
+
+mDNSexport void mDNSPlatformSendWakeupPacket(mDNSInterfaceID InterfaceID, char *EthAddr, char *IPAddr, int iteration)
+{
+    (void)InterfaceID;  // Unused
+    (void)EthAddr;      // Unused
+    (void)IPAddr;       // Unused
+    (void)iteration;    // Unused
+}
+
+mDNSexport void mDNSPlatformSendRawPacket(const void *const msg, const mDNSu8 *const end, mDNSInterfaceID InterfaceID)
+{
+    (void)msg;          // Unused
+    (void)end;          // Unused
+    (void)InterfaceID;  // Unused
+}
+
+mDNSexport void mDNSPlatformSetLocalAddressCacheEntry(const mDNSAddr *const tpa, const mDNSEthAddr *const tha, mDNSInterfaceID InterfaceID)
+{
+    (void)tpa;          // Unused
+    (void)tha;          // Unused
+    (void)InterfaceID;  // Unused
+}
+
+mDNSexport void mDNSPlatformSendKeepalive(mDNSAddr *sadd, mDNSAddr *dadd, mDNSIPPort *lport, mDNSIPPort *rport, mDNSu32 seq, mDNSu32 ack, mDNSu16 win)
+{
+    (void)sadd; (void)dadd; (void)lport; (void)rport; (void)seq; (void)ack; (void)win;  // Unused
+}
+
+mDNSexport mStatus mDNSPlatformRetrieveTCPInfo(mDNSAddr *laddr, mDNSIPPort *lport, mDNSAddr *raddr, mDNSIPPort *rport, mDNSTCPInfo *mti)
+{
+    (void)laddr; (void)lport; (void)raddr; (void)rport; (void)mti;  // Unused
+    return(mStatus_UnsupportedErr);
+}
+
+mDNSexport mStatus mDNSPlatformGetRemoteMacAddr(mDNSAddr *raddr)
+{
+    (void)raddr;    // Unused
+    return(mStatus_UnsupportedErr);
+}
+
+mDNSexport mStatus mDNSPlatformStoreSPSMACAddr(mDNSAddr *spsaddr, char *ifname)
+{
+    (void)spsaddr;  // Unused
+    (void)ifname;   // Unused
+    return(mStatus_UnsupportedErr);
+}
+
+mDNSexport mStatus mDNSPlatformClearSPSData(void)
+{
+    return(mStatus_UnsupportedErr);
+}
+
+mDNSexport mStatus mDNSPlatformStoreOwnerOptRecord(char *ifname, DNSMessage *msg, int length)
+{
+    (void)ifname;   // Unused
+    (void)msg;      // Unused
+    (void)length;   // Unused
+    return(mStatus_UnsupportedErr);
+}
+
+mDNSexport void mDNSPlatformSetSocktOpt(void *sock, mDNSTransport_Type transType, mDNSAddr_Type addrType, const DNSQuestion *q)
+{
+    (void)sock;         // Unused
+    (void)transType;    // Unused
+    (void)addrType;     // Unused
+    (void)q;            // Unused
+}
+
+mDNSexport void FreeEtcHosts(mDNS *const m, AuthRecord *const rr, mStatus result)
+{
+    (void)m;        // Unused
+    (void)rr;       // Unused
+    (void)result;   // Unused
+}
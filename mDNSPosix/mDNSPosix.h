@@ -0,0 +1,92 @@
+/* -*- Mode: C; tab-width: 4; c-file-style: "bsd"; c-basic-offset: 4; fill-column: 108; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (c) 2002-2019 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __mDNSPosix_h
+#define __mDNSPosix_h
+
+#include <signal.h>
+#include <sys/time.h>
+
+#include "mDNSEmbeddedAPI.h"
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+// PosixNetworkInterface is a record extension of the core NetworkInterfaceInfo
+// type that supports extra fields needed by the Posix platform.
+//
+// IMPORTANT: coreIntf must be the first field in the structure because
+// we cast between pointers to the two different types regularly.
+//
+// One PosixNetworkInterface is registered with the core for each address on each interface. The InterfaceID is
+// the kernel interface index, so every address on an interface shares it. The multicast sockets belong to the
+// first address of each family on an interface; later addresses of that family point to it through aliasIntf
+// and have no sockets of their own.
+
+typedef struct PosixNetworkInterface PosixNetworkInterface;
+
+struct PosixNetworkInterface
+{
+    NetworkInterfaceInfo coreIntf;      // MUST be the first element in this structure
+    PosixNetworkInterface *aliasIntf;   // Interface record that owns the sockets for this interface and family
+    int index;                          // Kernel interface index, also used as the InterfaceID
+    int multicastSocket4;               // Bound to 5353, joined to 224.0.0.251 on this interface only; or -1
+    int multicastSocket6;               // Bound to 5353, joined to FF02::FB on this interface only; or -1
+    mDNSBool seen;                      // Set while rescanning if the address is still present
+};
+
+// This is a struct that captures the platform-specific state of the mDNS core.
+
+struct mDNS_PlatformSupport_struct
+{
+    int unicastSocket4;                 // Ephemeral-port sockets used when the core sends unicast without a
+    int unicastSocket6;                 // UDPSocket of its own (for example, NAT-PMP and unicast replies)
+    int netlinkSocket;                  // Listens for link and address changes
+    mDNSBool interfacesChanged;         // Set by the netlink handler; the interface list is rescanned once per wakeup
+};
+
+// Event loop. File descriptors are watched for readability with epoll; the callbacks are made from
+// mDNSPosixRunEventLoopOnce(). A callback may add or remove descriptors, including its own.
+
+typedef void (*mDNSPosixEventCallback)(int fd, void *context);
+
+extern mStatus mDNSPosixAddFDToEventLoop(int fd, mDNSPosixEventCallback callback, void *context);
+extern mStatus mDNSPosixRemoveFDFromEventLoop(int fd);
+extern mStatus mDNSPosixListenForSignalInEventLoop(int signum);
+extern mStatus mDNSPosixIgnoreSignalInEventLoop(int signum);
+
+// Waits until a watched descriptor is ready, a signal registered with mDNSPosixListenForSignalInEventLoop()
+// arrives, or *pTimeout elapses (a NULL pTimeout waits indefinitely). Ready descriptors are dispatched to their
+// callbacks before returning; *pDataDispatched reports whether any were. Pending interface changes are applied
+// before returning.
+extern mStatus mDNSPosixRunEventLoopOnce(mDNS *m, const struct timeval *pTimeout, sigset_t *pSignalsReceived,
+                                         mDNSBool *pDataDispatched);
+
+// Reads the 5353 sockets on this many receive worker threads (see ReceiveWorkers.h) instead of on the thread
+// running the event loop. Must be called before mDNS_Init(); 0, the default, uses no worker threads.
+extern void mDNSPosixSetReceiveThreads(int threads);
+
+// Rescans the interfaces and registers or deregisters addresses with the core as needed.
+// Called automatically on netlink notifications; the daemon also calls it on SIGHUP.
+extern mStatus mDNSPlatformPosixRefreshInterfaceList(mDNS *const m);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
@@ -234,6 +234,7 @@ mDNSlocal mDNSBool GetConfigOption(char *dst, const char *option, FILE *f)
 mDNSexport void ReadDDNSSettingsFromConfFile(mDNS *const m, const char *const filename, domainname *const hostname, domainname *const domain, mDNSBool *DomainDiscoveryDisabled)
 {
     char buf[MAX_ESCAPED_DOMAIN_NAME] = "";
+    char alg[MAX_ESCAPED_DOMAIN_NAME] = "";
     mStatus err;
     FILE *f = fopen(filename, "r");
 
@@ -248,6 +249,7 @@ mDNSexport void ReadDDNSSettingsFromConfFile(mDNS *const m, const char *const fi
         if (domain && GetConfigOption(buf, "zone", f) && !MakeDomainNameFromDNSNameString(domain, buf)) goto badf;
         buf[0] = 0;
         GetConfigOption(buf, "secret-64", f);  // failure means no authentication
+        GetConfigOption(alg, "secret-alg", f); // failure means hmac-md5
         fclose(f);
         f = NULL;
     }
@@ -260,6 +262,8 @@ mDNSexport void ReadDDNSSettingsFromConfFile(mDNS *const m, const char *const fi
     if (domain && domain->c[0] && buf[0])
     {
         DomainAuthInfo *info = (DomainAuthInfo*) mDNSPlatformMemAllocateClear(sizeof(*info));
+        if (!strcasecmp(alg, "hmac-sha256")) info->algorithm = TSIG_Alg_HMAC_SHA256;
+        else if (alg[0] && strcasecmp(alg, "hmac-md5")) { LogMsg("ERROR: unsupported secret-alg %s", alg); mDNSPlatformMemFree(info); return; }
         // for now we assume keyname = service reg domain and we use same key for service and hostname registration
         err = mDNS_SetSecretForDomain(m, info, domain, domain, buf, NULL, 0);
         if (err) LogMsg("ERROR: mDNS_SetSecretForDomain returned %d for domain %##s", err, domain->c);
@@ -361,6 +361,16 @@ enum
      *
      * To state this more explicitly, mDNSResponder does not queue DNSServiceRefDeallocate so
      * that it occurs discretely before or after an event is handled.
+     *
+     * 6. Sharing without changing the application
+     * If the environment variable DNSSD_SHARED_CONNECTION is set to anything but "0" when the
+     * first operation starts, operations started without kDNSServiceFlagsShareConnection share
+     * one connection per process, which the library creates and closes itself. Their
+     * DNSServiceRefs otherwise behave as usual: DNSServiceRefSockFD() returns the shared socket,
+     * so every operation has the same one, and DNSServiceProcessResult() on any of them handles
+     * the results for all of them. If another operation's DNSServiceProcessResult() has already
+     * read everything, it returns without blocking. Notes 1, 2 and 5 above apply, so only set
+     * this for applications that use their DNSServiceRefs from a single thread.
      */
 
     kDNSServiceFlagsSuppressUnusable    = 0x8000,
@@ -907,7 +917,7 @@ typedef int32_t DNSServiceErrorType;
 /* DNSServiceGetProperty() Parameters:
  *
  * property:        The requested property.
- *                  Currently the only property defined is kDNSServiceProperty_DaemonVersion.
+ *                  The properties defined are kDNSServiceProperty_DaemonVersion and kDNSServiceProperty_Metrics.
  *
  * result:          Place to store result.
  *                  For retrieving DaemonVersion, this should be the address of a uint32_t.
@@ -950,6 +960,24 @@ DNSServiceErrorType DNSSD_API DNSServiceGetProperty
 
 #define kDNSServiceProperty_DaemonVersion "DaemonVersion"
 
+/*
+ * When requesting kDNSServiceProperty_Metrics, the result pointer must point to a
+ * character buffer, and the size parameter must be set to its size. 8192 bytes is enough.
+ *
+ * On return the buffer holds the daemon's live counters as null-terminated text, one
+ * "key=value ..." line per metric, and the size is set to the length of the text including
+ * the null. If that is more than the buffer's size, the text was cut short.
+ * Reading the metrics is cheap, and doesn't disturb the daemon, so they may be polled often.
+ *
+ * Example usage:
+ * char text[8192];
+ * uint32_t size = sizeof(text);
+ * DNSServiceErrorType err = DNSServiceGetProperty(kDNSServiceProperty_Metrics, text, &size);
+ * if (!err && size <= sizeof(text)) fputs(text, stdout);
+ */
+
+#define kDNSServiceProperty_Metrics "Metrics"
+
 /*********************************************************************************************
 *
 * Unix Domain Socket access, DNSServiceRef deallocation, and data processing functions
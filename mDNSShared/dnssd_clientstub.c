@@ -121,6 +121,10 @@ static void syslog( int priority, const char * message, ...)
 #define CTL_PATH_PREFIX "/var/tmp/dnssd_result_socket."
 #endif
 
+// If this is set to anything but "0", operations that would each open their own connection to the daemon share
+// one connection per process instead (see UseImplicitConnection() below)
+#define DNSSD_SHARED_CONNECTION_ENVVAR "DNSSD_SHARED_CONNECTION"
+
 typedef struct
 {
     ipc_msg_hdr ipc_hdr;
@@ -173,6 +177,9 @@ struct _DNSServiceRef_t
     dispatch_queue_t disp_queue;
 #endif
     void             *kacontext;
+    int implicit;                       // Set on the process-wide shared connection and its subordinates
+    uint32_t readcount;                 // On the shared connection, replies read from it; on its subordinates,
+                                        // the shared connection's readcount when their last DNSServiceProcessResult returned
 };
 
 struct _DNSRecordRef_t
@@ -479,6 +486,8 @@ static void FreeDNSServiceOp(DNSServiceOp *x)
         x->ProcessReply = NULL;
         x->AppCallback  = NULL;
         x->AppContext   = NULL;
+        x->implicit     = 0;
+        x->readcount    = 0;
 #if _DNS_SD_LIBDISPATCH
         if (x->disp_source) dispatch_release(x->disp_source);
         x->disp_source  = NULL;
@@ -497,6 +506,67 @@ static void FreeDNSServiceOp(DNSServiceOp *x)
     }
 }
 
+// The process-wide connection that operations share when DNSSD_SHARED_CONNECTION is set. Each operation becomes a
+// subordinate of it, exactly as if the application had created it with DNSServiceCreateConnection() and passed
+// kDNSServiceFlagsShareConnection, except that DNSServiceRefSockFD() and DNSServiceProcessResult() still work on it.
+// The daemon then keeps one socket per process rather than one per operation. Like any shared connection, it
+// assumes the application uses its DNSServiceRefs from one thread. It's closed when its last subordinate is
+// deallocated, so a process with no operations running holds no connection.
+static DNSServiceOp *ImplicitConnection = NULL;
+#if !defined(_WIN32)
+static pid_t ImplicitConnectionPid;     // A forked child mustn't use its parent's connection
+#endif
+
+static int UseImplicitConnection(uint32_t op)
+{
+    static int enabled = -1;
+    if (enabled < 0)
+    {
+        const char *env = getenv(DNSSD_SHARED_CONNECTION_ENVVAR);
+        enabled = (env && env[0] && strcmp(env, "0") != 0) ? 1 : 0;
+    }
+    if (!enabled) return 0;
+
+    // Only the operations whose results come back through DNSServiceProcessResult(). The one-shot requests
+    // (DNSServiceGetProperty() and the like) read their reply straight off the socket.
+    switch (op)
+    {
+    case resolve_request:
+    case query_request:
+    case addrinfo_request:
+    case browse_request:
+    case reg_service_request:
+    case enumeration_request:
+    case port_mapping_request:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static DNSServiceErrorType GetImplicitConnection(DNSServiceOp **primary)
+{
+    DNSServiceErrorType err;
+
+    // If the daemon went away, the old connection's subordinates keep it until the application deallocates them,
+    // and new operations get a new one
+    if (ImplicitConnection && !ImplicitConnection->ProcessReply) ImplicitConnection = NULL;
+#if !defined(_WIN32)
+    if (ImplicitConnection && ImplicitConnectionPid != getpid()) ImplicitConnection = NULL;
+#endif
+    if (!ImplicitConnection)
+    {
+        err = DNSServiceCreateConnection(&ImplicitConnection);
+        if (err) return err;
+        ImplicitConnection->implicit = 1;
+#if !defined(_WIN32)
+        ImplicitConnectionPid = getpid();
+#endif
+    }
+    *primary = ImplicitConnection;
+    return kDNSServiceErr_NoError;
+}
+
 // Return a connected service ref (deallocate with DNSServiceRefDeallocate)
 static DNSServiceErrorType ConnectToServer(DNSServiceRef *ref, DNSServiceFlags flags, uint32_t op, ProcessReplyFn ProcessReply, void *AppCallback, void *AppContext)
 {
@@ -506,6 +576,7 @@ static DNSServiceErrorType ConnectToServer(DNSServiceRef *ref, DNSServiceFlags f
 
     dnssd_sockaddr_t saddr;
     DNSServiceOp *sdr;
+    DNSServiceOp *primary = NULL;
 
     if (!ref) 
     { 
@@ -527,6 +598,12 @@ static DNSServiceErrorType ConnectToServer(DNSServiceRef *ref, DNSServiceFlags f
             *ref = NULL;
             return kDNSServiceErr_BadReference;
         }
+        primary = *ref;
+    }
+    else if (UseImplicitConnection(op))
+    {
+        DNSServiceErrorType err = GetImplicitConnection(&primary);
+        if (err) { *ref = NULL; return err; }
     }
 
     #if defined(_WIN32)
@@ -545,6 +622,7 @@ static DNSServiceErrorType ConnectToServer(DNSServiceRef *ref, DNSServiceFlags f
     if (!sdr) 
     { 
         syslog(LOG_WARNING, "dnssd_clientstub ConnectToServer: malloc failed"); 
+        if (primary && primary->implicit && !primary->next) DNSServiceRefDeallocate(primary);
         *ref = NULL; 
         return kDNSServiceErr_NoMemory; 
     }
@@ -567,20 +645,24 @@ static DNSServiceErrorType ConnectToServer(DNSServiceRef *ref, DNSServiceFlags f
     sdr->disp_queue    = NULL;
 #endif
     sdr->kacontext     = NULL;
+    sdr->implicit      = 0;
+    sdr->readcount     = 0;
     
-    if (flags & kDNSServiceFlagsShareConnection)
+    if (primary)
     {
-        DNSServiceOp **p = &(*ref)->next;       // Append ourselves to end of primary's list
+        DNSServiceOp **p = &primary->next;      // Append ourselves to end of primary's list
         while (*p) 
             p = &(*p)->next;
         *p = sdr;
         // Preincrement counter before we use it -- it helps with debugging if we know the all-zeroes ID should never appear
-        if (++(*ref)->uid.u32[0] == 0) 
-            ++(*ref)->uid.u32[1];               // In parent DNSServiceOp increment UID counter
-        sdr->primary    = *ref;                 // Set our primary pointer
-        sdr->sockfd     = (*ref)->sockfd;       // Inherit primary's socket
-        sdr->validator  = (*ref)->validator;
-        sdr->uid        = (*ref)->uid;
+        if (++primary->uid.u32[0] == 0) 
+            ++primary->uid.u32[1];              // In parent DNSServiceOp increment UID counter
+        sdr->primary    = primary;              // Set our primary pointer
+        sdr->sockfd     = primary->sockfd;      // Inherit primary's socket
+        sdr->validator  = primary->validator;
+        sdr->uid        = primary->uid;
+        sdr->implicit   = primary->implicit;
+        sdr->readcount  = primary->readcount;
         //printf("ConnectToServer sharing socket %d\n", sdr->sockfd);
     }
     else
@@ -965,7 +1047,7 @@ dnssd_sock_t DNSSD_API DNSServiceRefSockFD(DNSServiceRef sdRef)
         return dnssd_InvalidSocket;
     }
 
-    if (sdRef->primary)
+    if (sdRef->primary && !sdRef->implicit)
     {
         syslog(LOG_WARNING, "dnssd_clientstub DNSServiceRefSockFD undefined for kDNSServiceFlagsShareConnection subordinate DNSServiceRef %p", sdRef);
         return dnssd_InvalidSocket;
@@ -1060,6 +1142,29 @@ DNSServiceErrorType DNSSD_API DNSServiceProcessResult(DNSServiceRef sdRef)
         return kDNSServiceErr_BadReference;
     }
 
+    if (sdRef->primary && sdRef->implicit)
+    {
+        // Every operation on the shared connection has the same socket, so an application that selects on their
+        // sockets sees all of them become readable at once, and the first DNSServiceProcessResult() reads what
+        // all of them were waiting for. Only block if nothing has been read since this one's last call.
+        DNSServiceOp *const primary = sdRef->primary;
+        int alive = 1;
+        if (primary->readcount != sdRef->readcount && !more_bytes(primary->sockfd))
+        {
+            sdRef->readcount = primary->readcount;
+            return kDNSServiceErr_NoError;
+        }
+        // The callbacks may deallocate sdRef, which clears alive for us
+        sdRef->moreptr = &alive;
+        error = DNSServiceProcessResult(primary);
+        if (alive)
+        {
+            sdRef->moreptr = NULL;
+            sdRef->readcount = primary->readcount;
+        }
+        return error;
+    }
+
     if (sdRef->primary)
     {
         syslog(LOG_WARNING, "dnssd_clientstub DNSServiceProcessResult undefined for kDNSServiceFlagsShareConnection subordinate DNSServiceRef %p", sdRef);
@@ -1128,6 +1233,7 @@ DNSServiceErrorType DNSSD_API DNSServiceProcessResult(DNSServiceRef sdRef)
 
         data = malloc(cbh.ipc_hdr.datalen);
         if (!data) return kDNSServiceErr_NoMemory;
+        sdRef->readcount++;
         ioresult = read_all(sdRef->sockfd, data, cbh.ipc_hdr.datalen);
         if (ioresult < read_all_success) // On error, read_all will write a message to syslog for us
         {
@@ -1200,7 +1306,8 @@ void DNSSD_API DNSServiceRefDeallocate(DNSServiceRef sdRef)
 
     if (sdRef->primary)     // If this is a subordinate DNSServiceOp, just send a 'stop' command
     {
-        DNSServiceOp **p = &sdRef->primary->next;
+        DNSServiceOp *const primary = sdRef->primary;
+        DNSServiceOp **p = &primary->next;
         while (*p && *p != sdRef) p = &(*p)->next;
         if (*p)
         {
@@ -1215,10 +1322,13 @@ void DNSSD_API DNSServiceRefDeallocate(DNSServiceRef sdRef)
             }
             *p = sdRef->next;
             FreeDNSServiceOp(sdRef);
+            // The process-wide shared connection goes when the last operation on it does
+            if (primary->implicit && !primary->next) DNSServiceRefDeallocate(primary);
         }
     }
     else                    // else, make sure to terminate all subordinates as well
     {
+        if (sdRef == ImplicitConnection) ImplicitConnection = NULL;
 #if _DNS_SD_LIBDISPATCH
         // The cancel handler will close the fd if a dispatch source has been set
         if (sdRef->disp_source)
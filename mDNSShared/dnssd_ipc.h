@@ -106,6 +106,38 @@ extern char *win32_strerror(int inErrorCode);
 #define IPC_TLV_TYPE_RESOLVER_CONFIG_PLIST_DATA 1   // An nw_resolver_config as a binary property list.
 #define IPC_TLV_TYPE_REQUIRE_PRIVACY            2   // A uint8. Non-zero means privacy is required, zero means not required.
 
+// Binary state dump, written by the daemon a slice at a time (see udsserver_state_dump_start()) and rendered by
+// "dns-sd -Y <file>". The file starts with STATE_DUMP_MAGIC, then holds a sequence of TLVs, each a uint16 type and
+// a uint16 value length followed by the value. Integers are in network byte order. Names are uncompressed DNS wire
+// format, and rdata is wire format with uncompressed names. Readers skip TLV types they don't know, and any bytes
+// at the end of a value beyond the fields they know.
+#define STATE_DUMP_MAGIC     "mDNSdump"
+#define STATE_DUMP_MAGIC_LEN 8
+
+#define STATE_DUMP_TLV_HEADER       1   // uint32 daemon version, uint32 cache size in entities
+#define STATE_DUMP_TLV_CACHE_RECORD 2   // uint16 hash slot, uint32 interface index, int32 seconds until expiry,
+                                        // uint8 record type, uint8 flags, uint16 rrtype, uint16 rrclass, name,
+                                        // uint16 rdata length, rdata
+#define STATE_DUMP_TLV_AUTH_RECORD  3   // uint32 interface index, uint8 record type, uint8 flags, uint32 TTL,
+                                        // uint16 rrtype, uint16 rrclass, name, uint16 rdata length, rdata
+#define STATE_DUMP_TLV_QUESTION     4   // uint32 interface index, uint8 flags, int32 interval in seconds,
+                                        // int32 seconds until next query, uint32 answers, uint16 qtype, name
+#define STATE_DUMP_TLV_CLIENT       5   // uint32 socket, int32 process ID, uint32 request_op_t,
+                                        // uint32 replies queued, uint32 bytes queued, null-terminated process name
+#define STATE_DUMP_TLV_END          6   // uint32 TLVs written before this one, uint32 slices, uint32 longest slice
+                                        // in ms, uint32 ms from start to finish
+
+#define STATE_DUMP_CACHE_ACTIVE     0x01    // Answers an active question
+#define STATE_DUMP_CACHE_UNICAST    0x02    // Learned from a unicast DNS server
+#define STATE_DUMP_AUTH_DUPLICATE   0x01    // On the duplicate records list
+#define STATE_DUMP_AUTH_PROXIED     0x02    // Held on behalf of a sleeping host
+#define STATE_DUMP_AUTH_LOCAL       0x04    // LocalOnly or P2P record, including /etc/hosts
+#define STATE_DUMP_QUESTION_UNICAST    0x01
+#define STATE_DUMP_QUESTION_LONGLIVED  0x02
+#define STATE_DUMP_QUESTION_DUPLICATE  0x04
+#define STATE_DUMP_QUESTION_SUPPRESSED 0x08
+#define STATE_DUMP_QUESTION_LOCAL      0x10 // LocalOnly or P2P question
+
 // Structure packing macro. If we're not using GNUC, it's not fatal. Most compilers naturally pack the on-the-wire
 // structures correctly anyway, so a plain "struct" is usually fine. In the event that structures are not packed
 // correctly, our compile-time assertion checks will catch it and prevent inadvertent generation of non-working code.
@@ -38,6 +38,16 @@
     #endif
 #endif
 
+// Feature: Name compression table
+// Radar:   N/A
+// Enabled: Yes.
+// Keeps a per-message dictionary of emitted name suffixes so that name compression does not have to scan the
+// message built so far for every name it writes.
+
+#if !defined(MDNSRESPONDER_SUPPORTS_COMMON_COMPRESSION_TABLE)
+    #define MDNSRESPONDER_SUPPORTS_COMMON_COMPRESSION_TABLE     1
+#endif
+
 #define HAS_FEATURE_CAT(A, B)       A ## B
 #define HAS_FEATURE_CHECK_0         1
 #define HAS_FEATURE_CHECK_1         1
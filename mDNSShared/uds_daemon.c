@@ -16,6 +16,7 @@
 
 #if defined(_WIN32)
 #include <process.h>
+#include <io.h>
 #define usleep(X) Sleep(((X)+999)/1000)
 #else
 #include <fcntl.h>
@@ -24,6 +25,7 @@
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <sys/uio.h>
 #endif
 
 #include <stdlib.h>
@@ -119,6 +121,71 @@ static mDNSu32 i_mcount;   // sets mcount when McastLogging is enabled(PROF sign
 static mDNSu32 n_mrecords; // tracks the current active mcast records for McastLogging
 static mDNSu32 n_mquests;  // tracks the current active mcast questions for McastLogging
 
+// Small replies (browse, resolve and query results) are recycled through a free list instead of going back to
+// the allocator, since a busy browse can queue thousands of them between two calls to udsserver_idle()
+#define kReplyPoolTotalLen 512      // replies up to this size, including the ipc_msg_hdr, come from the pool
+#define kReplyPoolMaxFree  64       // most free buffers we keep around
+#define ReplyAllocSize(TOTALLEN) (sizeof(reply_state) - sizeof(ipc_msg_hdr) - sizeof(reply_hdr) + (TOTALLEN))
+static reply_state *ReplyFreeList;
+static mDNSu32 ReplyFreeCount;
+
+// Most queued replies handed to one writev()
+#if defined(IOV_MAX) && IOV_MAX < 64
+#define kMaxRepliesPerWrite IOV_MAX
+#else
+#define kMaxRepliesPerWrite 64
+#endif
+
+// Counters for the client reply path, shown in the state dump
+static struct
+{
+    mDNSu32 RepliesQueued;          // replies appended to client reply lists
+    mDNSu32 RepliesSent;            // replies completely written to clients
+    mDNSu32 ReplyWrites;            // writev()/WSASend() calls
+    mDNSu32 ReplyWriteMax;          // most replies completed by a single write
+    mDNSu32 ReplyBlockedWrites;     // writes that could not send everything because the client wasn't reading
+    mDNSu32 ReplyBytesPeak;         // most bytes queued for any single client
+} ReplyStats;
+
+// Largest DNSServiceGetProperty(kDNSServiceProperty_Metrics) reply text, which also bounds the request statistics dump
+#define kMetricsReplyMax 8192
+
+// Latency and queue depth histograms, kept per client operation type
+// Bucket 0 counts zero, bucket n counts values in [2^(n-1), 2^n), and the last bucket counts everything larger
+#define kRequestHistogramBuckets 17
+
+typedef struct
+{
+    mDNSu32 count;
+    mDNSu32 max;
+    mDNSu32 buckets[kRequestHistogramBuckets];
+} RequestHistogram;
+
+typedef enum
+{
+    RequestStats_Browse,
+    RequestStats_Resolve,
+    RequestStats_QueryRecord,
+    RequestStats_AddrInfo,
+    RequestStats_RegService,
+    RequestStats_Other,
+    RequestStats_Count
+} RequestStatsType;
+
+static const char *const RequestStatsNames[RequestStats_Count] =
+    { "browse", "resolve", "queryrecord", "addrinfo", "regservice", "other" };
+
+typedef struct
+{
+    mDNSu32 requests;               // requests handed to their handler
+    RequestHistogram firstAnswer;   // ms from handing the request to its handler until its first reply was queued
+    RequestHistogram replyWait;     // ms from queuing a reply until the client had read all of it
+    RequestHistogram queueDepth;    // replies waiting on the connection, sampled each time one is queued
+} RequestStats;
+
+static RequestStats RequestStatsByType[RequestStats_Count];
+mDNSlocal mDNSu32 FormatRequestStats(char *const buffer, const mDNSu32 buflen);
+
 
 #if MDNSRESPONDER_SUPPORTS(APPLE, METRICS)
 mDNSu32 curr_num_regservices = 0;
@@ -320,6 +387,73 @@ mDNSexport void LogMcastStateInfo(mDNSBool mflag, mDNSBool start, mDNSBool mstat
     }
 }
 
+mDNSlocal RequestStatsType RequestStatsTypeForRequestOp(mDNSu32 op)
+{
+    switch (op)
+    {
+        case browse_request:        return RequestStats_Browse;
+        case resolve_request:       return RequestStats_Resolve;
+        case query_request:         return RequestStats_QueryRecord;
+        case addrinfo_request:      return RequestStats_AddrInfo;
+        case reg_service_request:   return RequestStats_RegService;
+        default:                    return RequestStats_Other;
+    }
+}
+
+mDNSlocal RequestStatsType RequestStatsTypeForReplyOp(mDNSu32 op)
+{
+    switch (op)
+    {
+        case browse_reply_op:       return RequestStats_Browse;
+        case resolve_reply_op:      return RequestStats_Resolve;
+        case query_reply_op:        return RequestStats_QueryRecord;
+        case addrinfo_reply_op:     return RequestStats_AddrInfo;
+        case reg_service_reply_op:  return RequestStats_RegService;
+        default:                    return RequestStats_Other;
+    }
+}
+
+mDNSlocal mDNSu32 TicksToMilliseconds(mDNSs32 ticks)
+{
+    if (ticks <= 0) return 0;
+    return (mDNSu32)((double)ticks * 1000 / mDNSPlatformOneSecond);
+}
+
+mDNSlocal void RequestHistogramAdd(RequestHistogram *const h, const mDNSu32 value)
+{
+    mDNSu32 b = 0;
+    while (b < kRequestHistogramBuckets - 1 && (value >> b)) b++;
+    h->buckets[b]++;
+    h->count++;
+    if (h->max < value) h->max = value;
+}
+
+// Returns the upper bound of the bucket holding the given percentile, which is never more than the largest value seen
+mDNSlocal mDNSu32 RequestHistogramPercentile(const RequestHistogram *const h, const mDNSu32 percent)
+{
+    const mDNSu32 target = (mDNSu32)(((double)h->count * percent + 99) / 100);
+    mDNSu32 seen = 0, b;
+    if (!h->count) return 0;
+    for (b = 0; b < kRequestHistogramBuckets - 1; b++)
+    {
+        seen += h->buckets[b];
+        if (seen >= target) break;
+    }
+    if (b == kRequestHistogramBuckets - 1 || (b ? (1U << b) - 1 : 0) > h->max) return h->max;
+    return b ? (1U << b) - 1 : 0;
+}
+
+mDNSlocal void free_reply(reply_state *rep)
+{
+    if (rep->totallen <= kReplyPoolTotalLen && ReplyFreeCount < kReplyPoolMaxFree)
+    {
+        rep->next = ReplyFreeList;
+        ReplyFreeList = rep;
+        ReplyFreeCount++;
+    }
+    else freeL("reply_state", rep);
+}
+
 mDNSlocal void abort_request(request_state *req)
 {
     if (req->terminate == (req_termination_fn) ~0)
@@ -368,8 +502,11 @@ mDNSlocal void abort_request(request_state *req)
         {
             reply_state *ptr = req->replies;
             req->replies = req->replies->next;
-            freeL("reply_state (abort)", ptr);
+            free_reply(ptr);
         }
+        req->replies_tail       = mDNSNULL;
+        req->replies_queued     = 0;
+        req->reply_bytes_queued = 0;
     }
 
     // Set req->sd to something invalid, so that udsserver_idle knows to unlink and free this structure
@@ -437,7 +574,18 @@ mDNSlocal reply_state *create_reply(const reply_op_t op, const size_t datalen, r
         return NULL;
     }
 
-    reply = (reply_state *) callocL("reply_state", sizeof(reply_state) + datalen - sizeof(reply_hdr));
+    if (datalen + sizeof(ipc_msg_hdr) <= kReplyPoolTotalLen)
+    {
+        if (ReplyFreeList)
+        {
+            reply = ReplyFreeList;
+            ReplyFreeList = reply->next;
+            ReplyFreeCount--;
+            mDNSPlatformMemZero(reply, ReplyAllocSize(datalen + sizeof(ipc_msg_hdr)));
+        }
+        else reply = (reply_state *) callocL("reply_state", ReplyAllocSize(kReplyPoolTotalLen));
+    }
+    else reply = (reply_state *) callocL("reply_state", sizeof(reply_state) + datalen - sizeof(reply_hdr));
     if (!reply) FatalError("ERROR: calloc");
 
     reply->next     = mDNSNULL;
@@ -454,25 +602,56 @@ mDNSlocal reply_state *create_reply(const reply_op_t op, const size_t datalen, r
     return reply;
 }
 
+// append_reply() is called from core callbacks as well as from request handlers, and mDNS_TimeNow() expects to be
+// called with m->mDNS_busy == 0, so take the time from the lock instead
+mDNSlocal mDNSs32 GetTimeNow(mDNS *m)
+{
+    mDNSs32 time;
+    mDNS_Lock(m);
+    time = m->timenow;
+    mDNS_Unlock(m);
+    return time;
+}
+
 // Append a reply to the list in a request object
 // If our request is sharing a connection, then we append our reply_state onto the primary's list
 // If the request does not want asynchronous replies, then the reply is freed instead of being appended to any list.
+// The ipc_msg_hdr is converted to network byte order here, once, so udsserver_idle() can write it out as it is.
 mDNSlocal void append_reply(request_state *req, reply_state *rep)
 {
     request_state *r;
-    reply_state **ptr;
+
+    if (!req->answered && req->op_start)
+    {
+        req->answered = mDNStrue;
+        RequestHistogramAdd(&RequestStatsByType[RequestStatsTypeForRequestOp(req->hdr.op)].firstAnswer,
+                            TicksToMilliseconds(GetTimeNow(&mDNSStorage) - req->op_start));
+    }
 
     if (req->no_reply)
     {
-        freeL("reply_state/append_reply", rep);
+        free_reply(rep);
         return;
     }
 
-    r = req->primary ? req->primary : req;
-    ptr = &r->replies;
-    while (*ptr) ptr = &(*ptr)->next;
-    *ptr = rep;
+    rep->queued_time = GetTimeNow(&mDNSStorage);
+    ConvertHeaderBytes(rep->mhdr);
     rep->next = NULL;
+
+    r = req->primary ? req->primary : req;
+    if (r->replies) r->replies_tail->next = rep;
+    else r->replies = rep;
+    r->replies_tail = rep;
+
+    r->replies_queued++;
+    r->reply_bytes_queued += rep->totallen;
+    RequestHistogramAdd(&RequestStatsByType[RequestStatsTypeForRequestOp(req->hdr.op)].queueDepth, r->replies_queued);
+    if (r->reply_bytes_peak < r->reply_bytes_queued)
+    {
+        r->reply_bytes_peak = r->reply_bytes_queued;
+        if (ReplyStats.ReplyBytesPeak < r->reply_bytes_peak) ReplyStats.ReplyBytesPeak = r->reply_bytes_peak;
+    }
+    ReplyStats.RepliesQueued++;
 }
 
 // Generates a response message giving name, type, domain, plus interface index,
@@ -1292,6 +1471,9 @@ mDNSlocal void handle_cancel_request(request_state *request)
             }
 #endif
             freeL("request_state/handle_cancel_request", tmp);
+            // The client library numbers a connection's operations from a counter, so there's only ever one match,
+            // and stopping here saves walking every other client's requests on each cancel
+            break;
         }
         else
             req = &(*req)->next;
@@ -4148,6 +4330,27 @@ typedef packedstruct
     mDNSu32 vers;
 } DaemonVersionReply;
 
+typedef packedstruct
+{
+    mStatus err;
+    mDNSu32 len;
+    char text[kMetricsReplyMax];
+} MetricsReply;
+
+// The metrics are read without the lock: the core's are updated atomically, and the request statistics are only
+// ever touched on this thread. The text includes its terminating null.
+mDNSlocal void send_metrics(request_state *request)
+{
+    static MetricsReply x;
+    mDNSu32 len;
+    len  = mDNSMetricsFormat(x.text, sizeof(x.text));
+    len += FormatRequestStats(x.text + len, sizeof(x.text) - len);
+    len++;
+    x.err = 0;
+    x.len = dnssd_htonl(len);
+    send_all(request->sd, (const char *)&x, (int)(sizeof(x) - sizeof(x.text) + len));
+}
+
 mDNSlocal void handle_getproperty_request(request_state *request)
 {
     const mStatus BadParamErr = dnssd_htonl((mDNSu32)mStatus_BadParamErr);
@@ -4162,6 +4365,11 @@ mDNSlocal void handle_getproperty_request(request_state *request)
             send_all(request->sd, (const char *)&x, sizeof(x));
             return;
         }
+        if (!strcmp(prop, kDNSServiceProperty_Metrics))
+        {
+            send_metrics(request);
+            return;
+        }
     }
 
     // If we didn't recogize the requested property name, return BadParamErr
@@ -4880,11 +5088,13 @@ mDNSlocal void request_callback(dnssd_sock_t fd, void *info)
 {
     mStatus err = 0;
     request_state *req = info;
-    mDNSs32 min_size = sizeof(DNSServiceFlags);
+    mDNSs32 min_size;
     (void)fd; // Unused
 
     for (;;)
     {
+        // Reset for every message: a shared connection can deliver several in one callback
+        min_size = sizeof(DNSServiceFlags);
         read_msg(req);
         if (req->ts == t_morecoming)
             return;
@@ -4982,6 +5192,14 @@ mDNSlocal void request_callback(dnssd_sock_t fd, void *info)
         // Check if the request wants no asynchronous replies.
         if (req->hdr.ipc_flags & IPC_FLAGS_NOREPLY) req->no_reply = 1;
 
+        // Start the clock for operations that get their own request_state, so we can see how long the first answer takes
+        if (!LightweightOp(req->hdr.op))
+        {
+            req->op_start = NonZeroTime(mDNS_TimeNow(&mDNSStorage));
+            req->answered = mDNSfalse;
+            RequestStatsByType[RequestStatsTypeForRequestOp(req->hdr.op)].requests++;
+        }
+
         // If we're shutting down, don't allow new client requests
         // We do allow "cancel" and "getproperty" during shutdown
         if (mDNSStorage.ShutdownTime && req->hdr.op != cancel_request && req->hdr.op != getproperty_request)
@@ -5246,6 +5464,14 @@ mDNSexport int udsserver_exit(void)
     // Cancel all outstanding client requests
     while (all_requests) AbortUnlinkAndFree(all_requests);
 
+    while (ReplyFreeList)
+    {
+        reply_state *rep = ReplyFreeList;
+        ReplyFreeList = rep->next;
+        freeL("reply_state/udsserver_exit", rep);
+    }
+    ReplyFreeCount = 0;
+
 	RmvAutoBrowseDomain(0, &localdomain);
 	DeregisterLocalOnlyDomainEnumPTR(&mDNSStorage, &localdomain, mDNS_DomainTypeRegistration);
 	DeregisterLocalOnlyDomainEnumPTR(&mDNSStorage, &localdomain, mDNS_DomainTypeBrowse);
@@ -5749,6 +5975,67 @@ mDNSlocal void PrintCachedRecordsToFD(int fd, const CacheRecord *cr, mDNSu32 slo
     }
 }
 
+mDNSlocal void LogRequestStatsToFD(int fd)
+{
+    int t;
+    LogToFD(fd, "---- Client Request Latency ----");
+    LogToFD(fd, "Operation    Requests  First answer ms p50/p90/p99/max  Reply wait ms p50/p90/p99/max  Queue depth p50/p99/max");
+    for (t = 0; t < RequestStats_Count; t++)
+    {
+        const RequestStats *const rs = &RequestStatsByType[t];
+        if (!rs->requests && !rs->replyWait.count) continue;
+        LogToFD(fd, "%-11s %9u  %6u %u/%u/%u/%u  %6u %u/%u/%u/%u  %u/%u/%u", RequestStatsNames[t], rs->requests,
+                rs->firstAnswer.count, RequestHistogramPercentile(&rs->firstAnswer, 50), RequestHistogramPercentile(&rs->firstAnswer, 90),
+                RequestHistogramPercentile(&rs->firstAnswer, 99), rs->firstAnswer.max,
+                rs->replyWait.count, RequestHistogramPercentile(&rs->replyWait, 50), RequestHistogramPercentile(&rs->replyWait, 90),
+                RequestHistogramPercentile(&rs->replyWait, 99), rs->replyWait.max,
+                RequestHistogramPercentile(&rs->queueDepth, 50), RequestHistogramPercentile(&rs->queueDepth, 99), rs->queueDepth.max);
+    }
+}
+
+mDNSlocal void WriteStatsLineToFD(int fd, const char *const line, const mDNSu32 len)
+{
+#if defined(_WIN32)
+    (void)_write(fd, line, len);
+#else
+    (void)write(fd, line, len);
+#endif
+}
+
+mDNSlocal mDNSu32 FormatRequestHistogram(char *const buffer, const mDNSu32 buflen, const char *const op, const char *const metric,
+                                         const RequestHistogram *const h)
+{
+    mDNSu32 len, b;
+    len = mDNS_snprintf(buffer, buflen, "op=%s metric=%s count=%u max=%u buckets=", op, metric, h->count, h->max);
+    for (b = 0; b < kRequestHistogramBuckets; b++)
+        len += mDNS_snprintf(buffer + len, buflen - len, b ? ",%u" : "%u", h->buckets[b]);
+    len += mDNS_snprintf(buffer + len, buflen - len, "\n");
+    return len;
+}
+
+// Formats the per-operation request statistics as one "key=value ..." line per histogram, for tools to parse.
+// Bucket 0 counts zero and bucket n counts values in [2^(n-1), 2^n); the last bucket also counts everything larger.
+mDNSlocal mDNSu32 FormatRequestStats(char *const buffer, const mDNSu32 buflen)
+{
+    mDNSu32 len = 0;
+    int t;
+    for (t = 0; t < RequestStats_Count; t++)
+    {
+        const RequestStats *const rs = &RequestStatsByType[t];
+        len += mDNS_snprintf(buffer + len, buflen - len, "op=%s metric=requests count=%u\n", RequestStatsNames[t], rs->requests);
+        len += FormatRequestHistogram(buffer + len, buflen - len, RequestStatsNames[t], "first_answer_ms", &rs->firstAnswer);
+        len += FormatRequestHistogram(buffer + len, buflen - len, RequestStatsNames[t], "reply_wait_ms",   &rs->replyWait);
+        len += FormatRequestHistogram(buffer + len, buflen - len, RequestStatsNames[t], "queue_depth",     &rs->queueDepth);
+    }
+    return len;
+}
+
+mDNSexport void udsserver_request_stats_dump_to_fd(int fd)
+{
+    static char buffer[kMetricsReplyMax];
+    WriteStatsLineToFD(fd, buffer, FormatRequestStats(buffer, sizeof(buffer)));
+}
+
 mDNSexport void LogMDNSStatisticsToFD(int fd, mDNS *const m)
 {
     LogToFD(fd, "--- MDNS Statistics ---");
@@ -5781,6 +6068,58 @@ mDNSexport void LogMDNSStatisticsToFD(int fd, mDNS *const m)
     LogToFD(fd, "Cache refresh queries          %u", m->mDNSStats.CacheRefreshQueries);
     LogToFD(fd, "Cache refreshed                %u", m->mDNSStats.CacheRefreshed);
     LogToFD(fd, "Wakeup on Resolves             %u", m->mDNSStats.WakeOnResolves);
+    LogToFD(fd, "--------------------------------");
+
+    LogToFD(fd, "Receive batches                %u", m->mDNSStats.RecvBatches);
+    LogToFD(fd, "Receive batch packets          %u", m->mDNSStats.RecvBatchPackets);
+    LogToFD(fd, "Receive batch max              %u", m->mDNSStats.RecvBatchMax);
+    LogToFD(fd, "Send batches                   %u", m->mDNSStats.SendBatches);
+    LogToFD(fd, "Send batch packets             %u", m->mDNSStats.SendBatchPackets);
+    LogToFD(fd, "Send batch max                 %u", m->mDNSStats.SendBatchMax);
+    LogToFD(fd, "--------------------------------");
+
+    LogToFD(fd, "Client replies queued          %u", ReplyStats.RepliesQueued);
+    LogToFD(fd, "Client replies sent            %u", ReplyStats.RepliesSent);
+    LogToFD(fd, "Client reply writes            %u", ReplyStats.ReplyWrites);
+    LogToFD(fd, "Client replies per write max   %u", ReplyStats.ReplyWriteMax);
+    LogToFD(fd, "Client blocked writes          %u", ReplyStats.ReplyBlockedWrites);
+    LogToFD(fd, "Client reply bytes queued max  %u", ReplyStats.ReplyBytesPeak);
+    LogToFD(fd, "--------------------------------");
+
+    {
+        const CacheIndex *const ci = &m->rrcache_index;
+        const mDNSu32 entries = ci->count + ci->oldcount;
+        const mDNSu32 avgprobe = ci->lookups ? (mDNSu32)((double)ci->probes * 100 / ci->lookups) : 0;
+        LogToFD(fd, "Cache index slots              %u%s", ci->capacity, ci->oldslots ? " (resize in progress)" : "");
+        LogToFD(fd, "Cache index entries            %u", entries);
+        LogToFD(fd, "Cache index load factor        %u%%", ci->capacity ? entries * 100 / ci->capacity : 0);
+        LogToFD(fd, "Cache index lookups            %u", ci->lookups);
+        LogToFD(fd, "Cache index avg probe length   %u.%02u", avgprobe / 100, avgprobe % 100);
+        LogToFD(fd, "Cache index max probe length   %u", ci->maxprobe);
+        LogToFD(fd, "Cache index resizes            %u", ci->resizes);
+    }
+    {
+        const CacheSlabAllocator *const sa = &m->rrcache_slab;
+        mDNSu32 c;
+        LogToFD(fd, "Cache slab allocations         %u", sa->allocs);
+        LogToFD(fd, "Cache slab reused blocks       %u", sa->reused);
+        LogToFD(fd, "Cache slab oversize requests   %u", sa->oversize);
+        LogToFD(fd, "Cache slab failures            %u", sa->failures);
+        for (c = 0; c < CACHE_SLAB_CLASSES; c++)
+        {
+            const CacheSlabClass *const sc = &sa->classes[c];
+            LogToFD(fd, "Cache slab %4u-byte blocks     %u in use, %u free, %u slabs",
+                    (mDNSu32)CACHE_SLAB_MIN_BLOCK << c, sc->inuse, sc->free, sc->slabs);
+        }
+    }
+    {
+        const CacheLRU *const lru = &m->rrcache_lru;
+        LogToFD(fd, "Cache LRU records              %u", lru->count);
+        LogToFD(fd, "Cache LRU hits                 %u", lru->hits);
+        LogToFD(fd, "Cache LRU evictions            %u", lru->evictions);
+        LogToFD(fd, "Cache LRU second chances       %u", lru->secondchances);
+        LogToFD(fd, "Cache LRU eviction failures    %u", lru->failures);
+    }
 }
 
 mDNSexport void udsserver_info_dump_to_fd(int fd)
@@ -5909,10 +6248,15 @@ mDNSexport void udsserver_info_dump_to_fd(int fd)
             }
             // For non-subbordinate operations, and subbordinate operations that have lost their parent, write out their info
             LogClientInfoToFD(fd, req);
+            if (req->replies_queued)
+                LogToFD(fd, "%3d: %u repl%s (%u bytes) waiting to be read, peak %u bytes", req->sd, req->replies_queued,
+                        req->replies_queued == 1 ? "y" : "ies", req->reply_bytes_queued, req->reply_bytes_peak);
         foundparent:;
         }
     }
 
+    LogRequestStatsToFD(fd);
+
     LogToFD(fd, "-------- NAT Traversals --------");
     LogToFD(fd, "ExtAddress %.4a Retry %d Interval %d",
               &m->ExtAddress,
@@ -5991,6 +6335,31 @@ mDNSexport void udsserver_info_dump_to_fd(int fd)
             LogToFD(fd, "%##s %s", s->domain.c, ifname ? ifname : "");
         }
     }
+
+#if !MDNSRESPONDER_SUPPORTS(APPLE, QUERIER)
+    // Response times are in milliseconds; a server that hasn't answered yet shows zeros
+    LogToFD(fd, "---------- DNS Servers ---------");
+    if (!m->DNSServers) LogToFD(fd, "<None>");
+    else
+    {
+        const DNSServer *server;
+        LogToFD(fd, "  SRTT RTTVAR   RTO Penalty TCPConns TCPQueries Server");
+        for (server = m->DNSServers; server; server = server->next)
+        {
+            char *ifname = InterfaceNameForID(m, server->interface);
+            const DNSTCPConn *conn;
+            int open = 0;
+            for (conn = server->tcpConns; conn; conn = conn->next) open++;
+            LogToFD(fd, "%6d %6d %5d %7d %3d/%-4u %10u %#a:%d %##s %s %s%s",
+                      server->srtt * 1000 / mDNSPlatformOneSecond,
+                      server->rttvar * 1000 / mDNSPlatformOneSecond,
+                      DNSServerRTO(server) * 1000 / mDNSPlatformOneSecond,
+                      server->penaltyTime ? (server->penaltyTime - now) / mDNSPlatformOneSecond : 0,
+                      open, server->tcpConnsOpened, server->tcpQueries, &server->addr, mDNSVal16(server->port), server->domain.c, DNSScopeToString(server->scopeType),
+                      ifname ? ifname : "", (server->flags & DNSServerFlag_Delete) ? " (deleted)" : "");
+        }
+    }
+#endif
     LogMDNSStatisticsToFD(fd, m);
 
     LogToFD(fd, "---- Task Scheduling Timers ----");
@@ -6068,6 +6437,319 @@ mDNSexport void udsserver_info_dump_to_fd(int fd)
     LogTimerToFD(fd, "m->NextScheduledStopTime ", m->NextScheduledStopTime);
 }
 
+// Binary state dump (see STATE_DUMP_MAGIC in dnssd_ipc.h). udsserver_info_dump_to_fd() formats everything in one
+// go, which on a host with a large cache stalls the daemon for as long as that takes. This dump is written a slice
+// at a time from udsserver_idle(), with the core running in between. A slice writes at most kStateDumpSliceRecords
+// entries, and ends early if the buffer fills; the buffer is only written to the file once the lock is dropped.
+// Each list, and each hash slot, is resumed by the number of its entries already written. No pointers are kept
+// from one slice to the next, so the dump isn't a snapshot of one instant, but records that come and go during it
+// can't make it go wrong.
+#define kStateDumpBufferSize   65536
+#define kStateDumpSliceRecords 512
+#define kStateDumpMaxRecordTLV (4 + 20 + MAX_DOMAIN_NAME + 2 + MaximumRDSize)
+
+typedef enum
+{
+    StateDump_Cache,
+    StateDump_AuthRecords,
+    StateDump_DuplicateRecords,
+    StateDump_LocalOnlyRecords,
+    StateDump_Questions,
+    StateDump_LocalOnlyQuestions,
+    StateDump_Clients,
+    StateDump_Done
+} StateDumpPhase;
+
+typedef struct
+{
+    int fd;
+    mDNSBool failed;                // Set if a write failed; the rest of the dump is discarded
+    StateDumpPhase phase;
+    mDNSu32 slot;                   // Hash slot being written, in the phases that walk a hash table
+    mDNSu32 index;                  // Entries of the current list or hash slot already written
+    mDNSu32 tlvs;                   // TLVs written so far
+    mDNSu32 slices;
+    mDNSu32 longest;                // Longest slice, in ms
+    mDNSs32 started;
+    mDNSu32 len;                    // Bytes waiting in buffer
+    char buffer[kStateDumpBufferSize];
+} StateDumpState;
+
+static StateDumpState *StateDump;   // Non-NULL while a dump is in progress
+
+mDNSlocal void StateDumpFlush(StateDumpState *const d)
+{
+    mDNSu32 off = 0;
+    while (!d->failed && off < d->len)
+    {
+#if defined(_WIN32)
+        const int n = _write(d->fd, d->buffer + off, d->len - off);
+#else
+        const ssize_t n = write(d->fd, d->buffer + off, d->len - off);
+#endif
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) { LogMsg("StateDumpFlush: write failed %d (%s)", errno, strerror(errno)); d->failed = mDNStrue; }
+        else off += (mDNSu32)n;
+    }
+    d->len = 0;
+}
+
+// Starts a TLV with room for maxlen bytes of value, and returns where the value goes, or NULL if the buffer is full.
+// The buffer is empty at the start of each slice and holds several TLVs of the largest size, so every slice writes some.
+mDNSlocal char *StateDumpBegin(StateDumpState *const d, const mDNSu16 type, const mDNSu32 maxlen)
+{
+    char *ptr;
+    if (d->len + 4 + maxlen > sizeof(d->buffer)) return NULL;
+    ptr = d->buffer + d->len;
+    put_uint16(type, &ptr);
+    put_uint16(0, &ptr);            // Value length, filled in by StateDumpEnd()
+    return ptr;
+}
+
+mDNSlocal void StateDumpEnd(StateDumpState *const d, char *const end)
+{
+    char *lenptr = d->buffer + d->len + 2;
+    put_uint16((uint16_t)(end - lenptr - 2), &lenptr);
+    d->len = (mDNSu32)(end - d->buffer);
+    d->tlvs++;
+}
+
+mDNSlocal char *StateDumpPutName(char *ptr, const domainname *const name)
+{
+    const mDNSu16 len = DomainNameLength(name);
+    if (len > MAX_DOMAIN_NAME) { *ptr++ = 0; return ptr; }
+    mDNSPlatformMemCopy(ptr, name->c, len);
+    return ptr + len;
+}
+
+// Puts the rrtype, rrclass, name and rdata, which end both cache and auth record TLVs
+mDNSlocal char *StateDumpPutRecord(char *ptr, const ResourceRecord *const rr)
+{
+    mDNSu8 *rdata, *rdend = mDNSNULL;
+    put_uint16(rr->rrtype, &ptr);
+    put_uint16(rr->rrclass, &ptr);
+    ptr = StateDumpPutName(ptr, rr->name);
+    rdata = (mDNSu8 *)ptr + 2;
+    if (rr->RecordType != kDNSRecordTypePacketNegative) rdend = putRData(mDNSNULL, rdata, rdata + MaximumRDSize, rr);
+    if (!rdend) rdend = rdata;
+    put_uint16((uint16_t)(rdend - rdata), &ptr);
+    return (char *)rdend;
+}
+
+mDNSlocal mDNSBool StateDumpCacheRecord(StateDumpState *const d, mDNS *const m, const CacheRecord *const cr, const mDNSs32 now)
+{
+    char *ptr = StateDumpBegin(d, STATE_DUMP_TLV_CACHE_RECORD, kStateDumpMaxRecordTLV);
+    mDNSu8 flags = 0;
+    if (!ptr) return mDNSfalse;
+    if (cr->CRActiveQuestion)     flags |= STATE_DUMP_CACHE_ACTIVE;
+    if (!cr->resrec.InterfaceID)  flags |= STATE_DUMP_CACHE_UNICAST;
+    put_uint16((uint16_t)d->slot, &ptr);
+    put_uint32(mDNSPlatformInterfaceIndexfromInterfaceID(m, cr->resrec.InterfaceID, mDNStrue), &ptr);
+    put_uint32((uint32_t)(cr->resrec.rroriginalttl - (now - cr->TimeRcvd) / mDNSPlatformOneSecond), &ptr);
+    *ptr++ = (char)cr->resrec.RecordType;
+    *ptr++ = (char)flags;
+    StateDumpEnd(d, StateDumpPutRecord(ptr, &cr->resrec));
+    return mDNStrue;
+}
+
+mDNSlocal mDNSBool StateDumpAuthRecord(StateDumpState *const d, mDNS *const m, const AuthRecord *const ar, mDNSu8 flags)
+{
+    char *ptr = StateDumpBegin(d, STATE_DUMP_TLV_AUTH_RECORD, kStateDumpMaxRecordTLV);
+    if (!ptr) return mDNSfalse;
+    if (ar->WakeUp.HMAC.l[0]) flags |= STATE_DUMP_AUTH_PROXIED;
+    put_uint32(mDNSPlatformInterfaceIndexfromInterfaceID(m, ar->resrec.InterfaceID, mDNStrue), &ptr);
+    *ptr++ = (char)ar->resrec.RecordType;
+    *ptr++ = (char)flags;
+    put_uint32(ar->resrec.rroriginalttl, &ptr);
+    StateDumpEnd(d, StateDumpPutRecord(ptr, &ar->resrec));
+    return mDNStrue;
+}
+
+mDNSlocal mDNSBool StateDumpQuestion(StateDumpState *const d, mDNS *const m, const DNSQuestion *const q, mDNSu8 flags, const mDNSs32 now)
+{
+    char *ptr = StateDumpBegin(d, STATE_DUMP_TLV_QUESTION, 20 + MAX_DOMAIN_NAME);
+    if (!ptr) return mDNSfalse;
+    if (!mDNSOpaque16IsZero(q->TargetQID)) flags |= STATE_DUMP_QUESTION_UNICAST;
+    if (q->LongLived)                      flags |= STATE_DUMP_QUESTION_LONGLIVED;
+    if (q->DuplicateOf)                    flags |= STATE_DUMP_QUESTION_DUPLICATE;
+    if (q->Suppressed)                     flags |= STATE_DUMP_QUESTION_SUPPRESSED;
+    put_uint32(mDNSPlatformInterfaceIndexfromInterfaceID(m, q->InterfaceID, mDNStrue), &ptr);
+    *ptr++ = (char)flags;
+    put_uint32((uint32_t)(q->ThisQInterval / mDNSPlatformOneSecond), &ptr);
+    put_uint32((uint32_t)((NextQSendTime(q) - now) / mDNSPlatformOneSecond), &ptr);
+    put_uint32(q->CurrentAnswers, &ptr);
+    put_uint16(q->qtype, &ptr);
+    StateDumpEnd(d, StateDumpPutName(ptr, &q->qname));
+    return mDNStrue;
+}
+
+mDNSlocal mDNSBool StateDumpClient(StateDumpState *const d, const request_state *const req)
+{
+    char *ptr = StateDumpBegin(d, STATE_DUMP_TLV_CLIENT, 20 + sizeof(req->pid_name) + 1);
+    char name[sizeof(req->pid_name) + 1];
+    if (!ptr) return mDNSfalse;
+    mDNSPlatformMemCopy(name, req->pid_name, sizeof(req->pid_name));
+    name[sizeof(req->pid_name)] = 0;
+    put_uint32((uint32_t)req->sd, &ptr);
+    put_uint32((uint32_t)req->process_id, &ptr);
+    put_uint32(req->hdr.op, &ptr);
+    put_uint32(req->replies_queued, &ptr);
+    put_uint32(req->reply_bytes_queued, &ptr);
+    put_string(name, &ptr);
+    StateDumpEnd(d, ptr);
+    return mDNStrue;
+}
+
+// Moves on to the next list. The phases are in the order they are written.
+mDNSlocal void StateDumpNextPhase(StateDumpState *const d)
+{
+    d->phase = (StateDumpPhase)(d->phase + 1);
+    d->slot  = 0;
+    d->index = 0;
+}
+
+// Writes the next slice of the dump with the lock held. In each list, or hash slot, entry i is written if it wasn't
+// in an earlier slice (i >= d->index). The slice ends when it has written kStateDumpSliceRecords entries or the
+// buffer is full; a writer returns mDNSfalse in the latter case.
+mDNSlocal void StateDumpSlice(StateDumpState *const d, mDNS *const m, const mDNSs32 now)
+{
+    mDNSu32 budget = kStateDumpSliceRecords, i;
+    const CacheGroup *cg;
+    const CacheRecord *cr;
+    const AuthGroup *ag;
+    const AuthRecord *ar;
+    const DNSQuestion *q;
+    const request_state *req;
+
+    while (d->phase != StateDump_Done)
+    {
+        switch (d->phase)
+        {
+        case StateDump_Cache:
+            for (; d->slot < CACHE_HASH_SLOTS; d->slot++, d->index = 0)
+                for (cg = m->rrcache_hash[d->slot], i = 0; cg; cg = cg->next)
+                    for (cr = cg->members; cr; cr = cr->next, i++)
+                        if (i >= d->index)
+                        {
+                            if (!budget || !StateDumpCacheRecord(d, m, cr, now)) return;
+                            d->index++; budget--;
+                        }
+            break;
+
+        case StateDump_AuthRecords:
+        case StateDump_DuplicateRecords:
+            ar = (d->phase == StateDump_AuthRecords) ? m->ResourceRecords : m->DuplicateRecords;
+            for (i = 0; ar; ar = ar->next, i++)
+                if (i >= d->index)
+                {
+                    if (!budget || !StateDumpAuthRecord(d, m, ar, (d->phase == StateDump_AuthRecords) ? 0 : STATE_DUMP_AUTH_DUPLICATE)) return;
+                    d->index++; budget--;
+                }
+            break;
+
+        case StateDump_LocalOnlyRecords:
+            for (; d->slot < AUTH_HASH_SLOTS; d->slot++, d->index = 0)
+                for (ag = m->rrauth.rrauth_hash[d->slot], i = 0; ag; ag = ag->next)
+                    for (ar = ag->members; ar; ar = ar->next, i++)
+                        if (i >= d->index)
+                        {
+                            if (!budget || !StateDumpAuthRecord(d, m, ar, STATE_DUMP_AUTH_LOCAL)) return;
+                            d->index++; budget--;
+                        }
+            break;
+
+        case StateDump_Questions:
+        case StateDump_LocalOnlyQuestions:
+            q = (d->phase == StateDump_Questions) ? m->Questions : m->LocalOnlyQuestions;
+            for (i = 0; q; q = q->next, i++)
+                if (i >= d->index)
+                {
+                    if (!budget || !StateDumpQuestion(d, m, q, (d->phase == StateDump_Questions) ? 0 : STATE_DUMP_QUESTION_LOCAL, now)) return;
+                    d->index++; budget--;
+                }
+            break;
+
+        case StateDump_Clients:
+            for (req = all_requests, i = 0; req; req = req->next, i++)
+                if (i >= d->index)
+                {
+                    if (!budget || !StateDumpClient(d, req)) return;
+                    d->index++; budget--;
+                }
+            break;
+
+        case StateDump_Done:
+            return;
+        }
+        StateDumpNextPhase(d);
+    }
+}
+
+// Called from udsserver_idle() while a dump is in progress. The buffer is written out after the lock is dropped.
+mDNSlocal void StateDumpContinue(void)
+{
+    mDNS *const m = &mDNSStorage;
+    StateDumpState *const d = StateDump;
+    mDNSs32 start;
+    mDNSu32 ms;
+    char *ptr;
+
+    mDNS_Lock(m);
+    start = m->timenow;
+    StateDumpSlice(d, m, start);
+    mDNS_Unlock(m);
+    ms = TicksToMilliseconds(mDNS_TimeNow(m) - start);
+    if (d->longest < ms) d->longest = ms;
+    d->slices++;
+    StateDumpFlush(d);
+
+    if (d->phase == StateDump_Done)
+    {
+        const mDNSu32 total = TicksToMilliseconds(mDNS_TimeNow(m) - d->started);
+        const mDNSu32 tlvs = d->tlvs;
+        ptr = StateDumpBegin(d, STATE_DUMP_TLV_END, 16);    // The buffer was just emptied, so there's room
+        put_uint32(tlvs, &ptr);
+        put_uint32(d->slices, &ptr);
+        put_uint32(d->longest, &ptr);
+        put_uint32(total, &ptr);
+        StateDumpEnd(d, ptr);
+        StateDumpFlush(d);
+        LogMsg("State dump %s: %u entries in %u slices, longest %u ms, %u ms in all",
+               d->failed ? "failed" : "written", tlvs, d->slices, d->longest, total);
+#if defined(_WIN32)
+        _close(d->fd);
+#else
+        close(d->fd);
+#endif
+        freeL("StateDumpState", d);
+        StateDump = mDNSNULL;
+    }
+}
+
+// Starts writing a binary state dump to fd, which is closed when the dump has been written
+mDNSexport mStatus udsserver_state_dump_start(int fd)
+{
+    StateDumpState *d;
+    char *ptr;
+
+    if (StateDump) return mStatus_AlreadyRegistered;
+    d = (StateDumpState *)callocL("StateDumpState", sizeof(*d));
+    if (!d) return mStatus_NoMemoryErr;
+    d->fd      = fd;
+    d->phase   = StateDump_Cache;
+    d->started = mDNS_TimeNow(&mDNSStorage);
+
+    mDNSPlatformMemCopy(d->buffer, STATE_DUMP_MAGIC, STATE_DUMP_MAGIC_LEN);
+    d->len = STATE_DUMP_MAGIC_LEN;
+    ptr = StateDumpBegin(d, STATE_DUMP_TLV_HEADER, 8);
+    put_uint32(_DNS_SD_H, &ptr);
+    put_uint32(mDNSStorage.rrcache_size, &ptr);
+    StateDumpEnd(d, ptr);
+
+    StateDump = d;
+    return mStatus_NoError;
+}
+
 #if MDNS_MALLOC_DEBUGGING
 mDNSlocal void udsserver_validatelists(void *context)
 {
@@ -6139,14 +6821,42 @@ mDNSlocal void udsserver_validatelists(void *context)
 }
 #endif // MDNS_MALLOC_DEBUGGING
 
+// Writes as many of the queued replies as will fit in one writev(), and frees the ones that went out completely
+// Returns t_complete if everything gathered was written, t_morecoming if the client isn't keeping up
 mDNSlocal int send_msg(request_state *const req)
 {
-    reply_state *const rep = req->replies;      // Send the first waiting reply
+#if defined(_WIN32)
+    WSABUF iov[kMaxRepliesPerWrite];
+    DWORD sent;
+#else
+    struct iovec iov[kMaxRepliesPerWrite];
+#endif
+    reply_state *rep;
     ssize_t nwriten;
+    int n = 0;
+    mDNSu32 completed = 0;
+    mDNSs32 now;
 
-    ConvertHeaderBytes(rep->mhdr);
-    nwriten = send(req->sd, (char *)&rep->mhdr + rep->nwriten, rep->totallen - rep->nwriten, 0);
-    ConvertHeaderBytes(rep->mhdr);
+    for (rep = req->replies; rep && n < kMaxRepliesPerWrite; rep = rep->next, n++)
+    {
+        // Tell the client more replies follow this one, unless we've already started writing it
+        if (rep->next && rep->nwriten == 0)
+            rep->rhdr->flags |= dnssd_htonl(kDNSServiceFlagsMoreComing);
+#if defined(_WIN32)
+        iov[n].buf = (char *)rep->mhdr + rep->nwriten;
+        iov[n].len = rep->totallen - rep->nwriten;
+#else
+        iov[n].iov_base = (char *)rep->mhdr + rep->nwriten;
+        iov[n].iov_len  = rep->totallen - rep->nwriten;
+#endif
+    }
+
+#if defined(_WIN32)
+    nwriten = (WSASend(req->sd, iov, (DWORD)n, &sent, 0, NULL, NULL) == 0) ? (ssize_t)sent : -1;
+#else
+    nwriten = writev(req->sd, iov, n);
+#endif
+    ReplyStats.ReplyWrites++;
 
     if (nwriten < 0)
     {
@@ -6159,14 +6869,50 @@ mDNSlocal int send_msg(request_state *const req)
             else
 #endif
             {
+                rep = req->replies;
                 LogMsg("send_msg ERROR: failed to write %d of %d bytes to fd %d errno %d (%s)",
                        rep->totallen - rep->nwriten, rep->totallen, req->sd, dnssd_errno, dnssd_strerror(dnssd_errno));
                 return(t_error);
             }
         }
     }
-    rep->nwriten += nwriten;
-    return (rep->nwriten == rep->totallen) ? t_complete : t_morecoming;
+
+    now = mDNS_TimeNow(&mDNSStorage);
+    while (nwriten > 0)
+    {
+        const mDNSu32 remaining = req->replies->totallen - req->replies->nwriten;
+        rep = req->replies;
+        if ((size_t)nwriten < remaining)
+        {
+            rep->nwriten += (mDNSu32)nwriten;
+            req->reply_bytes_queued -= (mDNSu32)nwriten;
+            break;
+        }
+        nwriten -= remaining;
+        req->reply_bytes_queued -= remaining;
+        req->replies_queued--;
+        req->replies = rep->next;
+        if (!req->replies) req->replies_tail = mDNSNULL;
+        RequestHistogramAdd(&RequestStatsByType[RequestStatsTypeForReplyOp(ntohl(rep->mhdr->op))].replyWait,
+                            TicksToMilliseconds(now - rep->queued_time));
+        free_reply(rep);
+        completed++;
+    }
+
+    if (completed)
+    {
+        req->time_blocked = 0; // reset failure counter after successful send
+        req->unresponsiveness_reports = 0;
+        ReplyStats.RepliesSent += completed;
+        if (ReplyStats.ReplyWriteMax < completed) ReplyStats.ReplyWriteMax = completed;
+    }
+
+    if (completed < (mDNSu32)n)
+    {
+        ReplyStats.ReplyBlockedWrites++;
+        return(t_morecoming);
+    }
+    return(t_complete);
 }
 
 mDNSexport mDNSs32 udsserver_idle(mDNSs32 nextevent)
@@ -6174,6 +6920,12 @@ mDNSexport mDNSs32 udsserver_idle(mDNSs32 nextevent)
     mDNSs32 now = mDNS_TimeNow(&mDNSStorage);
     request_state **req = &all_requests;
 
+    if (StateDump)
+    {
+        StateDumpContinue();
+        if (StateDump) nextevent = now;     // Come straight back for the next slice
+    }
+
     while (*req)
     {
         request_state *const r = *req;
@@ -6191,18 +6943,8 @@ mDNSexport mDNSs32 udsserver_idle(mDNSs32 nextevent)
         while (r->replies)      // Send queued replies
         {
             transfer_state result;
-            if (r->replies->next)
-                r->replies->rhdr->flags |= dnssd_htonl(kDNSServiceFlagsMoreComing);
             result = send_msg(r);   // Returns t_morecoming if buffer full because client is not reading
-            if (result == t_complete)
-            {
-                reply_state *fptr = r->replies;
-                r->replies = r->replies->next;
-                freeL("reply_state/udsserver_idle", fptr);
-                r->time_blocked = 0; // reset failure counter after successful send
-                r->unresponsiveness_reports = 0;
-                continue;
-            }
+            if (result == t_complete) continue;
             else if (result == t_terminated)
             {
                 LogInfo("%3d: Could not write data to client PID[%d](%s) because connection is terminated by the client", r->sd, r->process_id, r->pid_name);
@@ -6230,15 +6972,10 @@ mDNSexport mDNSs32 udsserver_idle(mDNSs32 nextevent)
                 r->time_blocked = NonZeroTime(now);
             else if (now - r->time_blocked >= 10 * mDNSPlatformOneSecond * (r->unresponsiveness_reports+1))
             {
-                int num = 0;
-                struct reply_state *x = r->replies;
-                while (x)
-                {
-                    num++;
-                    x=x->next;
-                }
-                LogMsg("%3d: Could not write data to client PID[%d](%s) after %ld seconds, %d repl%s waiting",
-                       r->sd, r->process_id, r->pid_name, (now - r->time_blocked) / mDNSPlatformOneSecond, num, num == 1 ? "y" : "ies");
+                const mDNSu32 num = r->replies_queued;
+                LogMsg("%3d: Could not write data to client PID[%d](%s) after %ld seconds, %u repl%s (%u bytes) waiting",
+                       r->sd, r->process_id, r->pid_name, (now - r->time_blocked) / mDNSPlatformOneSecond, num, num == 1 ? "y" : "ies",
+                       r->reply_bytes_queued);
                 if (++r->unresponsiveness_reports >= 60)
                 {
                     LogMsg("%3d: Client PID[%d](%s) unresponsive; aborting connection", r->sd, r->process_id, r->pid_name);
@@ -126,6 +126,12 @@ struct request_state
 	mDNSs32 time_blocked;           // record time of a blocked client
 	int unresponsiveness_reports;
 	struct reply_state *replies;    // corresponding (active) reply list
+	struct reply_state *replies_tail; // last reply on the list, so appending doesn't have to walk it
+	mDNSu32 replies_queued;         // number of replies on the list
+	mDNSu32 reply_bytes_queued;     // bytes on the list not yet written to the client
+	mDNSu32 reply_bytes_peak;       // high-water mark of reply_bytes_queued
+	mDNSs32 op_start;               // when the request was handed to its handler, for latency accounting
+	mDNSu8 answered;                // set once the first reply for this request has been queued
 	req_termination_fn terminate;
 	DNSServiceFlags flags;
 	mDNSu32 interfaceIndex;
@@ -200,7 +206,8 @@ typedef struct reply_state
 	struct reply_state *next;       // If there are multiple unsent replies
 	mDNSu32 totallen;
 	mDNSu32 nwriten;
-	ipc_msg_hdr mhdr[1];
+	mDNSs32 queued_time;            // when append_reply() queued it, for latency accounting
+	ipc_msg_hdr mhdr[1];            // Note: In NETWORK byte order once the reply has been queued by append_reply()
 	reply_hdr rhdr[1];
 } reply_state;
 
@@ -213,6 +220,8 @@ typedef struct reply_state
 extern int udsserver_init(dnssd_sock_t skts[], const size_t count);
 extern mDNSs32 udsserver_idle(mDNSs32 nextevent);
 extern void udsserver_info_dump_to_fd(int fd);
+extern mStatus udsserver_state_dump_start(int fd);
+extern void udsserver_request_stats_dump_to_fd(int fd);
 extern void udsserver_handle_configchange(mDNS *const m);
 extern int udsserver_exit(void);    // should be called prior to app exit
 extern void LogMcastStateInfo(mDNSBool mflag, mDNSBool start, mDNSBool mstatelog);
@@ -4329,6 +4329,7 @@ mDNSlocal void SetDomainSecret( mDNS * const m, const domainname * inDomain )
 		{
 			ptr = (DomainAuthInfo*)malloc(sizeof(DomainAuthInfo));
 			require_action( ptr, exit, err = mStatus_NoMemoryErr );
+			ptr->algorithm = TSIG_Alg_HMAC_MD5;
 		}
 
 		err = mDNS_SetSecretForDomain(m, ptr, &domain, &key, outSecret, NULL, NULL );